@@ -0,0 +1,167 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: AllocationCounter.cpp
+ *
+ * Description:
+ * Implementation file for the AllocationCounter class, and the replacements of the global
+ * operator new and delete that count every allocation before handing it to malloc.
+ *
+ * Dependencies:
+ * - "AllocationCounter.h"
+ */
+
+#include "AllocationCounter.h"
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+using namespace std;
+
+AllocationCounter AllocationCounter::instance;
+AllocationCounter::Slot AllocationCounter::slots[ALLOCATION_MAX_THREADS];
+atomic<int> AllocationCounter::slotsTaken(0);
+
+namespace {
+
+    // Slot of the calling thread, a plain int so that reading it never allocates
+    thread_local int threadSlotIndex = -1;
+
+    // Allocates as the standard operator new does, calling the new handler until it succeeds
+    void* allocate(size_t bytes) {
+        AllocationCounter::countAllocation(bytes);
+        if (bytes == 0)
+            bytes = 1;
+        for (;;) {
+            void* memory = malloc(bytes);
+            if (memory)
+                return memory;
+            new_handler handler = get_new_handler();
+            if (!handler)
+                throw bad_alloc();
+            handler();
+        }
+    }
+
+    void* allocateNoThrow(size_t bytes) noexcept {
+        try {
+            return allocate(bytes);
+        } catch (...) {
+            return nullptr;
+        }
+    }
+
+    void release(void* memory) noexcept {
+        if (!memory)
+            return;
+        AllocationCounter::countFree();
+        free(memory);
+    }
+
+}
+
+void* operator new(size_t bytes) { return allocate(bytes); }
+void* operator new[](size_t bytes) { return allocate(bytes); }
+void* operator new(size_t bytes, const nothrow_t&) noexcept { return allocateNoThrow(bytes); }
+void* operator new[](size_t bytes, const nothrow_t&) noexcept { return allocateNoThrow(bytes); }
+void operator delete(void* memory) noexcept { release(memory); }
+void operator delete[](void* memory) noexcept { release(memory); }
+void operator delete(void* memory, const nothrow_t&) noexcept { release(memory); }
+void operator delete[](void* memory, const nothrow_t&) noexcept { release(memory); }
+#ifdef __cpp_sized_deallocation
+void operator delete(void* memory, size_t) noexcept { release(memory); }
+void operator delete[](void* memory, size_t) noexcept { release(memory); }
+#endif
+
+/**
+ * @brief Returns the counters of the calling thread, taking a slot on its first allocation.
+ */
+AllocationCounter::Slot& AllocationCounter::threadSlot() {
+    if (threadSlotIndex < 0) {
+        int slot = slotsTaken.fetch_add(1, memory_order_relaxed);
+        threadSlotIndex = slot < ALLOCATION_MAX_THREADS ? slot : ALLOCATION_MAX_THREADS - 1;
+    }
+    return slots[threadSlotIndex];
+}
+
+/**
+ * @brief Counts an allocation of the calling thread.
+ */
+void AllocationCounter::countAllocation(size_t bytes) {
+    Slot& slot = threadSlot();
+    slot.allocations.fetch_add(1, memory_order_relaxed);
+    slot.bytes.fetch_add(bytes, memory_order_relaxed);
+}
+
+/**
+ * @brief Counts a free of the calling thread.
+ */
+void AllocationCounter::countFree() {
+    threadSlot().frees.fetch_add(1, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the allocations the calling thread has made since it started.
+ *
+ * The difference between two calls is what the thread allocated in between, as long as
+ * it does not share its slot with other threads.
+ */
+uint64_t AllocationCounter::threadAllocations() {
+    return threadSlot().allocations.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the number of threads with a slot, the ones that have allocated.
+ */
+int AllocationCounter::threads() const {
+    int taken = slotsTaken.load(memory_order_relaxed);
+    return taken < ALLOCATION_MAX_THREADS ? taken : ALLOCATION_MAX_THREADS;
+}
+
+/**
+ * @brief Takes the allocations of every thread since the last call, once per frame.
+ *
+ * Called from the main loop at the end of a frame, the calling thread is taken as the main
+ * thread. Allocations a thread makes while the counts are taken end up in the next frame.
+ */
+void AllocationCounter::endFrame() {
+    if (mainSlot < 0)
+        mainSlot = (int)(&threadSlot() - slots);
+
+    lastFrameAllocations = 0;
+    lastFrameBytes = 0;
+    lastFrameFrees = 0;
+    int count = threads();
+    for (int i = 0; i < count; i++) {
+        uint64_t allocations = slots[i].allocations.load(memory_order_relaxed);
+        uint64_t frees = slots[i].frees.load(memory_order_relaxed);
+        uint64_t bytes = slots[i].bytes.load(memory_order_relaxed);
+        frameCounts[i] = allocations - lastAllocations[i];
+        lastFrameAllocations += frameCounts[i];
+        lastFrameFrees += frees - lastFrees[i];
+        lastFrameBytes += bytes - lastBytes[i];
+        lastAllocations[i] = allocations;
+        lastFrees[i] = frees;
+        lastBytes[i] = bytes;
+    }
+
+    if (isSteady() && lastFrameAllocations > 0) {
+        steadyAllocatingFrames++;
+#ifdef ALLOCATION_CHECK
+        cerr << "Steady frame made " << lastFrameAllocations << " heap allocations, " << lastFrameBytes
+             << " bytes:";
+        for (int i = 0; i < count; i++) {
+            if (frameCounts[i] > 0)
+                cerr << " " << (i == mainSlot ? "main thread" : "thread") << " " << i << " " << frameCounts[i];
+        }
+        cerr << endl;
+        assert(!"A steady frame allocated");
+#endif
+    }
+    if (undisturbedFrames < ALLOCATION_SETTLE_FRAMES)
+        undisturbedFrames++;
+}
@@ -0,0 +1,102 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: AllocationCounter.h
+ *
+ * Description:
+ * Header file for the AllocationCounter class, which counts the heap allocations of the
+ * application per thread and per frame. AllocationCounter.cpp replaces the global operator
+ * new and delete, so every allocation made through them is counted, the ones of the
+ * standard containers and strings included. Memory taken with malloc, such as that of
+ * ImGui, GLFW and the OpenGL driver, is not counted.
+ *
+ * Each thread counts into a slot of its own with relaxed atomics, at most
+ * ALLOCATION_MAX_THREADS threads get one and any further threads share the last. The main
+ * loop calls endFrame() once per frame to take the allocations of every thread since the
+ * last frame.
+ *
+ * A frame is steady when nothing has disturbed the application for ALLOCATION_SETTLE_FRAMES
+ * frames: no key, click or scroll, no resize, no widget in use and no input being recorded.
+ * That leaves time for the loads and rebuilds an event starts to finish. Steady frames
+ * should not allocate. Defining ALLOCATION_CHECK makes endFrame() report a steady frame that
+ * allocates and assert.
+ *
+ * Dependencies:
+ * - C++11 atomics
+ */
+
+#ifndef DATORGRAFIK_ALLOCATIONCOUNTER_H
+#define DATORGRAFIK_ALLOCATIONCOUNTER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Threads with counters of their own, any further threads share the last slot
+#define ALLOCATION_MAX_THREADS 32
+
+// Undisturbed frames before a frame is steady, time for streaming and caches to settle
+#define ALLOCATION_SETTLE_FRAMES 120
+
+class AllocationCounter {
+
+public:
+
+    static AllocationCounter& get() { return instance; }
+
+    // Called by the replaced operator new and delete of any thread
+    static void countAllocation(size_t bytes);
+    static void countFree();
+
+    // Allocations made by the calling thread since it started
+    static uint64_t threadAllocations();
+
+    void endFrame();
+    void disturb() { undisturbedFrames = 0; }
+    bool isSteady() const { return undisturbedFrames >= ALLOCATION_SETTLE_FRAMES; }
+
+    // Counts of the last frame, over all threads and per slot
+    uint64_t frameAllocations() const { return lastFrameAllocations; }
+    uint64_t frameBytes() const { return lastFrameBytes; }
+    uint64_t frameFrees() const { return lastFrameFrees; }
+    int threads() const;
+    uint64_t threadFrameAllocations(int thread) const { return frameCounts[thread]; }
+    bool isMainThread(int thread) const { return thread == mainSlot; }
+
+    // Steady frames that allocated since the start
+    uint64_t allocatingSteadyFrames() const { return steadyAllocatingFrames; }
+
+private:
+
+    struct Slot {
+        std::atomic<uint64_t> allocations;
+        std::atomic<uint64_t> frees;
+        std::atomic<uint64_t> bytes;
+    };
+
+    static AllocationCounter instance;
+
+    // Zero initialized before any constructor runs, operator new may be called that early
+    static Slot slots[ALLOCATION_MAX_THREADS];
+    static std::atomic<int> slotsTaken;
+
+    static Slot& threadSlot();
+
+    // Only used by the thread calling endFrame()
+    uint64_t lastAllocations[ALLOCATION_MAX_THREADS] = {};
+    uint64_t lastFrees[ALLOCATION_MAX_THREADS] = {};
+    uint64_t lastBytes[ALLOCATION_MAX_THREADS] = {};
+    uint64_t frameCounts[ALLOCATION_MAX_THREADS] = {};
+    uint64_t lastFrameAllocations = 0;
+    uint64_t lastFrameBytes = 0;
+    uint64_t lastFrameFrees = 0;
+    uint64_t steadyAllocatingFrames = 0;
+    int undisturbedFrames = 0;
+    int mainSlot = -1;
+
+};
+
+#endif //DATORGRAFIK_ALLOCATIONCOUNTER_H
@@ -0,0 +1,81 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: Arena.cpp
+ *
+ * Description:
+ * Implementation file for the Arena class.
+ *
+ * Dependencies:
+ * - "Arena.h"
+ */
+
+#include "Arena.h"
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * @brief Constructor for the Arena class, no memory is taken until the first allocation.
+ *
+ * @param blockSize Size of the blocks taken from the heap.
+ */
+Arena::Arena(size_t blockSize) {
+    this->blockSize = blockSize;
+    used = 0;
+    allocationCount = 0;
+    bytes = 0;
+}
+
+Arena::~Arena() {
+    for (Block& block : blocks)
+        delete[] block.data;
+}
+
+/**
+ * @brief Allocates memory that stays valid until the arena is reset or destroyed.
+ *
+ * @param bytes Size of the allocation.
+ * @param alignment Alignment of the allocation, a power of two no larger than that of std::max_align_t.
+ */
+void* Arena::allocate(size_t bytes, size_t alignment) {
+    allocationCount++;
+    this->bytes += bytes;
+
+    if (!blocks.empty()) {
+        Block& block = blocks.back();
+        uintptr_t address = (uintptr_t)block.data + used;
+        size_t padding = (alignment - address % alignment) % alignment;
+        if (used + padding + bytes <= block.size) {
+            used += padding + bytes;
+            return block.data + used - bytes;
+        }
+    }
+
+    // new[] returns memory aligned for any fundamental type
+    Block block;
+    block.size = max(blockSize, bytes);
+    block.data = new char[block.size];
+    blocks.push_back(block);
+    used = bytes;
+    return block.data;
+}
+
+/**
+ * @brief Frees everything allocated from the arena at once.
+ *
+ * The first block is kept for the next use, the others are given back to the heap.
+ */
+void Arena::reset() {
+    for (size_t i = 1; i < blocks.size(); i++)
+        delete[] blocks[i].data;
+    if (blocks.size() > 1)
+        blocks.resize(1);
+    used = 0;
+    allocationCount = 0;
+    bytes = 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: Arena.h
+ *
+ * Description:
+ * Header file for the Arena class, a linear allocator for the temporary buffers of one
+ * task, such as importing a mesh. Allocations bump a pointer through large blocks taken
+ * from the heap and are never freed one by one: everything goes at once when the arena
+ * is reset or destroyed. An arena belongs to one thread, so parallel imports each with
+ * their own arena do not meet in the heap for their temporaries.
+ *
+ * ArenaAllocator lets standard containers allocate from an arena. Freeing through it does
+ * nothing, so containers in an arena should be sized up front rather than grown.
+ *
+ * Dependencies:
+ * - C++11 standard library
+ */
+
+#ifndef DATORGRAFIK_ARENA_H
+#define DATORGRAFIK_ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+// Size of the blocks an arena takes from the heap, larger requests get a block of their own
+#define ARENA_BLOCK_SIZE (4u << 20)
+
+class Arena {
+
+public:
+
+    explicit Arena(size_t blockSize = ARENA_BLOCK_SIZE);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+    void reset();
+
+    // Allocations and bytes since the arena was created or reset, and the blocks it holds
+    size_t allocations() const { return allocationCount; }
+    size_t bytesAllocated() const { return bytes; }
+    size_t heapBlocks() const { return blocks.size(); }
+
+private:
+
+    struct Block {
+        char* data;
+        size_t size;
+    };
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+    size_t used;                // Bytes used of the last block
+    size_t allocationCount;
+    size_t bytes;
+
+};
+
+template<typename T>
+class ArenaAllocator {
+
+public:
+
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena& arena) : arena(&arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) {}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+private:
+
+    template<typename U> friend class ArenaAllocator;
+
+    Arena* arena;
+
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif //DATORGRAFIK_ARENA_H
@@ -0,0 +1,512 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: BatchRenderer.cpp
+ *
+ * Description:
+ * Implementation file for the BatchRenderer class.
+ *
+ * Dependencies:
+ * - "BatchRenderer.h"
+ */
+
+#include "BatchRenderer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "include/stb-master/stb_image_write.h"
+
+// Meshes parsed ahead of the renderer and frames waiting for an encoder
+#define BATCH_LOAD_QUEUE 4
+#define BATCH_ENCODE_QUEUE 8
+
+#define BATCH_FOV 45.0f
+
+using namespace std;
+
+/**
+ * @brief Constructs the BatchRenderer. No work is done until run() is called.
+ *
+ * @param options Input and output directories and the image settings.
+ */
+BatchRenderer::BatchRenderer(const BatchOptions& options) : options(options), jobs(JobSystem::get()) {
+    nextLoad = 0;
+    imagesWritten = 0;
+    failures = 0;
+
+    window = nullptr;
+    program = 0;
+    framebuffer = 0;
+    colorBuffer = 0;
+    depthBuffer = 0;
+    vao = 0;
+    vbo = 0;
+    ibo = 0;
+    packBuffers[0] = packBuffers[1] = 0;
+    frameCount = 0;
+    hasPending = false;
+}
+
+BatchRenderer::~BatchRenderer() {
+    destroyGL();
+}
+
+/**
+ * @brief Renders every OBJ file of the input directory.
+ *
+ * @return EXIT_SUCCESS when every file was rendered and written, EXIT_FAILURE otherwise.
+ */
+int BatchRenderer::run() {
+    if (options.size <= 0 || options.frames <= 0) {
+        cerr << "Image size and frame count must be positive" << endl;
+        return EXIT_FAILURE;
+    }
+    if (!listFiles())
+        return EXIT_FAILURE;
+    if (files.empty()) {
+        cerr << "No OBJ files in " << options.inputDir << endl;
+        return EXIT_FAILURE;
+    }
+
+#ifdef _WIN32
+    _mkdir(options.outputDir.c_str());
+#else
+    mkdir(options.outputDir.c_str(), 0755);
+#endif
+
+    bool gl = !options.cpu && initGL();
+    if (!gl)
+        softwareRenderer.reset(new SoftwareRenderer());
+    cout << "Rendering " << files.size() << " models with the " << (gl ? "OpenGL" : "CPU") << " backend" << endl;
+
+    auto start = chrono::steady_clock::now();
+
+    results.resize(files.size());
+    loads.reset(new JobCounter[files.size()]);
+
+    int models = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        startLoads(i + BATCH_LOAD_QUEUE);
+        jobs.wait(loads[i]);
+        LoadResult result = move(results[i]);
+        if (!result.mesh) {
+            cerr << "Skipping " << result.file << ": " << result.error << endl;
+            failures++;
+            continue;
+        }
+        if (gl)
+            renderGL(*result.mesh);
+        else
+            renderCPU(*result.mesh);
+        models++;
+    }
+    if (gl)
+        flushPending();
+    jobs.wait(encodes);
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Wrote " << imagesWritten << " images of " << models << " models to " << options.outputDir
+         << " in " << seconds << " s";
+    if (failures > 0)
+        cout << ", " << failures << " failed";
+    cout << endl;
+
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Collects the .obj files of the input directory in name order.
+ *
+ * @return false if the directory could not be read.
+ */
+bool BatchRenderer::listFiles() {
+    string dir = options.inputDir;
+    if (!dir.empty() && dir.back() != '/' && dir.back() != '\\')
+        dir += '/';
+
+    vector<string> names;
+#ifdef _WIN32
+    _finddata_t entry;
+    intptr_t handle = _findfirst((dir + "*.obj").c_str(), &entry);
+    if (handle == -1) {
+        cerr << "Cannot read directory " << options.inputDir << endl;
+        return false;
+    }
+    do {
+        names.push_back(entry.name);
+    } while (_findnext(handle, &entry) == 0);
+    _findclose(handle);
+#else
+    DIR* directory = opendir(dir.c_str());
+    if (!directory) {
+        cerr << "Cannot read directory " << options.inputDir << endl;
+        return false;
+    }
+    while (dirent* entry = readdir(directory)) {
+        string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".obj") == 0)
+            names.push_back(name);
+    }
+    closedir(directory);
+#endif
+
+    sort(names.begin(), names.end());
+    for (const string& name : names)
+        files.push_back(dir + name);
+    return true;
+}
+
+/**
+ * @brief Starts the load jobs of the files before an index that have not been started.
+ *
+ * Loads are started a few files ahead of the renderer, so loading never runs far ahead
+ * of rendering.
+ */
+void BatchRenderer::startLoads(size_t upTo) {
+    for (; nextLoad < min(upTo, files.size()); nextLoad++) {
+        size_t file = nextLoad;
+        jobs.run([this, file]() { load(file); }, &loads[file], nullptr, "Load OBJ");
+    }
+}
+
+/**
+ * @brief Load job, parses a file into its result.
+ */
+void BatchRenderer::load(size_t file) {
+    LoadResult& result = results[file];
+    result.file = files[file];
+    result.mesh.reset(new MeshData());
+    if (!MeshBuilder::loadObj(files[file], MESH_TEXCOORDS_NONE, *result.mesh, result.error))
+        result.mesh.reset();
+}
+
+/**
+ * @brief Encode job, writes a frame as an RGB PNG file.
+ */
+void BatchRenderer::encode(const EncodeJob& job) {
+    int size = job.size;
+    vector<unsigned char> rgb((size_t)size * size * 3);
+    for (int y = 0; y < size; y++) {
+        const unsigned char* src = &job.rgba[(size_t)(job.flip ? size - 1 - y : y) * size * 4];
+        unsigned char* dst = &rgb[(size_t)y * size * 3];
+        for (int x = 0; x < size; x++) {
+            dst[3 * x] = src[4 * x];
+            dst[3 * x + 1] = src[4 * x + 1];
+            dst[3 * x + 2] = src[4 * x + 2];
+        }
+    }
+
+    if (stbi_write_png(job.file.c_str(), size, size, 3, rgb.data(), size * 3)) {
+        imagesWritten++;
+    } else {
+        cerr << "Cannot write " << job.file << endl;
+        failures++;
+    }
+}
+
+/**
+ * @brief Starts an encode job for a frame, helping with the others while too many are waiting.
+ */
+void BatchRenderer::pushEncode(EncodeJob&& job) {
+    jobs.wait(encodes, BATCH_ENCODE_QUEUE - 1);
+    shared_ptr<EncodeJob> frame = make_shared<EncodeJob>(move(job));
+    jobs.run([this, frame]() { encode(*frame); }, &encodes, nullptr, "Encode PNG");
+}
+
+/**
+ * @brief Creates a hidden OpenGL context with an offscreen framebuffer.
+ *
+ * @return false if no context could be created, the caller then falls back to the CPU.
+ */
+bool BatchRenderer::initGL() {
+    if (!glfwInit()) {
+        cerr << "Cannot initialize GLFW, using the CPU renderer" << endl;
+        return false;
+    }
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+
+    window = glfwCreateWindow(options.size, options.size, "3D Studio", nullptr, nullptr);
+    if (!window) {
+        cerr << "Cannot create an OpenGL context, using the CPU renderer" << endl;
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(window);
+
+    glewExperimental = GL_TRUE;
+    GLenum error = glewInit();
+    if (error != GLEW_OK) {
+        cerr << "Cannot initialize GLEW: " << glewGetErrorString(error) << ", using the CPU renderer" << endl;
+        destroyGL();
+        return false;
+    }
+
+    programCache.init("shadercache");
+    shaders.init(&programCache, "vshader.glsl", "fshader.glsl");
+    program = shaders.program(SHADER_LIGHTS(1));
+
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, options.size, options.size);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, options.size, options.size);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        cerr << "Offscreen framebuffer is incomplete, using the CPU renderer" << endl;
+        destroyGL();
+        return false;
+    }
+
+    glGenBuffers(2, packBuffers);
+    for (GLuint buffer : packBuffers) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)options.size * options.size * 4, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+
+    glViewport(0, 0, options.size, options.size);
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+    return true;
+}
+
+/**
+ * @brief Deletes the OpenGL objects and the hidden window.
+ */
+void BatchRenderer::destroyGL() {
+    if (!window)
+        return;
+
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ibo);
+    glDeleteBuffers(2, packBuffers);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    vao = vbo = ibo = framebuffer = colorBuffer = depthBuffer = 0;
+    packBuffers[0] = packBuffers[1] = 0;
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    window = nullptr;
+}
+
+/**
+ * @brief Uploads a mesh and renders all of its frames into the offscreen framebuffer.
+ *
+ * Each frame is read back asynchronously, see readBack().
+ */
+void BatchRenderer::renderGL(const MeshData& mesh) {
+    size_t positionBytes = mesh.positions.size() * sizeof(glm::vec3);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, 2 * positionBytes, nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, positionBytes, mesh.positions.data());
+    glBufferSubData(GL_ARRAY_BUFFER, positionBytes, positionBytes, mesh.normals.data());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(),
+                 GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(ATTRIB_POSITION);
+    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0, (const void*)0);
+    glEnableVertexAttribArray(ATTRIB_NORMAL);
+    glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, (const void*)positionBytes);
+
+    glUseProgram(program);
+    glUniform3f(glGetUniformLocation(program, "i_a"), 0.2f, 0.2f, 0.2f);
+    glUniform3f(glGetUniformLocation(program, "i_l"), 1.0f, 1.0f, 1.0f);
+    glUniform3f(glGetUniformLocation(program, "am_material"), 0.6f, 0.6f, 0.6f);
+    glUniform3f(glGetUniformLocation(program, "di_material"), 0.5f, 0.5f, 0.5f);
+    glUniform3f(glGetUniformLocation(program, "spec_material"), 0.5f, 0.5f, 0.5f);
+    glUniform1i(glGetUniformLocation(program, "shininess"), 5);
+
+    for (int frame = 0; frame < options.frames; frame++) {
+        glm::mat4 model, view, projection;
+        glm::vec3 eye, light;
+        frameSetup(mesh, frame, model, view, projection, eye, light);
+
+        glUniformMatrix4fv(glGetUniformLocation(program, "M"), 1, GL_FALSE, glm::value_ptr(model));
+        glUniformMatrix4fv(glGetUniformLocation(program, "V"), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(glGetUniformLocation(program, "P"), 1, GL_FALSE, glm::value_ptr(projection));
+        glUniform3fv(glGetUniformLocation(program, "v"), 1, glm::value_ptr(eye));
+        glUniform3fv(glGetUniformLocation(program, "l"), 1, glm::value_ptr(light));
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT, (const void*)0);
+
+        readBack(outputFile(mesh, frame));
+    }
+}
+
+/**
+ * @brief Starts the read back of the current frame and finishes the one before it.
+ *
+ * @param file Output file of the current frame.
+ *
+ * glReadPixels into a pixel buffer object returns without waiting for the GPU. The
+ * previous frame's buffer is mapped one frame later, when it is most likely ready, so
+ * rendering and copying overlap.
+ */
+void BatchRenderer::readBack(const string& file) {
+    int buffer = frameCount++ % 2;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[buffer]);
+    glReadPixels(0, 0, options.size, options.size, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+
+    flushPending();
+    pending.file = file;
+    pending.buffer = buffer;
+    hasPending = true;
+}
+
+/**
+ * @brief Maps the buffer of the pending frame and queues it for encoding.
+ */
+void BatchRenderer::flushPending() {
+    if (!hasPending)
+        return;
+    hasPending = false;
+
+    EncodeJob job;
+    job.file = pending.file;
+    job.size = options.size;
+    job.flip = true;
+    job.rgba.resize((size_t)options.size * options.size * 4);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[pending.buffer]);
+    const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)job.rgba.size(), GL_MAP_READ_BIT);
+    if (!pixels) {
+        cerr << "Cannot read back " << job.file << endl;
+        failures++;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return;
+    }
+    memcpy(job.rgba.data(), pixels, job.rgba.size());
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pushEncode(move(job));
+}
+
+/**
+ * @brief Renders all frames of a mesh with the SoftwareRenderer.
+ */
+void BatchRenderer::renderCPU(const MeshData& mesh) {
+    SoftwareRenderer& renderer = *softwareRenderer;
+    if (renderer.width() != options.size || renderer.height() != options.size)
+        renderer.resize(options.size, options.size);
+
+    RasterMesh raster;
+    raster.positions = mesh.positions.data();
+    raster.normals = mesh.normals.data();
+    raster.texCoords = nullptr;
+    raster.vertexCount = mesh.positions.size();
+    raster.indices = mesh.indices.data();
+    raster.indexCount = mesh.indices.size();
+    raster.occlusion = nullptr;
+
+    RasterMaterial material;
+    material.ambient = glm::vec3(0.6f);
+    material.diffuse = glm::vec3(0.5f);
+    material.specular = glm::vec3(0.5f);
+    material.shininess = 5.0f;
+
+    RasterLight light;
+    light.ambient = glm::vec3(0.2f);
+    light.color = glm::vec3(1.0f);
+    light.directional = false;
+
+    for (int frame = 0; frame < options.frames; frame++) {
+        glm::mat4 model, view, projection;
+        glm::vec3 eye;
+        frameSetup(mesh, frame, model, view, projection, eye, light.position);
+
+        renderer.clear(glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
+        renderer.draw(raster, model, view, projection, eye, material, light, nullptr);
+
+        EncodeJob job;
+        job.file = outputFile(mesh, frame);
+        job.size = options.size;
+        job.flip = false;
+        const vector<uint32_t>& pixels = renderer.colorBuffer();
+        job.rgba.resize(pixels.size() * 4);
+        memcpy(job.rgba.data(), pixels.data(), job.rgba.size());
+        pushEncode(move(job));
+    }
+}
+
+/**
+ * @brief Computes the transforms of one frame.
+ *
+ * The mesh is centered on its bounding sphere, which the camera frames from slightly
+ * above. Turntable frames rotate the mesh a full turn around the y axis. The light sits
+ * in the direction of the Scene's default light.
+ */
+void BatchRenderer::frameSetup(const MeshData& mesh, int frame, glm::mat4& model, glm::mat4& view,
+                               glm::mat4& projection, glm::vec3& eye, glm::vec3& light) const {
+    float radius = max(mesh.radius, 1e-4f);
+    float angle = glm::two_pi<float>() * (float)frame / (float)options.frames;
+    model = glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 1.0f, 0.0f)) *
+            glm::translate(glm::mat4(1.0f), -mesh.center);
+
+    float distance = 1.05f * radius / sin(glm::radians(BATCH_FOV) * 0.5f);
+    eye = distance * glm::normalize(glm::vec3(0.0f, 0.35f, 1.0f));
+    view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    projection = glm::perspective(glm::radians(BATCH_FOV), 1.0f, max(distance - 1.1f * radius, 1e-3f * distance),
+                                  distance + 1.1f * radius);
+    light = 2.0f * distance * glm::normalize(glm::vec3(1.0f, 1.0f, 1.0f));
+}
+
+/**
+ * @brief Returns the image file of a frame, <name>.png or <name>_NNN.png for turntables.
+ */
+string BatchRenderer::outputFile(const MeshData& mesh, int frame) const {
+    string name = mesh.name;
+    size_t dot = name.find_last_of('.');
+    if (dot != string::npos)
+        name = name.substr(0, dot);
+
+    string file = options.outputDir;
+    if (!file.empty() && file.back() != '/' && file.back() != '\\')
+        file += '/';
+    file += name;
+    if (options.frames > 1) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), "_%03d", frame);
+        file += suffix;
+    }
+    return file + ".png";
+}
@@ -0,0 +1,134 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: BatchRenderer.h
+ *
+ * Description:
+ * Header file for the BatchRenderer class, the headless mode of the program. It renders
+ * every OBJ file of a directory into PNG thumbnails or N frame turntables without showing
+ * a window.
+ *
+ * The work is pipelined: load jobs parse OBJ files ahead of the renderer, the renderer
+ * draws into an offscreen framebuffer of a hidden OpenGL context (or the CPU
+ * SoftwareRenderer when no context can be created) and reads frames back through two
+ * pixel buffer objects, and encode jobs write the PNG files. The jobs run on the
+ * JobSystem, the renderer runs them too while it waits for a mesh.
+ *
+ * Dependencies:
+ * - GLEW (OpenGL Extension Wrangler Library)
+ * - GLFW (Graphics Library Framework)
+ * - GLM (OpenGL Mathematics)
+ * - stb_image_write
+ * - MeshBuilder.h, ShaderVariants.h, SoftwareRenderer.h, JobSystem.h
+ */
+
+#ifndef DATORGRAFIK_BATCHRENDERER_H
+#define DATORGRAFIK_BATCHRENDERER_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "JobSystem.h"
+#include "MeshBuilder.h"
+#include "ShaderVariants.h"
+#include "SoftwareRenderer.h"
+
+struct BatchOptions {
+    std::string inputDir;
+    std::string outputDir;
+    int size = 256;     // Width and height of the images
+    int frames = 1;     // 1 renders a thumbnail, more renders a turntable
+    bool cpu = false;   // Use the SoftwareRenderer even if OpenGL is available
+};
+
+class BatchRenderer {
+
+public:
+
+    explicit BatchRenderer(const BatchOptions& options);
+    ~BatchRenderer();
+
+    int run();
+
+private:
+
+    struct LoadResult {
+        std::string file;
+        std::unique_ptr<MeshData> mesh;
+        std::string error;
+    };
+
+    struct EncodeJob {
+        std::string file;
+        int size;
+        bool flip;                          // Rows are stored bottom row first
+        std::vector<unsigned char> rgba;
+    };
+
+    // Frame waiting in a pixel buffer object
+    struct PendingFrame {
+        std::string file;
+        int buffer;
+    };
+
+    BatchOptions options;
+
+    JobSystem& jobs;
+
+    // Load stage, a result and a counter per file
+    std::vector<std::string> files;
+    std::vector<LoadResult> results;
+    std::unique_ptr<JobCounter[]> loads;
+    size_t nextLoad;
+
+    // Encode stage
+    JobCounter encodes;
+    std::atomic<int> imagesWritten;
+    std::atomic<int> failures;
+
+    // OpenGL backend
+    GLFWwindow* window;
+    GLuint program;
+    GLuint framebuffer;
+    GLuint colorBuffer;
+    GLuint depthBuffer;
+    GLuint vao;
+    GLuint vbo;
+    GLuint ibo;
+    GLuint packBuffers[2];
+    int frameCount;
+    bool hasPending;
+    PendingFrame pending;
+    ProgramCache programCache;
+    ShaderVariants shaders;
+
+    // CPU backend
+    std::unique_ptr<SoftwareRenderer> softwareRenderer;
+
+    bool listFiles();
+    void startLoads(size_t upTo);
+    void load(size_t file);
+    void encode(const EncodeJob& job);
+    void pushEncode(EncodeJob&& job);
+
+    bool initGL();
+    void destroyGL();
+    void renderGL(const MeshData& mesh);
+    void readBack(const std::string& file);
+    void flushPending();
+    void renderCPU(const MeshData& mesh);
+
+    void frameSetup(const MeshData& mesh, int frame, glm::mat4& model, glm::mat4& view, glm::mat4& projection,
+                    glm::vec3& eye, glm::vec3& light) const;
+    std::string outputFile(const MeshData& mesh, int frame) const;
+
+};
+
+#endif //DATORGRAFIK_BATCHRENDERER_H
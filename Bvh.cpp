@@ -0,0 +1,494 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: Bvh.cpp
+ *
+ * Description:
+ * Implementation file for the Bvh class.
+ *
+ * Dependencies:
+ * - "Bvh.h"
+ */
+
+#include "Bvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Triangles per task when the build input is computed
+#define BVH_TRIANGLE_CHUNK 4096
+
+// Smallest subtree handed to a worker thread
+#define BVH_MIN_SUBTREE 256
+
+#define BVH_STACK_SIZE (2 * BVH_MAX_DEPTH + 2)
+
+namespace {
+
+inline float surfaceArea(const glm::vec3& lo, const glm::vec3& hi) {
+    glm::vec3 e = glm::max(hi - lo, glm::vec3(0.0f));
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+// Four floats, one per ray of a packet. Comparisons return a mask with bit i set for lane i.
+#ifdef __SSE2__
+struct Float4 {
+    __m128 v;
+};
+
+inline Float4 splat(float f) { return Float4{_mm_set1_ps(f)}; }
+inline Float4 load(const float* p) { return Float4{_mm_loadu_ps(p)}; }
+inline void store(float* p, Float4 a) { _mm_storeu_ps(p, a.v); }
+inline Float4 operator+(Float4 a, Float4 b) { return Float4{_mm_add_ps(a.v, b.v)}; }
+inline Float4 operator-(Float4 a, Float4 b) { return Float4{_mm_sub_ps(a.v, b.v)}; }
+inline Float4 operator*(Float4 a, Float4 b) { return Float4{_mm_mul_ps(a.v, b.v)}; }
+inline Float4 operator/(Float4 a, Float4 b) { return Float4{_mm_div_ps(a.v, b.v)}; }
+inline Float4 minimum(Float4 a, Float4 b) { return Float4{_mm_min_ps(a.v, b.v)}; }
+inline Float4 maximum(Float4 a, Float4 b) { return Float4{_mm_max_ps(a.v, b.v)}; }
+inline int lessEqual(Float4 a, Float4 b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); }
+inline int lessThan(Float4 a, Float4 b) { return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)); }
+#else
+struct Float4 {
+    float f[4];
+};
+
+template<typename Op>
+inline Float4 lanes(Float4 a, Float4 b, Op op) {
+    Float4 r;
+    for (int i = 0; i < 4; i++)
+        r.f[i] = op(a.f[i], b.f[i]);
+    return r;
+}
+
+inline Float4 splat(float f) { return Float4{{f, f, f, f}}; }
+inline Float4 load(const float* p) { return Float4{{p[0], p[1], p[2], p[3]}}; }
+inline void store(float* p, Float4 a) { copy(a.f, a.f + 4, p); }
+inline Float4 operator+(Float4 a, Float4 b) { return lanes(a, b, [](float x, float y) { return x + y; }); }
+inline Float4 operator-(Float4 a, Float4 b) { return lanes(a, b, [](float x, float y) { return x - y; }); }
+inline Float4 operator*(Float4 a, Float4 b) { return lanes(a, b, [](float x, float y) { return x * y; }); }
+inline Float4 operator/(Float4 a, Float4 b) { return lanes(a, b, [](float x, float y) { return x / y; }); }
+inline Float4 minimum(Float4 a, Float4 b) { return lanes(a, b, [](float x, float y) { return y < x ? y : x; }); }
+inline Float4 maximum(Float4 a, Float4 b) { return lanes(a, b, [](float x, float y) { return y > x ? y : x; }); }
+inline int lessEqual(Float4 a, Float4 b) {
+    int mask = 0;
+    for (int i = 0; i < 4; i++)
+        mask |= (a.f[i] <= b.f[i]) << i;
+    return mask;
+}
+inline int lessThan(Float4 a, Float4 b) {
+    int mask = 0;
+    for (int i = 0; i < 4; i++)
+        mask |= (a.f[i] < b.f[i]) << i;
+    return mask;
+}
+#endif
+
+struct PacketRays {
+    Float4 ox, oy, oz;
+    Float4 dx, dy, dz;
+    Float4 ix, iy, iz;      // Reciprocal directions
+};
+
+// Returns the lanes entering the box before tFar, and their entry distances
+inline int boxTest(const BvhNode& node, const PacketRays& r, Float4 tFar, int mask, Float4& tEntry) {
+    Float4 t0 = (splat(node.boundsMin.x) - r.ox) * r.ix;
+    Float4 t1 = (splat(node.boundsMax.x) - r.ox) * r.ix;
+    Float4 tMin = minimum(t0, t1), tMax = maximum(t0, t1);
+    t0 = (splat(node.boundsMin.y) - r.oy) * r.iy;
+    t1 = (splat(node.boundsMax.y) - r.oy) * r.iy;
+    tMin = maximum(tMin, minimum(t0, t1));
+    tMax = minimum(tMax, maximum(t0, t1));
+    t0 = (splat(node.boundsMin.z) - r.oz) * r.iz;
+    t1 = (splat(node.boundsMax.z) - r.oz) * r.iz;
+    tMin = maximum(tMin, minimum(t0, t1));
+    tMax = minimum(tMax, maximum(t0, t1));
+
+    tEntry = maximum(tMin, splat(0.0f));
+    return lessEqual(tEntry, minimum(tMax, tFar)) & mask;
+}
+
+// Smallest entry distance among the lanes of mask
+inline float nearest(Float4 t, int mask) {
+    float lane[4];
+    store(lane, t);
+    float result = FLT_MAX;
+    for (int i = 0; i < 4; i++) {
+        if (mask & (1 << i))
+            result = min(result, lane[i]);
+    }
+    return result;
+}
+
+}
+
+Bvh::Bvh() {
+}
+
+/**
+ * @brief Builds the hierarchy over an indexed triangle mesh.
+ *
+ * @param positions Vertex positions, in the space the rays will be given in.
+ * @param indices Three vertex indices per triangle.
+ * @param triangleCount Number of triangles.
+ * @param jobs Job system the build runs on.
+ *
+ * The top of the tree is split on the calling thread until the nodes are small enough
+ * to give every thread a few subtrees. The subtrees are then built in parallel into
+ * their own node lists and appended to the tree.
+ */
+void Bvh::build(const glm::vec3* positions, const unsigned int* indices, size_t triangleCount, JobSystem& jobs) {
+    nodes.clear();
+    triangles.clear();
+    triangleIds.clear();
+    if (triangleCount == 0)
+        return;
+
+    uint32_t n = (uint32_t)triangleCount;
+    centroids.resize(n);
+    boundsMin.resize(n);
+    boundsMax.resize(n);
+    triangles.resize(n);
+    jobs.parallelFor((n + BVH_TRIANGLE_CHUNK - 1) / BVH_TRIANGLE_CHUNK, [&](size_t chunk) {
+        uint32_t end = min<uint32_t>(n, (uint32_t)(chunk + 1) * BVH_TRIANGLE_CHUNK);
+        for (uint32_t i = (uint32_t)chunk * BVH_TRIANGLE_CHUNK; i < end; i++) {
+            const glm::vec3& a = positions[indices[3 * i]];
+            const glm::vec3& b = positions[indices[3 * i + 1]];
+            const glm::vec3& c = positions[indices[3 * i + 2]];
+            boundsMin[i] = glm::min(a, glm::min(b, c));
+            boundsMax[i] = glm::max(a, glm::max(b, c));
+            centroids[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+        }
+    });
+
+    triangleIds.resize(n);
+    iota(triangleIds.begin(), triangleIds.end(), 0u);
+
+    nodes.reserve(2 * (size_t)n);
+    nodes.resize(1);
+
+    vector<Subtree> deferred;
+    uint32_t deferBelow = 0;
+    if (jobs.size() > 1)
+        deferBelow = max<uint32_t>(n / (uint32_t)(jobs.size() * 4), BVH_MIN_SUBTREE);
+    buildNode(nodes, 0, 0, n, 0, deferBelow, deferBelow > 0 ? &deferred : nullptr);
+
+    vector<vector<BvhNode>> subtrees(deferred.size());
+    jobs.parallelFor(deferred.size(), [&](size_t i) {
+        subtrees[i].reserve(2 * (size_t)deferred[i].count);
+        subtrees[i].resize(1);
+        buildNode(subtrees[i], 0, deferred[i].first, deferred[i].count, deferred[i].depth, 0, nullptr);
+    });
+
+    // Node k > 0 of a subtree ends up at base + k, its root replaces the placeholder
+    for (size_t i = 0; i < subtrees.size(); i++) {
+        uint32_t base = (uint32_t)nodes.size() - 1;
+        for (size_t k = 0; k < subtrees[i].size(); k++) {
+            BvhNode node = subtrees[i][k];
+            if (node.count == 0)
+                node.leftFirst += base;
+            if (k == 0)
+                nodes[deferred[i].node] = node;
+            else
+                nodes.push_back(node);
+        }
+    }
+
+    jobs.parallelFor((n + BVH_TRIANGLE_CHUNK - 1) / BVH_TRIANGLE_CHUNK, [&](size_t chunk) {
+        uint32_t end = min<uint32_t>(n, (uint32_t)(chunk + 1) * BVH_TRIANGLE_CHUNK);
+        for (uint32_t i = (uint32_t)chunk * BVH_TRIANGLE_CHUNK; i < end; i++) {
+            uint32_t id = triangleIds[i];
+            const glm::vec3& a = positions[indices[3 * id]];
+            triangles[i].v0 = a;
+            triangles[i].e1 = positions[indices[3 * id + 1]] - a;
+            triangles[i].e2 = positions[indices[3 * id + 2]] - a;
+        }
+    });
+}
+
+/**
+ * @brief Finds the closest hit of every ray of a packet.
+ *
+ * @param packet Rays to trace, rays are only hit within tMax.
+ * @param hit Receives the hits.
+ */
+void Bvh::intersect(const RayPacket& packet, PacketHit& hit) const {
+    traverse<false>(packet, &hit);
+}
+
+/**
+ * @brief Tests which rays of a packet hit anything within tMax.
+ *
+ * @return Mask with bit i set when ray i is blocked.
+ */
+int Bvh::occluded(const RayPacket& packet) const {
+    return traverse<true>(packet, nullptr);
+}
+
+size_t Bvh::nodeCount() const {
+    return nodes.size();
+}
+
+size_t Bvh::triangleCount() const {
+    return triangles.size();
+}
+
+bool Bvh::empty() const {
+    return nodes.empty();
+}
+
+/**
+ * @brief Splits a node or makes it a leaf, and recurses into its children.
+ *
+ * @param out Node list the node and its descendants are stored in.
+ * @param node Index of the node in out.
+ * @param first First triangle of the node in triangleIds.
+ * @param count Number of triangles.
+ * @param depth Depth of the node in the whole tree.
+ * @param deferBelow Nodes with fewer triangles are added to deferred instead of built.
+ * @param deferred Subtrees left for the worker threads, nullptr builds everything.
+ */
+void Bvh::buildNode(vector<BvhNode>& out, uint32_t node, uint32_t first, uint32_t count, uint32_t depth,
+                    uint32_t deferBelow, vector<Subtree>* deferred) {
+    if (deferred && count < deferBelow) {
+        deferred->push_back({ node, first, count, depth });
+        return;
+    }
+
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (uint32_t i = first; i < first + count; i++) {
+        lo = glm::min(lo, boundsMin[triangleIds[i]]);
+        hi = glm::max(hi, boundsMax[triangleIds[i]]);
+    }
+    out[node].boundsMin = lo;
+    out[node].boundsMax = hi;
+    out[node].leftFirst = first;
+    out[node].count = count;
+
+    Split split;
+    if (count <= 2 || depth >= BVH_MAX_DEPTH || !findSplit(first, count, surfaceArea(lo, hi), split))
+        return;
+
+    auto begin = triangleIds.begin() + first;
+    auto middle = partition(begin, begin + count, [&](uint32_t id) {
+        int bin = (int)((centroids[id][split.axis] - split.origin) * split.scale);
+        return min(bin, BVH_BINS - 1) <= split.bin;
+    });
+    uint32_t leftCount = (uint32_t)(middle - begin);
+    if (leftCount == 0 || leftCount == count)
+        return;
+
+    uint32_t left = (uint32_t)out.size();
+    out.resize(out.size() + 2);
+    out[node].leftFirst = left;
+    out[node].count = 0;
+    buildNode(out, left, first, leftCount, depth + 1, deferBelow, deferred);
+    buildNode(out, left + 1, first + leftCount, count - leftCount, depth + 1, deferBelow, deferred);
+}
+
+/**
+ * @brief Finds the cheapest split of a node by the binned surface area heuristic.
+ *
+ * @param nodeArea Surface area of the node's bounds.
+ * @param split Receives the split.
+ * @return false when the node is better off as a leaf.
+ *
+ * The centroids are sorted into BVH_BINS bins along each axis and every boundary between
+ * two bins is evaluated. A split costs one traversal step plus the triangle tests of the
+ * children weighted by the probability of a ray hitting them.
+ */
+bool Bvh::findSplit(uint32_t first, uint32_t count, float nodeArea, Split& split) const {
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (uint32_t i = first; i < first + count; i++) {
+        lo = glm::min(lo, centroids[triangleIds[i]]);
+        hi = glm::max(hi, centroids[triangleIds[i]]);
+    }
+
+    float bestCost = FLT_MAX;
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = hi[axis] - lo[axis];
+        if (extent <= 0.0f)
+            continue;
+        float scale = BVH_BINS / extent;
+
+        uint32_t binCount[BVH_BINS] = {};
+        glm::vec3 binMin[BVH_BINS], binMax[BVH_BINS];
+        fill(binMin, binMin + BVH_BINS, glm::vec3(FLT_MAX));
+        fill(binMax, binMax + BVH_BINS, glm::vec3(-FLT_MAX));
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t id = triangleIds[i];
+            int bin = min((int)((centroids[id][axis] - lo[axis]) * scale), BVH_BINS - 1);
+            binCount[bin]++;
+            binMin[bin] = glm::min(binMin[bin], boundsMin[id]);
+            binMax[bin] = glm::max(binMax[bin], boundsMax[id]);
+        }
+
+        // Cost of everything right of each boundary, then sweep from the left
+        float rightCost[BVH_BINS];
+        glm::vec3 rMin(FLT_MAX), rMax(-FLT_MAX);
+        uint32_t rCount = 0;
+        for (int bin = BVH_BINS - 1; bin > 0; bin--) {
+            rMin = glm::min(rMin, binMin[bin]);
+            rMax = glm::max(rMax, binMax[bin]);
+            rCount += binCount[bin];
+            rightCost[bin - 1] = rCount > 0 ? surfaceArea(rMin, rMax) * rCount : 0.0f;
+        }
+
+        glm::vec3 lMin(FLT_MAX), lMax(-FLT_MAX);
+        uint32_t lCount = 0;
+        for (int bin = 0; bin < BVH_BINS - 1; bin++) {
+            lMin = glm::min(lMin, binMin[bin]);
+            lMax = glm::max(lMax, binMax[bin]);
+            lCount += binCount[bin];
+            if (lCount == 0 || lCount == count)
+                continue;
+            float cost = surfaceArea(lMin, lMax) * lCount + rightCost[bin];
+            if (cost < bestCost) {
+                bestCost = cost;
+                split.axis = axis;
+                split.bin = bin;
+                split.origin = lo[axis];
+                split.scale = scale;
+            }
+        }
+    }
+
+    if (bestCost == FLT_MAX)
+        return false;
+    float splitCost = 1.0f + bestCost / max(nodeArea, FLT_MIN);
+    return splitCost < (float)count || count > BVH_MAX_LEAF_SIZE;
+}
+
+/**
+ * @brief Traces a packet through the tree.
+ *
+ * @tparam anyHit Stop each ray at its first hit instead of searching for the closest.
+ * @param packet Rays to trace.
+ * @param hit Receives the closest hits when anyHit is false.
+ * @return Mask of the blocked rays when anyHit is true.
+ *
+ * A node is visited while any ray of the packet is still active in it. Of two children
+ * the one entered first is visited first, so closer hits prune the other one sooner.
+ */
+template<bool anyHit>
+int Bvh::traverse(const RayPacket& packet, PacketHit* hit) const {
+    int active = packet.mask & 15;
+    float tHit[4];
+    copy(packet.tMax, packet.tMax + 4, tHit);
+    if (hit) {
+        for (int i = 0; i < 4; i++) {
+            hit->t[i] = packet.tMax[i];
+            hit->triangle[i] = -1;
+            hit->u[i] = hit->v[i] = 0.0f;
+        }
+    }
+    if (nodes.empty() || active == 0)
+        return 0;
+
+    PacketRays r;
+    r.ox = load(packet.originX);
+    r.oy = load(packet.originY);
+    r.oz = load(packet.originZ);
+    r.dx = load(packet.directionX);
+    r.dy = load(packet.directionY);
+    r.dz = load(packet.directionZ);
+    r.ix = splat(1.0f) / r.dx;
+    r.iy = splat(1.0f) / r.dy;
+    r.iz = splat(1.0f) / r.dz;
+    Float4 tFar = load(tHit);
+
+    struct Entry {
+        Float4 t;
+        uint32_t node;
+    };
+    Entry stack[BVH_STACK_SIZE];
+    int size = 0;
+    int blocked = 0;
+
+    Float4 tEntry;
+    if (!boxTest(nodes[0], r, tFar, active, tEntry))
+        return 0;
+    stack[size++] = { tEntry, 0 };
+
+    while (size > 0) {
+        Entry entry = stack[--size];
+        if (!(lessEqual(entry.t, tFar) & active))
+            continue;
+        const BvhNode& node = nodes[entry.node];
+
+        if (node.count > 0) {
+            for (uint32_t k = node.leftFirst; k < node.leftFirst + node.count; k++) {
+                const Triangle& tri = triangles[k];
+                Float4 e1x = splat(tri.e1.x), e1y = splat(tri.e1.y), e1z = splat(tri.e1.z);
+                Float4 e2x = splat(tri.e2.x), e2y = splat(tri.e2.y), e2z = splat(tri.e2.z);
+
+                // Möller-Trumbore for the four rays at once
+                Float4 px = r.dy * e2z - r.dz * e2y;
+                Float4 py = r.dz * e2x - r.dx * e2z;
+                Float4 pz = r.dx * e2y - r.dy * e2x;
+                Float4 invDet = splat(1.0f) / (e1x * px + e1y * py + e1z * pz);
+                Float4 sx = r.ox - splat(tri.v0.x), sy = r.oy - splat(tri.v0.y), sz = r.oz - splat(tri.v0.z);
+                Float4 u = (sx * px + sy * py + sz * pz) * invDet;
+                Float4 qx = sy * e1z - sz * e1y;
+                Float4 qy = sz * e1x - sx * e1z;
+                Float4 qz = sx * e1y - sy * e1x;
+                Float4 v = (r.dx * qx + r.dy * qy + r.dz * qz) * invDet;
+                Float4 t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+
+                Float4 zero = splat(0.0f);
+                int hits = lessEqual(zero, u) & lessEqual(zero, v) & lessEqual(u + v, splat(1.0f)) &
+                           lessThan(zero, t) & lessThan(t, tFar) & active;
+                if (!hits)
+                    continue;
+
+                if (anyHit) {
+                    blocked |= hits;
+                    active &= ~hits;
+                    if (!active)
+                        return blocked;
+                    continue;
+                }
+
+                float laneT[4], laneU[4], laneV[4];
+                store(laneT, t);
+                store(laneU, u);
+                store(laneV, v);
+                for (int i = 0; i < 4; i++) {
+                    if (hits & (1 << i)) {
+                        tHit[i] = hit->t[i] = laneT[i];
+                        hit->triangle[i] = (int)triangleIds[k];
+                        hit->u[i] = laneU[i];
+                        hit->v[i] = laneV[i];
+                    }
+                }
+                tFar = load(tHit);
+            }
+            continue;
+        }
+
+        Float4 tLeft, tRight;
+        int left = boxTest(nodes[node.leftFirst], r, tFar, active, tLeft);
+        int right = boxTest(nodes[node.leftFirst + 1], r, tFar, active, tRight);
+        if (left && right) {
+            if (nearest(tLeft, left) <= nearest(tRight, right)) {
+                stack[size++] = { tRight, node.leftFirst + 1 };
+                stack[size++] = { tLeft, node.leftFirst };
+            } else {
+                stack[size++] = { tLeft, node.leftFirst };
+                stack[size++] = { tRight, node.leftFirst + 1 };
+            }
+        } else if (left) {
+            stack[size++] = { tLeft, node.leftFirst };
+        } else if (right) {
+            stack[size++] = { tRight, node.leftFirst + 1 };
+        }
+    }
+    return blocked;
+}
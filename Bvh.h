@@ -0,0 +1,120 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: Bvh.h
+ *
+ * Description:
+ * Header file for the Bvh class, a bounding volume hierarchy over the triangles of a mesh
+ * for ray casting on the CPU.
+ *
+ * The tree is built with the binned surface area heuristic. The top levels are split on
+ * the calling thread and the subtrees below them are built in parallel on the JobSystem.
+ * Rays are traced four at a time as packets, with the box and triangle tests of the four
+ * rays evaluated together in SSE registers.
+ *
+ * Dependencies:
+ * - GLM (OpenGL Mathematics)
+ * - JobSystem.h
+ */
+
+#ifndef DATORGRAFIK_BVH_H
+#define DATORGRAFIK_BVH_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "JobSystem.h"
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF_SIZE 8
+#define BVH_MAX_DEPTH 64
+
+// Interior nodes have count 0 and their children at leftFirst and leftFirst + 1.
+// Leaves hold the triangles [leftFirst, leftFirst + count).
+struct BvhNode {
+    glm::vec3 boundsMin;
+    uint32_t leftFirst;
+    glm::vec3 boundsMax;
+    uint32_t count;
+};
+
+// Four rays in SIMD friendly layout. Lanes without their bit in mask are ignored.
+struct RayPacket {
+    float originX[4], originY[4], originZ[4];
+    float directionX[4], directionY[4], directionZ[4];
+    float tMax[4];
+    int mask;
+};
+
+inline int packetRayCount(int mask) {
+    return (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+}
+
+// Closest hits of a packet, triangle is -1 where a ray missed. u and v are the
+// barycentrics of the triangle's second and third vertex.
+struct PacketHit {
+    float t[4];
+    int triangle[4];
+    float u[4], v[4];
+};
+
+class Bvh {
+
+public:
+
+    Bvh();
+
+    void build(const glm::vec3* positions, const unsigned int* indices, size_t triangleCount, JobSystem& jobs);
+
+    void intersect(const RayPacket& packet, PacketHit& hit) const;
+    int occluded(const RayPacket& packet) const;
+
+    size_t nodeCount() const;
+    size_t triangleCount() const;
+    bool empty() const;
+
+private:
+
+    // Triangle in the leaf order, as a vertex and two edges
+    struct Triangle {
+        glm::vec3 v0, e1, e2;
+    };
+
+    // Subtree left for a worker thread by the top level build
+    struct Subtree {
+        uint32_t node;
+        uint32_t first;
+        uint32_t count;
+        uint32_t depth;
+    };
+
+    // Triangles whose centroid falls in bins up to bin go to the left child
+    struct Split {
+        int axis;
+        int bin;
+        float origin;
+        float scale;
+    };
+
+    std::vector<BvhNode> nodes;
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> triangleIds;     // Mesh triangle of each leaf triangle
+
+    // Build input
+    std::vector<glm::vec3> centroids;
+    std::vector<glm::vec3> boundsMin;
+    std::vector<glm::vec3> boundsMax;
+
+    void buildNode(std::vector<BvhNode>& out, uint32_t node, uint32_t first, uint32_t count, uint32_t depth,
+                   uint32_t deferBelow, std::vector<Subtree>* deferred);
+    bool findSplit(uint32_t first, uint32_t count, float nodeArea, Split& split) const;
+
+    template<bool anyHit>
+    int traverse(const RayPacket& packet, PacketHit* hit) const;
+
+};
+
+#endif //DATORGRAFIK_BVH_H
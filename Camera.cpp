@@ -46,6 +46,7 @@ void Camera::init(int width, int height, GLuint program) {
 
     // Proj parameters
     fov = 60.0f;
+    nearplane = 0.1f;
     farplane = 500.0f;
     top = 1.0f;
     obliqueScale = 0.0f;
@@ -60,6 +61,18 @@ void Camera::init(int width, int height, GLuint program) {
 
     viewMatrix = glm::lookAt(eye,center,up);
 
+    setProgram(program);
+}
+
+/**
+ * @brief Looks up the camera's uniform locations in a shader program.
+ *
+ * @param program The OpenGL program ID.
+ *
+ * Called whenever a different shader variant is taken into use. The matrices
+ * have to be sent again afterwards.
+ */
+void Camera::setProgram(GLuint program) {
     locProj = glGetUniformLocation(program, "P");
     locView = glGetUniformLocation(program, "V");
     locEye = glGetUniformLocation(program, "v");
@@ -98,7 +111,7 @@ void Camera::sendProj(int width, int height, int projmode) {
         projectionMatrix = glm::perspective(
                 glm::radians(fov * aspectRatio),
                 aspectRatio,
-                0.1f,
+                nearplane,
                 farplane
         );
     }
@@ -108,7 +121,7 @@ void Camera::sendProj(int width, int height, int projmode) {
         projectionMatrix = glm::ortho(
                 -top, top,
                 -top, top,
-                0.1f, farplane
+                nearplane, farplane
         );
 
         glm::mat4 obliqueMatrix = glm::mat4(1.0f);
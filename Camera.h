@@ -34,6 +34,7 @@ public:
 
     Camera();
     void init(int width, int height, GLuint program);
+    void setProgram(GLuint program);
 
 
     void sendView();
@@ -48,6 +49,7 @@ public:
     float yaw;
 
     float fov;
+    float nearplane;
     float farplane;
     float top;
     float obliqueScale;
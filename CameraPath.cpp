@@ -0,0 +1,175 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: CameraPath.cpp
+ *
+ * Description:
+ * Implementation file for the CameraPath class.
+ *
+ * Dependencies:
+ * - "CameraPath.h"
+ */
+
+#include "CameraPath.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+/**
+ * @brief Reads the keys of a path from a file, replacing the ones held.
+ *
+ * @return False if the file could not be read or has a malformed line, nothing is replaced then.
+ */
+bool CameraPath::load(const string& path) {
+    ifstream file(path);
+    if (!file) {
+        cerr << "Could not open the camera path " << path << endl;
+        return false;
+    }
+
+    vector<Key> loaded;
+    string line;
+    int number = 0;
+    while (getline(file, line)) {
+        number++;
+        size_t comment = line.find('#');
+        if (comment != string::npos)
+            line.erase(comment);
+        istringstream values(line);
+        Key key;
+        if (!(values >> key.time))
+            continue;
+        if (!(values >> key.eye.x >> key.eye.y >> key.eye.z >> key.center.x >> key.center.y >> key.center.z)) {
+            cerr << path << ":" << number << ": expected <seconds> <eye x y z> <center x y z>" << endl;
+            return false;
+        }
+        loaded.push_back(key);
+    }
+    if (loaded.empty()) {
+        cerr << "The camera path " << path << " has no keys" << endl;
+        return false;
+    }
+
+    stable_sort(loaded.begin(), loaded.end(), [](const Key& a, const Key& b) { return a.time < b.time; });
+    keys.swap(loaded);
+    return true;
+}
+
+/**
+ * @brief Writes the keys to a file that load() reads back.
+ *
+ * @return False if the file could not be written.
+ */
+bool CameraPath::save(const string& path) const {
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        cerr << "Could not write the camera path " << path << endl;
+        return false;
+    }
+    fprintf(file, "# seconds eye.x eye.y eye.z center.x center.y center.z\n");
+    for (const Key& key : keys)
+        fprintf(file, "%g %.9g %.9g %.9g %.9g %.9g %.9g\n", key.time, key.eye.x, key.eye.y, key.eye.z,
+                key.center.x, key.center.y, key.center.z);
+    bool written = !ferror(file);
+    fclose(file);
+    return written;
+}
+
+/**
+ * @brief Adds a key, keeping the keys sorted by time.
+ */
+void CameraPath::addKey(double time, const glm::vec3& eye, const glm::vec3& center) {
+    Key key;
+    key.time = time;
+    key.eye = eye;
+    key.center = center;
+    vector<Key>::iterator after = upper_bound(keys.begin(), keys.end(), key,
+                                              [](const Key& a, const Key& b) { return a.time < b.time; });
+    keys.insert(after, key);
+}
+
+/**
+ * @brief Removes all keys.
+ */
+void CameraPath::clear() {
+    keys.clear();
+}
+
+/**
+ * @brief Returns the time of the last key, zero for an empty path.
+ */
+double CameraPath::duration() const {
+    return keys.empty() ? 0.0 : keys.back().time;
+}
+
+/**
+ * @brief Returns the camera of the path at a time.
+ *
+ * @param time Seconds, clamped to the keys.
+ * @param eye Set to the position of the camera.
+ * @param center Set to the point the camera looks at.
+ * @return False for an empty path, the camera is not set then.
+ */
+bool CameraPath::sample(double time, glm::vec3& eye, glm::vec3& center) const {
+    if (keys.empty())
+        return false;
+    if (keys.size() == 1 || time <= keys.front().time) {
+        eye = keys.front().eye;
+        center = keys.front().center;
+        return true;
+    }
+    if (time >= keys.back().time) {
+        eye = keys.back().eye;
+        center = keys.back().center;
+        return true;
+    }
+
+    // The segment from the last key at or before the time
+    size_t i = 0;
+    while (keys[i + 1].time <= time)
+        i++;
+    const Key& a = keys[i];
+    const Key& b = keys[i + 1];
+    float h = (float)(b.time - a.time);
+    float s = (float)((time - a.time) / (b.time - a.time));
+
+    // Cubic Hermite between the keys with the Catmull-Rom tangents
+    float s2 = s * s;
+    float s3 = s2 * s;
+    float h00 = 2.0f * s3 - 3.0f * s2 + 1.0f;
+    float h10 = s3 - 2.0f * s2 + s;
+    float h01 = -2.0f * s3 + 3.0f * s2;
+    float h11 = s3 - s2;
+
+    glm::vec3 eyeA, centerA, eyeB, centerB;
+    tangents(i, eyeA, centerA);
+    tangents(i + 1, eyeB, centerB);
+    eye = h00 * a.eye + h10 * h * eyeA + h01 * b.eye + h11 * h * eyeB;
+    center = h00 * a.center + h10 * h * centerA + h01 * b.center + h11 * h * centerB;
+    return true;
+}
+
+/**
+ * @brief Computes the tangents of a key, per second, from its neighbours.
+ *
+ * The first and the last key use the segment they end. Keys at the same time get
+ * no tangent.
+ */
+void CameraPath::tangents(size_t key, glm::vec3& eye, glm::vec3& center) const {
+    size_t before = key > 0 ? key - 1 : key;
+    size_t after = key + 1 < keys.size() ? key + 1 : key;
+    float span = (float)(keys[after].time - keys[before].time);
+    if (span <= 0.0f) {
+        eye = center = glm::vec3(0.0f);
+        return;
+    }
+    eye = (keys[after].eye - keys[before].eye) / span;
+    center = (keys[after].center - keys[before].center) / span;
+}
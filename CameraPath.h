@@ -0,0 +1,67 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: CameraPath.h
+ *
+ * Description:
+ * Header file for the CameraPath class, a scripted camera flythrough through keyframes
+ * of the eye and the point looked at.
+ *
+ * The keys are joined by a Catmull-Rom spline, which passes through every key with a
+ * tangent from its neighbours, so the camera neither stops nor turns sharply at them.
+ * The keys may be unevenly spaced in time. A flythrough samples the path at a fixed
+ * step per frame, so every run renders the same views.
+ *
+ * A path is a text file with one key per line, '#' starts a comment:
+ *
+ *   <seconds> <eye x y z> <center x y z>
+ *
+ * Dependencies:
+ * - GLM
+ */
+
+#ifndef DATORGRAFIK_CAMERAPATH_H
+#define DATORGRAFIK_CAMERAPATH_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Path time a flythrough advances per frame
+#define FLYTHROUGH_FRAME_SECONDS (1.0 / 60.0)
+
+// Time between the keys added from the GUI
+#define CAMERA_PATH_KEY_SECONDS 2.0
+
+class CameraPath {
+
+public:
+
+    struct Key {
+        double time;
+        glm::vec3 eye;
+        glm::vec3 center;
+    };
+
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    void addKey(double time, const glm::vec3& eye, const glm::vec3& center);
+    void clear();
+
+    size_t size() const { return keys.size(); }
+    double duration() const;
+    bool sample(double time, glm::vec3& eye, glm::vec3& center) const;
+
+private:
+
+    std::vector<Key> keys;      // Sorted by time
+
+    void tangents(size_t key, glm::vec3& eye, glm::vec3& center) const;
+
+};
+
+#endif //DATORGRAFIK_CAMERAPATH_H
@@ -0,0 +1,158 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: DepthPrepass.cpp
+ *
+ * Description:
+ * Implementation file for the DepthPrepass class.
+ *
+ * Dependencies:
+ * - "DepthPrepass.h"
+ * - "Profiler.h"
+ * - GLM (OpenGL Mathematics)
+ */
+
+#include "DepthPrepass.h"
+#include "Profiler.h"
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace std;
+
+/**
+ * @brief Default constructor for the DepthPrepass class.
+ */
+DepthPrepass::DepthPrepass() {
+    vao = 0;
+    depthDrawn = false;
+    shading = false;
+    depthFragments = 0;
+    shadedFragments = 0;
+}
+
+/**
+ * @brief Reads the shaders and creates the vertex array and the queries.
+ *
+ * @param cache The program cache the shader variants are built through.
+ */
+void DepthPrepass::init(ProgramCache* cache) {
+    shaders.init(cache, "depth_vshader.glsl", "depth_fshader.glsl");
+    glGenVertexArrays(1, &vao);
+    depthQuery.init(GL_SAMPLES_PASSED);
+    shadingQuery.init(GL_SAMPLES_PASSED);
+}
+
+/**
+ * @brief Sources the positions and indices from the buffers a mesh's vertex array uses.
+ *
+ * @param meshVao The vertex array the mesh is shaded with, its positions at the start of
+ *        their buffer.
+ *
+ * Call it again when the mesh is loaded into other buffers. The vertex array and array
+ * buffer bindings are restored.
+ */
+void DepthPrepass::setMesh(GLuint meshVao) {
+    GLint boundVao, arrayBuffer, positionBuffer, indexBuffer;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &boundVao);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &arrayBuffer);
+    glBindVertexArray(meshVao);
+    glGetVertexAttribiv(ATTRIB_POSITION, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &positionBuffer);
+    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &indexBuffer);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, (GLuint)positionBuffer);
+    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (const void*)0);
+    glEnableVertexAttribArray(ATTRIB_POSITION);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, (GLuint)indexBuffer);
+
+    glBindVertexArray((GLuint)boundVao);
+    glBindBuffer(GL_ARRAY_BUFFER, (GLuint)arrayBuffer);
+}
+
+/**
+ * @brief Returns the position only vertex array, for GpuScene::attachInstances().
+ */
+GLuint DepthPrepass::vertexArray() const {
+    return vao;
+}
+
+/**
+ * @brief Starts the pre-pass, with color writes off.
+ *
+ * The caller then binds the pre-pass program with use() and issues the same draws as in
+ * the shading pass, before calling beginShading().
+ */
+void DepthPrepass::begin() {
+    collect();
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    depthQuery.begin();
+    depthDrawn = true;
+}
+
+/**
+ * @brief Binds the pre-pass program and the position only vertex array.
+ *
+ * @param features SHADER_INSTANCED when the GpuScene is drawn, 0 for the object alone.
+ * @param projection The camera's projection matrix.
+ * @param view The camera's view matrix.
+ * @param model The object's model matrix, unused for the GpuScene.
+ *
+ * The matrices must be the ones the shading pass uses, or the GL_EQUAL test fails.
+ */
+void DepthPrepass::use(unsigned int features, const glm::mat4& projection, const glm::mat4& view,
+                       const glm::mat4& model) {
+    GLuint program = shaders.program(features & SHADER_INSTANCED);
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "P"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniformMatrix4fv(glGetUniformLocation(program, "V"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(program, "M"), 1, GL_FALSE, glm::value_ptr(model));
+    glBindVertexArray(vao);
+    PROFILE_STATE_CHANGES(2);
+}
+
+/**
+ * @brief Sets up the shading pass, to be tested against the pre-pass' depth if it ran.
+ *
+ * Without begin() this frame only the shaded fragments are counted. The caller binds
+ * its own program and vertex array.
+ */
+void DepthPrepass::beginShading() {
+    if (depthDrawn) {
+        depthQuery.end();
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    } else {
+        collect();
+        depthFragments = 0;
+    }
+    shadingQuery.begin();
+    shading = true;
+}
+
+/**
+ * @brief Ends the shading pass and restores the default depth test.
+ */
+void DepthPrepass::end() {
+    if (!shading)
+        return;
+    shadingQuery.end();
+    if (depthDrawn) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+    depthDrawn = false;
+    shading = false;
+}
+
+/**
+ * @brief Reads the fragment counts that have arrived.
+ */
+void DepthPrepass::collect() {
+    if (depthQuery.collect())
+        depthFragments = (long long)depthQuery.result;
+    if (shadingQuery.collect())
+        shadedFragments = (long long)shadingQuery.result;
+}
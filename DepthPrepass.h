@@ -0,0 +1,69 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: DepthPrepass.h
+ *
+ * Description:
+ * Header file for the DepthPrepass class, which draws the scene's depth before it is
+ * shaded, so every pixel runs the expensive fragment shader only once.
+ *
+ * The pre-pass draws the positions alone, from the position block at the start of the
+ * vertex buffer, with color writes off and an empty fragment shader. The shading pass
+ * then tests with GL_EQUAL and leaves depth writes off, which only the nearest surface
+ * passes. Both vertex shaders declare gl_Position invariant so the depths match.
+ *
+ * The fragments passing each pass are counted with GL_SAMPLES_PASSED queries. The count
+ * of the pre-pass is what the shading pass would have shaded without it, given the same
+ * draw order, so the two show how much overdraw it saves.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ * - GLM (OpenGL Mathematics)
+ * - ShaderVariants.h
+ * - GpuQuery.h
+ */
+
+#ifndef DATORGRAFIK_DEPTHPREPASS_H
+#define DATORGRAFIK_DEPTHPREPASS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "ShaderVariants.h"
+#include "GpuQuery.h"
+
+class DepthPrepass {
+
+public:
+
+    DepthPrepass();
+
+    void init(ProgramCache* cache);
+    void setMesh(GLuint meshVao);
+    GLuint vertexArray() const;
+
+    void begin();
+    void use(unsigned int features, const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model);
+    void beginShading();
+    void end();
+
+    // Results of a few frames back
+    long long depthFragments;       // Passing the pre-pass, 0 while it is off
+    long long shadedFragments;      // Passing the shading pass
+
+private:
+
+    ShaderVariants shaders;
+    GLuint vao;
+    GpuQuery depthQuery;
+    GpuQuery shadingQuery;
+    bool depthDrawn;
+    bool shading;
+
+    void collect();
+
+};
+
+#endif //DATORGRAFIK_DEPTHPREPASS_H
@@ -0,0 +1,190 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: DepthPyramid.cpp
+ *
+ * Description:
+ * Implementation file for the DepthPyramid class.
+ *
+ * Dependencies:
+ * - "DepthPyramid.h"
+ * - "ShaderVariants.h"
+ * - "MemoryTracker.h"
+ * - "Profiler.h"
+ */
+
+#include "DepthPyramid.h"
+#include "ShaderVariants.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * @brief Default constructor for the DepthPyramid class.
+ */
+DepthPyramid::DepthPyramid() {
+    pyramidProgram = 0;
+    depthTexture = 0;
+    pyramidTexture = 0;
+    locSourceLevel = -1;
+    depthWidth = 0;
+    depthHeight = 0;
+    pyramidWidth = 0;
+    pyramidHeight = 0;
+    levelCount = 0;
+    builtViewProjection = glm::mat4(1.0f);
+    built = false;
+}
+
+/**
+ * @brief Sets the program the levels are built with.
+ *
+ * @param program The program built from hiz_cshader.glsl.
+ *
+ * The textures are created by the first build(), once the viewport size is known.
+ */
+void DepthPyramid::init(GLuint program) {
+    pyramidProgram = program;
+    locSourceLevel = glGetUniformLocation(pyramidProgram, "sourceLevel");
+    glUseProgram(pyramidProgram);
+    glUniform1i(glGetUniformLocation(pyramidProgram, "source"), TEXTURE_UNIT_DEPTH_PYRAMID);
+    glUseProgram(0);
+}
+
+/**
+ * @brief Deletes the textures, they are created again by the next build().
+ */
+void DepthPyramid::release() {
+    MemoryTracker::get().releaseGpu(GL_TEXTURE, depthTexture);
+    MemoryTracker::get().releaseGpu(GL_TEXTURE, pyramidTexture);
+    glDeleteTextures(1, &depthTexture);
+    glDeleteTextures(1, &pyramidTexture);
+    depthTexture = pyramidTexture = 0;
+    depthWidth = depthHeight = 0;
+    built = false;
+}
+
+/**
+ * @brief Creates the depth copy and the pyramid for a viewport size.
+ */
+void DepthPyramid::resize(int width, int height) {
+    release();
+
+    depthWidth = width;
+    depthHeight = height;
+    pyramidWidth = 1;
+    while (pyramidWidth * 2 <= width)
+        pyramidWidth *= 2;
+    pyramidHeight = 1;
+    while (pyramidHeight * 2 <= height)
+        pyramidHeight *= 2;
+    levelCount = 1;
+    while ((max(pyramidWidth, pyramidHeight) >> levelCount) > 0)
+        levelCount++;
+
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &pyramidTexture);
+    glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, GL_R32F, pyramidWidth, pyramidHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    size_t pyramidBytes = 0;
+    for (int level = 0; level < levelCount; level++)
+        pyramidBytes += (size_t)max(1, pyramidWidth >> level) * max(1, pyramidHeight >> level) * 4;
+    MemoryTracker::get().trackGpu(GL_TEXTURE, depthTexture, "Depth pyramid depth copy", (size_t)width * height * 4);
+    MemoryTracker::get().trackGpu(GL_TEXTURE, pyramidTexture, "Depth pyramid", pyramidBytes);
+}
+
+/**
+ * @brief Copies the depth of the read framebuffer inside the viewport and builds the pyramid from it.
+ *
+ * @param viewProjection The projection times view matrix the depth was rendered with.
+ *
+ * Leaves the build program in use.
+ */
+void DepthPyramid::build(const glm::mat4& viewProjection) {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] <= 0 || viewport[3] <= 0)
+        return;
+
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_DEPTH_PYRAMID);
+    if (viewport[2] != depthWidth || viewport[3] != depthHeight)
+        resize(viewport[2], viewport[3]);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    glUseProgram(pyramidProgram);
+    PROFILE_STATE_CHANGES(2 + 2 * levelCount);
+    for (int level = 0; level < levelCount; level++) {
+        if (level > 0)
+            glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+        glUniform1i(locSourceLevel, level > 0 ? level - 1 : 0);
+        glBindImageTexture(0, pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        int width = max(1, pyramidWidth >> level), height = max(1, pyramidHeight >> level);
+        glDispatchCompute((GLuint)((width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE),
+                          (GLuint)((height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE), 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    builtViewProjection = viewProjection;
+    built = true;
+}
+
+/**
+ * @brief Returns true once the pyramid has been built.
+ */
+bool DepthPyramid::valid() const {
+    return built;
+}
+
+/**
+ * @brief Returns the pyramid texture, one R32F mip level per pyramid level.
+ */
+GLuint DepthPyramid::texture() const {
+    return pyramidTexture;
+}
+
+/**
+ * @brief Returns the view projection matrix the pyramid was built with.
+ */
+const glm::mat4& DepthPyramid::viewProjection() const {
+    return builtViewProjection;
+}
+
+/**
+ * @brief Returns the width of the first level in texels.
+ */
+int DepthPyramid::width() const {
+    return pyramidWidth;
+}
+
+/**
+ * @brief Returns the height of the first level in texels.
+ */
+int DepthPyramid::height() const {
+    return pyramidHeight;
+}
+
+/**
+ * @brief Returns the number of levels.
+ */
+int DepthPyramid::levels() const {
+    return levelCount;
+}
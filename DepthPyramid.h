@@ -0,0 +1,73 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: DepthPyramid.h
+ *
+ * Description:
+ * Header file for the DepthPyramid class, a hierarchical depth buffer (Hi-Z) used for
+ * occlusion culling on the GPU.
+ *
+ * The depth of the framebuffer being drawn to is copied into a texture, and a compute
+ * shader (hiz_cshader.glsl) reduces it into a mip chain where every texel holds the
+ * farthest depth of the area it covers. The first level is the largest power of two size
+ * that fits the viewport, so every level halves the one below. A bounding box whose
+ * nearest depth is behind the farthest depth of the few texels covering it is hidden.
+ *
+ * The pyramid remembers the view projection matrix it was built with, so the next frame
+ * can test against it with the matrix that matches its contents.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ * - GLM (OpenGL Mathematics)
+ */
+
+#ifndef DATORGRAFIK_DEPTHPYRAMID_H
+#define DATORGRAFIK_DEPTHPYRAMID_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Local size of hiz_cshader.glsl in both dimensions
+#define HIZ_GROUP_SIZE 8
+
+class DepthPyramid {
+
+public:
+
+    DepthPyramid();
+
+    void init(GLuint program);
+    void release();
+    void build(const glm::mat4& viewProjection);
+
+    bool valid() const;
+    GLuint texture() const;
+    const glm::mat4& viewProjection() const;
+    int width() const;
+    int height() const;
+    int levels() const;
+
+private:
+
+    GLuint pyramidProgram;
+    GLuint depthTexture;
+    GLuint pyramidTexture;
+    GLint locSourceLevel;
+
+    int depthWidth;
+    int depthHeight;
+    int pyramidWidth;
+    int pyramidHeight;
+    int levelCount;
+
+    glm::mat4 builtViewProjection;
+    bool built;
+
+    void resize(int width, int height);
+
+};
+
+#endif //DATORGRAFIK_DEPTHPYRAMID_H
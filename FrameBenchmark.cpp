@@ -0,0 +1,165 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: FrameBenchmark.cpp
+ *
+ * Description:
+ * Implementation file for the FrameBenchmark class.
+ *
+ * Dependencies:
+ * - "FrameBenchmark.h"
+ */
+
+#include "FrameBenchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+
+using namespace std;
+
+namespace {
+
+    // Writes a string as a JSON string
+    void writeString(ostream& out, const string& text) {
+        out << '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if ((unsigned char)c >= 0x20)
+                out << c;
+        }
+        out << '"';
+    }
+
+    void writeStats(ostream& out, const FrameBenchmark::Stats& stats) {
+        char text[160];
+        snprintf(text, sizeof(text), "{\"frames\": %d, \"average\": %.4f, \"p50\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+                 stats.frames, stats.average, stats.p50, stats.p99, stats.maximum);
+        out << text;
+    }
+
+}
+
+/**
+ * @brief Constructor for the FrameBenchmark class.
+ */
+FrameBenchmark::FrameBenchmark() {
+    running = false;
+    frames = 0;
+    warmup = 0;
+    frame = 0;
+}
+
+/**
+ * @brief Starts a run from the next frame.
+ *
+ * @param frames Frames to measure, 0 measures until the workload ends.
+ * @param warmup Frames run before measuring.
+ */
+void FrameBenchmark::start(int frames, int warmup) {
+    running = true;
+    this->frames = max(frames, 0);
+    this->warmup = max(warmup, 0);
+    frame = 0;
+    log.cpuMs.clear();
+    log.gpuMs.clear();
+    log.cpuMs.reserve(this->frames);
+    log.gpuMs.reserve(this->frames);
+    if (this->warmup == 0)
+        Profiler::get().setFrameLog(&log);
+}
+
+/**
+ * @brief Returns whether all frames asked for have been measured.
+ */
+bool FrameBenchmark::isDone() const {
+    return running && frames > 0 && frame >= warmup + frames;
+}
+
+/**
+ * @brief Counts a frame, called after the Profiler has finished it. Measuring starts after the warmup.
+ */
+void FrameBenchmark::endFrame() {
+    if (!running)
+        return;
+    frame++;
+    if (frame == warmup)
+        Profiler::get().setFrameLog(&log);
+}
+
+/**
+ * @brief Ends the run, waiting for the GPU times of the frames measured.
+ */
+void FrameBenchmark::finish() {
+    if (!running)
+        return;
+    Profiler::get().finishGpu();
+    Profiler::get().setFrameLog(nullptr);
+    running = false;
+}
+
+/**
+ * @brief Computes the statistics of frame times.
+ *
+ * The percentiles are nearest rank, so they are always times of measured frames.
+ */
+FrameBenchmark::Stats FrameBenchmark::statistics(vector<float> samples) {
+    Stats stats = Stats();
+    stats.frames = (int)samples.size();
+    if (samples.empty())
+        return stats;
+
+    sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (float sample : samples)
+        sum += sample;
+    size_t n = samples.size();
+    stats.average = sum / n;
+    stats.p50 = samples[(size_t)max(0.0, ceil(0.50 * n) - 1.0)];
+    stats.p99 = samples[(size_t)max(0.0, ceil(0.99 * n) - 1.0)];
+    stats.maximum = samples.back();
+    return stats;
+}
+
+/**
+ * @brief Writes the summary of the run as one JSON object.
+ *
+ * @param workload What was run, such as the replayed file.
+ * @param renderer Name of the renderer used.
+ * @param width Width of the window.
+ * @param height Height of the window.
+ */
+void FrameBenchmark::writeJson(ostream& out, const string& workload, const string& renderer,
+                               int width, int height) const {
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    Stats cpu = cpuStats();
+
+    out << "{\n  \"date\": ";
+    writeString(out, date);
+    out << ",\n  \"compiler\": ";
+#ifdef __VERSION__
+    writeString(out, __VERSION__);
+#else
+    writeString(out, "unknown");
+#endif
+    out << ",\n  \"workload\": ";
+    writeString(out, workload);
+    out << ",\n  \"renderer\": ";
+    writeString(out, renderer);
+    out << ",\n  \"width\": " << width << ",\n  \"height\": " << height;
+    out << ",\n  \"warmupFrames\": " << warmup << ",\n  \"frames\": " << cpu.frames;
+    char fps[32];
+    snprintf(fps, sizeof(fps), "%.2f", cpu.average > 0.0 ? 1000.0 / cpu.average : 0.0);
+    out << ",\n  \"fps\": " << fps;
+    out << ",\n  \"frameMs\": ";
+    writeStats(out, cpu);
+    out << ",\n  \"gpuMs\": ";
+    writeStats(out, gpuStats());
+    out << "\n}\n";
+}
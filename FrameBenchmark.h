@@ -0,0 +1,75 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: FrameBenchmark.h
+ *
+ * Description:
+ * Header file for the FrameBenchmark class, which measures the frames of the main loop
+ * while it runs a replay or a flythrough, and summarizes them as JSON.
+ *
+ * The first warmup frames are run but not measured, they load the shaders, fill the
+ * caches and let the texture streaming settle. The frames after them are measured by
+ * the Profiler: the CPU time of every frame and the GPU time of every frame whose
+ * queries could be issued. The GPU results are waited for when the run ends. The
+ * average, the median, the 99th percentile and the maximum of both are reported.
+ *
+ * Dependencies:
+ * - "Profiler.h"
+ */
+
+#ifndef DATORGRAFIK_FRAMEBENCHMARK_H
+#define DATORGRAFIK_FRAMEBENCHMARK_H
+
+#include "Profiler.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Frames run before measuring when no other number is asked for
+#define BENCHMARK_DEFAULT_WARMUP 30
+
+// File the summary is written to when no other is asked for
+#define BENCHMARK_DEFAULT_SUMMARY "benchmark.json"
+
+class FrameBenchmark {
+
+public:
+
+    struct Stats {
+        int frames;
+        double average;
+        double p50;
+        double p99;
+        double maximum;
+    };
+
+    FrameBenchmark();
+
+    void start(int frames, int warmup);
+    bool isRunning() const { return running; }
+    bool isDone() const;
+    void endFrame();
+    void finish();
+
+    int measuredFrames() const { return (int)log.cpuMs.size(); }
+    Stats cpuStats() const { return statistics(log.cpuMs); }
+    Stats gpuStats() const { return statistics(log.gpuMs); }
+    void writeJson(std::ostream& out, const std::string& workload, const std::string& renderer,
+                   int width, int height) const;
+
+    static Stats statistics(std::vector<float> samples);
+
+private:
+
+    bool running;
+    int frames;                 // Frames to measure, 0 until the workload ends
+    int warmup;
+    int frame;                  // Frames run since start(), the warmup included
+    Profiler::FrameLog log;
+
+};
+
+#endif //DATORGRAFIK_FRAMEBENCHMARK_H
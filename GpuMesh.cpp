@@ -0,0 +1,271 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: GpuMesh.cpp
+ *
+ * Description:
+ * Implementation file for the GpuMesh class.
+ *
+ * Dependencies:
+ * - "GpuMesh.h"
+ * - "ShaderVariants.h"
+ * - "3dstudio.h"
+ * - "MemoryTracker.h"
+ */
+
+#include "GpuMesh.h"
+#include "ShaderVariants.h"
+#include "3dstudio.h"
+#include "MemoryTracker.h"
+#include <iostream>
+
+using namespace std;
+
+/**
+ * @brief Default constructor for the GpuMesh class, nothing is created until init().
+ */
+GpuMesh::GpuMesh() {
+    vao = 0;
+    vbo = 0;
+    ibo = 0;
+    vertices = 0;
+    indices = 0;
+    texCoords = false;
+    occlusion = false;
+}
+
+/**
+ * @brief Creates the vertex array and the buffers, and binds the index buffer to the vertex array.
+ */
+void GpuMesh::init() {
+    if (vao != 0)
+        return;
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ibo);
+
+    GLint boundVao;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &boundVao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBindVertexArray((GLuint)boundVao);
+}
+
+/**
+ * @brief Uploads a mesh, replacing the one in the buffers.
+ *
+ * @param mesh A mesh MeshBuilder::validate() accepts.
+ *
+ * New buffers are created if the last ones were detached. The vertex array and array
+ * buffer bindings are restored.
+ */
+void GpuMesh::upload(const MeshData& mesh) {
+    size_t vSize = mesh.positions.size() * sizeof(glm::vec3);
+    size_t nSize = mesh.normals.size() * sizeof(glm::vec3);
+    size_t tSize = mesh.texCoords.size() * sizeof(glm::vec2);
+    size_t oSize = mesh.occlusion.size() * sizeof(float);
+    size_t iSize = mesh.indices.size() * sizeof(unsigned int);
+
+    if (vbo == 0) {
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ibo);
+    }
+
+    GLint boundVao, arrayBuffer;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &boundVao);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &arrayBuffer);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vSize + nSize + tSize + oSize, nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, vSize, mesh.positions.data());
+    glBufferSubData(GL_ARRAY_BUFFER, vSize, nSize, mesh.normals.data());
+    glBufferSubData(GL_ARRAY_BUFFER, vSize + nSize, tSize, mesh.texCoords.data());
+    glBufferSubData(GL_ARRAY_BUFFER, vSize + nSize + tSize, oSize, mesh.occlusion.data());
+
+    vertices = (GLsizei)mesh.positions.size();
+    indices = (GLsizei)mesh.indices.size();
+    texCoords = tSize > 0;
+    occlusion = oSize > 0;
+    bindAttributes();
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, iSize, mesh.indices.data(), GL_STATIC_DRAW);
+
+    MemoryTracker& memory = MemoryTracker::get();
+    memory.trackGpu(GL_BUFFER, vbo, ("Mesh " + mesh.name + " vertices").c_str(), vSize + nSize + tSize + oSize);
+    memory.trackGpu(GL_BUFFER, ibo, ("Mesh " + mesh.name + " indices").c_str(), iSize);
+
+    glBindVertexArray((GLuint)boundVao);
+    glBindBuffer(GL_ARRAY_BUFFER, (GLuint)arrayBuffer);
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR)
+        cerr << "OpenGL Error: mesh upload " << error << endl;
+}
+
+/**
+ * @brief Points the attributes of the bound vertex array at the bound vertex buffer.
+ *
+ * The arrays follow each other in the buffer, sized by the vertex count.
+ */
+void GpuMesh::bindAttributes() {
+    size_t vSize = (size_t)vertices * sizeof(glm::vec3);
+    size_t tSize = texCoords ? (size_t)vertices * sizeof(glm::vec2) : 0;
+
+    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), BUFFER_OFFSET(0));
+    glEnableVertexAttribArray(ATTRIB_POSITION);
+    glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_TRUE, sizeof(glm::vec3), BUFFER_OFFSET(vSize));
+    glEnableVertexAttribArray(ATTRIB_NORMAL);
+
+    if (texCoords) {
+        glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), BUFFER_OFFSET(2 * vSize));
+        glEnableVertexAttribArray(ATTRIB_TEXCOORD);
+    } else {
+        glDisableVertexAttribArray(ATTRIB_TEXCOORD);
+        glVertexAttrib2f(ATTRIB_TEXCOORD, 0.0f, 0.0f);
+    }
+    if (occlusion) {
+        glVertexAttribPointer(ATTRIB_OCCLUSION, 1, GL_FLOAT, GL_FALSE, sizeof(float), BUFFER_OFFSET(2 * vSize + tSize));
+        glEnableVertexAttribArray(ATTRIB_OCCLUSION);
+    } else {
+        glDisableVertexAttribArray(ATTRIB_OCCLUSION);
+        glVertexAttrib1f(ATTRIB_OCCLUSION, 1.0f);
+    }
+}
+
+/**
+ * @brief Reads the uploaded mesh back from the buffers.
+ *
+ * @param mesh Receives the vertex arrays and the indices, the rest is left as it is.
+ *
+ * Brings back a CPU copy that was dropped after the upload. Stalls until the GPU is done
+ * with the buffers.
+ */
+void GpuMesh::download(MeshData& mesh) const {
+    size_t vSize = (size_t)vertices * sizeof(glm::vec3);
+    size_t tSize = texCoords ? (size_t)vertices * sizeof(glm::vec2) : 0;
+
+    mesh.positions.resize(vertices);
+    mesh.normals.resize(vertices);
+    mesh.texCoords.resize(texCoords ? vertices : 0);
+    mesh.occlusion.resize(occlusion ? vertices : 0);
+    mesh.indices.resize(indices);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, vbo);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, vSize, mesh.positions.data());
+    glGetBufferSubData(GL_COPY_READ_BUFFER, vSize, vSize, mesh.normals.data());
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 2 * vSize, tSize, mesh.texCoords.data());
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 2 * vSize + tSize, mesh.occlusion.size() * sizeof(float),
+                       mesh.occlusion.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, ibo);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (size_t)indices * sizeof(unsigned int), mesh.indices.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+/**
+ * @brief Deletes the vertex array and the buffers.
+ */
+void GpuMesh::release() {
+    MemoryTracker::get().releaseGpu(GL_BUFFER, vbo);
+    MemoryTracker::get().releaseGpu(GL_BUFFER, ibo);
+    if (vao != 0)
+        glDeleteVertexArrays(1, &vao);
+    if (vbo != 0)
+        glDeleteBuffers(1, &vbo);
+    if (ibo != 0)
+        glDeleteBuffers(1, &ibo);
+    vao = vbo = ibo = 0;
+    vertices = indices = 0;
+    texCoords = occlusion = false;
+}
+
+/**
+ * @brief Takes the buffers of the uploaded mesh away from the vertex array, which is left empty.
+ *
+ * @return The buffers, now owned by the caller until attached or released.
+ */
+GpuMesh::Buffers GpuMesh::detach() {
+    Buffers buffers;
+    buffers.vbo = vbo;
+    buffers.ibo = ibo;
+    buffers.vertices = vertices;
+    buffers.indices = indices;
+    buffers.texCoords = texCoords;
+    buffers.occlusion = occlusion;
+    vbo = ibo = 0;
+    vertices = indices = 0;
+    texCoords = occlusion = false;
+    return buffers;
+}
+
+/**
+ * @brief Makes detached buffers those of the mesh again, releasing the current ones.
+ *
+ * The vertex array and array buffer bindings are restored.
+ */
+void GpuMesh::attach(const Buffers& buffers) {
+    Buffers current = detach();
+    release(current);
+
+    vbo = buffers.vbo;
+    ibo = buffers.ibo;
+    vertices = buffers.vertices;
+    indices = buffers.indices;
+    texCoords = buffers.texCoords;
+    occlusion = buffers.occlusion;
+
+    GLint boundVao, arrayBuffer;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &boundVao);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &arrayBuffer);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    bindAttributes();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+
+    glBindVertexArray((GLuint)boundVao);
+    glBindBuffer(GL_ARRAY_BUFFER, (GLuint)arrayBuffer);
+}
+
+/**
+ * @brief Deletes detached buffers.
+ */
+void GpuMesh::release(Buffers& buffers) {
+    if (buffers.vbo != 0) {
+        MemoryTracker::get().releaseGpu(GL_BUFFER, buffers.vbo);
+        glDeleteBuffers(1, &buffers.vbo);
+    }
+    if (buffers.ibo != 0) {
+        MemoryTracker::get().releaseGpu(GL_BUFFER, buffers.ibo);
+        glDeleteBuffers(1, &buffers.ibo);
+    }
+    buffers = Buffers();
+}
+
+/**
+ * @brief Returns the bytes the vertex and index buffers of detached buffers hold.
+ */
+size_t GpuMesh::bytes(const Buffers& buffers) {
+    size_t perVertex = 2 * sizeof(glm::vec3);
+    if (buffers.texCoords)
+        perVertex += sizeof(glm::vec2);
+    if (buffers.occlusion)
+        perVertex += sizeof(float);
+    return (size_t)buffers.vertices * perVertex + (size_t)buffers.indices * sizeof(unsigned int);
+}
+
+/**
+ * @brief Returns the bytes the vertex and index buffers of the uploaded mesh hold.
+ */
+size_t GpuMesh::bytes() const {
+    Buffers buffers;
+    buffers.vertices = vertices;
+    buffers.indices = indices;
+    buffers.texCoords = texCoords;
+    buffers.occlusion = occlusion;
+    return bytes(buffers);
+}
@@ -0,0 +1,83 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: GpuMesh.h
+ *
+ * Description:
+ * Header file for the GpuMesh class, which owns the vertex array, vertex buffer and index
+ * buffer of a mesh and uploads MeshData into them. It is the OpenGL half of loading a
+ * mesh, MeshBuilder is the other half, and must be used on the thread of the context.
+ *
+ * The vertex buffer holds the arrays of the mesh one after the other: positions, normals,
+ * texture coordinates and occlusion, bound to the attribute locations of ShaderVariants.h.
+ * A mesh without texture coordinates or occlusion gets constant attributes instead, (0, 0)
+ * and 1. The vertex array is kept across uploads, so it can be handed to other classes
+ * once. The buffers are reported to the MemoryTracker, and the mesh can be read back from
+ * them when its CPU copy has been dropped.
+ *
+ * The buffers of a mesh can be detached to keep it on the GPU while another is shown, the
+ * next upload then creates new buffers. Attaching them again points the vertex array back
+ * at them without uploading anything.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ * - "MeshData.h"
+ */
+
+#ifndef DATORGRAFIK_GPUMESH_H
+#define DATORGRAFIK_GPUMESH_H
+
+#include <GL/glew.h>
+#include "MeshData.h"
+
+class GpuMesh {
+
+public:
+
+    // The buffers of an uploaded mesh, with what the vertex array needs to draw from them
+    struct Buffers {
+        GLuint vbo = 0;
+        GLuint ibo = 0;
+        GLsizei vertices = 0;
+        GLsizei indices = 0;
+        bool texCoords = false;
+        bool occlusion = false;
+    };
+
+    GpuMesh();
+
+    void init();
+    void upload(const MeshData& mesh);
+    void download(MeshData& mesh) const;
+    void release();
+
+    Buffers detach();
+    void attach(const Buffers& buffers);
+    static void release(Buffers& buffers);
+    static size_t bytes(const Buffers& buffers);
+
+    GLuint vertexArray() const { return vao; }
+    GLuint vertexBuffer() const { return vbo; }
+    GLuint indexBuffer() const { return ibo; }
+    GLsizei indexCount() const { return indices; }
+    GLsizei vertexCount() const { return vertices; }
+    size_t bytes() const;
+
+private:
+
+    GLuint vao;
+    GLuint vbo;
+    GLuint ibo;
+    GLsizei vertices;
+    GLsizei indices;
+    bool texCoords;
+    bool occlusion;
+
+    void bindAttributes();
+
+};
+
+#endif //DATORGRAFIK_GPUMESH_H
@@ -0,0 +1,84 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: GpuQuery.cpp
+ *
+ * Description:
+ * Implementation file for the GpuQuery class.
+ *
+ * Dependencies:
+ * - "GpuQuery.h"
+ */
+
+#include "GpuQuery.h"
+
+/**
+ * @brief Default constructor for the GpuQuery class.
+ */
+GpuQuery::GpuQuery() {
+    target = 0;
+    for (GLuint& query : queries)
+        query = 0;
+    issued = 0;
+    read = 0;
+    running = false;
+    result = 0;
+}
+
+/**
+ * @brief Creates the queries.
+ *
+ * @param target What the queries measure, GL_TIME_ELAPSED or GL_SAMPLES_PASSED for instance.
+ */
+void GpuQuery::init(GLenum target) {
+    this->target = target;
+    glGenQueries(GPU_QUERY_RING, queries);
+}
+
+/**
+ * @brief Starts measuring, unless every query is still waiting for its result.
+ *
+ * Call collect() first to free the queries whose results have arrived. Only one query
+ * per target can be active at a time, so queries of the same target must not overlap.
+ */
+void GpuQuery::begin() {
+    if (queries[0] == 0 || issued - read == GPU_QUERY_RING)
+        return;
+    glBeginQuery(target, queries[issued % GPU_QUERY_RING]);
+    running = true;
+}
+
+/**
+ * @brief Stops measuring.
+ */
+void GpuQuery::end() {
+    if (!running)
+        return;
+    glEndQuery(target);
+    running = false;
+    issued++;
+}
+
+/**
+ * @brief Reads the results that have arrived, oldest first.
+ *
+ * @return True when result was updated.
+ */
+bool GpuQuery::collect() {
+    bool updated = false;
+    while (read != issued) {
+        GLuint query = queries[read % GPU_QUERY_RING];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+        read++;
+        updated = true;
+    }
+    return updated;
+}
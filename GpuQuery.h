@@ -0,0 +1,53 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: GpuQuery.h
+ *
+ * Description:
+ * Header file for the GpuQuery class, which reads back an OpenGL query around a range of
+ * commands, such as GL_TIME_ELAPSED or GL_SAMPLES_PASSED, without stalling.
+ *
+ * Results arrive a few frames after the commands were issued. The queries are used as a
+ * ring and only read once they are available, so the CPU never waits for the GPU. When
+ * all queries are still in flight a frame goes unmeasured.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ */
+
+#ifndef DATORGRAFIK_GPUQUERY_H
+#define DATORGRAFIK_GPUQUERY_H
+
+#include <GL/glew.h>
+
+// Queries in flight, the most frames a result can lag behind
+#define GPU_QUERY_RING 4
+
+class GpuQuery {
+
+public:
+
+    GpuQuery();
+
+    void init(GLenum target);
+    void begin();
+    void end();
+    bool collect();
+
+    // Latest result
+    GLuint64 result;
+
+private:
+
+    GLenum target;
+    GLuint queries[GPU_QUERY_RING];
+    unsigned int issued;
+    unsigned int read;
+    bool running;
+
+};
+
+#endif //DATORGRAFIK_GPUQUERY_H
@@ -0,0 +1,378 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: GpuScene.cpp
+ *
+ * Description:
+ * Implementation file for the GpuScene class.
+ *
+ * Dependencies:
+ * - "GpuScene.h"
+ * - "ShaderVariants.h"
+ * - "Profiler.h"
+ * - "MemoryTracker.h"
+ */
+
+#include "GpuScene.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include "ShaderVariants.h"
+#include <glm/ext.hpp>
+#include <numeric>
+
+using namespace std;
+
+/**
+ * @brief Default constructor for the GpuScene class.
+ */
+GpuScene::GpuScene() {
+    cullProgram = 0;
+    objectBuffer = 0;
+    materialBuffer = 0;
+    commandBuffers[0] = commandBuffers[1] = 0;
+    counterBuffers[0] = counterBuffers[1] = 0;
+    instanceBuffer = 0;
+    visibilityBuffer = 0;
+    occludedBuffer = 0;
+    locFrustum = -1;
+    locObjectCount = -1;
+    locIndexCount = -1;
+    locUseVisibility = -1;
+    locPhase = -1;
+    locUseDepthPyramid = -1;
+    locPyramidViewProjection = -1;
+    objectCount = 0;
+    frame = 0;
+    countedDraws = false;
+    useVisibility = false;
+    depthPyramid = nullptr;
+    visibleObjects = 0;
+    lateObjects = 0;
+    meshIndexCount = 0;
+    occludedObjects = 0;
+}
+
+/**
+ * @brief Creates the buffers and adds the object index attribute to a vertex array.
+ *
+ * @param cullProgram The program built from cull_cshader.glsl.
+ * @param vao The vertex array the mesh is drawn with.
+ *
+ * The array buffer binding is restored, since Model uploads its vertices to whichever
+ * buffer is bound.
+ */
+void GpuScene::init(GLuint cullProgram, GLuint vao) {
+    this->cullProgram = cullProgram;
+    locFrustum = glGetUniformLocation(cullProgram, "frustum");
+    locObjectCount = glGetUniformLocation(cullProgram, "objectCount");
+    locIndexCount = glGetUniformLocation(cullProgram, "indexCount");
+    locUseVisibility = glGetUniformLocation(cullProgram, "useVisibility");
+    locPhase = glGetUniformLocation(cullProgram, "phase");
+    locUseDepthPyramid = glGetUniformLocation(cullProgram, "useDepthPyramid");
+    locPyramidViewProjection = glGetUniformLocation(cullProgram, "pyramidViewProjection");
+    countedDraws = GLEW_ARB_indirect_parameters;
+
+    glUseProgram(cullProgram);
+    glUniform1i(glGetUniformLocation(cullProgram, "depthPyramid"), TEXTURE_UNIT_DEPTH_PYRAMID);
+    glUseProgram(0);
+
+    glGenBuffers(1, &objectBuffer);
+    glGenBuffers(1, &materialBuffer);
+    glGenBuffers(2, commandBuffers);
+    glGenBuffers(2, counterBuffers);
+    glGenBuffers(1, &instanceBuffer);
+    glGenBuffers(1, &visibilityBuffer);
+    glGenBuffers(1, &occludedBuffer);
+
+    MemoryTracker& memory = MemoryTracker::get();
+    GpuCullCounters counters = {};
+    for (GLuint buffer : counterBuffers) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GpuCullCounters), &counters, GL_DYNAMIC_COPY);
+        memory.trackGpu(GL_BUFFER, buffer, "GPU scene counters", sizeof(GpuCullCounters));
+    }
+    GLuint zero = 0;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, instanceBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), &zero, GL_STATIC_DRAW);
+    memory.trackGpu(GL_BUFFER, instanceBuffer, "GPU scene instance indices", sizeof(GLuint));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, visibilityBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_DRAW);
+    memory.trackGpu(GL_BUFFER, visibilityBuffer, "GPU scene visibility", sizeof(GLuint));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    attachInstances(vao);
+}
+
+/**
+ * @brief Deletes the buffers.
+ */
+void GpuScene::release() {
+    GLuint buffers[] = { objectBuffer, materialBuffer, commandBuffers[0], commandBuffers[1], counterBuffers[0],
+                         counterBuffers[1], instanceBuffer, visibilityBuffer, occludedBuffer };
+    for (GLuint buffer : buffers)
+        MemoryTracker::get().releaseGpu(GL_BUFFER, buffer);
+    glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+    objectBuffer = materialBuffer = instanceBuffer = visibilityBuffer = occludedBuffer = 0;
+    commandBuffers[0] = commandBuffers[1] = counterBuffers[0] = counterBuffers[1] = 0;
+    objectCount = 0;
+}
+
+/**
+ * @brief Sources the object index attribute of a vertex array from the draw commands.
+ *
+ * @param vao A vertex array the commands are drawn with, besides the one given to init().
+ */
+void GpuScene::attachInstances(GLuint vao) {
+    GLint arrayBuffer;
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &arrayBuffer);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glVertexAttribIPointer(ATTRIB_INSTANCE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (const void*)0);
+    glVertexAttribDivisor(ATTRIB_INSTANCE, 1);
+    glEnableVertexAttribArray(ATTRIB_INSTANCE);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
+}
+
+/**
+ * @brief Uploads the objects and sizes the command buffers for them.
+ *
+ * @param objects The objects, their material indices refer to the list given to setMaterials().
+ *
+ * When the number of objects is unchanged, such as when they are only reordered, the
+ * objects are written into the existing buffer and nothing else is touched.
+ */
+void GpuScene::setObjects(const vector<GpuObject>& objects) {
+    if (objects.size() == objectCount && objectCount > 0) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, objectBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, objects.size() * sizeof(GpuObject), objects.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return;
+    }
+    objectCount = objects.size();
+    MemoryTracker& memory = MemoryTracker::get();
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, objectBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, objects.size() * sizeof(GpuObject), objects.data(), GL_STATIC_DRAW);
+    memory.trackGpu(GL_BUFFER, objectBuffer, "GPU scene objects", objects.size() * sizeof(GpuObject));
+
+    for (GLuint buffer : commandBuffers) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, objects.size() * sizeof(DrawElementsIndirectCommand), nullptr,
+                     GL_DYNAMIC_COPY);
+        memory.trackGpu(GL_BUFFER, buffer, "GPU scene draw commands",
+                        objects.size() * sizeof(DrawElementsIndirectCommand));
+    }
+
+    // Objects the early pass hid, for the late pass to test again
+    glBindBuffer(GL_COPY_WRITE_BUFFER, occludedBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, max<size_t>(1, objects.size()) * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    memory.trackGpu(GL_BUFFER, occludedBuffer, "GPU scene occluded objects",
+                    max<size_t>(1, objects.size()) * sizeof(GLuint));
+
+    // Maps the base instance of a command back to the object index
+    vector<GLuint> indices(max<size_t>(1, objects.size()));
+    iota(indices.begin(), indices.end(), 0u);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, instanceBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    memory.trackGpu(GL_BUFFER, instanceBuffer, "GPU scene instance indices", indices.size() * sizeof(GLuint));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+/**
+ * @brief Uploads the materials.
+ */
+void GpuScene::setMaterials(const vector<GpuMaterial>& materials) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, materialBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, materials.size() * sizeof(GpuMaterial), materials.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    MemoryTracker::get().trackGpu(GL_BUFFER, materialBuffer, "GPU scene materials",
+                                  materials.size() * sizeof(GpuMaterial));
+}
+
+/**
+ * @brief Uploads a visibility mask the culling shader applies on top of its frustum test.
+ *
+ * @param mask One bit per object, object i is bit i % 32 of word i / 32, set when visible.
+ */
+void GpuScene::setVisibility(const vector<GLuint>& mask) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, visibilityBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, max<size_t>(1, mask.size()) * sizeof(GLuint), mask.empty() ? nullptr : mask.data(),
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    MemoryTracker::get().trackGpu(GL_BUFFER, visibilityBuffer, "GPU scene visibility",
+                                  max<size_t>(1, mask.size()) * sizeof(GLuint));
+    useVisibility = true;
+}
+
+/**
+ * @brief Stops applying the visibility mask.
+ */
+void GpuScene::clearVisibility() {
+    useVisibility = false;
+}
+
+/**
+ * @brief Sets the depth pyramid the objects are tested against, or nullptr to only use the frustum.
+ *
+ * The caller builds the pyramid between draw() and cullLate().
+ */
+void GpuScene::setDepthPyramid(const DepthPyramid* pyramid) {
+    depthPyramid = pyramid;
+}
+
+/**
+ * @brief Builds this frame's draw commands on the GPU, the early pass when there is a depth pyramid.
+ *
+ * @param viewProjection The camera's projection times view matrix.
+ * @param indexCount Number of indices of the shared mesh.
+ *
+ * Leaves the cull program in use, the caller switches back to its own program.
+ */
+void GpuScene::cull(const glm::mat4& viewProjection, GLsizei indexCount) {
+    if (objectCount == 0)
+        return;
+
+    // Read the counters before they are reused, the GPU is normally done with them by now
+    frame++;
+    GLuint counterBuffer = counterBuffers[frame & 1];
+    if (frame > 2) {
+        GpuCullCounters counters;
+        glBindBuffer(GL_COPY_READ_BUFFER, counterBuffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GpuCullCounters), &counters);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        visibleObjects = (int)(counters.drawCount[0] + counters.drawCount[1]);
+        lateObjects = (int)counters.drawCount[1];
+        occludedObjects = (int)counters.inFrustum - visibleObjects;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    dispatch(0, viewProjection, indexCount);
+}
+
+/**
+ * @brief Draws the commands built by cull() with the program in use.
+ *
+ * The program must be a variant with SHADER_INSTANCED and the vertex array given to
+ * init(), or one given to attachInstances(), must be bound.
+ */
+void GpuScene::draw() {
+    drawCommands(0);
+}
+
+/**
+ * @brief Builds the late pass' draw commands, for the objects the early pass hid that the rebuilt pyramid does not.
+ *
+ * Does nothing without a depth pyramid. Leaves the cull program in use.
+ */
+void GpuScene::cullLate(const glm::mat4& viewProjection, GLsizei indexCount) {
+    if (objectCount == 0 || depthPyramid == nullptr || !depthPyramid->valid())
+        return;
+    dispatch(1, viewProjection, indexCount);
+}
+
+/**
+ * @brief Draws the commands built by cullLate(), like draw().
+ */
+void GpuScene::drawLate() {
+    if (depthPyramid == nullptr || !depthPyramid->valid())
+        return;
+    drawCommands(1);
+}
+
+/**
+ * @brief Runs the culling shader for one pass.
+ *
+ * @param phase 0 for the early pass, 1 for the late pass.
+ *
+ * The early pass tests against the pyramid with the matrix it was built with, the late
+ * pass against the pyramid just built from this frame's depth.
+ */
+void GpuScene::dispatch(GLuint phase, const glm::mat4& viewProjection, GLsizei indexCount) {
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    glm::vec4 planes[6];
+    for (int i = 0; i < 3; i++) {
+        planes[2 * i] = rows[3] + rows[i];
+        planes[2 * i + 1] = rows[3] - rows[i];
+    }
+    for (glm::vec4& plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    GLuint commandBuffer = commandBuffers[phase];
+    if (!countedDraws) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    bool usePyramid = depthPyramid != nullptr && depthPyramid->valid();
+    glUseProgram(cullProgram);
+    PROFILE_STATE_CHANGES(usePyramid ? 3 : 1);
+    glUniform4fv(locFrustum, 6, glm::value_ptr(planes[0]));
+    glUniform1ui(locObjectCount, (GLuint)objectCount);
+    glUniform1ui(locIndexCount, (GLuint)indexCount);
+    meshIndexCount = indexCount;
+    glUniform1ui(locUseVisibility, useVisibility ? 1u : 0u);
+    glUniform1ui(locPhase, phase);
+    glUniform1ui(locUseDepthPyramid, usePyramid ? 1u : 0u);
+    if (usePyramid) {
+        glUniformMatrix4fv(locPyramidViewProjection, 1, GL_FALSE, glm::value_ptr(depthPyramid->viewProjection()));
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_DEPTH_PYRAMID);
+        glBindTexture(GL_TEXTURE_2D, depthPyramid->texture());
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_BINDING_OBJECTS, objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_BINDING_COMMANDS, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_BINDING_COUNTERS, counterBuffers[frame & 1]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_BINDING_VISIBILITY, visibilityBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_BINDING_OCCLUDED, occludedBuffer);
+    glDispatchCompute((GLuint)((objectCount + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE), 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    if (usePyramid) {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_DEPTH_PYRAMID);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+}
+
+/**
+ * @brief Draws the commands of one pass with the program in use.
+ */
+void GpuScene::drawCommands(GLuint phase) {
+    if (objectCount == 0)
+        return;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_BINDING_OBJECTS, objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_BINDING_MATERIALS, materialBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffers[phase]);
+
+    if (countedDraws) {
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, counterBuffers[frame & 1]);
+        glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, 0, (GLintptr)(phase * sizeof(GLuint)),
+                                            (GLsizei)objectCount, 0);
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+    } else {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, (GLsizei)objectCount, 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    // The GPU decides what is drawn, the count is the last one read back
+    PROFILE_DRAWS(1, (long long)max(phase == 0 ? visibleObjects - lateObjects : lateObjects, 0) * meshIndexCount / 3);
+}
+
+/**
+ * @brief Returns the number of objects.
+ */
+size_t GpuScene::size() const {
+    return objectCount;
+}
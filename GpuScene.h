@@ -0,0 +1,146 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: GpuScene.h
+ *
+ * Description:
+ * Header file for the GpuScene class, which draws many objects sharing one mesh without
+ * any per object work on the CPU.
+ *
+ * The transforms, bounds and material indices of the objects and the materials live in
+ * shader storage buffers. Every frame a compute shader (cull_cshader.glsl) tests each
+ * object against the view frustum and appends a draw command for the visible ones, and
+ * everything is drawn with one glMultiDrawElementsIndirect call. The command's base
+ * instance selects the object, through an instanced vertex attribute holding the object
+ * index, since GLSL 4.30 has no gl_BaseInstance.
+ *
+ * A visibility mask computed on the CPU, such as the result of the OcclusionCuller, can
+ * be given as well, and the compute shader then also drops the objects it marks hidden.
+ *
+ * With a DepthPyramid the culling runs in two passes. The early pass tests the objects
+ * against the pyramid built from the previous frame, with the matrix it was built with,
+ * and draws the ones it does not hide. The caller then builds the pyramid again from the
+ * depth drawn so far, and the late pass tests the objects the early pass hid against it
+ * and draws the ones that have become visible, so nothing is missing for a frame when
+ * the camera moves.
+ *
+ * With ARB_indirect_parameters the draw count is read from the buffer the compute shader
+ * counts into. Without it the command buffer is cleared first, and the commands past the
+ * visible ones draw zero instances.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ * - GLM (OpenGL Mathematics)
+ * - DepthPyramid.h
+ */
+
+#ifndef DATORGRAFIK_GPUSCENE_H
+#define DATORGRAFIK_GPUSCENE_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "DepthPyramid.h"
+
+// Shader storage buffer binding points, after those of LightClusters
+#define GPU_BINDING_OBJECTS 3
+#define GPU_BINDING_MATERIALS 4
+#define GPU_BINDING_COMMANDS 5
+#define GPU_BINDING_COUNTERS 6
+#define GPU_BINDING_VISIBILITY 7
+#define GPU_BINDING_OCCLUDED 8
+
+// Local size of cull_cshader.glsl
+#define GPU_CULL_GROUP_SIZE 64
+
+// std430 layout shared with the shaders
+struct GpuObject {
+    glm::mat4 model;
+    glm::vec4 bounds;       // Bounding sphere in object space, w is the radius
+    GLuint material;
+    GLuint padding[3];
+};
+
+struct GpuMaterial {
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;     // w is the shininess exponent
+};
+
+// Counters of one frame
+struct GpuCullCounters {
+    GLuint drawCount[2];    // Commands appended by the early and the late pass
+    GLuint inFrustum;       // Objects passing the visibility mask and the frustum test
+    GLuint padding;
+};
+
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+class GpuScene {
+
+public:
+
+    GpuScene();
+
+    void init(GLuint cullProgram, GLuint vao);
+    void release();
+    void attachInstances(GLuint vao);
+    void setObjects(const std::vector<GpuObject>& objects);
+    void setMaterials(const std::vector<GpuMaterial>& materials);
+    void setVisibility(const std::vector<GLuint>& mask);
+    void clearVisibility();
+    void setDepthPyramid(const DepthPyramid* pyramid);
+
+    void cull(const glm::mat4& viewProjection, GLsizei indexCount);
+    void draw();
+    void cullLate(const glm::mat4& viewProjection, GLsizei indexCount);
+    void drawLate();
+
+    size_t size() const;
+
+    // Results of the frame before the previous one, read back late so the CPU does not wait
+    int visibleObjects;
+    int lateObjects;        // Drawn by the late pass
+    int occludedObjects;    // Hidden by the depth pyramid
+
+private:
+
+    GLuint cullProgram;
+    GLuint objectBuffer;
+    GLuint materialBuffer;
+    GLuint commandBuffers[2];      // Early and late pass
+    GLuint counterBuffers[2];      // Frames in flight
+    GLuint instanceBuffer;
+    GLuint visibilityBuffer;
+    GLuint occludedBuffer;
+
+    GLint locFrustum;
+    GLint locObjectCount;
+    GLint locIndexCount;
+    GLint locUseVisibility;
+    GLint locPhase;
+    GLint locUseDepthPyramid;
+    GLint locPyramidViewProjection;
+
+    size_t objectCount;
+    GLsizei meshIndexCount;     // Of the last cull, for the profiler
+    unsigned int frame;
+    bool countedDraws;
+    bool useVisibility;
+    const DepthPyramid* depthPyramid;
+
+    void dispatch(GLuint phase, const glm::mat4& viewProjection, GLsizei indexCount);
+    void drawCommands(GLuint phase);
+
+};
+
+#endif //DATORGRAFIK_GPUSCENE_H
@@ -0,0 +1,54 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: GpuTimer.cpp
+ *
+ * Description:
+ * Implementation file for the GpuTimer class.
+ *
+ * Dependencies:
+ * - "GpuTimer.h"
+ */
+
+#include "GpuTimer.h"
+
+/**
+ * @brief Default constructor for the GpuTimer class.
+ */
+GpuTimer::GpuTimer() {
+    milliseconds = 0.0f;
+}
+
+/**
+ * @brief Creates the queries.
+ */
+void GpuTimer::init() {
+    query.init(GL_TIME_ELAPSED);
+}
+
+/**
+ * @brief Starts measuring, see GpuQuery::begin(). Timers must not overlap.
+ */
+void GpuTimer::begin() {
+    query.begin();
+}
+
+/**
+ * @brief Stops measuring, see GpuQuery::end().
+ */
+void GpuTimer::end() {
+    query.end();
+}
+
+/**
+ * @brief Reads the results that have arrived, see GpuQuery::collect(). True when milliseconds was updated.
+ */
+bool GpuTimer::collect() {
+    if (!query.collect())
+        return false;
+    milliseconds = (float)(query.result / 1.0e6);
+    return true;
+}
@@ -0,0 +1,47 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: GpuTimer.h
+ *
+ * Description:
+ * Header file for the GpuTimer class, which measures how long the GPU spends on a range
+ * of commands with GL_TIME_ELAPSED queries.
+ *
+ * The results are read through a GpuQuery, so they arrive a few frames late and the CPU
+ * never waits for the GPU. When all queries are still in flight a frame goes unmeasured.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ * - GpuQuery.h
+ */
+
+#ifndef DATORGRAFIK_GPUTIMER_H
+#define DATORGRAFIK_GPUTIMER_H
+
+#include <GL/glew.h>
+#include "GpuQuery.h"
+
+class GpuTimer {
+
+public:
+
+    GpuTimer();
+
+    void init();
+    void begin();
+    void end();
+    bool collect();
+
+    // Latest result
+    float milliseconds;
+
+private:
+
+    GpuQuery query;
+
+};
+
+#endif //DATORGRAFIK_GPUTIMER_H
@@ -0,0 +1,297 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: InputRecorder.cpp
+ *
+ * Description:
+ * Implementation file for the InputRecorder class.
+ *
+ * Dependencies:
+ * - "InputRecorder.h"
+ */
+
+#include "InputRecorder.h"
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+    // Integer values of an event type, the others carry two doubles
+    int intValues(char type) {
+        switch (type) {
+            case 'k': return 4;
+            case 'b': return 3;
+            case 'c':
+            case 'e':
+            case 'f': return 1;
+            default: return 0;
+        }
+    }
+
+    bool isType(char type) {
+        return intValues(type) > 0 || type == 'm' || type == 's' || type == 'l';
+    }
+
+}
+
+/**
+ * @brief Constructor for the InputRecorder class.
+ */
+InputRecorder::InputRecorder() {
+    currentMode = Idle;
+    start = State();
+    currentFrame = 0;
+    frameCount = 0;
+    inFrame = false;
+    replayIndex = 0;
+}
+
+/**
+ * @brief Returns an event with integer values, for the frame and time to be filled in.
+ */
+InputRecorder::Event InputRecorder::event(char type, int a, int b, int c, int d) {
+    Event event = Event();
+    event.type = type;
+    event.values[0] = a;
+    event.values[1] = b;
+    event.values[2] = c;
+    event.values[3] = d;
+    return event;
+}
+
+/**
+ * @brief Returns an event with a position or a delta, for the frame and time to be filled in.
+ */
+InputRecorder::Event InputRecorder::event(char type, double x, double y) {
+    Event event = Event();
+    event.type = type;
+    event.x = x;
+    event.y = y;
+    return event;
+}
+
+/**
+ * @brief Sets the function that replayed events are handed to.
+ */
+void InputRecorder::setDispatcher(const Dispatcher& dispatcher) {
+    this->dispatcher = dispatcher;
+}
+
+/**
+ * @brief Drops the events held and starts recording from the next one.
+ *
+ * @param state The camera, the movement flags and the cursor the replay is to start from.
+ */
+void InputRecorder::startRecording(const State& state) {
+    if (currentMode == Replaying)
+        stopReplay();
+    currentMode = Recording;
+    start = state;
+    eventList.clear();
+    currentFrame = 0;
+    frameCount = 0;
+    origin = chrono::steady_clock::now();
+}
+
+/**
+ * @brief Adds an event to the recording in the current frame, if recording.
+ */
+void InputRecorder::record(const Event& event) {
+    if (currentMode != Recording)
+        return;
+    Event recorded = event;
+    recorded.frame = currentFrame;
+    recorded.time = chrono::duration<double>(chrono::steady_clock::now() - origin).count();
+    eventList.push_back(recorded);
+}
+
+/**
+ * @brief Stops recording. The frames recorded so far, the one running included, are kept.
+ */
+void InputRecorder::stopRecording() {
+    if (currentMode != Recording)
+        return;
+    frameCount = currentFrame + (inFrame ? 1 : 0);
+    currentMode = Idle;
+}
+
+/**
+ * @brief Writes the recording held to a file.
+ *
+ * @return False if the file could not be written.
+ */
+bool InputRecorder::save(const string& path) const {
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        cerr << "Could not write the input recording " << path << endl;
+        return false;
+    }
+
+    // Doubles are written with all their digits, so a replay reads back the same values
+    fprintf(file, "3dstudio-input 1\n");
+    fprintf(file, "camera %.9g %.9g %.9g %.9g %.9g %.9g\n", start.eye.x, start.eye.y, start.eye.z,
+            start.center.x, start.center.y, start.center.z);
+    fprintf(file, "state %u %.17g %.17g\n", start.flags, start.cursorX, start.cursorY);
+    fprintf(file, "frames %u\n", frameCount);
+    for (const Event& event : eventList) {
+        fprintf(file, "%u %.6f %c", event.frame, event.time, event.type);
+        int count = intValues(event.type);
+        if (count > 0) {
+            for (int i = 0; i < count; i++)
+                fprintf(file, " %d", event.values[i]);
+        } else {
+            fprintf(file, " %.17g %.17g", event.x, event.y);
+        }
+        fputc('\n', file);
+    }
+    bool written = !ferror(file);
+    fclose(file);
+    if (!written)
+        cerr << "Could not write the input recording " << path << endl;
+    return written;
+}
+
+/**
+ * @brief Reads a recording from a file, replacing the one held.
+ *
+ * @return False if the file could not be read or is not a recording, nothing is replaced then.
+ */
+bool InputRecorder::load(const string& path) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        cerr << "Could not open the input recording " << path << endl;
+        return false;
+    }
+
+    State state = State();
+    unsigned int frames = 0;
+    int version = 0;
+    bool valid = fscanf(file, " 3dstudio-input %d", &version) == 1 && version == 1 &&
+                 fscanf(file, " camera %f %f %f %f %f %f", &state.eye.x, &state.eye.y, &state.eye.z,
+                        &state.center.x, &state.center.y, &state.center.z) == 6 &&
+                 fscanf(file, " state %u %lf %lf", &state.flags, &state.cursorX, &state.cursorY) == 3 &&
+                 fscanf(file, " frames %u", &frames) == 1;
+
+    vector<Event> events;
+    while (valid) {
+        Event event = Event();
+        int read = fscanf(file, " %u %lf %c", &event.frame, &event.time, &event.type);
+        if (read == EOF)
+            break;
+        if (read != 3 || !isType(event.type) || event.frame >= frames ||
+            (!events.empty() && event.frame < events.back().frame)) {
+            valid = false;
+            break;
+        }
+        int count = intValues(event.type);
+        for (int i = 0; i < count && valid; i++)
+            valid = fscanf(file, " %d", &event.values[i]) == 1;
+        if (count == 0)
+            valid = fscanf(file, " %lf %lf", &event.x, &event.y) == 2;
+        events.push_back(event);
+    }
+    fclose(file);
+
+    if (!valid) {
+        cerr << "Not a valid input recording: " << path << endl;
+        return false;
+    }
+    if (currentMode != Idle) {
+        stopRecording();
+        stopReplay();
+    }
+    start = state;
+    eventList.swap(events);
+    frameCount = frames;
+    return true;
+}
+
+/**
+ * @brief Starts replaying the recording held from its first frame.
+ *
+ * The cursor is moved to where it was when the recording started. The GUI is told
+ * the cursor is inside the window, so it stops reading the real one.
+ *
+ * @return False if nothing is recorded.
+ */
+bool InputRecorder::startReplay() {
+    if (currentMode == Recording || frameCount == 0)
+        return false;
+    currentMode = Replaying;
+    currentFrame = 0;
+    replayIndex = 0;
+    if (dispatcher) {
+        dispatcher(event('e', 1));
+        dispatcher(event('m', start.cursorX, start.cursorY));
+    }
+    return true;
+}
+
+/**
+ * @brief Stops replaying and hands the cursor back to the GUI.
+ */
+void InputRecorder::stopReplay() {
+    if (currentMode != Replaying)
+        return;
+    currentMode = Idle;
+    if (dispatcher)
+        dispatcher(event('e', 0));
+}
+
+/**
+ * @brief Takes the mouse look of the current frame from the replay.
+ *
+ * It is recorded before the events of the frame, as the main loop reads it before
+ * polling them.
+ *
+ * @return False if the frame has no mouse look, the deltas are zero then.
+ */
+bool InputRecorder::takeLook(double& dx, double& dy) {
+    dx = dy = 0.0;
+    if (currentMode != Replaying || replayIndex >= eventList.size())
+        return false;
+    const Event& event = eventList[replayIndex];
+    if (event.frame != currentFrame || event.type != 'l')
+        return false;
+    dx = event.x;
+    dy = event.y;
+    replayIndex++;
+    return true;
+}
+
+/**
+ * @brief Hands the events of the current frame to the dispatcher, in the place of polling.
+ */
+void InputRecorder::replayEvents() {
+    if (currentMode != Replaying)
+        return;
+    while (replayIndex < eventList.size() && eventList[replayIndex].frame == currentFrame) {
+        const Event& event = eventList[replayIndex++];
+        if (event.type != 'l' && dispatcher)
+            dispatcher(event);
+    }
+}
+
+/**
+ * @brief Marks the start of a frame of the main loop.
+ */
+void InputRecorder::beginFrame() {
+    inFrame = true;
+}
+
+/**
+ * @brief Moves to the next frame. A replay stops after its last frame.
+ */
+void InputRecorder::endFrame() {
+    inFrame = false;
+    if (currentMode == Idle)
+        return;
+    currentFrame++;
+    if (currentMode == Replaying && currentFrame >= frameCount)
+        stopReplay();
+}
@@ -0,0 +1,115 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: InputRecorder.h
+ *
+ * Description:
+ * Header file for the InputRecorder class, which records the input of the window
+ * and replays it, so performance runs can be repeated on the same workload.
+ *
+ * Events are recorded as the GLFW callbacks deliver them, keys and the mouse of the
+ * GUI alike, each with the frame and the time it arrived in. The mouse look of a
+ * frame is recorded as the delta the main loop read from the cursor. A replay hands
+ * every event to the dispatcher in the frame it was recorded in, so the camera,
+ * which moves a fixed step per frame, follows the same path however fast the frames
+ * are. The camera, the movement state and the cursor are restored when a replay
+ * starts. The scene and the GUI settings are not recorded, a replay starts from the
+ * ones in use.
+ *
+ * A recording is a text file:
+ *
+ *   3dstudio-input 1
+ *   camera <eye x y z> <center x y z>
+ *   state <movement flags> <cursor x y>
+ *   frames <count>
+ *   <frame> <seconds> <type> <values>
+ *
+ * with one of the types
+ *   k key scancode action mods, c codepoint, b button action mods, m x y (cursor),
+ *   s x y (scroll), e entered, f focused, l dx dy (mouse look)
+ *
+ * Dependencies:
+ * - GLM
+ * - C++11 chrono and functional
+ */
+
+#ifndef DATORGRAFIK_INPUTRECORDER_H
+#define DATORGRAFIK_INPUTRECORDER_H
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+class InputRecorder {
+
+public:
+
+    enum Mode { Idle, Recording, Replaying };
+
+    struct Event {
+        unsigned int frame;
+        double time;            // Seconds since the recording started
+        char type;              // One of the types of the file
+        int values[4];
+        double x;
+        double y;
+    };
+
+    // What a recording starts from
+    struct State {
+        glm::vec3 eye;
+        glm::vec3 center;
+        unsigned int flags;     // Movement flags, packed by the window
+        double cursorX;
+        double cursorY;
+    };
+
+    typedef std::function<void(const Event&)> Dispatcher;
+
+    InputRecorder();
+
+    static Event event(char type, int a = 0, int b = 0, int c = 0, int d = 0);
+    static Event event(char type, double x, double y);
+
+    Mode mode() const { return currentMode; }
+    unsigned int frame() const { return currentFrame; }
+    unsigned int frames() const { return frameCount; }
+    size_t events() const { return eventList.size(); }
+    const State& startState() const { return start; }
+
+    void setDispatcher(const Dispatcher& dispatcher);
+
+    void startRecording(const State& state);
+    void record(const Event& event);
+    void stopRecording();
+    bool save(const std::string& path) const;
+
+    bool load(const std::string& path);
+    bool startReplay();
+    void stopReplay();
+    bool takeLook(double& dx, double& dy);
+    void replayEvents();
+
+    void beginFrame();
+    void endFrame();
+
+private:
+
+    Mode currentMode;
+    Dispatcher dispatcher;
+    State start;
+    std::vector<Event> eventList;
+    unsigned int currentFrame;
+    unsigned int frameCount;
+    bool inFrame;               // Between beginFrame() and endFrame()
+    size_t replayIndex;
+    std::chrono::steady_clock::time_point origin;
+
+};
+
+#endif //DATORGRAFIK_INPUTRECORDER_H
@@ -0,0 +1,319 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: JobSystem.cpp
+ *
+ * Description:
+ * Implementation file for the JobSystem class.
+ *
+ * Dependencies:
+ * - "JobSystem.h"
+ * - "TraceRecorder.h"
+ */
+
+#include "JobSystem.h"
+#include "TraceRecorder.h"
+#include <algorithm>
+
+using namespace std;
+
+JobSystem JobSystem::instance;
+thread_local size_t JobSystem::queueIndex = 0;
+
+/**
+ * @brief Constructor for the JobSystem class, the workers are started by start().
+ */
+JobSystem::JobSystem() {
+    started = false;
+    queued = 0;
+    waiting = 0;
+    stopping = false;
+}
+
+/**
+ * @brief Stops and joins the workers. Jobs that have not started are dropped.
+ */
+JobSystem::~JobSystem() {
+    {
+        lock_guard<mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    workCondition.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+    for (auto& queue : queues) {
+        while (!queue->empty())
+            jobPool.destroy(queue->popFront());
+    }
+}
+
+/**
+ * @brief Starts one worker per hardware thread besides the calling one, at least one.
+ */
+void JobSystem::start() {
+    lock_guard<mutex> lock(startMutex);
+    if (started)
+        return;
+    unsigned int hardware = thread::hardware_concurrency();
+    unsigned int threads = hardware > 2 ? hardware - 1 : 1;
+    for (unsigned int i = 0; i <= threads; i++)
+        queues.emplace_back(new Queue());
+    for (unsigned int i = 1; i <= threads; i++)
+        workers.emplace_back(&JobSystem::workerLoop, this, (size_t)i);
+    started = true;
+}
+
+/**
+ * @brief Returns the number of threads working on a parallelFor(), the caller included.
+ */
+size_t JobSystem::size() {
+    if (!started)
+        start();
+    return workers.size() + 1;
+}
+
+/**
+ * @brief Queues a job.
+ *
+ * @param task Function to run on some thread.
+ * @param counter Counted up now and down when the job has finished, may be null.
+ * @param after The job is held back until this counter reaches zero, may be null.
+ * @param name Name of the job in traces, must outlive the job.
+ */
+void JobSystem::run(const function<void()>& task, JobCounter* counter, JobCounter* after, const char* name) {
+    if (!started)
+        start();
+
+    Job* job = jobPool.create();
+    job->task = task;
+    job->name = name;
+    job->counter = counter;
+    if (counter)
+        counter->pending++;
+
+    if (after) {
+        lock_guard<mutex> lock(after->mutex);
+        if (after->pending > 0) {
+            after->held.push_back(job);
+            return;
+        }
+    }
+    push(job);
+}
+
+/**
+ * @brief Runs queued jobs until a counter has come down to a value.
+ *
+ * @param counter The counter waited for.
+ * @param target Value to wait for, 0 waits for all of its jobs.
+ *
+ * Sleeps only when there is no job left to run. The counter may be destroyed as soon as
+ * this returns.
+ */
+void JobSystem::wait(JobCounter& counter, int target) {
+    while (counter.pending > target) {
+        Job* job = take();
+        if (job) {
+            execute(job);
+            continue;
+        }
+
+        waiting++;
+        {
+            unique_lock<mutex> lock(sleepMutex);
+            doneCondition.wait(lock, [&]() { return counter.pending <= target || queued > 0; });
+        }
+        waiting--;
+    }
+
+    // The last job to finish may still hold the lock
+    lock_guard<mutex> lock(counter.mutex);
+}
+
+/**
+ * @brief Runs body(begin, end) over the range [0, count) split in contiguous pieces.
+ *
+ * Called by the parallelFor() templates, parallelFor(count, task) runs task(i) for every i.
+ *
+ * @param count Number of items.
+ * @param minChunk Smallest number of items worth a job of its own.
+ * @param body Function processing the items in [begin, end). It is called from several
+ *        threads at once.
+ *
+ * The pieces are JOB_CHUNKS_PER_THREAD per thread, or minChunk items if that is more.
+ * The calling thread processes pieces too and returns when all of them are done. Calls
+ * may be nested, in jobs as well.
+ */
+void JobSystem::parallelForRange(size_t count, size_t minChunk, const function<void(size_t, size_t)>& body) {
+    if (count == 0)
+        return;
+    size_t grain = max(max<size_t>(1, minChunk), count / (size() * JOB_CHUNKS_PER_THREAD));
+    if (count <= grain) {
+        body(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    splitRange(0, count, grain, body, counter);
+    wait(counter);
+}
+
+/**
+ * @brief Pushes the upper half of a range as a job until the rest is a grain, and processes the rest.
+ */
+void JobSystem::splitRange(size_t begin, size_t end, size_t grain, const function<void(size_t, size_t)>& body,
+                           JobCounter& counter) {
+    while (end - begin > grain) {
+        size_t middle = begin + (end - begin) / 2;
+        Job* job = jobPool.create();
+        job->name = "Parallel for";
+        job->counter = &counter;
+        job->body = &body;
+        job->begin = middle;
+        job->end = end;
+        job->grain = grain;
+        counter.pending++;
+        push(job);
+        end = middle;
+    }
+    body(begin, end);
+}
+
+void JobSystem::workerLoop(size_t index) {
+    queueIndex = index;
+    TRACE_THREAD_NAME("Worker");
+    while (true) {
+        Job* job = take();
+        if (job) {
+            execute(job);
+            continue;
+        }
+
+        unique_lock<mutex> lock(sleepMutex);
+        workCondition.wait(lock, [this]() { return stopping || queued > 0; });
+        if (stopping)
+            return;
+    }
+}
+
+/**
+ * @brief Puts a job on the back of the deque of the calling thread and wakes a thread for it.
+ */
+void JobSystem::push(Job* job) {
+    Queue& queue = *queues[queueIndex];
+    {
+        lock_guard<mutex> lock(queue.mutex);
+        queue.pushBack(job);
+    }
+    queued++;
+
+    {
+        lock_guard<mutex> lock(sleepMutex);
+    }
+    workCondition.notify_one();
+    if (waiting > 0)
+        doneCondition.notify_all();
+}
+
+/**
+ * @brief Takes the newest job of the calling thread's deque, or steals the oldest of another.
+ *
+ * @return null if every deque is empty.
+ */
+Job* JobSystem::take() {
+    if (queued == 0)
+        return nullptr;
+
+    size_t own = queueIndex;
+    {
+        Queue& queue = *queues[own];
+        lock_guard<mutex> lock(queue.mutex);
+        if (!queue.empty()) {
+            Job* job = queue.popBack();
+            queued--;
+            return job;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); i++) {
+        Queue& queue = *queues[(own + i) % queues.size()];
+        lock_guard<mutex> lock(queue.mutex);
+        if (!queue.empty()) {
+            Job* job = queue.popFront();
+            queued--;
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Adds a job after the newest, doubling the ring when it is full.
+ */
+void JobSystem::Queue::pushBack(Job* job) {
+    if (count == ring.size()) {
+        vector<Job*> grown(max<size_t>(16, ring.size() * 2));
+        for (size_t i = 0; i < count; i++)
+            grown[i] = ring[(head + i) & (ring.size() - 1)];
+        ring.swap(grown);
+        head = 0;
+    }
+    ring[(head + count) & (ring.size() - 1)] = job;
+    count++;
+}
+
+/**
+ * @brief Removes and returns the newest job, the deque must not be empty.
+ */
+Job* JobSystem::Queue::popBack() {
+    count--;
+    return ring[(head + count) & (ring.size() - 1)];
+}
+
+/**
+ * @brief Removes and returns the oldest job, the deque must not be empty.
+ */
+Job* JobSystem::Queue::popFront() {
+    Job* job = ring[head];
+    head = (head + 1) & (ring.size() - 1);
+    count--;
+    return job;
+}
+
+void JobSystem::execute(Job* job) {
+    {
+        TRACE_SCOPE(job->name);
+        if (job->body)
+            splitRange(job->begin, job->end, job->grain, *job->body, *job->counter);
+        else
+            job->task();
+    }
+    finish(job->counter);
+    jobPool.destroy(job);
+}
+
+/**
+ * @brief Counts a job of a counter as finished, releasing the jobs held back by it at zero.
+ */
+void JobSystem::finish(JobCounter* counter) {
+    if (!counter)
+        return;
+
+    vector<Job*> released;
+    {
+        lock_guard<mutex> lock(counter->mutex);
+        if (--counter->pending == 0)
+            released.swap(counter->held);
+    }
+    for (Job* job : released)
+        push(job);
+
+    if (waiting > 0) {
+        {
+            lock_guard<mutex> lock(sleepMutex);
+        }
+        doneCondition.notify_all();
+    }
+}
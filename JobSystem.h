@@ -0,0 +1,163 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: JobSystem.h
+ *
+ * Description:
+ * Header file for the JobSystem class, the worker threads all subsystems hand their work
+ * to: loops over vertices, triangles, tiles and instances, texture decodes and the loads
+ * and encodes of the batch renderer. No subsystem starts threads of its own.
+ *
+ * Every worker has a deque of jobs. A worker pushes the jobs it creates onto the back of
+ * its own deque and takes its next job from there, newest first, while idle workers steal
+ * from the front of the others, oldest first. Threads that are not workers share one more
+ * deque. A parallelFor() splits its range in halves, pushing one half as a job and keeping
+ * the other, until the pieces reach a grain sized from the range and the number of
+ * threads, so a thief takes the largest piece left and uneven work balances out.
+ *
+ * Jobs count down a JobCounter when they finish. A thread waiting for a counter runs
+ * jobs in the meantime instead of blocking, which is what lets jobs start jobs and wait
+ * for them, and lets the main thread take part in its own loops. A job can also be held
+ * back until another counter reaches zero.
+ *
+ * Jobs must not block on anything but JobCounters, a job sleeping on a lock another job
+ * releases can stall a worker. The workers start on first use. Jobs are taken from a Pool,
+ * so running one does not go through the heap once the pool has grown. The pieces of a
+ * parallelFor() are jobs of their own kind that refer to the loop's body instead of
+ * copying it, and the body is only held by reference, so a loop does not allocate either.
+ *
+ * Dependencies:
+ * - C++11 threads and atomics
+ * - "TraceRecorder.h"
+ * - "Pool.h"
+ */
+
+#ifndef DATORGRAFIK_JOBSYSTEM_H
+#define DATORGRAFIK_JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Pool.h"
+
+// Pieces a parallelFor() aims to split into per thread
+#define JOB_CHUNKS_PER_THREAD 8
+
+class JobSystem;
+struct Job;
+
+// Number of jobs still to finish, for waiting on them
+class JobCounter {
+
+public:
+
+    JobCounter() : pending(0) {}
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    int value() const { return pending.load(); }
+    bool done() const { return pending.load() == 0; }
+
+private:
+
+    friend class JobSystem;
+
+    std::atomic<int> pending;
+    std::mutex mutex;
+    std::vector<Job*> held;     // Started when the counter reaches zero
+
+};
+
+struct Job {
+    std::function<void()> task;
+    const char* name;           // Trace name, must outlive the job
+    JobCounter* counter;
+
+    // A piece of a parallelFor() to split further, run instead of the task when set
+    const std::function<void(size_t, size_t)>* body;
+    size_t begin;
+    size_t end;
+    size_t grain;
+};
+
+class JobSystem {
+
+public:
+
+    static JobSystem& get() { return instance; }
+    ~JobSystem();
+
+    void run(const std::function<void()>& task, JobCounter* counter = nullptr,
+             JobCounter* after = nullptr, const char* name = "Job");
+    void wait(JobCounter& counter, int target = 0);
+
+    // Callables larger than a std::function holds inline are passed on by reference
+    template<typename TASK>
+    void parallelFor(size_t count, const TASK& task) {
+        parallelFor(count, 1, [&task](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                task(i);
+        });
+    }
+    template<typename BODY>
+    void parallelFor(size_t count, size_t minChunk, const BODY& body) {
+        parallelForRange(count, minChunk, std::cref(body));
+    }
+
+    size_t size();
+    bool isWorker() const { return queueIndex > 0; }
+
+private:
+
+    // A deque of jobs in a ring that only grows, so once it has held the most jobs queued
+    // at a time, pushing and taking jobs no longer allocate
+    struct Queue {
+        std::mutex mutex;
+        std::vector<Job*> ring;     // Its size is 0 or a power of two
+        size_t head = 0;            // Index of the oldest job
+        size_t count = 0;
+
+        bool empty() const { return count == 0; }
+        void pushBack(Job* job);
+        Job* popBack();
+        Job* popFront();
+    };
+
+    static JobSystem instance;
+    static thread_local size_t queueIndex;      // 0 on threads that are not workers
+
+    std::atomic<bool> started;
+    std::mutex startMutex;
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues; // The shared deque, then one per worker
+    Pool<Job> jobPool;
+
+    std::atomic<int> queued;                    // Jobs in the deques
+    std::atomic<int> waiting;                   // Threads sleeping in wait()
+    std::mutex sleepMutex;
+    std::condition_variable workCondition;
+    std::condition_variable doneCondition;
+    bool stopping;
+
+    JobSystem();
+
+    void start();
+    void workerLoop(size_t index);
+    void push(Job* job);
+    Job* take();
+    void execute(Job* job);
+    void finish(JobCounter* counter);
+    void parallelForRange(size_t count, size_t minChunk, const std::function<void(size_t, size_t)>& body);
+    void splitRange(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& body,
+                    JobCounter& counter);
+
+};
+
+#endif //DATORGRAFIK_JOBSYSTEM_H
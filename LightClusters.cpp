@@ -0,0 +1,240 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: LightClusters.cpp
+ *
+ * Description:
+ * Implementation file for the LightClusters class.
+ *
+ * Dependencies:
+ * - "LightClusters.h"
+ * - "JobSystem.h"
+ * - "MemoryTracker.h"
+ */
+
+#include "LightClusters.h"
+#include "JobSystem.h"
+#include "MemoryTracker.h"
+#include <glm/ext.hpp>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/**
+ * @brief Default constructor for the LightClusters class.
+ */
+LightClusters::LightClusters() {
+    lightBuffer = 0;
+    gridBuffer = 0;
+    indexBuffer = 0;
+    zScale = 1.0f;
+    zBias = 0.0f;
+    maxLightsPerCluster = 0;
+    averageLightsPerCluster = 0.0f;
+}
+
+/**
+ * @brief Creates the shader storage buffers.
+ */
+void LightClusters::init() {
+    glGenBuffers(1, &lightBuffer);
+    glGenBuffers(1, &gridBuffer);
+    glGenBuffers(1, &indexBuffer);
+    grid.resize(CLUSTER_X * CLUSTER_Y * CLUSTER_Z);
+}
+
+/**
+ * @brief Deletes the shader storage buffers.
+ */
+void LightClusters::release() {
+    GLuint buffers[] = { lightBuffer, gridBuffer, indexBuffer };
+    for (GLuint buffer : buffers)
+        MemoryTracker::get().releaseGpu(GL_BUFFER, buffer);
+    glDeleteBuffers(3, buffers);
+    lightBuffer = gridBuffer = indexBuffer = 0;
+}
+
+/**
+ * @brief Looks up the cluster uniforms in a shader program.
+ *
+ * @param program The OpenGL program ID.
+ */
+void LightClusters::setProgram(GLuint program) {
+    locDims = glGetUniformLocation(program, "clusterDims");
+    locZ = glGetUniformLocation(program, "clusterZ");
+    locViewport = glGetUniformLocation(program, "viewportSize");
+}
+
+/**
+ * @brief Bins the lights into the clusters and uploads the result.
+ *
+ * @param lights The lights to bin, in world space.
+ * @param view The camera's view matrix.
+ * @param projection The camera's projection matrix.
+ * @param nearplane Distance to the near plane.
+ * @param farplane Distance to the far plane.
+ *
+ * Light bounds are computed in parallel over the lights. The clusters are then filled
+ * in parallel over the depth slices, each slice writing its own index list, and the
+ * lists are joined into one buffer with an offset and count per cluster.
+ */
+void LightClusters::update(const vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection,
+                           float nearplane, float farplane) {
+    float logRatio = log(farplane / nearplane);
+    zScale = CLUSTER_Z / logRatio;
+    zBias = CLUSTER_Z * log(nearplane) / logRatio;
+
+    bounds.resize(lights.size());
+    JobSystem::get().parallelFor(lights.size(), 256, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            bounds[i] = lightBounds(lights[i], view, projection, nearplane, farplane);
+    });
+
+    sliceIndices.resize(CLUSTER_Z);
+    JobSystem::get().parallelFor(CLUSTER_Z, 1, [&](size_t begin, size_t end) {
+        for (size_t z = begin; z < end; z++) {
+            glm::uvec2* cells = &grid[z * CLUSTER_X * CLUSTER_Y];
+
+            // Count the lights of each cell first, so the slice's list is filled in place
+            for (int c = 0; c < CLUSTER_X * CLUSTER_Y; c++)
+                cells[c] = glm::uvec2(0u);
+            for (size_t i = 0; i < bounds.size(); i++) {
+                const LightBounds& b = bounds[i];
+                if (!b.visible || (int)z < b.minZ || (int)z > b.maxZ)
+                    continue;
+                for (int y = b.minY; y <= b.maxY; y++) {
+                    for (int x = b.minX; x <= b.maxX; x++)
+                        cells[y * CLUSTER_X + x].y++;
+                }
+            }
+
+            // Offsets are relative to the slice until the slices are joined
+            GLuint offset = 0;
+            for (int c = 0; c < CLUSTER_X * CLUSTER_Y; c++) {
+                cells[c].x = offset;
+                offset += cells[c].y;
+                cells[c].y = 0;
+            }
+            vector<GLuint>& out = sliceIndices[z];
+            out.resize(offset);
+            for (size_t i = 0; i < bounds.size(); i++) {
+                const LightBounds& b = bounds[i];
+                if (!b.visible || (int)z < b.minZ || (int)z > b.maxZ)
+                    continue;
+                for (int y = b.minY; y <= b.maxY; y++) {
+                    for (int x = b.minX; x <= b.maxX; x++) {
+                        glm::uvec2& cell = cells[y * CLUSTER_X + x];
+                        out[cell.x + cell.y++] = (GLuint)i;
+                    }
+                }
+            }
+        }
+    });
+
+    indices.clear();
+    for (int z = 0; z < CLUSTER_Z; z++) {
+        GLuint base = (GLuint)indices.size();
+        for (int c = 0; c < CLUSTER_X * CLUSTER_Y; c++)
+            grid[z * CLUSTER_X * CLUSTER_Y + c].x += base;
+        indices.insert(indices.end(), sliceIndices[z].begin(), sliceIndices[z].end());
+    }
+
+    maxLightsPerCluster = 0;
+    for (const glm::uvec2& cluster : grid)
+        maxLightsPerCluster = max(maxLightsPerCluster, (int)cluster.y);
+    averageLightsPerCluster = (float)indices.size() / grid.size();
+
+    // An empty buffer cannot be bound, so there is always at least one entry
+    if (indices.empty())
+        indices.push_back(0);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, max<size_t>(1, lights.size()) * sizeof(Light),
+                 lights.empty() ? nullptr : lights.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gridBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, grid.size() * sizeof(glm::uvec2), grid.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    MemoryTracker& memory = MemoryTracker::get();
+    memory.trackGpu(GL_BUFFER, lightBuffer, "Light clusters lights", max<size_t>(1, lights.size()) * sizeof(Light));
+    memory.trackGpu(GL_BUFFER, gridBuffer, "Light clusters grid", grid.size() * sizeof(glm::uvec2));
+    memory.trackGpu(GL_BUFFER, indexBuffer, "Light clusters indices", indices.size() * sizeof(GLuint));
+}
+
+/**
+ * @brief Binds the cluster buffers and sends the grid parameters to the current program.
+ *
+ * @param viewportWidth Width of the viewport in pixels.
+ * @param viewportHeight Height of the viewport in pixels.
+ */
+void LightClusters::bind(int viewportWidth, int viewportHeight) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING_LIGHTS, lightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING_GRID, gridBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING_INDICES, indexBuffer);
+
+    glUniform3ui(locDims, CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+    glUniform2f(locZ, zScale, zBias);
+    glUniform2f(locViewport, (float)viewportWidth, (float)viewportHeight);
+}
+
+/**
+ * @brief Computes the range of clusters a light's sphere of influence can touch.
+ *
+ * The view space bounding box of the sphere is projected with its near face clamped to
+ * the near plane, which gives a conservative screen rectangle for both perspective and
+ * parallel projections.
+ */
+LightClusters::LightBounds LightClusters::lightBounds(const Light& light, const glm::mat4& view,
+                                                      const glm::mat4& projection,
+                                                      float nearplane, float farplane) const {
+    LightBounds b;
+    glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+    float r = light.range;
+
+    float minDepth = -center.z - r;
+    float maxDepth = -center.z + r;
+    b.visible = maxDepth >= nearplane && minDepth <= farplane;
+    if (!b.visible)
+        return b;
+
+    b.minZ = slice(max(minDepth, nearplane));
+    b.maxZ = slice(min(maxDepth, farplane));
+
+    float zNear = min(center.z + r, -nearplane);
+    float zFar = min(center.z - r, -nearplane);
+    glm::vec2 ndcMin(1.0f), ndcMax(-1.0f);
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec4 p(center.x + ((corner & 1) ? r : -r),
+                    center.y + ((corner & 2) ? r : -r),
+                    (corner & 4) ? zNear : zFar,
+                    1.0f);
+        glm::vec4 clip = projection * p;
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+
+    if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f) {
+        b.visible = false;
+        return b;
+    }
+
+    b.minX = glm::clamp((int)floor((ndcMin.x * 0.5f + 0.5f) * CLUSTER_X), 0, CLUSTER_X - 1);
+    b.maxX = glm::clamp((int)floor((ndcMax.x * 0.5f + 0.5f) * CLUSTER_X), 0, CLUSTER_X - 1);
+    b.minY = glm::clamp((int)floor((ndcMin.y * 0.5f + 0.5f) * CLUSTER_Y), 0, CLUSTER_Y - 1);
+    b.maxY = glm::clamp((int)floor((ndcMax.y * 0.5f + 0.5f) * CLUSTER_Y), 0, CLUSTER_Y - 1);
+    return b;
+}
+
+/**
+ * @brief Returns the depth slice of a view space distance, same formula as fshader.glsl.
+ */
+int LightClusters::slice(float depth) const {
+    return glm::clamp((int)floor(log(depth) * zScale - zBias), 0, CLUSTER_Z - 1);
+}
@@ -0,0 +1,88 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: LightClusters.h
+ *
+ * Description:
+ * Header file for the LightClusters class, which implements clustered forward lighting.
+ * The view frustum is divided into a 3D grid of clusters, screen tiles in x and y and
+ * exponentially spaced depth slices in z. Every frame the Scene's lights are binned into
+ * the clusters on the CPU, spread over all cores, and the per-cluster light index lists
+ * are uploaded to shader storage buffers. The fragment shader then only loops over the
+ * lights of its own cluster.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ * - GLM (OpenGL Mathematics)
+ * - Scene.h
+ */
+
+#ifndef DATORGRAFIK_LIGHTCLUSTERS_H
+#define DATORGRAFIK_LIGHTCLUSTERS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Scene.h"
+
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+
+// Shader storage buffer binding points used by fshader.glsl
+#define CLUSTER_BINDING_LIGHTS 0
+#define CLUSTER_BINDING_GRID 1
+#define CLUSTER_BINDING_INDICES 2
+
+class LightClusters {
+
+public:
+
+    LightClusters();
+
+    void init();
+    void release();
+    void setProgram(GLuint program);
+    void update(const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection,
+                float nearplane, float farplane);
+    void bind(int viewportWidth, int viewportHeight);
+
+    // Statistics for the latest update
+    int maxLightsPerCluster;
+    float averageLightsPerCluster;
+
+private:
+
+    struct LightBounds {
+        int minX, maxX;
+        int minY, maxY;
+        int minZ, maxZ;
+        bool visible;
+    };
+
+    GLuint lightBuffer;
+    GLuint gridBuffer;
+    GLuint indexBuffer;
+
+    GLuint locDims;
+    GLuint locZ;
+    GLuint locViewport;
+
+    float zScale;
+    float zBias;
+
+    std::vector<LightBounds> bounds;
+    std::vector<glm::uvec2> grid;
+    std::vector<GLuint> indices;
+    std::vector<std::vector<GLuint>> sliceIndices;
+
+    LightBounds lightBounds(const Light& light, const glm::mat4& view, const glm::mat4& projection,
+                            float nearplane, float farplane) const;
+    int slice(float depth) const;
+
+};
+
+#endif //DATORGRAFIK_LIGHTCLUSTERS_H
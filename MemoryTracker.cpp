@@ -0,0 +1,106 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: MemoryTracker.cpp
+ *
+ * Description:
+ * Implementation file for the MemoryTracker class.
+ *
+ * Dependencies:
+ * - "MemoryTracker.h"
+ */
+
+#include "MemoryTracker.h"
+#include <iostream>
+
+using namespace std;
+
+MemoryTracker MemoryTracker::instance;
+
+/**
+ * @brief Sets the CPU memory held by an asset.
+ *
+ * @param asset Name of the asset, such as "Mesh cube.obj".
+ * @param bytes Bytes held, 0 forgets the asset.
+ */
+void MemoryTracker::setCpuBytes(const string& asset, size_t bytes) {
+    auto it = assets.find(asset);
+    if (it != assets.end()) {
+        cpuTotal -= it->second;
+        if (bytes == 0) {
+            assets.erase(it);
+            return;
+        }
+        it->second = bytes;
+    } else if (bytes > 0) {
+        assets[asset] = bytes;
+    }
+    cpuTotal += bytes;
+}
+
+/**
+ * @brief Records the storage of an OpenGL object, replacing what was recorded for it before.
+ *
+ * @param type GL_BUFFER, GL_TEXTURE or GL_RENDERBUFFER.
+ * @param name The OpenGL name of the object.
+ * @param owner What the object holds, shown in the memory panel and the leak report.
+ * @param bytes Bytes of storage allocated for the object.
+ */
+void MemoryTracker::trackGpu(GLenum type, GLuint name, const char* owner, size_t bytes) {
+    if (name == 0)
+        return;
+    GpuObject& object = objects[make_pair(type, name)];
+    gpuTotal += bytes - object.bytes;
+    object.type = type;
+    object.name = name;
+    object.owner = owner;
+    object.bytes = bytes;
+}
+
+/**
+ * @brief Forgets an OpenGL object, called when its owner deletes it.
+ */
+void MemoryTracker::releaseGpu(GLenum type, GLuint name) {
+    auto it = objects.find(make_pair(type, name));
+    if (it == objects.end())
+        return;
+    gpuTotal -= it->second.bytes;
+    objects.erase(it);
+}
+
+/**
+ * @brief Lists the OpenGL objects that are still tracked on cerr.
+ *
+ * @return The number of objects listed.
+ *
+ * Called right before the context is destroyed, when every owner should have deleted its
+ * objects. An object the context no longer knows was deleted without being released.
+ */
+size_t MemoryTracker::reportLeaks() const {
+    for (const auto& entry : objects) {
+        const GpuObject& object = entry.second;
+        bool alive = (object.type == GL_BUFFER && glIsBuffer(object.name)) ||
+                     (object.type == GL_TEXTURE && glIsTexture(object.name)) ||
+                     (object.type == GL_RENDERBUFFER && glIsRenderbuffer(object.name));
+        cerr << "Leaked " << typeName(object.type) << " " << object.name << ": " << object.owner << ", "
+             << object.bytes << " bytes" << (alive ? "" : " (deleted but not released)") << endl;
+    }
+    if (!objects.empty())
+        cerr << objects.size() << " OpenGL objects leaked, " << gpuTotal << " bytes" << endl;
+    return objects.size();
+}
+
+/**
+ * @brief Returns a readable name of an object type.
+ */
+const char* MemoryTracker::typeName(GLenum type) {
+    switch (type) {
+        case GL_BUFFER: return "buffer";
+        case GL_TEXTURE: return "texture";
+        case GL_RENDERBUFFER: return "renderbuffer";
+        default: return "object";
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: MemoryTracker.h
+ *
+ * Description:
+ * Header file for the MemoryTracker class, which accounts for the memory held by the
+ * assets and the OpenGL objects of the application. CPU memory is counted per asset, a
+ * loaded mesh or a decoded texture, as set by its owner. GPU memory is counted per buffer,
+ * texture and renderbuffer: their owners report the bytes they allocate and the objects
+ * they delete.
+ *
+ * An object still tracked when the context is about to be destroyed was never deleted by
+ * its owner, and reportLeaks() lists it. The tracker is not thread safe, it is used from
+ * the thread of the context like the objects it tracks.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ */
+
+#ifndef DATORGRAFIK_MEMORYTRACKER_H
+#define DATORGRAFIK_MEMORYTRACKER_H
+
+#include <GL/glew.h>
+#include <map>
+#include <string>
+#include <utility>
+
+class MemoryTracker {
+
+public:
+
+    struct GpuObject {
+        GLenum type;            // GL_BUFFER, GL_TEXTURE or GL_RENDERBUFFER
+        GLuint name;
+        std::string owner;
+        size_t bytes;
+    };
+
+    static MemoryTracker& get() { return instance; }
+
+    void setCpuBytes(const std::string& asset, size_t bytes);
+
+    void trackGpu(GLenum type, GLuint name, const char* owner, size_t bytes);
+    void releaseGpu(GLenum type, GLuint name);
+
+    size_t cpuBytes() const { return cpuTotal; }
+    size_t gpuBytes() const { return gpuTotal; }
+    const std::map<std::string, size_t>& cpuAssets() const { return assets; }
+    const std::map<std::pair<GLenum, GLuint>, GpuObject>& gpuObjects() const { return objects; }
+
+    size_t reportLeaks() const;
+
+    static const char* typeName(GLenum type);
+
+private:
+
+    static MemoryTracker instance;
+
+    std::map<std::string, size_t> assets;
+    std::map<std::pair<GLenum, GLuint>, GpuObject> objects;
+    size_t cpuTotal = 0;
+    size_t gpuTotal = 0;
+
+};
+
+#endif //DATORGRAFIK_MEMORYTRACKER_H
@@ -0,0 +1,240 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: MeshBuilder.cpp
+ *
+ * Description:
+ * Implementation file for the MeshBuilder class.
+ *
+ * Dependencies:
+ * - "MeshBuilder.h"
+ */
+
+#include "MeshBuilder.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+/**
+ * @brief Loads an OBJ file into a mesh.
+ *
+ * @param path Path of the OBJ file. Material files are looked up next to it.
+ * @param texCoords How texture coordinates are generated.
+ * @param mesh Receives the geometry, left untouched when loading fails.
+ * @param error Receives a description of the problem when loading fails.
+ * @return true if the file held at least one triangle and the result is valid.
+ */
+bool MeshBuilder::loadObj(const string& path, MeshTexCoords texCoords, MeshData& mesh, string& error) {
+    tinyobj::ObjReaderConfig config;
+    size_t slash = path.find_last_of("/\\");
+    config.mtl_search_path = slash == string::npos ? "" : path.substr(0, slash + 1);
+
+    tinyobj::ObjReader reader;
+    if (!reader.ParseFromFile(path, config)) {
+        error = reader.Error().empty() ? "Could not read " + path : reader.Error();
+        while (!error.empty() && (error.back() == '\n' || error.back() == '\r'))
+            error.pop_back();
+        return false;
+    }
+
+    MeshData built;
+    if (!build(reader.GetAttrib(), reader.GetShapes(), texCoords, built, error)) {
+        error += " in " + path;
+        return false;
+    }
+    built.name = path.substr(slash == string::npos ? 0 : slash + 1);
+    mesh = std::move(built);
+    return true;
+}
+
+/**
+ * @brief Builds a mesh from parsed OBJ data.
+ *
+ * @return false if there are no vertices or triangles, or the result is not valid.
+ */
+bool MeshBuilder::build(const tinyobj::attrib_t& attrib, const vector<tinyobj::shape_t>& shapes,
+                        MeshTexCoords texCoords, MeshData& mesh, string& error) {
+    readPositions(attrib, mesh.positions);
+    if (mesh.positions.empty()) {
+        error = "No vertices";
+        return false;
+    }
+    readIndices(shapes, mesh.indices);
+    if (mesh.indices.empty()) {
+        error = "No triangles";
+        return false;
+    }
+    // tinyobjloader only warns about faces referring to missing vertices
+    if (!validateIndices(mesh.indices, mesh.positions.size(), error))
+        return false;
+
+    generateNormals(mesh.positions, mesh.indices, mesh.normals);
+    computeBounds(mesh);
+    if (texCoords == MESH_TEXCOORDS_PLANAR)
+        planarTexCoords(mesh.positions, mesh.texCoords);
+    else if (texCoords == MESH_TEXCOORDS_SPHERE)
+        sphereTexCoords(mesh.positions, mesh.texCoords);
+    else
+        mesh.texCoords.clear();
+    mesh.occlusion.clear();
+
+    return validate(mesh, error);
+}
+
+/**
+ * @brief Reads the vertex positions of parsed OBJ data.
+ */
+void MeshBuilder::readPositions(const tinyobj::attrib_t& attrib, vector<glm::vec3>& positions) {
+    size_t vertexCount = attrib.vertices.size() / 3;
+    positions.resize(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        positions[v] = glm::vec3(attrib.vertices[3 * v], attrib.vertices[3 * v + 1], attrib.vertices[3 * v + 2]);
+}
+
+/**
+ * @brief Reads the triangle indices of all shapes, skipping faces of other sizes.
+ */
+void MeshBuilder::readIndices(const vector<tinyobj::shape_t>& shapes, vector<unsigned int>& indices) {
+    size_t triangles = 0;
+    for (const tinyobj::shape_t& shape : shapes)
+        triangles += count(shape.mesh.num_face_vertices.begin(), shape.mesh.num_face_vertices.end(), 3);
+    indices.clear();
+    indices.reserve(3 * triangles);
+    for (const tinyobj::shape_t& shape : shapes) {
+        size_t offset = 0;
+        for (unsigned char faceVertices : shape.mesh.num_face_vertices) {
+            if (faceVertices == 3) {
+                for (int k = 0; k < 3; k++)
+                    indices.push_back((unsigned int)shape.mesh.indices[offset + k].vertex_index);
+            }
+            offset += faceVertices;
+        }
+    }
+}
+
+/**
+ * @brief Accumulates the face normals around each vertex and normalizes them.
+ *
+ * The face normals are weighted by the area of their faces. A vertex no face uses
+ * gets the normal +y.
+ */
+void MeshBuilder::generateNormals(const vector<glm::vec3>& positions, const vector<unsigned int>& indices,
+                                  vector<glm::vec3>& normals) {
+    normals.assign(positions.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::vec3& a = positions[indices[i]];
+        const glm::vec3& b = positions[indices[i + 1]];
+        const glm::vec3& c = positions[indices[i + 2]];
+        glm::vec3 faceNormal = glm::cross(b - a, c - a);
+        normals[indices[i]] += faceNormal;
+        normals[indices[i + 1]] += faceNormal;
+        normals[indices[i + 2]] += faceNormal;
+    }
+    for (glm::vec3& n : normals) {
+        float length = glm::length(n);
+        n = length > 0.0f ? n / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+}
+
+/**
+ * @brief Computes the bounding box of the positions and the sphere around the box.
+ */
+void MeshBuilder::computeBounds(MeshData& mesh) {
+    if (mesh.positions.empty()) {
+        mesh.boundsMin = mesh.boundsMax = mesh.center = glm::vec3(0.0f);
+        mesh.radius = 0.0f;
+        return;
+    }
+    glm::vec3 lo(numeric_limits<float>::max()), hi(numeric_limits<float>::lowest());
+    for (const glm::vec3& position : mesh.positions) {
+        lo = glm::min(lo, position);
+        hi = glm::max(hi, position);
+    }
+    mesh.boundsMin = lo;
+    mesh.boundsMax = hi;
+    mesh.center = (lo + hi) * 0.5f;
+    mesh.radius = 0.5f * glm::length(hi - lo);
+}
+
+/**
+ * @brief Takes the texture coordinates from the x and y of the positions, with u flipped.
+ */
+void MeshBuilder::planarTexCoords(const vector<glm::vec3>& positions, vector<glm::vec2>& texCoords) {
+    texCoords.resize(positions.size());
+    for (size_t v = 0; v < positions.size(); v++)
+        texCoords[v] = glm::vec2(1.0f - positions[v].x, positions[v].y);
+}
+
+/**
+ * @brief Maps the positions onto a unit sphere around the origin, with u flipped.
+ */
+void MeshBuilder::sphereTexCoords(const vector<glm::vec3>& positions, vector<glm::vec2>& texCoords) {
+    texCoords.resize(positions.size());
+    for (size_t v = 0; v < positions.size(); v++) {
+        const glm::vec3& position = positions[v];
+        float theta = atan2(position.z, position.x);
+        float phi = asin(glm::clamp(position.y, -1.0f, 1.0f));
+        float u = 0.5f + (theta / (2.0f * 3.14f));
+        float t = 0.5f - (phi / 3.14f);
+        texCoords[v] = glm::vec2(1.0f - u, t);
+    }
+}
+
+/**
+ * @brief Checks that a mesh can be uploaded and drawn as it is.
+ *
+ * @param error Receives the first problem found.
+ * @return true if every index is a vertex, the indices make whole triangles, the other
+ *         arrays are empty or have one value per vertex and all positions are finite.
+ */
+bool MeshBuilder::validate(const MeshData& mesh, string& error) {
+    size_t vertexCount = mesh.positions.size();
+    if (mesh.indices.size() % 3 != 0) {
+        error = "Index count " + to_string(mesh.indices.size()) + " is not a multiple of 3";
+        return false;
+    }
+    if (mesh.normals.size() != vertexCount) {
+        error = "Expected " + to_string(vertexCount) + " normals, not " + to_string(mesh.normals.size());
+        return false;
+    }
+    if (!mesh.texCoords.empty() && mesh.texCoords.size() != vertexCount) {
+        error = "Expected " + to_string(vertexCount) + " texture coordinates, not " + to_string(mesh.texCoords.size());
+        return false;
+    }
+    if (!mesh.occlusion.empty() && mesh.occlusion.size() != vertexCount) {
+        error = "Expected " + to_string(vertexCount) + " occlusion values, not " + to_string(mesh.occlusion.size());
+        return false;
+    }
+    if (!validateIndices(mesh.indices, vertexCount, error))
+        return false;
+    for (size_t v = 0; v < vertexCount; v++) {
+        const glm::vec3& p = mesh.positions[v];
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) {
+            error = "Vertex " + to_string(v) + " is not finite";
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Checks that every index refers to one of the vertices.
+ *
+ * @param error Receives the first index out of range.
+ * @return true if all indices are below vertexCount.
+ */
+bool MeshBuilder::validateIndices(const vector<unsigned int>& indices, size_t vertexCount, string& error) {
+    for (size_t i = 0; i < indices.size(); i++) {
+        if (indices[i] >= vertexCount) {
+            error = "Index " + to_string(i) + " refers to vertex " + to_string((int)indices[i]) +
+                    " of " + to_string(vertexCount);
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: MeshBuilder.h
+ *
+ * Description:
+ * Header file for the MeshBuilder class, which turns OBJ files into validated MeshData
+ * without OpenGL. It is the CPU half of loading a mesh, GpuMesh is the other half.
+ *
+ * All shapes of a file are merged and only its triangles are kept. Normals are the face
+ * normals around each vertex, accumulated and normalized. Texture coordinates are either
+ * mapped onto a sphere around the origin or taken from the x and y of the positions, and
+ * u is flipped in both. The steps are exposed on their own for the benchmarks.
+ *
+ * Nothing is shared between calls, so meshes can be built on any number of threads at
+ * once.
+ *
+ * Dependencies:
+ * - "MeshData.h"
+ * - GLM (OpenGL Mathematics)
+ * - tinyobjloader
+ */
+
+#ifndef DATORGRAFIK_MESHBUILDER_H
+#define DATORGRAFIK_MESHBUILDER_H
+
+#include "MeshData.h"
+#include "include/tiny_obj_loader.h"
+#include <string>
+#include <vector>
+
+enum MeshTexCoords {
+    MESH_TEXCOORDS_NONE,
+    MESH_TEXCOORDS_PLANAR,      // (x, y) of the position
+    MESH_TEXCOORDS_SPHERE       // Longitude and latitude of a unit sphere
+};
+
+class MeshBuilder {
+
+public:
+
+    static bool loadObj(const std::string& path, MeshTexCoords texCoords, MeshData& mesh, std::string& error);
+    static bool build(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes,
+                      MeshTexCoords texCoords, MeshData& mesh, std::string& error);
+
+    static void readPositions(const tinyobj::attrib_t& attrib, std::vector<glm::vec3>& positions);
+    static void readIndices(const std::vector<tinyobj::shape_t>& shapes, std::vector<unsigned int>& indices);
+    static void generateNormals(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                                std::vector<glm::vec3>& normals);
+    static void computeBounds(MeshData& mesh);
+    static void planarTexCoords(const std::vector<glm::vec3>& positions, std::vector<glm::vec2>& texCoords);
+    static void sphereTexCoords(const std::vector<glm::vec3>& positions, std::vector<glm::vec2>& texCoords);
+
+    static bool validate(const MeshData& mesh, std::string& error);
+    static bool validateIndices(const std::vector<unsigned int>& indices, size_t vertexCount, std::string& error);
+
+};
+
+#endif //DATORGRAFIK_MESHBUILDER_H
@@ -0,0 +1,51 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: MeshData.h
+ *
+ * Description:
+ * The CPU side geometry of a mesh, in the planar arrays its vertex buffer is made of:
+ * positions, normals, texture coordinates and baked occlusion, one of each per vertex,
+ * and the triangle indices. MeshBuilder fills it without OpenGL, GpuMesh uploads it.
+ *
+ * Dependencies:
+ * - GLM (OpenGL Mathematics)
+ */
+
+#ifndef DATORGRAFIK_MESHDATA_H
+#define DATORGRAFIK_MESHDATA_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+struct MeshData {
+    std::string name;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texCoords;     // Empty when the mesh has none
+    std::vector<float> occlusion;         // Empty until it is baked
+    std::vector<unsigned int> indices;    // Three per triangle
+
+    // Bounding box and its bounding sphere
+    glm::vec3 boundsMin{0.0f};
+    glm::vec3 boundsMax{0.0f};
+    glm::vec3 center{0.0f};
+    float radius = 0.0f;
+
+    size_t vertexCount() const { return positions.size(); }
+    size_t triangleCount() const { return indices.size() / 3; }
+    bool empty() const { return indices.empty(); }
+
+    // Bytes held by the arrays
+    size_t byteSize() const {
+        return positions.capacity() * sizeof(glm::vec3) + normals.capacity() * sizeof(glm::vec3) +
+               texCoords.capacity() * sizeof(glm::vec2) + occlusion.capacity() * sizeof(float) +
+               indices.capacity() * sizeof(unsigned int);
+    }
+};
+
+#endif //DATORGRAFIK_MESHDATA_H
@@ -0,0 +1,328 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: Meshlets.cpp
+ *
+ * Description:
+ * Implementation file for the Meshlets class.
+ *
+ * Dependencies:
+ * - "Meshlets.h"
+ */
+
+#include "Meshlets.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+
+using namespace std;
+
+namespace {
+
+// Appends an index range, merged with the previous one when they are adjacent
+void appendRange(MeshletDraws& draws, unsigned int indexOffset, unsigned int indexCount) {
+    const void* offset = (const void*)(uintptr_t)(indexOffset * sizeof(unsigned int));
+    if (!draws.counts.empty()) {
+        uintptr_t end = (uintptr_t)draws.offsets.back() + draws.counts.back() * sizeof(unsigned int);
+        if (end == (uintptr_t)offset) {
+            draws.counts.back() += (GLsizei)indexCount;
+            return;
+        }
+    }
+    draws.counts.push_back((GLsizei)indexCount);
+    draws.offsets.push_back(offset);
+}
+
+}
+
+/**
+ * @brief Splits a mesh into meshlets and reorders its indices to match.
+ *
+ * @param positions Vertex positions.
+ * @param indices Three vertex indices per triangle, reordered so every meshlet is a contiguous range.
+ * @param arena Holds the adjacency and the other temporaries of the build.
+ *
+ * A meshlet starts from the first triangle not yet used and grows by the neighbouring
+ * triangle that adds the fewest new vertices, until it is full or has no neighbours left.
+ * This keeps meshlets compact, which gives tight bounds and narrow normal cones.
+ */
+void Meshlets::build(const vector<glm::vec3>& positions, vector<unsigned int>& indices, Arena& arena) {
+    meshlets.clear();
+
+    size_t triangleCount = indices.size() / 3;
+    size_t vertexCount = positions.size();
+    if (triangleCount == 0)
+        return;
+
+    // Triangles around each vertex, in compressed rows
+    ArenaAllocator<unsigned int> temporary(arena);
+    ArenaVector<unsigned int> adjacencyOffsets(vertexCount + 1, 0, temporary);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacencyOffsets[indices[i] + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    ArenaVector<unsigned int> adjacency(triangleCount * 3, 0, temporary);
+    ArenaVector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1, temporary);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+    ArenaVector<bool> emitted(triangleCount, false, ArenaAllocator<bool>(arena));
+    ArenaVector<unsigned int> vertexMeshlet(vertexCount, UINT_MAX, temporary);
+    ArenaVector<unsigned int> candidateMeshlet(triangleCount, UINT_MAX, temporary);
+    ArenaVector<unsigned int> candidates(temporary);
+    vector<unsigned int> reordered;
+    reordered.reserve(triangleCount * 3);
+    size_t seed = 0;
+
+    while (true) {
+        unsigned int id = (unsigned int)meshlets.size();
+        Meshlet meshlet;
+        meshlet.indexOffset = (unsigned int)reordered.size();
+        int vertices = 0, triangles = 0;
+        candidates.clear();
+
+        auto newVertices = [&](unsigned int t) {
+            int count = 0;
+            for (int k = 0; k < 3; k++)
+                count += vertexMeshlet[indices[3 * t + k]] != id;
+            return count;
+        };
+
+        while (triangles < MESHLET_MAX_TRIANGLES) {
+            long best = -1;
+            int bestNew = 4;
+            for (size_t i = 0; i < candidates.size();) {
+                unsigned int t = candidates[i];
+                if (emitted[t]) {
+                    candidates[i] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+                int added = newVertices(t);
+                if (added < bestNew) {
+                    best = t;
+                    bestNew = added;
+                    if (added == 0)
+                        break;
+                }
+                i++;
+            }
+
+            if (best < 0) {
+                if (triangles > 0)
+                    break;
+                while (seed < triangleCount && emitted[seed])
+                    seed++;
+                if (seed == triangleCount)
+                    break;
+                best = (long)seed;
+                bestNew = newVertices((unsigned int)seed);
+            }
+            if (vertices + bestNew > MESHLET_MAX_VERTICES)
+                break;
+
+            emitted[best] = true;
+            triangles++;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[3 * best + k];
+                reordered.push_back(v);
+                if (vertexMeshlet[v] != id) {
+                    vertexMeshlet[v] = id;
+                    vertices++;
+                }
+                for (unsigned int a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; a++) {
+                    unsigned int t = adjacency[a];
+                    if (!emitted[t] && candidateMeshlet[t] != id) {
+                        candidateMeshlet[t] = id;
+                        candidates.push_back(t);
+                    }
+                }
+            }
+        }
+
+        if (triangles == 0)
+            break;
+        meshlet.indexCount = (unsigned int)reordered.size() - meshlet.indexOffset;
+        computeBounds(meshlet, positions, reordered);
+        meshlets.push_back(meshlet);
+    }
+
+    indices.swap(reordered);
+}
+
+/**
+ * @brief Computes the bounding sphere and the normal cone of a meshlet.
+ *
+ * The cone cutoff is the sine of the widest angle between the axis and a face normal,
+ * as in the culling test of meshoptimizer. Cones of 90 degrees or more can never be
+ * back facing and get a cutoff of 1.
+ */
+void Meshlets::computeBounds(Meshlet& meshlet, const vector<glm::vec3>& positions,
+                             const vector<unsigned int>& indices) const {
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    glm::vec3 normalSum(0.0f);
+    unsigned int end = meshlet.indexOffset + meshlet.indexCount;
+
+    for (unsigned int i = meshlet.indexOffset; i < end; i += 3) {
+        const glm::vec3& a = positions[indices[i]];
+        const glm::vec3& b = positions[indices[i + 1]];
+        const glm::vec3& c = positions[indices[i + 2]];
+        lo = glm::min(lo, glm::min(a, glm::min(b, c)));
+        hi = glm::max(hi, glm::max(a, glm::max(b, c)));
+
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length > 0.0f)
+            normalSum += normal / length;
+    }
+
+    meshlet.center = (lo + hi) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (unsigned int i = meshlet.indexOffset; i < end; i++)
+        meshlet.radius = max(meshlet.radius, glm::length(positions[indices[i]] - meshlet.center));
+
+    float sumLength = glm::length(normalSum);
+    meshlet.coneAxis = sumLength > 0.0f ? normalSum / sumLength : glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.coneCutoff = 1.0f;
+    if (sumLength <= 0.0f)
+        return;
+
+    float minDot = 1.0f;
+    for (unsigned int i = meshlet.indexOffset; i < end; i += 3) {
+        const glm::vec3& a = positions[indices[i]];
+        glm::vec3 normal = glm::cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a);
+        float length = glm::length(normal);
+        if (length > 0.0f)
+            minDot = min(minDot, glm::dot(meshlet.coneAxis, normal / length));
+    }
+    if (minDot > 0.0f)
+        meshlet.coneCutoff = sqrt(1.0f - minDot * minDot);
+}
+
+/**
+ * @brief Removes all meshlets.
+ */
+void Meshlets::clear() {
+    meshlets.clear();
+}
+
+/**
+ * @brief Finds the meshlets that can be seen and the index ranges to draw them with.
+ *
+ * @param model The model matrix, which must not scale the axes differently.
+ * @param view The camera's view matrix.
+ * @param projection The camera's projection matrix, perspective or parallel.
+ * @param coneCulling Whether back facing meshlets are dropped, only correct for closed meshes
+ *        since OpenGL draws both sides of the triangles.
+ * @param frontToBack Whether the ranges are ordered by the distance of their meshlets from
+ *        the eye, nearest first, instead of by their place in the index buffer.
+ * @param jobs Job system the meshlets are tested on.
+ * @param draws Receives the ranges for glMultiDrawElements and the visible counts.
+ *
+ * The test runs in object space. The frustum planes are taken from the combined matrix,
+ * and the eye, or the view direction of a parallel projection, is the point the
+ * projection maps to infinite depth.
+ */
+void Meshlets::cull(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, bool coneCulling,
+                    bool frontToBack, JobSystem& jobs, MeshletDraws& draws) {
+    glm::mat4 clip = projection * view * model;
+
+    glm::vec4 planes[6];
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+    for (int i = 0; i < 3; i++) {
+        planes[2 * i] = rows[3] + rows[i];
+        planes[2 * i + 1] = rows[3] - rows[i];
+    }
+    for (glm::vec4& plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    glm::vec4 eye = glm::inverse(clip) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+    bool perspective = fabs(eye.w) > 1e-6f * glm::length(glm::vec3(eye));
+    glm::vec3 eyePosition = perspective ? glm::vec3(eye) / eye.w : glm::vec3(0.0f);
+    glm::vec3 viewDirection = perspective ? glm::vec3(0.0f) : glm::normalize(glm::vec3(eye));
+
+    size_t chunks = (meshlets.size() + MESHLET_CULL_CHUNK - 1) / MESHLET_CULL_CHUNK;
+    chunkVisible.resize(chunks);
+
+    auto cullChunk = [&](size_t chunk) {
+        vector<unsigned int>& out = chunkVisible[chunk];
+        out.clear();
+
+        size_t end = min(meshlets.size(), (chunk + 1) * MESHLET_CULL_CHUNK);
+        for (size_t m = chunk * MESHLET_CULL_CHUNK; m < end; m++) {
+            const Meshlet& meshlet = meshlets[m];
+
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++)
+                inside = glm::dot(glm::vec3(planes[p]), meshlet.center) + planes[p].w >= -meshlet.radius;
+            if (!inside)
+                continue;
+
+            if (coneCulling && meshlet.coneCutoff < 1.0f) {
+                bool backFacing;
+                if (perspective) {
+                    glm::vec3 toCenter = meshlet.center - eyePosition;
+                    backFacing = glm::dot(toCenter, meshlet.coneAxis) >=
+                                 meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+                } else {
+                    backFacing = glm::dot(viewDirection, meshlet.coneAxis) >= meshlet.coneCutoff;
+                }
+                if (backFacing)
+                    continue;
+            }
+
+            out.push_back((unsigned int)m);
+        }
+    };
+
+    if (chunks > 1)
+        jobs.parallelFor(chunks, cullChunk);
+    else if (chunks == 1)
+        cullChunk(0);
+
+    visible.clear();
+    for (const vector<unsigned int>& chunk : chunkVisible)
+        visible.insert(visible.end(), chunk.begin(), chunk.end());
+
+    // Nearest first, so the depth test rejects more of the fragments behind
+    if (frontToBack) {
+        depthKeys.resize(meshlets.size());
+        for (unsigned int m : visible) {
+            const glm::vec3& center = meshlets[m].center;
+            depthKeys[m] = perspective ? glm::dot(center - eyePosition, center - eyePosition)
+                                       : glm::dot(center, viewDirection);
+        }
+        sort(visible.begin(), visible.end(),
+             [this](unsigned int a, unsigned int b) { return depthKeys[a] < depthKeys[b]; });
+    }
+
+    draws.counts.clear();
+    draws.offsets.clear();
+    draws.visibleMeshlets = visible.size();
+    draws.visibleTriangles = 0;
+    for (unsigned int m : visible) {
+        appendRange(draws, meshlets[m].indexOffset, meshlets[m].indexCount);
+        draws.visibleTriangles += meshlets[m].indexCount / 3;
+    }
+}
+
+/**
+ * @brief Returns the number of meshlets.
+ */
+size_t Meshlets::size() const {
+    return meshlets.size();
+}
+
+/**
+ * @brief Returns whether there are no meshlets.
+ */
+bool Meshlets::empty() const {
+    return meshlets.empty();
+}
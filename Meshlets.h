@@ -0,0 +1,87 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: Meshlets.h
+ *
+ * Description:
+ * Header file for the Meshlets class, which splits a mesh into small clusters of
+ * triangles so that the parts of a large mesh that cannot be seen are not drawn.
+ *
+ * Clusters are grown over shared vertices until they reach MESHLET_MAX_VERTICES or
+ * MESHLET_MAX_TRIANGLES, and the index buffer is reordered so that every cluster is a
+ * contiguous range of it. Each cluster keeps a bounding sphere and a cone bounding its
+ * face normals. Every frame the clusters are tested against the view frustum, and
+ * optionally against the cone for back facing clusters, on the JobSystem. The visible
+ * ranges are merged and drawn with a single glMultiDrawElements call, optionally sorted
+ * front to back first.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ * - GLM (OpenGL Mathematics)
+ * - JobSystem.h
+ * - Arena.h
+ */
+
+#ifndef DATORGRAFIK_MESHLETS_H
+#define DATORGRAFIK_MESHLETS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "JobSystem.h"
+#include "Arena.h"
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// Clusters tested per culling task
+#define MESHLET_CULL_CHUNK 512
+
+struct Meshlet {
+    glm::vec3 center;           // Bounding sphere in object space
+    float radius;
+    glm::vec3 coneAxis;         // Average facing of the triangles
+    float coneCutoff;           // Sine of the cone's half angle, 1 when the cone is too wide to cull with
+    unsigned int indexOffset;   // First index in the reordered index buffer
+    unsigned int indexCount;
+};
+
+// Index ranges for glMultiDrawElements
+struct MeshletDraws {
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    size_t visibleMeshlets;
+    size_t visibleTriangles;
+};
+
+class Meshlets {
+
+public:
+
+    void build(const std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices, Arena& arena);
+    void clear();
+
+    void cull(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, bool coneCulling,
+              bool frontToBack, JobSystem& jobs, MeshletDraws& draws);
+
+    size_t size() const;
+    bool empty() const;
+
+private:
+
+    std::vector<Meshlet> meshlets;
+
+    // Visible meshlets found by each culling task, merged in order afterwards
+    std::vector<std::vector<unsigned int>> chunkVisible;
+    std::vector<unsigned int> visible;
+    std::vector<float> depthKeys;       // Sort keys of the visible meshlets, by meshlet
+
+    void computeBounds(Meshlet& meshlet, const std::vector<glm::vec3>& positions,
+                       const std::vector<unsigned int>& indices) const;
+
+};
+
+#endif //DATORGRAFIK_MESHLETS_H
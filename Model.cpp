@@ -4,6 +4,13 @@
 
 
 #include "Model.h"
+#include "ShaderVariants.h"
+#include "Profiler.h"
+#include "MeshBuilder.h"
+#include "MemoryTracker.h"
+#include "Arena.h"
+#include "AllocationCounter.h"
+#include "ResidencyManager.h"
 
 
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -22,60 +29,59 @@ using namespace std;
 
 
 
-void Model::handleTextures(){
-
-    int width, height, nrChannels;
-
-    if(textureFilePath.size() != 0){
-        textureFilePath += "/";
-    }
-
-    texture_image = stbi_load((textureFilePath + textureFileName).c_str(), &width, &height, &nrChannels, 0);
-
-    cout << "Handling texture: " << (textureFilePath + textureFileName) << endl;
+/**
+ * @brief Hands a texture file over to the texture streamer.
+ *
+ * @param dir Directory of the image, may be empty.
+ * @param file File name of the image.
+ * @param handle The texture currently streamed for this slot, replaced if the file has changed.
+ * @param path The path currently streamed for this slot.
+ *
+ * Decoding and upload happen in the background, so the returned texture can be bound right away.
+ */
+void Model::streamTexture(const string& dir, const string& file, unsigned int& handle, string& path){
 
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    string newPath = dir.empty() ? file : dir + "/" + file;
 
-    // Wrapping
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // Filtering
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (handle != 0 && newPath == path)
+        return;
 
-    // Upload the texture data to the GPU
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, texture_image);
+    if (handle != 0)
+        textureStreamer->release(handle);
 
-    // Generate mipmaps
-    glGenerateMipmap(GL_TEXTURE_2D);
+    cout << "Handling texture: " << newPath << endl;
 
-    // Release active texture
-    glBindTexture(GL_TEXTURE_2D, 0);
+    handle = textureStreamer->request(newPath);
+    path = newPath;
+}
 
-    // Free the loaded image data
-    stbi_image_free(texture_image);
+/**
+ * @brief Streams the diffuse texture and, if one has been chosen, the normal map.
+ */
+void Model::handleTextures(){
+    PROFILE_SCOPE("Load textures");
 
+    streamTexture(textureFilePath, textureFileName, texture, texturePath);
 
+    if (!normalMapFileName.empty())
+        streamTexture(normalMapFilePath, normalMapFileName, normalMap, normalMapPath);
 
     GLenum error = glGetError();
     if (error != GL_NO_ERROR) {
         std::cerr << "OpenGL Error: texture loading " << error << std::endl;
     }
-
-
 }
 
 Model::Model(){
     this->program = 0;
-    this->vao = 0;
+    this->gpuMesh = nullptr;
 }
 
-Model::Model(GLuint program, GLuint vao){
+Model::Model(GLuint program, GpuMesh* gpuMesh){
     this->program = program;
-    this->vao = vao;
+    this->gpuMesh = gpuMesh;
     objFileName = "sphere_large.obj";
-    objFilePath = "OBJs/";
+    objFilePath = "./OBJs/";
     latestObj = "sphere_large.obj";
 
     materialAmbient[0] = 0.6f;
@@ -97,339 +103,348 @@ Model::Model(GLuint program, GLuint vao){
     textureShow = false;
 }
 
+void Model::changeObject()
+{
+    loadGeometry();
+}
+
+void Model::changeTextures() {
+    loadGeometry();
+}
+
+void Model::changeNormalMap() {
+    handleTextures();
+}
+
+
 /**
- * @brief Initializes and configures a TinyObjReader to load an OBJ file.
+ * @brief Loads the OBJ file objFileName and uploads it for rendering.
  *
- * This function prompts the user for the name of the OBJ file (excluding the extension),
- * constructs the full file path, and uses TinyObjReader to parse the OBJ file.
+ * The mesh is built by MeshBuilder, its occlusion baked and its meshlets built, all
+ * without OpenGL, and then uploaded through the GpuMesh. The sphere models get texture
+ * coordinates mapped onto the sphere, other models take them from x and y.
  *
- * @return A configured tinyobj::ObjReader object for loading the specified OBJ file.
- *         The caller should check for any errors or warnings after using the returned object.
- *         If parsing fails, the function prints an error message and exits with code 1.
+ * The model shown before is kept in the cache, and a model found there is shown again
+ * without importing it: from its buffers if they are still resident, else uploaded from
+ * its CPU copy. The CPU copy of the geometry is dropped after the upload unless keepCpuMesh
+ * is set.
  *
- * @note The function assumes that the OBJ files are located in the "OBJs" directory.
- *       The configuration options for the reader are kept minimal for simplicity.
- *       Errors during parsing trigger an exit with an error message.
- *       Warnings, if any, are printed to the standard output.
+ * @note If the file cannot be loaded the latest OBJ is loaded instead, and if that fails
+ *       too the current mesh is kept. The object's boundaries are used to scale the model
+ *       matrix, which is sent to the vertex shader through the uniform 'locModel'.
  */
-tinyobj::ObjReader
-Model::OBJLoaderInit(){
-
-    tinyobj::ObjReaderConfig reader_config;
-    reader_config.mtl_search_path = "OBJs/";
-    tinyobj::ObjReader reader;
+void Model::loadGeometry()
+{
+    PROFILE_SCOPE("Load geometry");
+    string path = objFilePath + objFileName;
 
+    // Only the texture has changed, or the model is still in the cache
+    if (path == loadedPath || restoreCached(path)) {
+        useGeometry();
+        return;
+    }
 
-    if (!reader.ParseFromFile(objFilePath+objFileName, reader_config)) {
-        if (!reader.Error().empty()) {
-            std::cerr << "TinyObjReader: " << reader.Error();
+    // Temporaries of the import, freed together when it is done
+    Arena localArena;
+    Arena& arena = importArena ? *importArena : localArena;
+    arena.reset();
+    uint64_t heapAllocations = AllocationCounter::threadAllocations();
+    MeshData loaded;
+    string error;
+    bool built;
+    {
+        PROFILE_SCOPE("Build mesh");
+        bool sphere = objFileName == "sphere_large.obj" || objFileName == "sphere.obj";
+        built = MeshBuilder::loadObj(path, sphere ? MESH_TEXCOORDS_SPHERE : MESH_TEXCOORDS_PLANAR, loaded, error);
+    }
+    if (!built) {
+        cout << "\n" << ANSI_COLOR_RED << "ERROR: " << ANSI_COLOR_RESET << error
+             << "\nOBJ Loading interupted." << endl;
+        if (objFileName == latestObj) {
+            cout << ANSI_COLOR_RED << "Failed to load Object " << objFileName << "." << ANSI_COLOR_RESET << endl << endl;
+            return;
         }
+        cout << "Loading latest OBJ (\"" << latestObj << "\") instead.\n" << endl;
+        objFileName = latestObj;
+        loadGeometry();
+        return;
     }
 
-    if (!reader.Warning().empty()) {
-        std::cout << "TinyObjReader: " << reader.Warning();
+    {
+        PROFILE_SCOPE("Bake occlusion");
+        if (occlusionBaker)
+            occlusionBaker->bake(objFileName, loaded.positions, loaded.normals, loaded.indices, loaded.occlusion);
+        else
+            loaded.occlusion.assign(loaded.positions.size(), 1.0f);
     }
-
-    if (!reader.Valid()) {
-        std::cout << "TinyObjReader: Could not read .obj file correctly" ;
+    Meshlets loadedMeshlets;
+    {
+        PROFILE_SCOPE("Build meshlets");
+        loadedMeshlets.build(loaded.positions, loaded.indices, arena);
     }
 
-    return reader;
+    cacheCurrent();
+    mesh = std::move(loaded);
+    meshlets = std::move(loadedMeshlets);
+    loadedPath = path;
+
+    {
+        PROFILE_SCOPE("Upload");
+        gpuMesh->upload(mesh);
+    }
+    cpuMesh = true;
+    if (keepCpuMesh)
+        reportCpuBytes();
+    else
+        dropCpuMesh();
+    trackResidency();
+
+    useGeometry();
+
+    importTemporaries = arena.allocations();
+    importTemporaryBytes = arena.bytesAllocated();
+    importArenaBlocks = arena.heapBlocks();
+    importHeapAllocations = AllocationCounter::threadAllocations() - heapAllocations;
+    arena.reset();
+    cout << ANSI_COLOR_GREEN << "Object " << objFileName << " loaded successfully!" << ANSI_COLOR_RESET << endl << endl;
 }
 
 /**
- * @brief Inserts vertices from the provided TinyObj attrib into a vector of glm::vec3.
- *
- * This function iterates through the vertices in the TinyObj attrib and inserts each vertex
- * into the specified vector. Additionally, it calculates and returns a glm::vec3 representing
- * the inverse sizes (1/size) of the bounding box dimensions (x, y, z) of the inserted vertices.
- *
- * @return A glm::vec3 representing the inverse sizes (1/size) of the bounding box dimensions (x, y, z)
- *         of the inserted vertices. This can be used for normalization or scaling purposes.
- *
- * @note The function calculates the bounding box dimensions (x, y, z) and inserts each vertex
- *       into the provided vector. It also prints the coordinates of each inserted vertex to the console.
- *       The returned glm::vec3 can be used for scaling to normalize the dimensions of the loaded geometry.
+ * @brief Sets up the model matrix, textures and uniforms for the loaded geometry.
  */
-glm::vec3 Model::insertVertices(){
-    float xMax = std::numeric_limits<float>::lowest(), xMin = std::numeric_limits<float>::max();
-    float yMax = std::numeric_limits<float>::lowest(), yMin = std::numeric_limits<float>::max();
-    float zMax = std::numeric_limits<float>::lowest(), zMin = std::numeric_limits<float>::max();
-
-    auto attrib = reader.GetAttrib();
-
-    for(size_t v = 0; v < attrib.vertices.size() / 3; ++v) {
-        tinyobj::real_t vx = attrib.vertices[3 * v];
-        tinyobj::real_t vy = attrib.vertices[3 * v + 1];
-        tinyobj::real_t vz = attrib.vertices[3 * v + 2];
-
-        xMax = std::max(xMax, vx);
-        xMin = std::min(xMin, vx);
-
-        yMax = std::max(yMax, vy);
-        yMin = std::min(yMin, vy);
-
-        zMax = std::max(zMax, vz);
-        zMin = std::min(zMin, vz);
-
-        glm::vec3 vertex = glm::vec3(vx, vy, vz);
-        vertices.push_back(vertex);
-    }
+void Model::useGeometry()
+{
+    earth = objFileName == "sphere_large.obj" && textureFileName == "erf.jpg";
 
-    float sizeX = xMax - xMin;
-    float sizeY = yMax - yMin;
-    float sizeZ = zMax - zMin;
+    boundingMin = mesh.boundsMin;
+    boundingMax = mesh.boundsMax;
+    boundingCenter = mesh.center;
+    boundingRadius = mesh.radius;
+    glm::vec3 size = mesh.boundsMax - mesh.boundsMin;
+    float scalar = std::max(size.x, std::max(size.y, size.z));
+    float scaleFactor = scalar > 0.0f ? 1.0f / scalar : 1.0f;
+    modelMat = glm::scale(glm::mat4x4{1.0f}, glm::vec3(scaleFactor));
 
-    float scalar = std::max(sizeX, std::max(sizeY, sizeZ));
-    float scaleFactor = 1.0f / scalar;
+    handleTextures();
+    setProgram(program);
 
-    return {scaleFactor, scaleFactor, scaleFactor};
+    glUseProgram(program);
+    glUniformMatrix4fv(locModel, 1, GL_FALSE, value_ptr(modelMat));
+    glUseProgram(0);
 }
 
-
 /**
- * @brief Inserts vertex indices from the first shape of TinyObj data into a vector of unsigned integers.
+ * @brief Moves the loaded model into the cache, with its buffers detached from the vertex array.
  *
- * This function iterates through the face indices of the first shape in the provided TinyObj data
- * and inserts each vertex index into the specified vector.
- *
- * @note The function assumes the presence of at least one shape in the provided vector.
+ * The cached model stays registered with the ResidencyManager, which may evict its buffers.
  */
-void Model::insertIndices(){
-
-
-    // Loop over indices in the face.
-    auto shapes = reader.GetShapes();
-
-
-
-    if (!reader.Warning().empty()) {
-        std::cout << "TinyObjReader: " << reader.Warning();
-    }
-
-    if (!reader.Error().empty()) {
-        std::cout << "TinyObjReader: " << reader.Error();
-    }
-
-    for (size_t v = 0; v < shapes[0].mesh.num_face_vertices.size(); v++) {
-        tinyobj::index_t idx = shapes[0].mesh.indices[3 * v];
-        indices.push_back(static_cast<unsigned int>(idx.vertex_index));
-        idx = shapes[0].mesh.indices[3 * v + 1];
-        indices.push_back(static_cast<unsigned int>(idx.vertex_index));
-        idx = shapes[0].mesh.indices[3 * v + 2];
-        indices.push_back(static_cast<unsigned int>(idx.vertex_index));
-    }
+void Model::cacheCurrent()
+{
+    if (loadedPath.empty())
+        return;
+
+    CachedModel& cached = cache[loadedPath];
+    cached.mesh = std::move(mesh);
+    cached.cpuMesh = cpuMesh;
+    cached.meshlets = std::move(meshlets);
+    cached.buffers = gpuMesh->detach();
+    cached.residencyId = residencyId;
+
+    mesh = MeshData();
+    meshlets.clear();
+    cpuMesh = false;
+    residencyId = -1;
+    loadedPath.clear();
 }
 
-void Model::insertNormals(){
+/**
+ * @brief Shows a model from the cache again, caching the loaded one in its place.
+ *
+ * @param path Path of the OBJ file.
+ * @return False if the model is not in the cache.
+ */
+bool Model::restoreCached(const string& path)
+{
+    auto it = cache.find(path);
+    if (it == cache.end())
+        return false;
 
-    normals.resize(vertices.size());
+    CachedModel cached = std::move(it->second);
+    cache.erase(it);
+    cacheCurrent();
 
-    for (size_t i = 0; i < indices.size(); i += 3)
-    {
-        // Get the face normal
-        auto vector1 = vertices[indices[(size_t)i + 1]] - vertices[indices[i]];
-        auto vector2 = vertices[indices[(size_t)i + 2]] - vertices[indices[i]];
-        auto faceNormal = glm::cross(vector1, vector2);
-        glm::normalize(faceNormal);
-
-        // Add the face normal to the 3 vertices normal touching this face
-        normals[indices[i]] += faceNormal;
-        normals[indices[(size_t)i + 1]] += faceNormal;
-        normals[indices[(size_t)i + 2]] += faceNormal;
-    }
+    mesh = std::move(cached.mesh);
+    cpuMesh = cached.cpuMesh;
+    meshlets = std::move(cached.meshlets);
+    residencyId = cached.residencyId;
+    loadedPath = path;
 
-    // Normalize vertices normal
-    for (size_t i = 0; i < vertices.size(); i++){
-        glm::normalize(normals[i]);
+    const char* from = "GPU";
+    if (cached.buffers.vbo != 0) {
+        gpuMesh->attach(cached.buffers);
+    } else {
+        PROFILE_SCOPE("Upload");
+        gpuMesh->upload(mesh);
+        from = "CPU";
     }
+    ResidencyManager::get().setBytes(residencyId, gpuMesh->bytes());
+    ResidencyManager::get().touch(residencyId);
 
+    cout << ANSI_COLOR_GREEN << "Object " << objFileName << " restored from its " << from << " copy!"
+         << ANSI_COLOR_RESET << endl << endl;
+    return true;
 }
 
-void Model::changeObject()
+/**
+ * @brief Frees the buffers of a cached model, called by the ResidencyManager.
+ *
+ * A model without a CPU copy has nothing left to upload from, and is imported again when
+ * shown next.
+ */
+void Model::evictCached(const string& path)
 {
-    vertices.clear();
-    indices.clear();
-    normals.clear();
-    texCoords.clear();
-    loadGeometry();
-}
-
-void Model::changeTextures() {
-    texCoords.clear();
-    loadGeometry();
+    auto it = cache.find(path);
+    if (it == cache.end())
+        return;
+
+    CachedModel& cached = it->second;
+    GpuMesh::release(cached.buffers);
+    if (cached.cpuMesh) {
+        ResidencyManager::get().setBytes(cached.residencyId, 0);
+        return;
+    }
+    ResidencyManager::get().remove(cached.residencyId);
+    MemoryTracker::get().setCpuBytes("Mesh " + cached.mesh.name, 0);
+    cache.erase(it);
 }
 
-glm::vec2 calculateSphereTexCoord(const glm::vec3& vertex) {
-    float theta = atan2(vertex.z, vertex.x);
-    float phi = asin(vertex.y);  // assuming your sphere is centered at (0,0,0) and has a radius
-    float u = 0.5 + (theta / (2.0 * 3.14));
-    float v = 0.5 - (phi / 3.14);
-
-    return glm::vec2(u, v);
+/**
+ * @brief Registers the freshly uploaded model with the ResidencyManager.
+ */
+void Model::trackResidency()
+{
+    ResidencyManager& residency = ResidencyManager::get();
+    string path = loadedPath;
+    residencyId = residency.add("Mesh " + mesh.name, [this, path]() { evictCached(path); });
+    residency.setBytes(residencyId, gpuMesh->bytes());
 }
 
-glm::vec2 invertHCoordinate(const glm::vec2& original) {
-    return glm::vec2(1.0f - original.x, original.y);
+/**
+ * @brief Marks the loaded geometry as used this frame, so its buffers are not evicted.
+ */
+void Model::markDrawn()
+{
+    ResidencyManager::get().touch(residencyId);
 }
 
-
-
-bool Model::checkOBJ() {
-    if(reader.GetAttrib().vertices.empty()){
-        cout << "\n" << ANSI_COLOR_RED << "ERROR: " << ANSI_COLOR_RESET << "No vertices could be read."
-                                          "\nOBJ Loading interupted."
-                                          "\nLoading latest OBJ (\""+latestObj+"\") instead.\n" << endl;
-        objFileName = latestObj;
-        changeObject();
-        return false;
-    }
-
-    if(reader.GetShapes().empty()){
-        cout << "\n" << ANSI_COLOR_RED << "ERROR: " << ANSI_COLOR_RESET << "No indices could be read."
-                                          "\nOBJ Loading interupted."
-                                          "\nLoading latest OBJ (\""+latestObj+"\") instead.\n" << endl;
-        objFileName = latestObj;
-        changeObject();
-        return false;
+/**
+ * @brief Deletes the buffers of the cached models and unregisters all models.
+ *
+ * @note Must run while the OpenGL context is still current. The buffers of the loaded
+ *       model belong to the GpuMesh and are released with it.
+ */
+void Model::releaseCache()
+{
+    ResidencyManager& residency = ResidencyManager::get();
+    for (auto& entry : cache) {
+        GpuMesh::release(entry.second.buffers);
+        residency.remove(entry.second.residencyId);
     }
-    return true;
+    cache.clear();
+    residency.remove(residencyId);
+    residencyId = -1;
 }
 
-
 /**
- * @brief Loads and prepares geometry data for rendering using OpenGL.
+ * @brief Looks up the model's uniform locations in a shader program.
  *
- * This function initializes a TinyObjReader, extracts vertex and index data,
- * sets up the necessary OpenGL buffers and attributes, and loads the object's model matrix.
- * It also binds the vertex array and program for rendering.
+ * @param program The OpenGL program ID.
  *
- * @note The function assumes the availability of a properly configured OpenGL program.
- *       The vertex and index data are extracted and stored in the 'vertices' and 'indices' vectors.
- *       The object's boundaries are calculated and used to scale the model matrix.
- *       The program, vertex array, and buffers are bound to the current OpenGL state.
- *       Vertex attributes are set and object data is loaded into the array buffer and index array.
- *       The model matrix is sent to the vertex shader through the uniform 'locModel'.
- *       Finally, the vertex array and program are unbound for safety.
+ * Vertex attributes use fixed locations shared by all shader variants,
+ * so only the uniforms have to be looked up again when the program changes.
  */
-void Model::loadGeometry()
-{
-
-    bool load_error = false;
-    reader = OBJLoaderInit();
-    if (!reader.Error().empty()){
-        load_error = true;
-        objFileName = latestObj;
-        OBJLoaderInit();
-    }
-
-
-    if(!checkOBJ()) return;
-
-    glm::vec3 objBoundaries = insertVertices();
-    modelMat = glm::scale( glm::mat4x4{1.0f}, objBoundaries);
-    insertIndices();
-    insertNormals();
+void Model::setProgram(GLuint program){
+    this->program = program;
 
     locModel = glGetUniformLocation(program,"M");
     locAmbientMaterial = glGetUniformLocation(program, "am_material");
     locDiffuseMaterial = glGetUniformLocation(program, "di_material");
     locSpecularMaterial = glGetUniformLocation(program, "spec_material");
     locShininess = glGetUniformLocation(program, "shininess");
-    // Get locations of the attributes in the shader
-    locVertices = glGetAttribLocation( program, "vPosition");
-    locNormals = glGetAttribLocation(program, "vNormal");
-    locTextures = glGetAttribLocation(program, "vTexCoord");
-
-
-
-    glUseProgram(program);
-    glBindVertexArray(vao);
-
-    // Konfigurera och aktivera attributpekare för vertices och normals
-    glVertexAttribPointer(locVertices, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), BUFFER_OFFSET(0));
-    glEnableVertexAttribArray(locVertices);
-
-    glVertexAttribPointer(locNormals, 3, GL_FLOAT, GL_TRUE, sizeof(glm::vec3), BUFFER_OFFSET(vertices.size() * sizeof(float) * 3));
-    glEnableVertexAttribArray(locNormals);
-
-    // Konfigurera och aktivera attributpekare för texturkoordinater
-    glVertexAttribPointer(locTextures, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), BUFFER_OFFSET(vertices.size() * sizeof(float) * 3 + normals.size() * sizeof(float) * 3));
-    glEnableVertexAttribArray(locTextures);
-
-    handleTextures();
-
-    if(objFileName == "sphere_large.obj" || objFileName == "sphere.obj"){
-        for (const auto& vertex : vertices) {
-            texCoords.push_back(calculateSphereTexCoord(vertex));
-        }
-    } else {
-        for (const auto& vertex : vertices) {
-            texCoords.push_back(glm::vec2(vertex.x, vertex.y));
-        }
-    }
-
-    for (auto& texCoord : texCoords) {
-        texCoord = invertHCoordinate(texCoord);
-    }
-
-
-    GLenum error = glGetError();
-    if (error != GL_NO_ERROR) {
-        std::cerr << "OpenGL Error: pointer error: " << error << std::endl;
-    }
-
-
-
-
-    // Load object data to the array buffer and index array
-    size_t vSize = vertices.size()*sizeof(float)*3;
-    size_t iSize = indices.size()*sizeof(unsigned int);
-    size_t nSize = normals.size()*sizeof(float)*3;
-    size_t tSize = texCoords.size()* sizeof(glm::vec2);
-
-    glVertexAttribPointer(locNormals, 3, GL_FLOAT, GL_TRUE, 0,
-                          BUFFER_OFFSET(vSize));
-    error = glGetError();
-    if (error != GL_NO_ERROR) {
-        std::cerr << "OpenGL Error: normal error: " << error << std::endl;
-    }
-
-
-
-
-    glBufferData(GL_ARRAY_BUFFER, vSize + nSize + tSize, nullptr, GL_STATIC_DRAW);
-
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vSize, vertices.data());
-    glBufferSubData(GL_ARRAY_BUFFER, vSize, nSize, normals.data());
-    glBufferSubData(GL_ARRAY_BUFFER, vSize + nSize, tSize, texCoords.data());
+}
 
+unsigned int Model::getIndices() {
+    return gpuMesh ? static_cast<unsigned int>(gpuMesh->indexCount()) : 0;
+}
 
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, iSize, indices.data(), GL_STATIC_DRAW );
+const std::vector<glm::vec3>& Model::getVertices() const {
+    return mesh.positions;
+}
 
+const std::vector<glm::vec3>& Model::getNormals() const {
+    return mesh.normals;
+}
 
-    glUniformMatrix4fv(locModel, 1, GL_FALSE, value_ptr(modelMat));
+const std::vector<glm::vec2>& Model::getTexCoords() const {
+    return mesh.texCoords;
+}
 
-    error = glGetError();
-    if (error != GL_NO_ERROR) {
-        std::cerr << "OpenGL Error: buffer error: " << error << std::endl;
-    }
+const std::vector<unsigned int>& Model::getIndexData() const {
+    return mesh.indices;
+}
 
+/**
+ * @brief Returns the baked ambient occlusion, one value per vertex.
+ */
+const std::vector<float>& Model::getOcclusion() const {
+    return mesh.occlusion;
+}
 
+/**
+ * @brief Returns the path of the diffuse texture currently streamed for the model.
+ */
+const std::string& Model::getTexturePath() const {
+    return texturePath;
+}
 
-    glBindVertexArray(0);
-    glUseProgram(0);
+/**
+ * @brief Returns whether the CPU copy of the geometry is there, which the get functions return.
+ */
+bool Model::hasCpuMesh() const {
+    return cpuMesh;
+}
 
-    if(load_error) {
-        cout << ANSI_COLOR_RED << "Failed to load Object " << objFileName << "." << ANSI_COLOR_RESET << endl << endl;
-    } else {
-        cout << ANSI_COLOR_GREEN << "Object " << objFileName << " loaded successfully!" << ANSI_COLOR_RESET << endl << endl;
-    }
+/**
+ * @brief Frees the CPU copy of the geometry, the uploaded buffers are all that is left.
+ *
+ * The bounds are kept. The get functions return empty arrays until restoreCpuMesh().
+ */
+void Model::dropCpuMesh() {
+    if (!cpuMesh)
+        return;
+    std::vector<glm::vec3>().swap(mesh.positions);
+    std::vector<glm::vec3>().swap(mesh.normals);
+    std::vector<glm::vec2>().swap(mesh.texCoords);
+    std::vector<float>().swap(mesh.occlusion);
+    std::vector<unsigned int>().swap(mesh.indices);
+    cpuMesh = false;
+    reportCpuBytes();
+}
 
+/**
+ * @brief Reads a dropped CPU copy of the geometry back from the uploaded buffers.
+ */
+void Model::restoreCpuMesh() {
+    if (cpuMesh || !gpuMesh || gpuMesh->indexCount() == 0)
+        return;
+    PROFILE_SCOPE("Restore CPU mesh");
+    gpuMesh->download(mesh);
+    cpuMesh = true;
+    reportCpuBytes();
 }
 
-unsigned int Model::getIndices() {
-    return static_cast<unsigned int>(indices.size());
+void Model::reportCpuBytes() {
+    MemoryTracker::get().setCpuBytes("Mesh " + mesh.name, mesh.byteSize());
 }
 
 void Model::sendModel(bool materialChanged){
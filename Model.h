@@ -9,33 +9,87 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp> // perspective, translate, rotate
 #include "openglwindow.h"
-#include "include/tiny_obj_loader.h"
+#include "MeshData.h"
+#include "GpuMesh.h"
+#include "TextureStreamer.h"
+#include "OcclusionBaker.h"
+#include "Meshlets.h"
+#include "Arena.h"
+#include <map>
 
 
 class Model {
 
 public:
     Model();
-    Model(GLuint program, GLuint vao);
+    Model(GLuint program, GpuMesh* gpuMesh);
 
     void changeObject();
     void loadGeometry();
+    void setProgram(GLuint program);
     unsigned int getIndices();
+
+    // CPU side geometry, as uploaded to the vertex buffer
+    const std::vector<glm::vec3>& getVertices() const;
+    const std::vector<glm::vec3>& getNormals() const;
+    const std::vector<glm::vec2>& getTexCoords() const;
+    const std::vector<unsigned int>& getIndexData() const;
+    const std::vector<float>& getOcclusion() const;
+    const std::string& getTexturePath() const;
     void sendModel(bool materialChanged);
 
+    // The CPU copy of the geometry can be dropped once uploaded and read back when needed
+    bool hasCpuMesh() const;
+    void dropCpuMesh();
+    void restoreCpuMesh();
+
+    // Keeps the loaded geometry resident while it is drawn, and frees the models kept to switch back to
+    void markDrawn();
+    void releaseCache();
+
     std::string objFileName;
     std::string objFilePath;
     std::string latestObj;
 
     glm::mat4x4 modelMat;
 
-    unsigned char *texture_image;
+    // Bounding sphere and box in object space, before modelMat is applied
+    glm::vec3 boundingCenter;
+    float boundingRadius = 0.0f;
+    glm::vec3 boundingMin;
+    glm::vec3 boundingMax;
 
     std::string textureFileName;
     std::string textureFilePath;
-    unsigned int texture;
+    unsigned int texture = 0;
     bool textureShow = false;
 
+    // The large sphere with the earth texture, set when loaded so frames need not compare names
+    bool earth = false;
+
+    std::string normalMapFileName;
+    std::string normalMapFilePath;
+    unsigned int normalMap = 0;
+    bool normalMapShow = false;
+
+    // Drops the CPU copy of the geometry right after each upload
+    bool keepCpuMesh = true;
+
+    TextureStreamer* textureStreamer = nullptr;
+    OcclusionBaker* occlusionBaker = nullptr;
+
+    // Holds the temporaries of every import, reset between them so its first block is reused
+    Arena* importArena = nullptr;
+
+    // What the last import took from the arena, and its allocations from the heap
+    size_t importTemporaries = 0;
+    size_t importTemporaryBytes = 0;
+    size_t importArenaBlocks = 0;
+    size_t importHeapAllocations = 0;
+
+    // Clusters of the index buffer, which is stored in meshlet order
+    Meshlets meshlets;
+
     glm::vec3 materialAmbient;
     glm::vec3 materialDiffuse;
     glm::vec3 materialSpecular;
@@ -43,24 +97,35 @@ public:
 
 
     void changeTextures();
-    GLuint tBuffer;
+    void changeNormalMap();
 
 private:
 
+    // A model loaded before, kept to switch back to without importing it again
+    struct CachedModel {
+        MeshData mesh;
+        bool cpuMesh = false;
+        Meshlets meshlets;
+        GpuMesh::Buffers buffers;       // Empty once evicted by the ResidencyManager
+        int residencyId = -1;
+    };
+
     // Shader Program
     GLuint program;
-    GLuint vao;
-
+    GpuMesh* gpuMesh;
 
+    // Geometry data, with the baked ambient occlusion per vertex
+    MeshData mesh;
+    bool cpuMesh = false;       // The arrays of mesh hold the uploaded geometry
+    std::string loadedPath;
+    int residencyId = -1;
 
-    // Geometry data
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec3> normals;
-    std::vector<unsigned int> indices;
+    // Models loaded before, by path
+    std::map<std::string, CachedModel> cache;
 
     // Texture data
-    std::vector<glm::vec2> texCoords;
-    tinyobj::ObjReader reader;
+    std::string texturePath;
+    std::string normalMapPath;
 
 
     GLuint locModel;
@@ -68,18 +133,17 @@ private:
     GLuint locDiffuseMaterial;
     GLuint locSpecularMaterial;
     GLuint locShininess;
-    GLuint locVertices;
-    GLuint locNormals;
-    GLuint locTextures;
 
 
 
-    tinyobj::ObjReader OBJLoaderInit();
     void handleTextures();
-    void insertIndices();
-    glm::vec3 insertVertices();
-    void insertNormals();
-    bool checkOBJ();
+    void useGeometry();
+    void cacheCurrent();
+    bool restoreCached(const std::string& path);
+    void evictCached(const std::string& path);
+    void trackResidency();
+    void reportCpuBytes();
+    void streamTexture(const std::string& dir, const std::string& file, unsigned int& handle, std::string& path);
 
 };
 
@@ -0,0 +1,189 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: OcclusionBaker.cpp
+ *
+ * Description:
+ * Implementation file for the OcclusionBaker class.
+ *
+ * Dependencies:
+ * - "OcclusionBaker.h"
+ */
+
+#include "OcclusionBaker.h"
+#include "Sampling.h"
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+using namespace std;
+
+// Vertices per baking task
+#define AO_VERTEX_CHUNK 256
+
+struct OcclusionFileHeader {
+    char magic[4];
+    unsigned int count;
+};
+
+namespace {
+
+// FNV-1a over raw bytes, chained through the seed
+unsigned long long hashBytes(const void* data, size_t size, unsigned long long seed) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    unsigned long long h = seed;
+    for (size_t i = 0; i < size; i++) {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+}
+
+/**
+ * @brief Creates the baker, it casts rays on the workers of the JobSystem.
+ */
+OcclusionBaker::OcclusionBaker() : jobs(JobSystem::get()) {
+    bakeMs = 0.0f;
+    fromCache = false;
+}
+
+/**
+ * @brief Computes the ambient occlusion of every vertex of a mesh.
+ *
+ * @param name Name of the model, used in the cache file name.
+ * @param positions Vertex positions.
+ * @param normals Vertex normals, they do not need to be normalized.
+ * @param indices Three vertex indices per triangle.
+ * @param occlusion Receives one value per vertex, 1 unoccluded and 0 fully occluded.
+ *
+ * The result is read from the mesh cache if this mesh has been baked before, otherwise
+ * it is baked and written to the cache.
+ */
+void OcclusionBaker::bake(const string& name, const vector<glm::vec3>& positions, const vector<glm::vec3>& normals,
+                          const vector<unsigned int>& indices, vector<float>& occlusion) {
+    auto start = chrono::steady_clock::now();
+
+    string file = cacheFile(name, positions, indices);
+    fromCache = load(file, positions.size(), occlusion);
+    if (!fromCache) {
+        occlusion.assign(positions.size(), 1.0f);
+
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (const glm::vec3& p : positions) {
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+        float diagonal = positions.empty() ? 0.0f : glm::length(hi - lo);
+        float distance = AO_DISTANCE * diagonal;
+        float offset = 1e-4f * diagonal;
+
+        bvh.build(positions.data(), indices.data(), indices.size() / 3, jobs);
+
+        if (!bvh.empty() && normals.size() == positions.size()) {
+            size_t chunks = (positions.size() + AO_VERTEX_CHUNK - 1) / AO_VERTEX_CHUNK;
+            jobs.parallelFor(chunks, [&](size_t chunk) {
+                size_t end = min(positions.size(), (chunk + 1) * AO_VERTEX_CHUNK);
+                for (size_t v = chunk * AO_VERTEX_CHUNK; v < end; v++) {
+                    float length = glm::length(normals[v]);
+                    if (!(length > 0.0f))
+                        continue;
+                    glm::vec3 normal = normals[v] / length;
+                    glm::vec3 origin = positions[v] + normal * offset;
+                    uint32_t random = hashSeed((uint32_t)v) | 1u;
+
+                    // Four rays of the same vertex per packet, they share origin and hemisphere
+                    int blocked = 0;
+                    for (int ray = 0; ray < AO_RAYS; ray += 4) {
+                        RayPacket packet;
+                        packet.mask = 15;
+                        for (int i = 0; i < 4; i++) {
+                            glm::vec3 d = sampleCosineHemisphere(normal, nextRandom(random), nextRandom(random));
+                            packet.originX[i] = origin.x;
+                            packet.originY[i] = origin.y;
+                            packet.originZ[i] = origin.z;
+                            packet.directionX[i] = d.x;
+                            packet.directionY[i] = d.y;
+                            packet.directionZ[i] = d.z;
+                            packet.tMax[i] = distance;
+                        }
+                        blocked += packetRayCount(bvh.occluded(packet));
+                    }
+                    occlusion[v] = 1.0f - (float)blocked / AO_RAYS;
+                }
+            });
+        }
+
+        store(file, occlusion);
+    }
+
+    bakeMs = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Builds the cache file name from the model name, the mesh and the bake settings.
+ */
+string OcclusionBaker::cacheFile(const string& name, const vector<glm::vec3>& positions,
+                                 const vector<unsigned int>& indices) const {
+    const int rays = AO_RAYS;
+    const float distance = AO_DISTANCE;
+    unsigned long long key = hashBytes(positions.data(), positions.size() * sizeof(glm::vec3), 14695981039346656037ull);
+    key = hashBytes(indices.data(), indices.size() * sizeof(unsigned int), key);
+    key = hashBytes(&rays, sizeof(rays), key);
+    key = hashBytes(&distance, sizeof(distance), key);
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", key);
+    return string(AO_CACHE_DIR) + "/" + name + "-" + hex + ".ao";
+}
+
+/**
+ * @brief Reads a bake from the cache.
+ *
+ * @return false if there is no valid cache file for count vertices.
+ */
+bool OcclusionBaker::load(const string& file, size_t count, vector<float>& occlusion) const {
+    ifstream fs(file, ios::binary);
+    if (!fs)
+        return false;
+
+    OcclusionFileHeader header;
+    fs.read((char*)&header, sizeof(header));
+    if (!fs || string(header.magic, 4) != "3DAO" || header.count != count)
+        return false;
+
+    occlusion.resize(count);
+    fs.read((char*)occlusion.data(), count * sizeof(float));
+    return (bool)fs;
+}
+
+/**
+ * @brief Writes a bake to the cache.
+ */
+void OcclusionBaker::store(const string& file, const vector<float>& occlusion) const {
+#ifdef _WIN32
+    _mkdir(AO_CACHE_DIR);
+#else
+    mkdir(AO_CACHE_DIR, 0755);
+#endif
+
+    ofstream fs(file, ios::binary);
+    if (!fs) {
+        cerr << "Could not write mesh cache " << file << endl;
+        return;
+    }
+    OcclusionFileHeader header = { {'3', 'D', 'A', 'O'}, (unsigned int)occlusion.size() };
+    fs.write((const char*)&header, sizeof(header));
+    fs.write((const char*)occlusion.data(), occlusion.size() * sizeof(float));
+}
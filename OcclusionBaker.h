@@ -0,0 +1,63 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: OcclusionBaker.h
+ *
+ * Description:
+ * Header file for the OcclusionBaker class, which bakes ambient occlusion into a value
+ * per vertex when a model is loaded. The shaders scale the ambient term by it, which
+ * gives contact shadows without any per frame cost.
+ *
+ * Every vertex casts AO_RAYS cosine weighted rays over its hemisphere against a Bvh of
+ * the mesh, on all cores. The result is the fraction of rays that escape within
+ * AO_DISTANCE. Bakes are stored in the mesh cache folder keyed by the mesh contents, so
+ * a model is only baked the first time it is loaded.
+ *
+ * Dependencies:
+ * - GLM (OpenGL Mathematics)
+ * - Bvh.h, JobSystem.h
+ */
+
+#ifndef DATORGRAFIK_OCCLUSIONBAKER_H
+#define DATORGRAFIK_OCCLUSIONBAKER_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "Bvh.h"
+#include "JobSystem.h"
+
+#define AO_RAYS 64
+#define AO_DISTANCE 0.25f       // Ray length relative to the diagonal of the mesh's bounds
+#define AO_CACHE_DIR "meshcache"
+
+class OcclusionBaker {
+
+public:
+
+    OcclusionBaker();
+
+    void bake(const std::string& name, const std::vector<glm::vec3>& positions,
+              const std::vector<glm::vec3>& normals, const std::vector<unsigned int>& indices,
+              std::vector<float>& occlusion);
+
+    // Statistics for the latest bake
+    float bakeMs;
+    bool fromCache;
+
+private:
+
+    JobSystem& jobs;
+    Bvh bvh;
+
+    std::string cacheFile(const std::string& name, const std::vector<glm::vec3>& positions,
+                          const std::vector<unsigned int>& indices) const;
+    bool load(const std::string& file, size_t count, std::vector<float>& occlusion) const;
+    void store(const std::string& file, const std::vector<float>& occlusion) const;
+
+};
+
+#endif //DATORGRAFIK_OCCLUSIONBAKER_H
@@ -0,0 +1,357 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: OcclusionCuller.cpp
+ *
+ * Description:
+ * Implementation file for the OcclusionCuller class.
+ *
+ * Dependencies:
+ * - "OcclusionCuller.h"
+ */
+
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+/**
+ * @brief Default constructor for the OcclusionCuller class.
+ */
+OcclusionCuller::OcclusionCuller() {
+    viewProjection = glm::mat4(1.0f);
+    frontWinding = 0.0f;
+    widthPixels = 0;
+    heightPixels = 0;
+    tilesX = 0;
+    tilesY = 0;
+    occluderCount = 0;
+    occluderTriangles = 0;
+    rasterMs = 0.0f;
+}
+
+/**
+ * @brief Sets the mesh every occluder is drawn with.
+ *
+ * A mesh is closed when every edge is shared by exactly two triangles running it in
+ * opposite directions. The sign of its volume then tells which winding faces outwards.
+ */
+void OcclusionCuller::setOccluderMesh(const vector<glm::vec3>& positions, const vector<unsigned int>& indices) {
+    meshPositions = positions;
+    meshIndices = indices;
+
+    unordered_map<uint64_t, int> edges;
+    float volume = 0.0f;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        for (int k = 0; k < 3; k++) {
+            uint64_t a = indices[i + k], b = indices[i + (k + 1) % 3];
+            edges[a << 32 | b]++;
+        }
+        volume += glm::dot(positions[indices[i]], glm::cross(positions[indices[i + 1]], positions[indices[i + 2]]));
+    }
+
+    bool closed = !edges.empty();
+    for (const auto& edge : edges) {
+        auto opposite = edges.find(edge.first << 32 | edge.first >> 32);
+        if (edge.second != 1 || opposite == edges.end() || opposite->second != 1) {
+            closed = false;
+            break;
+        }
+    }
+    frontWinding = !closed || volume == 0.0f ? 0.0f : (volume > 0.0f ? 1.0f : -1.0f);
+}
+
+/**
+ * @brief Starts a frame, clearing the depth buffer and the occluder list.
+ *
+ * @param viewProjection The camera's projection times view matrix.
+ * @param aspect Width over height of the viewport.
+ */
+void OcclusionCuller::begin(const glm::mat4& viewProjection, float aspect) {
+    this->viewProjection = viewProjection;
+
+    widthPixels = OCCLUSION_WIDTH;
+    tilesX = widthPixels / OCCLUSION_TILE;
+    tilesY = max(1, (int)ceil(widthPixels / max(aspect, 0.01f) / OCCLUSION_TILE));
+    heightPixels = tilesY * OCCLUSION_TILE;
+
+    depth.assign((size_t)widthPixels * heightPixels, 1.0f);
+    tileMax.assign((size_t)tilesX * tilesY, 1.0f);
+    occluders.clear();
+}
+
+/**
+ * @brief Adds an instance of the occluder mesh to this frame's occluders.
+ */
+void OcclusionCuller::addOccluder(const glm::mat4& model) {
+    occluders.push_back(model);
+}
+
+/**
+ * @brief Rasterizes the occluders added since begin().
+ *
+ * The occluders are transformed and set up in parallel, then every band of tile rows
+ * is rasterized by one task, so no two tasks write the same pixels.
+ */
+void OcclusionCuller::rasterize(JobSystem& jobs) {
+    auto start = chrono::steady_clock::now();
+
+    clipVertices.resize(occluders.size());
+    triangles.resize(occluders.size());
+    jobs.parallelFor(occluders.size(), [this](size_t occluder) {
+        setupOccluder(occluder);
+    });
+    jobs.parallelFor(tilesY, [this](size_t band) {
+        rasterizeBand(band);
+    });
+
+    occluderCount = (int)occluders.size();
+    occluderTriangles = 0;
+    for (size_t i = 0; i < occluders.size(); i++)
+        occluderTriangles += (int)triangles[i].size();
+    rasterMs = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Transforms one occluder and sets up its triangles.
+ *
+ * Back faces of closed meshes are dropped before clipping. The determinant of the clip
+ * space x, y and w has the sign of the winding on screen when all three w are positive,
+ * other triangles are kept.
+ */
+void OcclusionCuller::setupOccluder(size_t occluder) {
+    glm::mat4 clipMatrix = viewProjection * occluders[occluder];
+    vector<glm::vec4>& clip = clipVertices[occluder];
+    clip.resize(meshPositions.size());
+    for (size_t v = 0; v < meshPositions.size(); v++)
+        clip[v] = clipMatrix * glm::vec4(meshPositions[v], 1.0f);
+
+    vector<ScreenTriangle>& out = triangles[occluder];
+    out.clear();
+    for (size_t i = 0; i + 2 < meshIndices.size(); i += 3) {
+        glm::vec4 v[3] = { clip[meshIndices[i]], clip[meshIndices[i + 1]], clip[meshIndices[i + 2]] };
+
+        // Triangles entirely outside the view frustum
+        if ((v[0].x > v[0].w && v[1].x > v[1].w && v[2].x > v[2].w) ||
+            (v[0].x < -v[0].w && v[1].x < -v[1].w && v[2].x < -v[2].w) ||
+            (v[0].y > v[0].w && v[1].y > v[1].w && v[2].y > v[2].w) ||
+            (v[0].y < -v[0].w && v[1].y < -v[1].w && v[2].y < -v[2].w) ||
+            (v[0].z > v[0].w && v[1].z > v[1].w && v[2].z > v[2].w))
+            continue;
+
+        if (frontWinding != 0.0f && v[0].w > 0.0f && v[1].w > 0.0f && v[2].w > 0.0f) {
+            float winding = glm::determinant(glm::mat3(glm::vec3(v[0].x, v[0].y, v[0].w),
+                                                       glm::vec3(v[1].x, v[1].y, v[1].w),
+                                                       glm::vec3(v[2].x, v[2].y, v[2].w)));
+            if (winding * frontWinding <= 0.0f)
+                continue;
+        }
+
+        if (insideClipPlanes(v[0]) && insideClipPlanes(v[1]) && insideClipPlanes(v[2])) {
+            setupTriangle(v[0], v[1], v[2], out);
+        } else {
+            clipTriangle(v[0], v[1], v[2],
+                         [](const glm::vec4& p, const glm::vec4& q, float t, glm::vec4& result) {
+                             result = glm::mix(p, q, t);
+                         },
+                         [&](const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+                             setupTriangle(a, b, c, out);
+                         });
+        }
+    }
+}
+
+/**
+ * @brief Projects a clipped triangle to the depth buffer and sets up its edge functions.
+ */
+void OcclusionCuller::setupTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c,
+                                    vector<ScreenTriangle>& out) const {
+    const glm::vec4* clip[3] = { &a, &b, &c };
+    glm::vec2 s[3];
+    float z[3];
+    for (int i = 0; i < 3; i++) {
+        glm::vec3 ndc = glm::vec3(*clip[i]) / clip[i]->w;
+        s[i] = glm::vec2((ndc.x * 0.5f + 0.5f) * widthPixels, (0.5f - ndc.y * 0.5f) * heightPixels);
+        z[i] = ndc.z;
+    }
+
+    ScreenTriangle tri;
+    if (!setupEdges(s, widthPixels, heightPixels, tri))
+        return;
+
+    tri.zA = tri.zB = tri.zC = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        tri.zA += z[tri.order[i]] * tri.edgeA[i];
+        tri.zB += z[tri.order[i]] * tri.edgeB[i];
+        tri.zC += z[tri.order[i]] * tri.edgeC[i];
+    }
+    out.push_back(tri);
+}
+
+/**
+ * @brief Rasterizes all occluder triangles touching one row of tiles and updates the tiles' farthest depth.
+ *
+ * Spans start on a multiple of four pixels, which keeps the four wide loads inside the
+ * row since the width is a multiple of the tile size. Pixels left of a triangle's bounds
+ * fail its edge test, so they need no extra mask.
+ */
+void OcclusionCuller::rasterizeBand(size_t band) {
+    int y0 = (int)band * OCCLUSION_TILE;
+    int y1 = min(heightPixels, y0 + OCCLUSION_TILE) - 1;
+
+    for (const vector<ScreenTriangle>& list : triangles) {
+        for (const ScreenTriangle& tri : list) {
+            int by0 = max(tri.minY, y0), by1 = min(tri.maxY, y1);
+            if (by0 > by1)
+                continue;
+            int bx0 = tri.minX & ~3, bx1 = tri.maxX;
+
+            for (int y = by0; y <= by1; y++) {
+                float py = y + 0.5f;
+                float* row = &depth[(size_t)y * widthPixels];
+#ifdef __SSE2__
+                const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+                __m128 px = _mm_add_ps(_mm_set1_ps(bx0 + 0.5f), lane);
+                __m128 e[3], step[3];
+                for (int i = 0; i < 3; i++) {
+                    e[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.edgeA[i]), px),
+                                      _mm_set1_ps(tri.edgeB[i] * py + tri.edgeC[i]));
+                    step[i] = _mm_set1_ps(tri.edgeA[i] * 4.0f);
+                }
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.zA), px), _mm_set1_ps(tri.zB * py + tri.zC));
+                __m128 zStep = _mm_set1_ps(tri.zA * 4.0f);
+                const __m128 zero = _mm_setzero_ps();
+
+                for (int x = bx0; x <= bx1; x += 4) {
+                    __m128 inside = _mm_and_ps(_mm_cmpge_ps(e[0], zero),
+                                               _mm_and_ps(_mm_cmpge_ps(e[1], zero), _mm_cmpge_ps(e[2], zero)));
+                    if (_mm_movemask_ps(inside)) {
+                        __m128 stored = _mm_loadu_ps(row + x);
+                        __m128 nearest = _mm_min_ps(stored, z);
+                        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+                    }
+                    for (int i = 0; i < 3; i++)
+                        e[i] = _mm_add_ps(e[i], step[i]);
+                    z = _mm_add_ps(z, zStep);
+                }
+#else
+                for (int x = bx0; x <= bx1; x++) {
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for (int i = 0; i < 3; i++)
+                        inside = inside && tri.edgeA[i] * px + tri.edgeB[i] * py + tri.edgeC[i] >= 0.0f;
+                    float z = tri.zA * px + tri.zB * py + tri.zC;
+                    if (inside && z < row[x])
+                        row[x] = z;
+                }
+#endif
+            }
+        }
+    }
+
+    for (int tx = 0; tx < tilesX; tx++) {
+        float farthest = -1.0f;
+        for (int y = y0; y <= y1; y++) {
+            const float* row = &depth[(size_t)y * widthPixels + tx * OCCLUSION_TILE];
+            for (int x = 0; x < OCCLUSION_TILE; x++)
+                farthest = max(farthest, row[x]);
+        }
+        tileMax[band * tilesX + tx] = farthest;
+    }
+}
+
+/**
+ * @brief Tests a box against the occluders rasterized this frame.
+ *
+ * @param model Transform of the box.
+ * @param boxMin Smallest corner of the box, before the transform.
+ * @param boxMax Largest corner of the box, before the transform.
+ * @return OUTSIDE when the box is outside the view frustum, OCCLUDED when the occluders
+ *         hide it and VISIBLE otherwise. Boxes crossing the near plane are always visible.
+ */
+OcclusionCuller::Visibility OcclusionCuller::testBox(const glm::mat4& model, const glm::vec3& boxMin,
+                                                     const glm::vec3& boxMax) const {
+    glm::mat4 clipMatrix = viewProjection * model;
+
+    int outside[6] = { 0, 0, 0, 0, 0, 0 };
+    bool crossesNear = false;
+    float minX = 1e30f, maxX = -1e30f, minY = 1e30f, maxY = -1e30f, minZ = 1e30f;
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 p((corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y,
+                    (corner & 4) ? boxMax.z : boxMin.z);
+        glm::vec4 c = clipMatrix * glm::vec4(p, 1.0f);
+        outside[0] += c.x < -c.w;
+        outside[1] += c.x > c.w;
+        outside[2] += c.y < -c.w;
+        outside[3] += c.y > c.w;
+        outside[4] += c.z < -c.w;
+        outside[5] += c.z > c.w;
+        if (c.z < -c.w || c.w <= 0.0f) {
+            crossesNear = true;
+            continue;
+        }
+
+        glm::vec3 ndc = glm::vec3(c) / c.w;
+        float sx = (ndc.x * 0.5f + 0.5f) * widthPixels;
+        float sy = (0.5f - ndc.y * 0.5f) * heightPixels;
+        minX = min(minX, sx);
+        maxX = max(maxX, sx);
+        minY = min(minY, sy);
+        maxY = max(maxY, sy);
+        minZ = min(minZ, ndc.z);
+    }
+    for (int plane = 0; plane < 6; plane++) {
+        if (outside[plane] == 8)
+            return OUTSIDE;
+    }
+    if (crossesNear)
+        return VISIBLE;
+
+    // One pixel of margin, occluder edges only cover the pixels whose centers they contain
+    int x0 = max(0, (int)floor(minX) - 1), x1 = min(widthPixels - 1, (int)ceil(maxX) + 1);
+    int y0 = max(0, (int)floor(minY) - 1), y1 = min(heightPixels - 1, (int)ceil(maxY) + 1);
+    if (x0 > x1 || y0 > y1)
+        return OUTSIDE;
+
+    for (int ty = y0 / OCCLUSION_TILE; ty <= y1 / OCCLUSION_TILE; ty++) {
+        for (int tx = x0 / OCCLUSION_TILE; tx <= x1 / OCCLUSION_TILE; tx++) {
+            if (minZ > tileMax[ty * tilesX + tx])
+                continue;
+
+            int py0 = max(y0, ty * OCCLUSION_TILE), py1 = min(y1, ty * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+            int px0 = max(x0, tx * OCCLUSION_TILE), px1 = min(x1, tx * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+            for (int y = py0; y <= py1; y++) {
+                const float* row = &depth[(size_t)y * widthPixels];
+                for (int x = px0; x <= px1; x++) {
+                    if (minZ <= row[x])
+                        return VISIBLE;
+                }
+            }
+        }
+    }
+    return OCCLUDED;
+}
+
+/**
+ * @brief Returns the width of the depth buffer in pixels.
+ */
+int OcclusionCuller::width() const {
+    return widthPixels;
+}
+
+/**
+ * @brief Returns the height of the depth buffer in pixels.
+ */
+int OcclusionCuller::height() const {
+    return heightPixels;
+}
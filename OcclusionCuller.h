@@ -0,0 +1,97 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: OcclusionCuller.h
+ *
+ * Description:
+ * Header file for the OcclusionCuller class, a software occlusion culler in the style of
+ * masked occlusion culling. A few large occluders are rasterized into a small depth
+ * buffer on the CPU, four pixels at a time with SSE2, and every object's bounding box is
+ * then tested against it before it is submitted to the GPU.
+ *
+ * Next to the depth buffer every OCCLUSION_TILE square tile keeps its farthest depth, so
+ * most hidden boxes are rejected from a handful of tiles without reading any pixels. Box
+ * tests are conservative: the box's nearest depth is compared, and its screen rectangle
+ * is grown by a pixel so that occluder edges, which are only sampled at pixel centers,
+ * never hide anything that is partly visible.
+ *
+ * When the occluder mesh is closed only the faces turned towards the camera are drawn,
+ * which halves the work and still covers the whole silhouette.
+ *
+ * Dependencies:
+ * - GLM (OpenGL Mathematics)
+ * - JobSystem.h
+ * - TriangleSetup.h
+ */
+
+#ifndef DATORGRAFIK_OCCLUSIONCULLER_H
+#define DATORGRAFIK_OCCLUSIONCULLER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "JobSystem.h"
+#include "TriangleSetup.h"
+
+#define OCCLUSION_WIDTH 256         // Depth buffer width in pixels, the height follows the aspect ratio
+#define OCCLUSION_TILE 8
+#define OCCLUSION_MAX_OCCLUDERS 16
+#define OCCLUSION_MIN_OCCLUDER_SIZE 0.05f   // Smallest occluder, in screen heights
+
+class OcclusionCuller {
+
+public:
+
+    enum Visibility { VISIBLE, OCCLUDED, OUTSIDE };
+
+    OcclusionCuller();
+
+    void setOccluderMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+
+    void begin(const glm::mat4& viewProjection, float aspect);
+    void addOccluder(const glm::mat4& model);
+    void rasterize(JobSystem& jobs);
+
+    Visibility testBox(const glm::mat4& model, const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+    int width() const;
+    int height() const;
+
+    // Statistics for the latest frame
+    int occluderCount;
+    int occluderTriangles;
+    float rasterMs;
+
+private:
+
+    // Depth is a plane over the screen like the edge functions
+    struct ScreenTriangle : ScreenEdges {
+        float zA, zB, zC;
+    };
+
+    std::vector<glm::vec3> meshPositions;
+    std::vector<unsigned int> meshIndices;
+    float frontWinding;             // Sign of the front faces' clip space winding, 0 to keep both sides
+
+    glm::mat4 viewProjection;
+    std::vector<glm::mat4> occluders;
+    std::vector<std::vector<glm::vec4>> clipVertices;
+    std::vector<std::vector<ScreenTriangle>> triangles;
+
+    int widthPixels;
+    int heightPixels;
+    int tilesX;
+    int tilesY;
+    std::vector<float> depth;       // NDC depth, cleared to the far plane
+    std::vector<float> tileMax;     // Farthest depth in each tile
+
+    void setupOccluder(size_t occluder);
+    void setupTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c,
+                       std::vector<ScreenTriangle>& out) const;
+    void rasterizeBand(size_t band);
+
+};
+
+#endif //DATORGRAFIK_OCCLUSIONCULLER_H
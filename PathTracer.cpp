@@ -0,0 +1,401 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: PathTracer.cpp
+ *
+ * Description:
+ * Implementation file for the PathTracer class.
+ *
+ * Dependencies:
+ * - "PathTracer.h"
+ */
+
+#include "PathTracer.h"
+#include "Sampling.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+// Background where primary rays miss, the clear color of the window
+#define PATH_BACKGROUND 0.2f
+
+// Bounces after which paths are ended by russian roulette
+#define PATH_ROULETTE_BOUNCE 2
+
+#define PATH_FAR 1e30f
+
+namespace {
+
+inline uint32_t packColor(const glm::vec3& c) {
+    glm::vec3 v = glm::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f;
+    return (uint32_t)v.r | ((uint32_t)v.g << 8) | ((uint32_t)v.b << 16) | 0xFF000000u;
+}
+
+}
+
+/**
+ * @brief Creates the path tracer, it traces on the workers of the JobSystem.
+ */
+PathTracer::PathTracer() : jobs(JobSystem::get()) {
+    samples = 0;
+    raysPerSecond = 0.0;
+    bvhBuildMs = 0.0f;
+    bvhNodes = 0;
+
+    widthPixels = 0;
+    heightPixels = 0;
+
+    hasScene = false;
+    sceneRevision = 0;
+    sceneModel = glm::mat4(1.0f);
+    epsilon = 1e-4f;
+
+    viewProjection = glm::mat4(1.0f);
+    inverseViewProjection = glm::mat4(1.0f);
+
+    material = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f };
+    light = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), false };
+    texture = nullptr;
+    bounces = 0;
+}
+
+/**
+ * @brief Sets the mesh to trace, the hierarchy is rebuilt only when it has changed.
+ *
+ * @param mesh Mesh in model space, as given to the SoftwareRenderer.
+ * @param model Model matrix putting the mesh in world space.
+ * @param revision Changes whenever the mesh data changes.
+ */
+void PathTracer::setScene(const RasterMesh& mesh, const glm::mat4& model, unsigned int revision) {
+    if (hasScene && revision == sceneRevision && model == sceneModel)
+        return;
+    hasScene = true;
+    sceneRevision = revision;
+    sceneModel = model;
+
+    auto start = chrono::steady_clock::now();
+
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+    positions.resize(mesh.vertexCount);
+    normals.resize(mesh.vertexCount);
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (size_t i = 0; i < mesh.vertexCount; i++) {
+        positions[i] = glm::vec3(model * glm::vec4(mesh.positions[i], 1.0f));
+        normals[i] = normalMatrix * mesh.normals[i];
+        lo = glm::min(lo, positions[i]);
+        hi = glm::max(hi, positions[i]);
+    }
+    if (mesh.texCoords)
+        texCoords.assign(mesh.texCoords, mesh.texCoords + mesh.vertexCount);
+    else
+        texCoords.clear();
+    indices.assign(mesh.indices, mesh.indices + mesh.indexCount);
+    epsilon = 1e-4f * max(glm::length(hi - lo), 1e-3f);
+
+    bvh.build(positions.data(), indices.data(), indices.size() / 3, jobs);
+
+    bvhBuildMs = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+    bvhNodes = bvh.nodeCount();
+    reset();
+}
+
+/**
+ * @brief Sets the camera, the image starts over if it has moved.
+ */
+void PathTracer::setCamera(const glm::mat4& view, const glm::mat4& projection) {
+    glm::mat4 matrix = projection * view;
+    if (matrix == viewProjection)
+        return;
+    viewProjection = matrix;
+    inverseViewProjection = glm::inverse(matrix);
+    reset();
+}
+
+/**
+ * @brief Sets the material, the main light and the number of diffuse bounces.
+ *
+ * @param texture Diffuse texture or nullptr, it must stay alive while it is used.
+ */
+void PathTracer::setShading(const RasterMaterial& material, const RasterLight& light, const RasterTexture* texture,
+                            int bounces) {
+    if (material.ambient == this->material.ambient && material.diffuse == this->material.diffuse &&
+        material.specular == this->material.specular && material.shininess == this->material.shininess &&
+        light.ambient == this->light.ambient && light.color == this->light.color &&
+        light.position == this->light.position && light.directional == this->light.directional &&
+        texture == this->texture && bounces == this->bounces)
+        return;
+
+    this->material = material;
+    this->light = light;
+    this->texture = texture;
+    this->bounces = bounces;
+    reset();
+}
+
+void PathTracer::resize(int width, int height) {
+    if (width == widthPixels && height == heightPixels)
+        return;
+    widthPixels = width;
+    heightPixels = height;
+    accumulation.resize((size_t)width * height);
+    color.resize((size_t)width * height);
+    reset();
+}
+
+/**
+ * @brief Adds samples to the image for about budgetMs milliseconds, at least one.
+ *
+ * Nothing is traced once PATH_MAX_SAMPLES samples have been taken.
+ */
+void PathTracer::render(float budgetMs) {
+    if (!hasScene || bvh.empty() || widthPixels == 0 || heightPixels == 0 || samples >= PATH_MAX_SAMPLES)
+        return;
+
+    auto start = chrono::steady_clock::now();
+    uint64_t rays = 0;
+    float elapsedMs = 0.0f;
+    do {
+        renderSample();
+        for (uint64_t count : tileRays)
+            rays += count;
+        elapsedMs = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+    } while (elapsedMs < budgetMs && samples < PATH_MAX_SAMPLES);
+    raysPerSecond = rays / max(elapsedMs * 1e-3, 1e-6);
+
+    float scale = 1.0f / samples;
+    jobs.parallelFor((size_t)heightPixels, [&](size_t y) {
+        size_t row = y * widthPixels;
+        for (int x = 0; x < widthPixels; x++)
+            color[row + x] = packColor(accumulation[row + x] * scale);
+    });
+}
+
+int PathTracer::width() const {
+    return widthPixels;
+}
+
+int PathTracer::height() const {
+    return heightPixels;
+}
+
+const vector<uint32_t>& PathTracer::colorBuffer() const {
+    return color;
+}
+
+/**
+ * @brief Clears the accumulated samples.
+ */
+void PathTracer::reset() {
+    samples = 0;
+    fill(accumulation.begin(), accumulation.end(), glm::vec3(0.0f));
+}
+
+/**
+ * @brief Traces one path per pixel over the whole image.
+ */
+void PathTracer::renderSample() {
+    size_t tilesX = (widthPixels + PATH_TILE_SIZE - 1) / PATH_TILE_SIZE;
+    size_t tilesY = (heightPixels + PATH_TILE_SIZE - 1) / PATH_TILE_SIZE;
+    tileRays.assign(tilesX * tilesY, 0);
+    jobs.parallelFor(tilesX * tilesY, [this](size_t tile) { renderTile(tile); });
+    samples++;
+}
+
+/**
+ * @brief Traces one sample for the pixels of a tile, as packets of two by two pixels.
+ */
+void PathTracer::renderTile(size_t tile) {
+    int tilesX = (widthPixels + PATH_TILE_SIZE - 1) / PATH_TILE_SIZE;
+    int x0 = (int)(tile % tilesX) * PATH_TILE_SIZE;
+    int y0 = (int)(tile / tilesX) * PATH_TILE_SIZE;
+    int x1 = min(x0 + PATH_TILE_SIZE, widthPixels);
+    int y1 = min(y0 + PATH_TILE_SIZE, heightPixels);
+
+    uint32_t sampleSeed = hashSeed((uint32_t)samples * 0x9E3779B9u + 1u);
+    uint64_t rays = 0;
+    for (int y = y0; y < y1; y += 2) {
+        for (int x = x0; x < x1; x += 2) {
+            int pixelX[4] = { x, x + 1, x, x + 1 };
+            int pixelY[4] = { y, y, y + 1, y + 1 };
+            int mask = 0;
+            PathLane lanes[4];
+            for (int i = 0; i < 4; i++) {
+                if (pixelX[i] < x1 && pixelY[i] < y1) {
+                    mask |= 1 << i;
+                    uint32_t pixel = (uint32_t)(pixelY[i] * widthPixels + pixelX[i]);
+                    lanes[i].random = hashSeed(pixel ^ sampleSeed) | 1u;
+                }
+            }
+
+            tracePacket(pixelX, pixelY, mask, lanes, rays);
+
+            for (int i = 0; i < 4; i++) {
+                if (mask & (1 << i))
+                    accumulation[(size_t)pixelY[i] * widthPixels + pixelX[i]] += lanes[i].radiance;
+            }
+        }
+    }
+    tileRays[tile] = rays;
+}
+
+/**
+ * @brief Traces the paths of up to four pixels together.
+ *
+ * @param pixelX Pixel columns.
+ * @param pixelY Pixel rows, counted from the top.
+ * @param mask Lanes that hold a pixel.
+ * @param lanes Receive the radiance of each path.
+ * @param rays Incremented by the number of rays cast.
+ *
+ * At every hit the main light is sampled with a shadow ray and shaded like fshader.glsl,
+ * then the path continues in a cosine weighted direction with the diffuse color as its
+ * albedo. Paths leaving the scene see the ambient color.
+ */
+void PathTracer::tracePacket(const int pixelX[4], const int pixelY[4], int mask, PathLane lanes[4], uint64_t& rays) const {
+    RayPacket packet;
+    packet.mask = mask;
+    for (int i = 0; i < 4; i++) {
+        lanes[i].throughput = glm::vec3(1.0f);
+        lanes[i].radiance = glm::vec3(0.0f);
+        if (!(mask & (1 << i))) {
+            packet.originX[i] = packet.originY[i] = packet.originZ[i] = 0.0f;
+            packet.directionX[i] = packet.directionY[i] = packet.directionZ[i] = 1.0f;
+            packet.tMax[i] = 0.0f;
+            continue;
+        }
+
+        // Jittered point within the pixel, through the near and far planes
+        float sx = (pixelX[i] + nextRandom(lanes[i].random)) / widthPixels;
+        float sy = (pixelY[i] + nextRandom(lanes[i].random)) / heightPixels;
+        glm::vec4 nearPoint = inverseViewProjection * glm::vec4(2.0f * sx - 1.0f, 1.0f - 2.0f * sy, -1.0f, 1.0f);
+        glm::vec4 farPoint = inverseViewProjection * glm::vec4(2.0f * sx - 1.0f, 1.0f - 2.0f * sy, 1.0f, 1.0f);
+        glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+        glm::vec3 ray = glm::vec3(farPoint) / farPoint.w - origin;
+        float length = glm::length(ray);
+        glm::vec3 direction = ray / length;
+
+        packet.originX[i] = origin.x;
+        packet.originY[i] = origin.y;
+        packet.originZ[i] = origin.z;
+        packet.directionX[i] = direction.x;
+        packet.directionY[i] = direction.y;
+        packet.directionZ[i] = direction.z;
+        packet.tMax[i] = length;
+    }
+
+    const bool textured = texture && texture->width > 0 && texCoords.size() == positions.size();
+
+    for (int bounce = 0; packet.mask != 0; bounce++) {
+        PacketHit hit;
+        bvh.intersect(packet, hit);
+        rays += packetRayCount(packet.mask);
+
+        RayPacket shadow;
+        shadow.mask = 0;
+        glm::vec3 direct[4];
+
+        for (int i = 0; i < 4; i++) {
+            int bit = 1 << i;
+            if (!(packet.mask & bit))
+                continue;
+            PathLane& lane = lanes[i];
+
+            if (hit.triangle[i] < 0) {
+                lane.radiance += lane.throughput * (bounce == 0 ? glm::vec3(PATH_BACKGROUND) : light.ambient);
+                packet.mask &= ~bit;
+                continue;
+            }
+
+            const unsigned int* tri = &indices[3 * (size_t)hit.triangle[i]];
+            float w1 = hit.u[i], w2 = hit.v[i], w0 = 1.0f - w1 - w2;
+            glm::vec3 direction(packet.directionX[i], packet.directionY[i], packet.directionZ[i]);
+            glm::vec3 position(packet.originX[i], packet.originY[i], packet.originZ[i]);
+            position += direction * hit.t[i];
+
+            // Both sides of the surface are lit, the normals are turned towards the ray
+            glm::vec3 geometric = glm::cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+            if (glm::dot(geometric, direction) > 0.0f)
+                geometric = -geometric;
+            geometric = glm::normalize(geometric);
+            glm::vec3 normal = normals[tri[0]] * w0 + normals[tri[1]] * w1 + normals[tri[2]] * w2;
+            float normalLength = glm::length(normal);
+            normal = normalLength > 0.0f ? normal / normalLength : geometric;
+            if (glm::dot(normal, geometric) < 0.0f)
+                normal = -normal;
+
+            glm::vec4 surface(1.0f);
+            if (textured)
+                surface = sampleTexture(*texture, texCoords[tri[0]] * w0 + texCoords[tri[1]] * w1 + texCoords[tri[2]] * w2);
+            glm::vec3 offsetOrigin = position + geometric * epsilon;
+
+            // Main light, the Phong terms of fshader.glsl
+            if (light.color != glm::vec3(0.0f)) {
+                glm::vec3 toLight = light.directional ? light.position : light.position - position;
+                float distance = light.directional ? PATH_FAR : glm::length(toLight);
+                glm::vec3 light_position = glm::normalize(toLight);
+                float cosine = glm::dot(normal, light_position);
+                if (cosine > 0.0f && distance > epsilon) {
+                    glm::vec3 r = glm::reflect(-light_position, normal);
+                    glm::vec3 diffuse = cosine * light.color * material.diffuse;
+                    float highlight = pow(max(glm::dot(r, -direction), 0.0f), (float)(int)material.shininess);
+                    glm::vec3 specular = max(glm::dot(diffuse, glm::vec3(1.0f)), 0.0f) * highlight * light.color * material.specular;
+                    direct[i] = lane.throughput * (diffuse + specular) * glm::vec3(surface);
+
+                    shadow.mask |= bit;
+                    shadow.originX[i] = offsetOrigin.x;
+                    shadow.originY[i] = offsetOrigin.y;
+                    shadow.originZ[i] = offsetOrigin.z;
+                    shadow.directionX[i] = light_position.x;
+                    shadow.directionY[i] = light_position.y;
+                    shadow.directionZ[i] = light_position.z;
+                    shadow.tMax[i] = distance - epsilon;
+                }
+            }
+
+            // Continue the path, or end it after the last bounce
+            glm::vec3 next = sampleCosineHemisphere(normal, nextRandom(lane.random), nextRandom(lane.random));
+            lane.throughput *= material.diffuse * glm::vec3(surface);
+            bool alive = bounce < bounces && glm::dot(next, geometric) > 0.0f;
+            if (alive && bounce >= PATH_ROULETTE_BOUNCE) {
+                float keep = glm::clamp(max(lane.throughput.r, max(lane.throughput.g, lane.throughput.b)), 0.05f, 0.95f);
+                if (nextRandom(lane.random) < keep)
+                    lane.throughput /= keep;
+                else
+                    alive = false;
+            }
+            if (!alive) {
+                packet.mask &= ~bit;
+                continue;
+            }
+            packet.originX[i] = offsetOrigin.x;
+            packet.originY[i] = offsetOrigin.y;
+            packet.originZ[i] = offsetOrigin.z;
+            packet.directionX[i] = next.x;
+            packet.directionY[i] = next.y;
+            packet.directionZ[i] = next.z;
+            packet.tMax[i] = PATH_FAR;
+        }
+
+        if (shadow.mask) {
+            for (int i = 0; i < 4; i++) {
+                if (!(shadow.mask & (1 << i))) {
+                    shadow.originX[i] = shadow.originY[i] = shadow.originZ[i] = 0.0f;
+                    shadow.directionX[i] = shadow.directionY[i] = shadow.directionZ[i] = 1.0f;
+                    shadow.tMax[i] = 0.0f;
+                }
+            }
+            int blocked = bvh.occluded(shadow);
+            rays += packetRayCount(shadow.mask);
+            for (int i = 0; i < 4; i++) {
+                if ((shadow.mask & ~blocked) & (1 << i))
+                    lanes[i].radiance += direct[i];
+            }
+        }
+    }
+}
@@ -0,0 +1,109 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: PathTracer.h
+ *
+ * Description:
+ * Header file for the PathTracer class, a progressive CPU path tracer that renders
+ * reference images of the scene GeometryRender draws.
+ *
+ * The mesh is put in world space and ray cast through a Bvh. The main light is sampled
+ * directly with shadow rays and shaded with the same Phong terms as fshader.glsl, and
+ * indirect light is gathered by diffuse bounces, with the ambient color as the light of
+ * the sky. Every call adds samples to an accumulation buffer until the view, scene or
+ * shading changes, so the image refines while the camera stands still.
+ *
+ * Tiles of the image are traced in parallel on the JobSystem, two by two pixels at a
+ * time as one ray packet.
+ *
+ * Dependencies:
+ * - GLM (OpenGL Mathematics)
+ * - Bvh.h, SoftwareRenderer.h, JobSystem.h
+ */
+
+#ifndef DATORGRAFIK_PATHTRACER_H
+#define DATORGRAFIK_PATHTRACER_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "SoftwareRenderer.h"
+#include "JobSystem.h"
+
+#define PATH_TILE_SIZE 16
+#define PATH_MAX_SAMPLES 1024
+
+class PathTracer {
+
+public:
+
+    PathTracer();
+
+    void setScene(const RasterMesh& mesh, const glm::mat4& model, unsigned int revision);
+    void setCamera(const glm::mat4& view, const glm::mat4& projection);
+    void setShading(const RasterMaterial& material, const RasterLight& light, const RasterTexture* texture,
+                    int bounces);
+    void resize(int width, int height);
+
+    void render(float budgetMs);
+
+    int width() const;
+    int height() const;
+
+    // Packed RGBA8 (R in the lowest byte), top row first
+    const std::vector<uint32_t>& colorBuffer() const;
+
+    // Statistics
+    int samples;
+    double raysPerSecond;
+    float bvhBuildMs;
+    size_t bvhNodes;
+
+private:
+
+    // Path state of one ray of a packet
+    struct PathLane {
+        glm::vec3 throughput;
+        glm::vec3 radiance;
+        uint32_t random;
+    };
+
+    JobSystem& jobs;
+    Bvh bvh;
+
+    int widthPixels;
+    int heightPixels;
+    std::vector<glm::vec3> accumulation;
+    std::vector<uint32_t> color;
+    std::vector<uint64_t> tileRays;
+
+    // Scene in world space
+    bool hasScene;
+    unsigned int sceneRevision;
+    glm::mat4 sceneModel;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texCoords;
+    std::vector<unsigned int> indices;
+    float epsilon;
+
+    glm::mat4 viewProjection;
+    glm::mat4 inverseViewProjection;
+
+    RasterMaterial material;
+    RasterLight light;
+    const RasterTexture* texture;
+    int bounces;
+
+    void reset();
+    void renderSample();
+    void renderTile(size_t tile);
+    void tracePacket(const int pixelX[4], const int pixelY[4], int mask, PathLane lanes[4], uint64_t& rays) const;
+
+};
+
+#endif //DATORGRAFIK_PATHTRACER_H
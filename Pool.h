@@ -0,0 +1,102 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: Pool.h
+ *
+ * Description:
+ * Header file for the Pool class, an allocator for many small objects of one type that
+ * are created and destroyed all the time, such as the jobs of the JobSystem. Objects are
+ * carved from blocks of POOL_BLOCK_OBJECTS and destroyed objects go on a free list to be
+ * reused, so the heap is only visited when the pool grows. Blocks are kept until the pool
+ * is destroyed. The pool is thread safe, its lock is only held to take or give back a slot.
+ *
+ * Dependencies:
+ * - C++11 standard library
+ */
+
+#ifndef DATORGRAFIK_POOL_H
+#define DATORGRAFIK_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Objects in each block a pool takes from the heap
+#define POOL_BLOCK_OBJECTS 256
+
+template<typename T>
+class Pool {
+
+public:
+
+    Pool() : freeList(nullptr), liveCount(0) {}
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    // Objects still alive are not destroyed, only their memory is freed
+    ~Pool() = default;
+
+    template<typename... ARGS>
+    T* create(ARGS&&... args) {
+        Slot* slot;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!freeList)
+                grow();
+            slot = freeList;
+            freeList = slot->next;
+            liveCount++;
+        }
+        return new (&slot->storage) T(std::forward<ARGS>(args)...);
+    }
+
+    void destroy(T* object) {
+        if (!object)
+            return;
+        object->~T();
+        Slot* slot = reinterpret_cast<Slot*>(object);
+        std::lock_guard<std::mutex> lock(mutex);
+        slot->next = freeList;
+        freeList = slot;
+        liveCount--;
+    }
+
+    size_t live() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return liveCount;
+    }
+    size_t capacity() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return blocks.size() * POOL_BLOCK_OBJECTS;
+    }
+
+private:
+
+    union Slot {
+        Slot* next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    mutable std::mutex mutex;
+    Slot* freeList;
+    std::vector<std::unique_ptr<Slot[]>> blocks;
+    size_t liveCount;
+
+    void grow() {
+        Slot* block = new Slot[POOL_BLOCK_OBJECTS];
+        blocks.emplace_back(block);
+        for (size_t i = 0; i < POOL_BLOCK_OBJECTS; i++) {
+            block[i].next = freeList;
+            freeList = &block[i];
+        }
+    }
+
+};
+
+#endif //DATORGRAFIK_POOL_H
@@ -0,0 +1,332 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: Profiler.cpp
+ *
+ * Description:
+ * Implementation file for the Profiler class.
+ *
+ * Dependencies:
+ * - "Profiler.h"
+ */
+
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+Profiler Profiler::instance;
+
+/**
+ * @brief Constructor for the Profiler class, disabled and without any scopes.
+ */
+Profiler::Profiler() {
+    enabled = false;
+    frameNumber = 0;
+    current = Counters();
+    counters = Counters();
+    frameLog = nullptr;
+    frameLogStart = 0;
+    cpuHistoryIndex = 0;
+    gpuHistoryIndex = 0;
+    cpuHistoryCount = 0;
+    gpuHistoryCount = 0;
+    fill(cpuFrameHistory, cpuFrameHistory + PROFILER_HISTORY, 0.0f);
+    fill(gpuFrameHistory, gpuFrameHistory + PROFILER_HISTORY, 0.0f);
+    cpuFrameAverage = cpuFrameMaximum = 0.0f;
+    gpuFrameAverage = gpuFrameMaximum = 0.0f;
+    for (GpuFrame& frame : gpuFrames) {
+        frame.usedQueries = 0;
+        frame.number = 0;
+        frame.pending = false;
+    }
+    gpuSlot = 0;
+    gpuAccepting = false;
+}
+
+/**
+ * @brief Starts measuring a frame.
+ *
+ * @param enable Whether the frame is measured. The setting holds until the next frame,
+ *        so scopes always begin and end under the same setting.
+ *
+ * The thread calling it is taken as the main thread. The GPU passes of earlier frames
+ * whose results have arrived are read.
+ */
+void Profiler::beginFrame(bool enable) {
+    mainThread = this_thread::get_id();
+    enabled = enable;
+    if (!enabled)
+        return;
+
+    frameStart = Clock::now();
+    current = Counters();
+    for (Scope& scope : scopeList) {
+        if (!scope.gpu)
+            scope.frameMs = 0.0;
+    }
+
+    collectGpu();
+    gpuSlot = (int)(frameNumber % PROFILER_GPU_FRAMES);
+    GpuFrame& frame = gpuFrames[gpuSlot];
+    gpuAccepting = !frame.pending;
+    if (gpuAccepting) {
+        frame.passes.clear();
+        frame.usedQueries = 0;
+        frame.number = frameNumber;
+    }
+    gpuStack.clear();
+}
+
+/**
+ * @brief Finishes the frame and adds it to the history.
+ */
+void Profiler::endFrame() {
+    if (!enabled)
+        return;
+
+    cpuHistoryIndex = (cpuHistoryIndex + 1) % PROFILER_HISTORY;
+    cpuHistoryCount = min(cpuHistoryCount + 1, PROFILER_HISTORY);
+    chrono::duration<double, milli> frameTime = Clock::now() - frameStart;
+    cpuFrameHistory[cpuHistoryIndex] = (float)frameTime.count();
+    summarize(cpuFrameHistory, cpuHistoryIndex, cpuHistoryCount, cpuFrameAverage, cpuFrameMaximum);
+    if (frameLog != nullptr)
+        frameLog->cpuMs.push_back((float)frameTime.count());
+
+    for (Scope& scope : scopeList) {
+        if (scope.gpu)
+            continue;
+        scope.history[cpuHistoryIndex] = (float)scope.frameMs;
+        summarize(scope.history, cpuHistoryIndex, cpuHistoryCount, scope.average, scope.maximum);
+    }
+    counters = current;
+
+    if (gpuAccepting && !gpuFrames[gpuSlot].passes.empty())
+        gpuFrames[gpuSlot].pending = true;
+    frameNumber++;
+}
+
+/**
+ * @brief Opens a CPU scope under the innermost open one.
+ *
+ * @return False when called from another thread than the main loop's, nothing is recorded then.
+ */
+bool Profiler::beginScope(const char* name) {
+    if (this_thread::get_id() != mainThread)
+        return false;
+    int parent = cpuStack.empty() ? -1 : cpuStack.back().scope;
+    OpenScope open;
+    open.scope = findScope(name, parent, false);
+    open.start = Clock::now();
+    cpuStack.push_back(open);
+    return true;
+}
+
+/**
+ * @brief Closes the innermost CPU scope and adds its time to the frame.
+ */
+void Profiler::endScope() {
+    if (cpuStack.empty())
+        return;
+    OpenScope open = cpuStack.back();
+    cpuStack.pop_back();
+    chrono::duration<double, milli> time = Clock::now() - open.start;
+    scopeList[open.scope].frameMs += time.count();
+}
+
+/**
+ * @brief Opens a GPU pass under the innermost open one, with a timestamp query.
+ *
+ * @return False when the pass is not measured, because it is not on the main thread or
+ *         this frame's queries are still in flight.
+ */
+bool Profiler::beginGpuScope(const char* name) {
+    if (!gpuAccepting || this_thread::get_id() != mainThread)
+        return false;
+    GpuFrame& frame = gpuFrames[gpuSlot];
+    int parent = gpuStack.empty() ? -1 : frame.passes[gpuStack.back()].scope;
+
+    GpuPass pass;
+    pass.scope = findScope(name, parent, true);
+    pass.begin = nextQuery(frame);
+    pass.end = 0;
+    glQueryCounter(pass.begin, GL_TIMESTAMP);
+    gpuStack.push_back((int)frame.passes.size());
+    frame.passes.push_back(pass);
+    return true;
+}
+
+/**
+ * @brief Closes the innermost GPU pass with a timestamp query.
+ */
+void Profiler::endGpuScope() {
+    if (gpuStack.empty())
+        return;
+    GpuFrame& frame = gpuFrames[gpuSlot];
+    GpuPass& pass = frame.passes[gpuStack.back()];
+    gpuStack.pop_back();
+    pass.end = nextQuery(frame);
+    glQueryCounter(pass.end, GL_TIMESTAMP);
+}
+
+/**
+ * @brief Logs the times of the frames from the next one on, nullptr stops logging.
+ *
+ * The log must outlive the logging. GPU times are added when their results are read,
+ * finishGpu() reads the ones still in flight.
+ */
+void Profiler::setFrameLog(FrameLog* log) {
+    frameLog = log;
+    frameLogStart = frameNumber;
+}
+
+/**
+ * @brief Waits for the GPU and reads all frames still in flight.
+ */
+void Profiler::finishGpu() {
+    bool pending = false;
+    for (const GpuFrame& frame : gpuFrames)
+        pending = pending || frame.pending;
+    if (!pending)
+        return;
+    glFinish();
+    collectGpu();
+}
+
+/**
+ * @brief Returns all scopes, in the order they were first seen.
+ */
+const vector<Profiler::Scope>& Profiler::scopes() const {
+    return scopeList;
+}
+
+/**
+ * @brief Returns the oldest entry of the CPU histories, the offset for ImGui::PlotLines.
+ */
+int Profiler::cpuHistoryOffset() const {
+    return (cpuHistoryIndex + 1) % PROFILER_HISTORY;
+}
+
+/**
+ * @brief Returns the oldest entry of the GPU histories, the offset for ImGui::PlotLines.
+ */
+int Profiler::gpuHistoryOffset() const {
+    return (gpuHistoryIndex + 1) % PROFILER_HISTORY;
+}
+
+/**
+ * @brief Returns the scope with a name under a parent, created when it is new.
+ */
+int Profiler::findScope(const char* name, int parent, bool gpu) {
+    for (size_t i = 0; i < scopeList.size(); i++) {
+        const Scope& scope = scopeList[i];
+        if (scope.parent == parent && scope.gpu == gpu && (scope.name == name || strcmp(scope.name, name) == 0))
+            return (int)i;
+    }
+
+    Scope scope;
+    scope.name = name;
+    scope.parent = parent;
+    scope.depth = parent < 0 ? 0 : scopeList[parent].depth + 1;
+    scope.gpu = gpu;
+    scope.frameMs = 0.0;
+    fill(scope.history, scope.history + PROFILER_HISTORY, 0.0f);
+    scope.average = 0.0f;
+    scope.maximum = 0.0f;
+    scopeList.push_back(scope);
+    return (int)scopeList.size() - 1;
+}
+
+/**
+ * @brief Returns an unused query of a frame, creating one when all are used.
+ */
+GLuint Profiler::nextQuery(GpuFrame& frame) {
+    if (frame.usedQueries == frame.queries.size()) {
+        GLuint query;
+        glGenQueries(1, &query);
+        frame.queries.push_back(query);
+    }
+    return frame.queries[frame.usedQueries++];
+}
+
+/**
+ * @brief Reads the frames in flight whose results have arrived, oldest first.
+ *
+ * Timestamps complete in order, so a frame is done when its last query is.
+ */
+void Profiler::collectGpu() {
+    while (true) {
+        GpuFrame* oldest = nullptr;
+        for (GpuFrame& frame : gpuFrames) {
+            if (frame.pending && (oldest == nullptr || frame.number < oldest->number))
+                oldest = &frame;
+        }
+        if (oldest == nullptr)
+            return;
+
+        GLint available = 0;
+        glGetQueryObjectiv(oldest->queries[oldest->usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+        readGpuFrame(*oldest);
+        oldest->pending = false;
+    }
+}
+
+/**
+ * @brief Adds the pass times of a finished frame to the GPU history.
+ */
+void Profiler::readGpuFrame(GpuFrame& frame) {
+    for (Scope& scope : scopeList) {
+        if (scope.gpu)
+            scope.frameMs = 0.0;
+    }
+
+    double frameMs = 0.0;
+    for (const GpuPass& pass : frame.passes) {
+        if (pass.end == 0)
+            continue;
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(pass.begin, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(pass.end, GL_QUERY_RESULT, &end);
+        double ms = end > begin ? (end - begin) / 1.0e6 : 0.0;
+        scopeList[pass.scope].frameMs += ms;
+        if (scopeList[pass.scope].parent < 0)
+            frameMs += ms;
+    }
+
+    gpuHistoryIndex = (gpuHistoryIndex + 1) % PROFILER_HISTORY;
+    gpuHistoryCount = min(gpuHistoryCount + 1, PROFILER_HISTORY);
+    gpuFrameHistory[gpuHistoryIndex] = (float)frameMs;
+    if (frameLog != nullptr && frame.number >= frameLogStart)
+        frameLog->gpuMs.push_back((float)frameMs);
+    summarize(gpuFrameHistory, gpuHistoryIndex, gpuHistoryCount, gpuFrameAverage, gpuFrameMaximum);
+    for (Scope& scope : scopeList) {
+        if (!scope.gpu)
+            continue;
+        scope.history[gpuHistoryIndex] = (float)scope.frameMs;
+        summarize(scope.history, gpuHistoryIndex, gpuHistoryCount, scope.average, scope.maximum);
+    }
+}
+
+/**
+ * @brief Computes the average and the maximum of the newest entries of a history.
+ *
+ * @param history The ring of PROFILER_HISTORY entries.
+ * @param newest Index of the newest entry.
+ * @param count Number of entries recorded so far, at most PROFILER_HISTORY.
+ */
+void Profiler::summarize(const float* history, int newest, int count, float& average, float& maximum) {
+    float sum = 0.0f;
+    maximum = 0.0f;
+    for (int i = 0; i < count; i++) {
+        float value = history[(newest - i + PROFILER_HISTORY) % PROFILER_HISTORY];
+        sum += value;
+        maximum = max(maximum, value);
+    }
+    average = count > 0 ? sum / count : 0.0f;
+}
@@ -0,0 +1,236 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: Profiler.h
+ *
+ * Description:
+ * Header file for the Profiler class, a hierarchical frame profiler for the main loop.
+ *
+ * CPU time is measured by ProfileScope objects, which time the block they live in and
+ * nest under the scope open when they are created. GPU time is measured per render pass
+ * by GpuProfileScope objects, with a GL_TIMESTAMP query at either end. The queries of
+ * PROFILER_GPU_FRAMES frames are in flight at once and a frame is only read once all its
+ * results are available, so the GPU is never waited for. When the oldest frame is still
+ * in flight the GPU passes of the current frame go unmeasured.
+ *
+ * Every scope keeps PROFILER_HISTORY frames of history for the graphs, its average and
+ * its maximum. Draw calls, triangles and state changes are counted per frame where the
+ * draw code reports them. A FrameLog keeps the time of every frame, for benchmarks.
+ *
+ * While the profiler is disabled, which it is by default, a scope costs one test of a
+ * flag. Defining PROFILER_DISABLED compiles the macros out entirely. Scopes are only
+ * measured on the thread running the main loop. On every thread they are also handed
+ * to the TraceRecorder while it records.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ * - C++11 threads and chrono
+ * - "TraceRecorder.h"
+ */
+
+#ifndef DATORGRAFIK_PROFILER_H
+#define DATORGRAFIK_PROFILER_H
+
+#include "TraceRecorder.h"
+#include <GL/glew.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Frames kept for the graphs, the averages and the maxima
+#define PROFILER_HISTORY 240
+
+// Frames of GPU queries in flight, the most frames the GPU results lag behind
+#define PROFILER_GPU_FRAMES 3
+
+class Profiler {
+
+public:
+
+    struct Scope {
+        const char* name;       // Must outlive the profiler, normally a string literal
+        int parent;             // Index of the enclosing scope, -1 at the top
+        int depth;
+        bool gpu;
+        double frameMs;         // Accumulated over the frame being measured
+        float history[PROFILER_HISTORY];
+        float average;
+        float maximum;
+    };
+
+    struct Counters {
+        int drawCalls;
+        long long triangles;
+        int stateChanges;       // Program, vertex array, framebuffer and texture binds
+    };
+
+    // Whole frame times, in milliseconds, of every frame measured while it is set
+    struct FrameLog {
+        std::vector<float> cpuMs;
+        std::vector<float> gpuMs;
+    };
+
+    static Profiler& get() { return instance; }
+    bool isEnabled() const { return enabled; }
+
+    void beginFrame(bool enable);
+    void endFrame();
+
+    bool beginScope(const char* name);
+    void endScope();
+    bool beginGpuScope(const char* name);
+    void endGpuScope();
+
+    void countDraws(int calls, long long triangles) {
+        if (enabled) {
+            current.drawCalls += calls;
+            current.triangles += triangles;
+        }
+    }
+    void countStateChanges(int changes) {
+        if (enabled)
+            current.stateChanges += changes;
+    }
+
+    void setFrameLog(FrameLog* log);
+    void finishGpu();
+
+    const std::vector<Scope>& scopes() const;
+    int cpuHistoryOffset() const;
+    int gpuHistoryOffset() const;
+
+    // Whole frames, in the same rings as the scopes
+    float cpuFrameHistory[PROFILER_HISTORY];
+    float gpuFrameHistory[PROFILER_HISTORY];    // Sum of the outermost GPU passes
+    float cpuFrameAverage;
+    float cpuFrameMaximum;
+    float gpuFrameAverage;
+    float gpuFrameMaximum;
+
+    // Counts of the last finished frame
+    Counters counters;
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct OpenScope {
+        int scope;
+        Clock::time_point start;
+    };
+
+    struct GpuPass {
+        int scope;
+        GLuint begin;
+        GLuint end;
+    };
+
+    // Queries of one frame, reused once its results are read
+    struct GpuFrame {
+        std::vector<GpuPass> passes;
+        std::vector<GLuint> queries;
+        size_t usedQueries;
+        unsigned int number;
+        bool pending;
+    };
+
+    static Profiler instance;
+
+    bool enabled;
+    std::thread::id mainThread;
+    Clock::time_point frameStart;
+    unsigned int frameNumber;
+    Counters current;
+    FrameLog* frameLog;
+    unsigned int frameLogStart;         // First frame logged, GPU results of earlier ones arrive late
+
+    std::vector<Scope> scopeList;
+    std::vector<OpenScope> cpuStack;
+    std::vector<int> gpuStack;          // Open passes of the current GPU frame
+    int cpuHistoryIndex;                // Newest entry
+    int gpuHistoryIndex;
+    int cpuHistoryCount;                // Entries recorded, up to PROFILER_HISTORY
+    int gpuHistoryCount;
+
+    GpuFrame gpuFrames[PROFILER_GPU_FRAMES];
+    int gpuSlot;
+    bool gpuAccepting;
+
+    Profiler();
+
+    int findScope(const char* name, int parent, bool gpu);
+    GLuint nextQuery(GpuFrame& frame);
+    void collectGpu();
+    void readGpuFrame(GpuFrame& frame);
+    static void summarize(const float* history, int newest, int count, float& average, float& maximum);
+
+};
+
+/*
+ * Times the enclosing block on the CPU, under the scope open when it is created, and
+ * traces it.
+ */
+class ProfileScope {
+
+public:
+
+    explicit ProfileScope(const char* name) : trace(name) {
+        active = Profiler::get().isEnabled() && Profiler::get().beginScope(name);
+    }
+    ~ProfileScope() {
+        if (active)
+            Profiler::get().endScope();
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+
+    TraceScope trace;
+    bool active;
+
+};
+
+/*
+ * Times the GL commands issued in the enclosing block on the GPU.
+ */
+class GpuProfileScope {
+
+public:
+
+    explicit GpuProfileScope(const char* name) {
+        active = Profiler::get().isEnabled() && Profiler::get().beginGpuScope(name);
+    }
+    ~GpuProfileScope() {
+        if (active)
+            Profiler::get().endGpuScope();
+    }
+
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+private:
+
+    bool active;
+
+};
+
+#ifdef PROFILER_DISABLED
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#define PROFILE_DRAWS(calls, triangles) ((void)0)
+#define PROFILE_STATE_CHANGES(changes) ((void)0)
+#else
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILER_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope PROFILER_CONCAT(gpuProfileScope, __LINE__)(name)
+#define PROFILE_DRAWS(calls, triangles) Profiler::get().countDraws(calls, triangles)
+#define PROFILE_STATE_CHANGES(changes) Profiler::get().countStateChanges(changes)
+#endif
+
+#endif //DATORGRAFIK_PROFILER_H
@@ -0,0 +1,370 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: ProgramCache.cpp
+ *
+ * Description:
+ * Implementation file for the ProgramCache class and the shader program build functions
+ * used by ShaderVariants and the render passes.
+ *
+ * Dependencies:
+ * - "ProgramCache.h"
+ * - "Profiler.h"
+ */
+
+#include "ProgramCache.h"
+#include "Profiler.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+using namespace std;
+
+// Header in front of every cached binary
+struct ProgramBinaryHeader {
+    char magic[4];
+    GLenum format;
+    GLint length;
+};
+
+/**
+ * @brief Reads the vertex and fragment shader files of a program.
+ *
+ * @param vShaderFile The vertex shader file.
+ * @param fShaderFile The fragment shader file.
+ * @return The sources, named after the files.
+ *
+ * @note A missing shader file prints an error and exits, like a failed compile.
+ */
+ProgramSource readProgramSource(const string& vShaderFile, const string& fShaderFile)
+{
+    ProgramSource source;
+    source.name = vShaderFile + "/" + fShaderFile;
+
+    string files[2] = { vShaderFile, fShaderFile };
+    string* sources[2] = { &source.vertex, &source.fragment };
+    for (int i = 0; i < 2; ++i) {
+        ifstream fs(files[i]);
+        if (!fs) {
+            cerr << "Failed to read " << files[i] << endl;
+            exit(EXIT_FAILURE);
+        }
+        stringstream text;
+        text << fs.rdbuf();
+        *sources[i] = text.str();
+    }
+    return source;
+}
+
+/**
+ * @brief Reads the compute shader file of a program.
+ *
+ * @param cShaderFile The compute shader file.
+ * @return The source, named after the file.
+ *
+ * @note A missing shader file prints an error and exits, like a failed compile.
+ */
+ProgramSource readComputeSource(const string& cShaderFile)
+{
+    ProgramSource source;
+    source.name = cShaderFile;
+
+    ifstream fs(cShaderFile);
+    if (!fs) {
+        cerr << "Failed to read " << cShaderFile << endl;
+        exit(EXIT_FAILURE);
+    }
+    stringstream text;
+    text << fs.rdbuf();
+    source.compute = text.str();
+    return source;
+}
+
+/**
+ * @brief Issues compilation and linking of a shader program without waiting for the result.
+ *
+ * @param source The program's name and shader sources.
+ * @return The program, which has to be passed to checkProgram() before use.
+ */
+GLuint issueProgram(const ProgramSource& source)
+{
+    GLuint program = glCreateProgram();
+
+    struct shaders_t{
+        const string* source;
+        GLenum   type;
+    };
+
+    shaders_t shaders[3] = {
+        { &source.vertex, GL_VERTEX_SHADER },
+        { &source.fragment, GL_FRAGMENT_SHADER },
+        { &source.compute, GL_COMPUTE_SHADER }
+    };
+
+    for (int i = 0; i < 3; ++i ) {
+        if (shaders[i].source->empty())
+            continue;
+        GLuint shader = glCreateShader( shaders[i].type );
+        const char *shaderSrc = shaders[i].source->c_str();
+        glShaderSource( shader, 1, &shaderSrc, NULL );
+        glCompileShader( shader );
+        glAttachShader( program, shader );
+    }
+
+    glProgramParameteri( program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+    glLinkProgram( program );
+
+    return program;
+}
+
+/**
+ * @brief Waits for a program issued with issueProgram() and checks that it compiled and linked.
+ *
+ * @param program The program.
+ * @param name Name used in error messages, typically the shader file names.
+ *
+ * @note Like the rest of the start up code, compile and link errors print the info log
+ *       and exit the program. The shader objects are released once the program is linked.
+ */
+void checkProgram(GLuint program, const string& name)
+{
+    GLint  linked;
+    GLint  count;
+    GLuint shaders[3];
+
+    glGetProgramiv( program, GL_LINK_STATUS, &linked );
+    glGetAttachedShaders( program, 3, &count, shaders );
+
+    if ( !linked ) {
+        GLint  logSize;
+
+        for (int i = 0; i < count; ++i ) {
+            GLint  compiled;
+            glGetShaderiv( shaders[i], GL_COMPILE_STATUS, &compiled );
+            if ( compiled )
+                continue;
+
+            cerr << "Failed to compile " << name << endl;
+            glGetShaderiv( shaders[i], GL_INFO_LOG_LENGTH, &logSize );
+            if (logSize > 0) {
+                char logMsg[logSize+1];
+                glGetShaderInfoLog( shaders[i], logSize, nullptr, &(logMsg[0]) );
+                cerr << "Shader info log: " << logMsg << endl;
+            }
+            exit( EXIT_FAILURE );
+        }
+
+        cerr << "Shader program " << name << " failed to link!" << endl;
+
+        glGetProgramiv( program, GL_INFO_LOG_LENGTH, &logSize);
+        if ( logSize > 0 ) {
+            char logMsg[logSize+1];
+            glGetProgramInfoLog( program, logSize, NULL, &(logMsg[0]) );
+            cerr << "Program info log: " << logMsg << endl;
+        }
+        exit( EXIT_FAILURE );
+    }
+
+    for (int i = 0; i < count; ++i ) {
+        glDetachShader( program, shaders[i] );
+        glDeleteShader( shaders[i] );
+    }
+}
+
+/**
+ * @brief Compiles and links a shader program from vertex and fragment shader sources.
+ *
+ * @param vShaderSource Source of the vertex shader.
+ * @param fShaderSource Source of the fragment shader.
+ * @param name Name used in error messages, typically the shader file names.
+ * @return The linked program.
+ */
+GLuint buildProgram(const string& vShaderSource, const string& fShaderSource, const string& name)
+{
+    ProgramSource source = { name, vShaderSource, fShaderSource, "" };
+    GLuint program = issueProgram(source);
+    checkProgram(program, name);
+    return program;
+}
+
+/**
+ * @brief Default constructor for the ProgramCache class.
+ */
+ProgramCache::ProgramCache() {
+    enabled = false;
+    loadedFromDisk = 0;
+    compiled = 0;
+}
+
+/**
+ * @brief Prepares the cache for the current OpenGL context.
+ *
+ * @param cacheDir Directory the program binaries are stored in, created if missing.
+ *
+ * Caching is disabled if the driver offers no program binary formats.
+ * Parallel shader compilation is switched on when the driver supports it.
+ */
+void ProgramCache::init(const string& cacheDir) {
+    this->cacheDir = cacheDir;
+
+    driver = string((const char*)glGetString(GL_VENDOR)) + "\n" +
+             string((const char*)glGetString(GL_RENDERER)) + "\n" +
+             string((const char*)glGetString(GL_VERSION));
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    enabled = formats > 0;
+
+#ifdef _WIN32
+    _mkdir(cacheDir.c_str());
+#else
+    mkdir(cacheDir.c_str(), 0755);
+#endif
+
+#ifdef GL_KHR_parallel_shader_compile
+    if (GLEW_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+#endif
+}
+
+/**
+ * @brief Returns a linked program for one set of sources, from disk if possible.
+ */
+GLuint ProgramCache::build(const ProgramSource& source) {
+    return build(vector<ProgramSource>(1, source))[0];
+}
+
+/**
+ * @brief Returns linked programs for several sets of sources.
+ *
+ * @param sources The programs to build.
+ * @return The programs, in the same order as the sources.
+ *
+ * Cached binaries are tried first. All remaining programs are issued for compilation
+ * before the first status query, then checked and written to the cache.
+ */
+vector<GLuint> ProgramCache::build(const vector<ProgramSource>& sources) {
+    PROFILE_SCOPE("Build programs");
+    vector<GLuint> programs(sources.size(), 0);
+    vector<string> files(sources.size());
+
+    for (size_t i = 0; i < sources.size(); i++) {
+        files[i] = cacheFile(sources[i]);
+        if (enabled)
+            programs[i] = load(files[i]);
+        if (programs[i] != 0)
+            loadedFromDisk++;
+    }
+
+    vector<size_t> issued;
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (programs[i] == 0) {
+            programs[i] = issueProgram(sources[i]);
+            issued.push_back(i);
+        }
+    }
+
+    // Waits for the driver to finish compiling and linking
+    PROFILE_SCOPE("Compile programs");
+    for (size_t i : issued) {
+        checkProgram(programs[i], sources[i].name);
+        if (enabled)
+            store(programs[i], files[i]);
+        compiled++;
+    }
+
+    return programs;
+}
+
+/**
+ * @brief Builds the cache file name from the driver strings and the shader sources.
+ */
+string ProgramCache::cacheFile(const ProgramSource& source) const {
+    unsigned long long key = hash(driver, 14695981039346656037ull);
+    key = hash(source.vertex, key);
+    key = hash(source.fragment, key);
+    key = hash(source.compute, key);
+
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", key);
+    return cacheDir + "/" + name + ".bin";
+}
+
+/**
+ * @brief Loads a program binary from disk.
+ *
+ * @return The program, or 0 if there is no cached binary or the driver rejected it.
+ *         Rejected binaries are removed so they are rebuilt.
+ */
+GLuint ProgramCache::load(const string& file) {
+    ifstream fs(file, ios::binary);
+    if (!fs)
+        return 0;
+
+    ProgramBinaryHeader header;
+    fs.read((char*)&header, sizeof(header));
+    if (!fs || string(header.magic, 4) != "3DSP" || header.length <= 0)
+        return 0;
+
+    vector<char> binary(header.length);
+    fs.read(binary.data(), header.length);
+    if (!fs)
+        return 0;
+    fs.close();
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), header.length);
+
+    GLint linked;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glDeleteProgram(program);
+        remove(file.c_str());
+        return 0;
+    }
+    return program;
+}
+
+/**
+ * @brief Writes a linked program's binary to disk.
+ */
+void ProgramCache::store(GLuint program, const string& file) {
+    ProgramBinaryHeader header = { {'3', 'D', 'S', 'P'}, 0, 0 };
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+    if (header.length <= 0)
+        return;
+
+    vector<char> binary(header.length);
+    glGetProgramBinary(program, header.length, nullptr, &header.format, binary.data());
+
+    ofstream fs(file, ios::binary);
+    if (!fs) {
+        cerr << "Could not write shader cache " << file << endl;
+        return;
+    }
+    fs.write((const char*)&header, sizeof(header));
+    fs.write(binary.data(), header.length);
+}
+
+/**
+ * @brief FNV-1a hash, chained through the seed.
+ */
+unsigned long long ProgramCache::hash(const string& data, unsigned long long seed) {
+    unsigned long long h = seed;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    // Separate consecutive strings so "ab"+"c" and "a"+"bc" differ
+    h ^= 0xff;
+    h *= 1099511628211ull;
+    return h;
+}
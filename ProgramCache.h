@@ -0,0 +1,71 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: ProgramCache.h
+ *
+ * Description:
+ * Header file for the ProgramCache class and the shader program build functions.
+ * Linked programs are stored on disk with glGetProgramBinary, keyed by a hash of their
+ * sources (defines included) and the driver's vendor, renderer and version strings,
+ * so later runs skip compilation. Programs that are not cached, or whose binary the driver
+ * rejects, are compiled in one batch: every compile and link is issued before any status
+ * is queried, which lets drivers with KHR_parallel_shader_compile work on them in parallel.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ */
+
+#ifndef DATORGRAFIK_PROGRAMCACHE_H
+#define DATORGRAFIK_PROGRAMCACHE_H
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+
+// A program has either a vertex and a fragment shader, or only a compute shader
+struct ProgramSource {
+    std::string name;
+    std::string vertex;
+    std::string fragment;
+    std::string compute;
+};
+
+ProgramSource readProgramSource(const std::string& vShaderFile, const std::string& fShaderFile);
+ProgramSource readComputeSource(const std::string& cShaderFile);
+GLuint issueProgram(const ProgramSource& source);
+void checkProgram(GLuint program, const std::string& name);
+GLuint buildProgram(const std::string& vShaderSource, const std::string& fShaderSource, const std::string& name);
+
+class ProgramCache {
+
+public:
+
+    ProgramCache();
+
+    void init(const std::string& cacheDir);
+
+    GLuint build(const ProgramSource& source);
+    std::vector<GLuint> build(const std::vector<ProgramSource>& sources);
+
+    // Statistics for the latest runs
+    int loadedFromDisk;
+    int compiled;
+
+private:
+
+    std::string cacheDir;
+    std::string driver;
+    bool enabled;
+
+    std::string cacheFile(const ProgramSource& source) const;
+    GLuint load(const std::string& file);
+    void store(GLuint program, const std::string& file);
+
+    static unsigned long long hash(const std::string& data, unsigned long long seed);
+
+};
+
+#endif //DATORGRAFIK_PROGRAMCACHE_H
@@ -0,0 +1,110 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: ResidencyManager.cpp
+ *
+ * Description:
+ * Implementation file for the ResidencyManager class.
+ *
+ * Dependencies:
+ * - "ResidencyManager.h"
+ */
+
+#include "ResidencyManager.h"
+#include <algorithm>
+
+using namespace std;
+
+ResidencyManager ResidencyManager::instance;
+
+/**
+ * @brief Registers a resource, which holds no bytes until setBytes() and counts as used this frame.
+ *
+ * @param name Name the resource is listed under.
+ * @param evict Called to free the GPU copy of the resource, which must then set its bytes to 0
+ *              or remove it. The resource is not touched while it is evicted.
+ * @return The id the resource is reported under.
+ */
+int ResidencyManager::add(const string& name, const function<void()>& evict) {
+    Resource& resource = entries[nextId];
+    resource.name = name;
+    resource.bytes = 0;
+    resource.lastUsedFrame = frame;
+    resource.evict = evict;
+    return nextId++;
+}
+
+/**
+ * @brief Forgets a resource, for instance once its owner has deleted it.
+ */
+void ResidencyManager::remove(int id) {
+    auto it = entries.find(id);
+    if (it == entries.end())
+        return;
+    total -= it->second.bytes;
+    entries.erase(it);
+}
+
+/**
+ * @brief Sets the bytes a resource holds on the GPU, 0 once it has been evicted.
+ */
+void ResidencyManager::setBytes(int id, size_t bytes) {
+    auto it = entries.find(id);
+    if (it == entries.end())
+        return;
+    total = total - it->second.bytes + bytes;
+    it->second.bytes = bytes;
+}
+
+/**
+ * @brief Marks a resource as used in the current frame, which keeps it resident.
+ */
+void ResidencyManager::touch(int id) {
+    auto it = entries.find(id);
+    if (it != entries.end())
+        it->second.lastUsedFrame = frame;
+}
+
+/**
+ * @brief Evicts resources while over budget and starts the next frame, called once per frame.
+ *
+ * Resources not used this frame are evicted least recently used first, and of those used
+ * equally long ago the largest first, so that as few as possible have to be uploaded again.
+ */
+void ResidencyManager::update() {
+    if (total > budget) {
+        candidates.clear();
+        for (const auto& entry : entries) {
+            if (entry.second.bytes > 0 && entry.second.lastUsedFrame != frame)
+                candidates.push_back(entry.first);
+        }
+        sort(candidates.begin(), candidates.end(), [this](int a, int b) {
+            const Resource& ra = entries[a];
+            const Resource& rb = entries[b];
+            if (ra.lastUsedFrame != rb.lastUsedFrame)
+                return ra.lastUsedFrame < rb.lastUsedFrame;
+            return ra.bytes > rb.bytes;
+        });
+
+        for (int id : candidates) {
+            if (total <= budget)
+                break;
+            auto it = entries.find(id);
+            if (it == entries.end())
+                continue;
+
+            // The callback may remove the resource, and with it the callback itself
+            size_t before = total;
+            function<void()> evict = it->second.evict;
+            evict();
+            if (total < before) {
+                evictions++;
+                evictedBytes += before - total;
+            }
+        }
+    }
+    frame++;
+}
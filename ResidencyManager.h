@@ -0,0 +1,82 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: ResidencyManager.h
+ *
+ * Description:
+ * Header file for the ResidencyManager class, which keeps the meshes and textures resident
+ * in VRAM within one budget. Every resource is registered by its owner with a callback
+ * that evicts it, and the owner reports the bytes it holds on the GPU and touches it in
+ * every frame it is drawn. At the end of a frame update() evicts the least recently used
+ * resources that were not drawn in that frame, until the total is within the budget.
+ *
+ * Evicting only gives up the GPU copy. The owner keeps what it needs to upload the
+ * resource again, a CPU copy or the path to load it from, and does so when the resource is
+ * used next. Resources drawn in the current frame are never evicted, so the budget can be
+ * exceeded by what is on screen. The manager is not thread safe, it is used from the thread
+ * of the context like the resources it manages.
+ *
+ * Dependencies:
+ * - C++11 standard library
+ */
+
+#ifndef DATORGRAFIK_RESIDENCYMANAGER_H
+#define DATORGRAFIK_RESIDENCYMANAGER_H
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// VRAM budget of the meshes and textures together until another is set
+#define RESIDENCY_DEFAULT_BUDGET (512u << 20)
+
+class ResidencyManager {
+
+public:
+
+    struct Resource {
+        std::string name;
+        size_t bytes;
+        unsigned int lastUsedFrame;
+        std::function<void()> evict;
+    };
+
+    static ResidencyManager& get() { return instance; }
+
+    int add(const std::string& name, const std::function<void()>& evict);
+    void remove(int id);
+    void setBytes(int id, size_t bytes);
+    void touch(int id);
+
+    void update();
+
+    size_t residentBytes() const { return total; }
+    unsigned int currentFrame() const { return frame; }
+    const std::map<int, Resource>& resources() const { return entries; }
+
+    size_t budget = RESIDENCY_DEFAULT_BUDGET;
+
+    // Evictions that freed memory, and the bytes they freed, since the start
+    unsigned int evictions = 0;
+    size_t evictedBytes = 0;
+
+private:
+
+    static ResidencyManager instance;
+
+    std::map<int, Resource> entries;
+    int nextId = 0;
+    size_t total = 0;
+    unsigned int frame = 0;
+
+    // Resources in the order update() evicts them, kept to reuse its memory every frame
+    std::vector<int> candidates;
+
+};
+
+#endif //DATORGRAFIK_RESIDENCYMANAGER_H
@@ -0,0 +1,191 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: ResolutionScaler.cpp
+ *
+ * Description:
+ * Implementation file for the ResolutionScaler class.
+ *
+ * Dependencies:
+ * - "ResolutionScaler.h"
+ * - "Profiler.h"
+ * - "MemoryTracker.h"
+ */
+
+#include "ResolutionScaler.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * @brief Default constructor for the ResolutionScaler class.
+ */
+ResolutionScaler::ResolutionScaler() {
+    upscaleProgram = 0;
+    framebuffer = 0;
+    colorTexture = 0;
+    depthBuffer = 0;
+    emptyVao = 0;
+    locRenderSize = -1;
+    locSharpness = -1;
+    for (GLint& value : viewport)
+        value = 0;
+    targetWidth = 0;
+    targetHeight = 0;
+    active = false;
+    scale = 1.0f;
+    sceneMs = 0.0f;
+    renderWidth = 0;
+    renderHeight = 0;
+}
+
+/**
+ * @brief Creates the framebuffer and the timer.
+ *
+ * @param upscaleProgram The program built from upscale_vshader.glsl and upscale_fshader.glsl.
+ *
+ * The attachments are created by the first begin(), once the window size is known.
+ */
+void ResolutionScaler::init(GLuint upscaleProgram) {
+    this->upscaleProgram = upscaleProgram;
+    locRenderSize = glGetUniformLocation(upscaleProgram, "renderSize");
+    locSharpness = glGetUniformLocation(upscaleProgram, "sharpness");
+    glUseProgram(upscaleProgram);
+    glUniform1i(glGetUniformLocation(upscaleProgram, "scene"), 0);
+    glUseProgram(0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glGenVertexArrays(1, &emptyVao);
+    timer.init();
+}
+
+/**
+ * @brief Deletes the framebuffer and its attachments.
+ */
+void ResolutionScaler::release() {
+    MemoryTracker::get().releaseGpu(GL_TEXTURE, colorTexture);
+    MemoryTracker::get().releaseGpu(GL_RENDERBUFFER, depthBuffer);
+    glDeleteTextures(1, &colorTexture);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteVertexArrays(1, &emptyVao);
+    colorTexture = depthBuffer = framebuffer = emptyVao = 0;
+    targetWidth = targetHeight = 0;
+}
+
+/**
+ * @brief Allocates the attachments for the largest scale.
+ *
+ * The texture bound to the active unit is kept, it may be the object's texture.
+ */
+void ResolutionScaler::resize(int width, int height) {
+    MemoryTracker::get().releaseGpu(GL_TEXTURE, colorTexture);
+    MemoryTracker::get().releaseGpu(GL_RENDERBUFFER, depthBuffer);
+    glDeleteTextures(1, &colorTexture);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    targetWidth = width;
+    targetHeight = height;
+
+    GLint boundTexture;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+    glGenTextures(1, &colorTexture);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, (GLuint)boundTexture);
+
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    MemoryTracker::get().trackGpu(GL_TEXTURE, colorTexture, "Dynamic resolution color", (size_t)width * height * 4);
+    MemoryTracker::get().trackGpu(GL_RENDERBUFFER, depthBuffer, "Dynamic resolution depth", (size_t)width * height * 4);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        cerr << "Dynamic resolution framebuffer is incomplete" << endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+/**
+ * @brief Picks this frame's scale and binds the framebuffer with the viewport set to it.
+ *
+ * @param budgetMs GPU time the scene may take.
+ * @param minScale Smallest scale of the window size.
+ * @param maxScale Largest scale of the window size.
+ *
+ * The viewport in effect is taken as the window size. The framebuffer is cleared.
+ */
+void ResolutionScaler::begin(float budgetMs, float minScale, float maxScale) {
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] <= 0 || viewport[3] <= 0 || upscaleProgram == 0)
+        return;
+
+    if (timer.collect()) {
+        sceneMs = timer.milliseconds;
+        float ratio = budgetMs / max(sceneMs, 0.01f);
+        if (fabs(1.0f - ratio) > RESOLUTION_DEAD_BAND)
+            scale += (scale * sqrt(ratio) - scale) * RESOLUTION_SMOOTHING;
+    }
+    maxScale = max(minScale, maxScale);
+    scale = min(max(scale, minScale), maxScale);
+
+    int width = max(1, (int)(viewport[2] * maxScale + 0.5f));
+    int height = max(1, (int)(viewport[3] * maxScale + 0.5f));
+    if (width != targetWidth || height != targetHeight)
+        resize(width, height);
+    renderWidth = min(targetWidth, max(1, (int)(viewport[2] * scale + 0.5f)));
+    renderHeight = min(targetHeight, max(1, (int)(viewport[3] * scale + 0.5f)));
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    PROFILE_STATE_CHANGES(1);
+    glViewport(0, 0, renderWidth, renderHeight);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    timer.begin();
+    active = true;
+}
+
+/**
+ * @brief Draws the scaled frame into the window and restores the viewport.
+ *
+ * @param sharpness Strength of the sharpening, from 0 to 1.
+ *
+ * Leaves the upscale program in use.
+ */
+void ResolutionScaler::end(float sharpness) {
+    if (!active)
+        return;
+    active = false;
+    timer.end();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(upscaleProgram);
+    glUniform2f(locRenderSize, (float)renderWidth, (float)renderHeight);
+    glUniform1f(locSharpness, sharpness);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glBindVertexArray(emptyVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    PROFILE_DRAWS(1, 1);
+    PROFILE_STATE_CHANGES(4);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (depthTest)
+        glEnable(GL_DEPTH_TEST);
+}
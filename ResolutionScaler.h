@@ -0,0 +1,76 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: ResolutionScaler.h
+ *
+ * Description:
+ * Header file for the ResolutionScaler class, which keeps the GPU time of the scene
+ * within a budget by changing the resolution it is rendered at.
+ *
+ * The scene is drawn into an offscreen framebuffer, at a scale of the window size that
+ * follows the GpuTimer's measurements of earlier frames. The time is taken to grow with
+ * the pixel count, so the scale moves towards the square root of budget over time, with
+ * some smoothing and a dead band so it settles. The framebuffer is allocated for the
+ * largest scale and only the lower left part is drawn to, so changing the scale costs
+ * nothing. The result is upscaled into the window with a sharpening filter
+ * (upscale_vshader.glsl and upscale_fshader.glsl), after which the GUI is drawn at the
+ * window's resolution as usual.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ * - GpuTimer.h
+ */
+
+#ifndef DATORGRAFIK_RESOLUTIONSCALER_H
+#define DATORGRAFIK_RESOLUTIONSCALER_H
+
+#include <GL/glew.h>
+#include "GpuTimer.h"
+
+// Fraction of the way to the wanted scale taken per measurement
+#define RESOLUTION_SMOOTHING 0.3f
+
+// Measurements within this fraction of the budget leave the scale alone
+#define RESOLUTION_DEAD_BAND 0.05f
+
+class ResolutionScaler {
+
+public:
+
+    ResolutionScaler();
+
+    void init(GLuint upscaleProgram);
+    void release();
+    void begin(float budgetMs, float minScale, float maxScale);
+    void end(float sharpness);
+
+    // Statistics for the latest frame
+    float scale;
+    float sceneMs;
+    int renderWidth;
+    int renderHeight;
+
+private:
+
+    GLuint upscaleProgram;
+    GLuint framebuffer;
+    GLuint colorTexture;
+    GLuint depthBuffer;
+    GLuint emptyVao;
+    GLint locRenderSize;
+    GLint locSharpness;
+
+    GpuTimer timer;
+    GLint viewport[4];
+    int targetWidth;
+    int targetHeight;
+    bool active;
+
+    void resize(int width, int height);
+
+};
+
+#endif //DATORGRAFIK_RESOLUTIONSCALER_H
@@ -0,0 +1,58 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: Sampling.h
+ *
+ * Description:
+ * Random numbers and direction sampling for the ray casting code. The generators are
+ * small and seeded explicitly so results do not depend on the thread a ray is traced on.
+ *
+ * Dependencies:
+ * - GLM (OpenGL Mathematics)
+ */
+
+#ifndef DATORGRAFIK_SAMPLING_H
+#define DATORGRAFIK_SAMPLING_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Scrambles an integer into a seed
+inline uint32_t hashSeed(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Uniform float in [0, 1) from a xorshift generator, the state must not be 0
+inline float nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+// Cosine weighted direction around the unit vector n, from two uniform numbers
+inline glm::vec3 sampleCosineHemisphere(const glm::vec3& n, float r1, float r2) {
+    float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+    float a = -1.0f / (sign + n.z);
+    float b = n.x * n.y * a;
+    glm::vec3 tangent(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+    glm::vec3 bitangent(b, sign + n.y * n.y * a, -n.y);
+
+    float phi = 2.0f * glm::pi<float>() * r1;
+    float radius = std::sqrt(r2);
+    return glm::normalize(tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi)) +
+                          n * std::sqrt(std::max(0.0f, 1.0f - r2)));
+}
+
+#endif //DATORGRAFIK_SAMPLING_H
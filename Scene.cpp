@@ -15,6 +15,8 @@
  */
 
 #include "Scene.h"
+#include <random>
+
 /**
  * @brief Default constructor for the Scene class.
  *
@@ -52,4 +54,39 @@ void Scene::sendScene() {
     glUniform3fv(locI_A, 1,  glm::value_ptr(ambientColor));
     glUniform3fv(locI_L, 1,  glm::value_ptr(lightColor));
     glUniform3fv(locL, 1,  glm::value_ptr(lightPos));
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Fills the light list with randomly placed showroom lights.
+ *
+ * @param count Number of lights.
+ * @param seed Seed for the random generator, the same seed gives the same lights.
+ *
+ * The lights are spread around the object at the origin. Every fourth light is a spot
+ * light aimed at the origin, the rest are point lights.
+ */
+void Scene::generateLights(int count, unsigned int seed) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> position(-4.0f, 4.0f);
+    std::uniform_real_distribution<float> range(0.3f, 1.2f);
+    std::uniform_real_distribution<float> hue(0.0f, 1.0f);
+
+    lights.resize(count);
+    for (int i = 0; i < count; i++) {
+        Light& light = lights[i];
+        light.position = glm::vec3(position(random), position(random), position(random));
+        light.range = range(random);
+        light.color = glm::vec3(hue(random), hue(random), hue(random)) * 0.25f;
+
+        if (i % 4 == 3) {
+            light.type = LIGHT_SPOT;
+            light.direction = glm::normalize(-light.position);
+            light.cosCutoff = std::cos(glm::radians(25.0f));
+            light.range *= 2.0f;
+        } else {
+            light.type = LIGHT_POINT;
+            light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+            light.cosCutoff = -1.0f;
+        }
+    }
+}
@@ -8,7 +8,8 @@
  * File: scene.h
  *
  * Description:
- * Header file for the Scene class, which manages the scene's lighting parameters.
+ * Header file for the Scene class, which manages the scene's lighting parameters:
+ * the main Phong light and a list of point and spot lights rendered with clustered shading.
  *
  * Dependencies:
  * - "openglwindow.h"
@@ -21,6 +22,20 @@
 
 
 #include "openglwindow.h"
+#include <vector>
+
+#define LIGHT_POINT 0.0f
+#define LIGHT_SPOT 1.0f
+
+// Laid out as three vec4 so a light list can be uploaded to a std430 buffer as is
+struct Light {
+    glm::vec3 position;
+    float range;
+    glm::vec3 color;
+    float type;
+    glm::vec3 direction;
+    float cosCutoff;
+};
 
 class Scene {
 
@@ -33,7 +48,14 @@ public:
     glm::vec3 lightColor{};
     glm::vec3 ambientColor{};
 
+    // When set, lightPos is the direction towards a light infinitely far away
+    bool lightDirectional = false;
+
+    // Point and spot lights, in addition to the main light
+    std::vector<Light> lights;
+
     void sendScene();
+    void generateLights(int count, unsigned int seed);
 
 private:
 
@@ -0,0 +1,182 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: ShaderVariants.cpp
+ *
+ * Description:
+ * Implementation file for the ShaderVariants class.
+ *
+ * Dependencies:
+ * - "ShaderVariants.h"
+ */
+
+#include "ShaderVariants.h"
+#include "ShadowMap.h"
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+/**
+ * @brief Default constructor for the ShaderVariants class.
+ */
+ShaderVariants::ShaderVariants() {
+    cache = nullptr;
+}
+
+/**
+ * @brief Reads the shader sources all variants are generated from.
+ *
+ * @param cache The program cache variants are built through.
+ * @param vShaderFile The vertex shader file.
+ * @param fShaderFile The fragment shader file.
+ */
+void ShaderVariants::init(ProgramCache* cache, const string& vShaderFile, const string& fShaderFile) {
+    this->cache = cache;
+    this->vShaderFile = vShaderFile;
+    this->fShaderFile = fShaderFile;
+    ProgramSource source = readProgramSource(vShaderFile, fShaderFile);
+    vShaderSource = source.vertex;
+    fShaderSource = source.fragment;
+}
+
+/**
+ * @brief Returns the program for a feature mask, compiling it on first use.
+ *
+ * @param features Bitwise or of SHADER_* feature bits and SHADER_LIGHTS(n).
+ * @return The linked program with its samplers bound to their texture units.
+ */
+GLuint ShaderVariants::program(unsigned int features) {
+    features = normalize(features);
+
+    auto it = programs.find(features);
+    if (it != programs.end())
+        return it->second;
+
+    GLuint program = cache->build(source(features));
+    setupProgram(program);
+
+    programs[features] = program;
+    return program;
+}
+
+/**
+ * @brief Builds several variants in one batch so their compiles can overlap.
+ *
+ * @param featureList Feature masks of the variants to build. Variants already built are skipped.
+ */
+void ShaderVariants::precompile(const vector<unsigned int>& featureList) {
+    vector<unsigned int> missing;
+    vector<ProgramSource> sources;
+
+    for (unsigned int features : featureList) {
+        features = normalize(features);
+        if (programs.count(features) || find(missing.begin(), missing.end(), features) != missing.end())
+            continue;
+        missing.push_back(features);
+        sources.push_back(source(features));
+    }
+
+    vector<GLuint> built = cache->build(sources);
+    for (size_t i = 0; i < built.size(); i++) {
+        setupProgram(built[i]);
+        programs[missing[i]] = built[i];
+    }
+}
+
+/**
+ * @brief Returns the number of compiled variants.
+ */
+size_t ShaderVariants::size() const {
+    return programs.size();
+}
+
+/**
+ * @brief Drops features that cannot be used together.
+ *
+ * Texturing and normal mapping need texture coordinates in the vertex format.
+ * Shadows and directional lighting apply to the main light only.
+ */
+unsigned int ShaderVariants::normalize(unsigned int features) {
+    if (!(features & SHADER_TEXCOORD))
+        features &= ~(SHADER_TEXTURE | SHADER_NORMAL_MAP);
+    if (!(features & SHADER_LIGHT_MASK))
+        features &= ~(SHADER_SHADOWS | SHADER_DIRECTIONAL);
+    return features;
+}
+
+/**
+ * @brief Builds the #define block for a feature mask.
+ */
+string ShaderVariants::defines(unsigned int features) {
+    ostringstream defs;
+    if (features & SHADER_TEXCOORD)
+        defs << "#define HAS_TEXCOORD\n";
+    if (features & SHADER_TEXTURE)
+        defs << "#define USE_TEXTURE\n";
+    if (features & SHADER_NORMAL_MAP)
+        defs << "#define USE_NORMAL_MAP\n";
+    if (features & SHADER_CLUSTERED)
+        defs << "#define CLUSTERED_LIGHTS\n";
+    if (features & SHADER_SHADOWS)
+        defs << "#define USE_SHADOWS\n" << "#define SHADOW_CASCADES " << SHADOW_CASCADES << "\n";
+    if (features & SHADER_DIRECTIONAL)
+        defs << "#define DIRECTIONAL_LIGHT\n";
+    if (features & SHADER_OCCLUSION)
+        defs << "#define HAS_OCCLUSION\n";
+    if (features & SHADER_INSTANCED)
+        defs << "#define GPU_INSTANCES\n";
+    defs << "#define LIGHT_COUNT " << ((features & SHADER_LIGHT_MASK) >> SHADER_LIGHT_SHIFT) << "\n";
+    return defs.str();
+}
+
+/**
+ * @brief Generates the sources of one variant.
+ */
+ProgramSource ShaderVariants::source(unsigned int features) const {
+    string defs = defines(features);
+    ProgramSource source;
+    source.name = vShaderFile + "/" + fShaderFile + " variant " + to_string(features);
+    source.vertex = insertDefines(vShaderSource, defs);
+    source.fragment = insertDefines(fShaderSource, defs);
+    return source;
+}
+
+/**
+ * @brief Binds the samplers of a new program to their texture units.
+ *
+ * Samplers never change unit, so they are set once per program.
+ */
+void ShaderVariants::setupProgram(GLuint program) {
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "ourTexture"), TEXTURE_UNIT_DIFFUSE);
+    glUniform1i(glGetUniformLocation(program, "normalMap"), TEXTURE_UNIT_NORMAL_MAP);
+    glUniform1i(glGetUniformLocation(program, "shadowMap"), TEXTURE_UNIT_SHADOW_MAP);
+    glUseProgram(0);
+}
+
+/**
+ * @brief Inserts the defines right after the #version line, which has to come first.
+ *
+ * A #line directive keeps line numbers in compile errors matching the shader file.
+ */
+string ShaderVariants::insertDefines(const string& source, const string& defines) {
+    size_t version = source.find("#version");
+    if (version == string::npos)
+        return defines + source;
+
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == string::npos)
+        return source + "\n" + defines;
+
+    int nextLine = 2;
+    for (size_t i = 0; i < version; i++) {
+        if (source[i] == '\n')
+            nextLine++;
+    }
+
+    return source.substr(0, lineEnd + 1) + defines + "#line " + to_string(nextLine) + "\n" + source.substr(lineEnd + 1);
+}
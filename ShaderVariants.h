@@ -0,0 +1,88 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: ShaderVariants.h
+ *
+ * Description:
+ * Header file for the ShaderVariants class, which builds shader permutations from one pair of
+ * shader sources. Every feature is a bit in a mask and becomes a #define in the generated
+ * source, so each draw runs a program compiled for exactly the features it uses instead of
+ * branching on uniforms. Programs are compiled on first use, or in a batch up front, and
+ * cached by their mask.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ * - ProgramCache.h
+ */
+
+#ifndef DATORGRAFIK_SHADERVARIANTS_H
+#define DATORGRAFIK_SHADERVARIANTS_H
+
+#include <GL/glew.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "ProgramCache.h"
+
+// Fixed vertex attribute locations, shared by all variants
+#define ATTRIB_POSITION 0
+#define ATTRIB_NORMAL 1
+#define ATTRIB_TEXCOORD 2
+#define ATTRIB_OCCLUSION 3
+#define ATTRIB_INSTANCE 4
+
+// Texture units used by the samplers of all variants
+#define TEXTURE_UNIT_DIFFUSE 0
+#define TEXTURE_UNIT_NORMAL_MAP 1
+#define TEXTURE_UNIT_SHADOW_MAP 2
+#define TEXTURE_UNIT_DEPTH_PYRAMID 3   // Only sampled by the compute shaders of DepthPyramid and GpuScene
+
+// Shader feature bits
+#define SHADER_TEXCOORD     (1u << 0)   // Vertex format carries texture coordinates
+#define SHADER_TEXTURE      (1u << 1)   // Modulate with the diffuse texture
+#define SHADER_NORMAL_MAP   (1u << 2)   // Perturb normals with a tangent space normal map
+#define SHADER_CLUSTERED    (1u << 3)   // Add the Scene's light list through the light clusters
+#define SHADER_SHADOWS      (1u << 4)   // Shadow the main light with the ShadowMap
+#define SHADER_DIRECTIONAL  (1u << 5)   // The main light is directional, l[0] points towards it
+#define SHADER_OCCLUSION    (1u << 6)   // Scale the ambient term by the baked occlusion attribute
+#define SHADER_INSTANCED    (1u << 7)   // Transform and material per instance from the GpuScene buffers
+
+// Number of Phong lights, stored above the feature bits
+#define SHADER_LIGHT_SHIFT 8
+#define SHADER_LIGHT_MASK (3u << SHADER_LIGHT_SHIFT)
+#define SHADER_LIGHTS(n) ((unsigned int)(n) << SHADER_LIGHT_SHIFT)
+
+class ShaderVariants {
+
+public:
+
+    ShaderVariants();
+
+    void init(ProgramCache* cache, const std::string& vShaderFile, const std::string& fShaderFile);
+    GLuint program(unsigned int features);
+    void precompile(const std::vector<unsigned int>& featureList);
+    size_t size() const;
+
+    static unsigned int normalize(unsigned int features);
+    static std::string defines(unsigned int features);
+
+private:
+
+    ProgramCache* cache;
+    std::string vShaderFile;
+    std::string fShaderFile;
+    std::string vShaderSource;
+    std::string fShaderSource;
+
+    std::map<unsigned int, GLuint> programs;
+
+    ProgramSource source(unsigned int features) const;
+    static void setupProgram(GLuint program);
+    static std::string insertDefines(const std::string& source, const std::string& defines);
+
+};
+
+#endif //DATORGRAFIK_SHADERVARIANTS_H
@@ -0,0 +1,320 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: ShadowMap.cpp
+ *
+ * Description:
+ * Implementation file for the ShadowMap class.
+ *
+ * Dependencies:
+ * - "ShadowMap.h"
+ * - "ShaderVariants.h"
+ * - "Profiler.h"
+ * - "MemoryTracker.h"
+ */
+
+#include "ShadowMap.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include "ShaderVariants.h"
+#include <glm/ext.hpp>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// Weight of the logarithmic split scheme against the uniform one
+#define CASCADE_SPLIT_LAMBDA 0.75f
+
+/**
+ * @brief Default constructor for the ShadowMap class.
+ */
+ShadowMap::ShadowMap() {
+    texture = 0;
+    framebuffer = 0;
+    depthProgram = 0;
+    layers = 0;
+    renders = 0;
+    casterRadius = 0.0f;
+    casterRevision = 0;
+    for (int i = 0; i < SHADOW_CASCADES; i++) {
+        cascadeSplits[i] = 0.0f;
+        casterVisible[i] = false;
+        rendered[i] = false;
+    }
+}
+
+/**
+ * @brief Creates the depth texture array and the framebuffer used by the shadow pass.
+ *
+ * @param depthProgram The depth only program the casters are rendered with.
+ */
+void ShadowMap::init(GLuint depthProgram) {
+    this->depthProgram = depthProgram;
+    locLightMVP = glGetUniformLocation(depthProgram, "lightMVP");
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, SHADOW_CASCADES,
+                 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    // Everything outside the map is lit
+    float border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // 24 bit depth takes 4 bytes a texel
+    MemoryTracker::get().trackGpu(GL_TEXTURE, texture, "Shadow map",
+                                  (size_t)SHADOW_MAP_SIZE * SHADOW_MAP_SIZE * SHADOW_CASCADES * 4);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+/**
+ * @brief Deletes the depth texture array and the framebuffer.
+ */
+void ShadowMap::release() {
+    MemoryTracker::get().releaseGpu(GL_TEXTURE, texture);
+    glDeleteTextures(1, &texture);
+    glDeleteFramebuffers(1, &framebuffer);
+    texture = framebuffer = 0;
+}
+
+/**
+ * @brief Looks up the shadow uniforms in a shader program.
+ *
+ * @param program The OpenGL program ID.
+ */
+void ShadowMap::setProgram(GLuint program) {
+    locShadowMatrix = glGetUniformLocation(program, "shadowMatrix");
+    locCascadeSplits = glGetUniformLocation(program, "cascadeSplits");
+    locShadowLayers = glGetUniformLocation(program, "shadowLayers");
+}
+
+/**
+ * @brief Sets the object casting shadows.
+ *
+ * @param model The caster's model matrix.
+ * @param center Center of the caster's bounding sphere, in object space.
+ * @param radius Radius of the caster's bounding sphere, in object space.
+ * @param revision Changed by the caller whenever the caster's geometry changes.
+ */
+void ShadowMap::setCaster(const glm::mat4& model, const glm::vec3& center, float radius, unsigned int revision) {
+    float scale = max(glm::length(glm::vec3(model[0])),
+                      max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    casterModel = model;
+    casterCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+    casterRadius = radius * scale;
+    casterRevision = revision;
+}
+
+/**
+ * @brief Fits a single perspective map from a point light around the caster.
+ *
+ * @param lightPos Position of the light.
+ *
+ * Shadows are switched off while the light is inside the caster's bounding sphere,
+ * since no single frustum covers it then.
+ */
+void ShadowMap::updatePointLight(const glm::vec3& lightPos) {
+    glm::vec3 toCaster = casterCenter - lightPos;
+    float distance = glm::length(toCaster);
+    if (distance <= casterRadius * 1.05f) {
+        layers = 0;
+        return;
+    }
+
+    glm::vec3 up = fabs(toCaster.y) > 0.99f * distance ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+    float fov = min(2.0f * asin(casterRadius / distance) * 1.1f, glm::radians(170.0f));
+    float nearplane = max((distance - casterRadius) * 0.9f, 0.01f);
+    float farplane = distance + casterRadius * 1.1f;
+
+    layers = 1;
+    lightMatrix[0] = glm::perspective(fov, 1.0f, nearplane, farplane) * glm::lookAt(lightPos, casterCenter, up);
+    casterVisible[0] = true;
+    cascadeSplits[0] = 0.0f;
+}
+
+/**
+ * @brief Fits the cascades of a directional light to the camera's view frustum.
+ *
+ * @param towardsLight Direction from the scene towards the light.
+ * @param view The camera's view matrix.
+ * @param projection The camera's projection matrix.
+ * @param nearplane The camera's near plane.
+ * @param farplane The camera's far plane.
+ *
+ * The depth range up to SHADOW_DISTANCE is split between the cascades with a blend of
+ * logarithmic and uniform splits. Each cascade is an orthographic box around the bounding
+ * sphere of its frustum slice. The box is snapped to whole texels and only spans the caster
+ * in depth, so it stays the same while the camera only rotates within a texel and the map
+ * can be reused.
+ */
+void ShadowMap::updateDirectionalLight(const glm::vec3& towardsLight, const glm::mat4& view,
+                                       const glm::mat4& projection, float nearplane, float farplane) {
+    if (glm::length(towardsLight) < 1e-4f) {
+        layers = 0;
+        return;
+    }
+
+    glm::vec3 direction = -glm::normalize(towardsLight);
+    glm::vec3 up = fabs(direction.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+    glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+    // Corners of the camera frustum on the near and far planes
+    glm::mat4 inverse = glm::inverse(projection * view);
+    glm::vec3 nearCorners[4], farCorners[4];
+    for (int i = 0; i < 4; i++) {
+        glm::vec2 ndc((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f);
+        glm::vec4 n = inverse * glm::vec4(ndc, -1.0f, 1.0f);
+        glm::vec4 f = inverse * glm::vec4(ndc, 1.0f, 1.0f);
+        nearCorners[i] = glm::vec3(n) / n.w;
+        farCorners[i] = glm::vec3(f) / f.w;
+    }
+
+    float shadowFar = max(min(farplane, SHADOW_DISTANCE), nearplane * 2.0f);
+    glm::vec3 caster = glm::vec3(lightView * glm::vec4(casterCenter, 1.0f));
+
+    float sliceNear = nearplane;
+    for (int c = 0; c < SHADOW_CASCADES; c++) {
+        float p = (c + 1) / (float)SHADOW_CASCADES;
+        float logSplit = nearplane * pow(shadowFar / nearplane, p);
+        float uniformSplit = nearplane + (shadowFar - nearplane) * p;
+        float sliceFar = CASCADE_SPLIT_LAMBDA * logSplit + (1.0f - CASCADE_SPLIT_LAMBDA) * uniformSplit;
+
+        glm::vec3 corners[8];
+        glm::vec3 center(0.0f);
+        for (int i = 0; i < 4; i++) {
+            corners[i] = glm::mix(nearCorners[i], farCorners[i], (sliceNear - nearplane) / (farplane - nearplane));
+            corners[i + 4] = glm::mix(nearCorners[i], farCorners[i], (sliceFar - nearplane) / (farplane - nearplane));
+            center += corners[i] + corners[i + 4];
+        }
+        center /= 8.0f;
+
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners)
+            radius = max(radius, glm::length(corner - center));
+        radius = ceil(radius * 16.0f) / 16.0f;
+
+        float texel = 2.0f * radius / SHADOW_MAP_SIZE;
+        glm::vec3 origin = glm::vec3(lightView * glm::vec4(center, 1.0f));
+        origin.x = floor(origin.x / texel) * texel;
+        origin.y = floor(origin.y / texel) * texel;
+
+        float margin = casterRadius * 0.05f + 0.01f;
+        glm::mat4 lightProj = glm::ortho(origin.x - radius, origin.x + radius,
+                                         origin.y - radius, origin.y + radius,
+                                         -(caster.z + casterRadius + margin), -(caster.z - casterRadius - margin));
+
+        lightMatrix[c] = lightProj * lightView;
+        cascadeSplits[c] = sliceFar;
+        casterVisible[c] = fabs(caster.x - origin.x) < radius + casterRadius &&
+                           fabs(caster.y - origin.y) < radius + casterRadius;
+        sliceNear = sliceFar;
+    }
+    layers = SHADOW_CASCADES;
+}
+
+/**
+ * @brief Switches shadows off.
+ */
+void ShadowMap::disable() {
+    layers = 0;
+}
+
+/**
+ * @brief Renders the layers whose light or caster changed since they were last rendered.
+ *
+ * @param drawCasters Draws the shadow casters, with their vertex array bound.
+ * @return The number of layers rendered, 0 when every layer could be reused.
+ *
+ * Layers the caster does not reach are only cleared. The current program is changed
+ * when anything is rendered, the framebuffer and viewport are restored.
+ */
+int ShadowMap::render(const function<void()>& drawCasters) {
+    int count = 0;
+    GLint viewport[4];
+    GLint previousFramebuffer = 0;
+
+    for (int layer = 0; layer < layers; layer++) {
+        if (isCurrent(layer))
+            continue;
+
+        if (count == 0) {
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+            glUseProgram(depthProgram);
+            PROFILE_STATE_CHANGES(2);
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(3.0f, 8.0f);
+        }
+
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        if (casterVisible[layer]) {
+            glm::mat4 mvp = lightMatrix[layer] * casterModel;
+            glUniformMatrix4fv(locLightMVP, 1, GL_FALSE, glm::value_ptr(mvp));
+            drawCasters();
+        }
+
+        rendered[layer] = true;
+        renderedCaster[layer] = casterVisible[layer];
+        renderedMatrix[layer] = lightMatrix[layer];
+        renderedModel[layer] = casterModel;
+        renderedRevision[layer] = casterRevision;
+        count++;
+    }
+
+    if (count > 0) {
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        PROFILE_STATE_CHANGES(1);
+        renders += count;
+    }
+    return count;
+}
+
+/**
+ * @brief Binds the shadow map and sends the light matrices to the current program.
+ */
+void ShadowMap::bind() {
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_SHADOW_MAP);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniformMatrix4fv(locShadowMatrix, SHADOW_CASCADES, GL_FALSE, glm::value_ptr(lightMatrix[0]));
+    glUniform1fv(locCascadeSplits, SHADOW_CASCADES, cascadeSplits);
+    glUniform1i(locShadowLayers, layers);
+}
+
+/**
+ * @brief Checks whether a layer still holds the shadows of the current light and caster.
+ *
+ * An empty layer stays valid whatever the light matrix, as long as it remains empty.
+ */
+bool ShadowMap::isCurrent(int layer) const {
+    if (!rendered[layer])
+        return false;
+    if (!casterVisible[layer])
+        return !renderedCaster[layer];
+    return renderedCaster[layer] &&
+           renderedMatrix[layer] == lightMatrix[layer] &&
+           renderedModel[layer] == casterModel &&
+           renderedRevision[layer] == casterRevision;
+}
@@ -0,0 +1,90 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: ShadowMap.h
+ *
+ * Description:
+ * Header file for the ShadowMap class, which renders and caches the shadow map of the Scene's
+ * main light. A point light gets one perspective map fitted around the shadow caster. A
+ * directional light gets cascaded maps, with the Camera's depth range split between the
+ * cascades. Every layer remembers the light matrix and caster state it was rendered with
+ * and is only rendered again when one of them changes, so a static scene costs no shadow
+ * passes at all.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ * - GLM (OpenGL Mathematics)
+ */
+
+#ifndef DATORGRAFIK_SHADOWMAP_H
+#define DATORGRAFIK_SHADOWMAP_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <functional>
+
+#define SHADOW_MAP_SIZE 1024
+#define SHADOW_CASCADES 3
+
+// Cascades cover at most this far from the camera, regardless of the far plane
+#define SHADOW_DISTANCE 20.0f
+
+class ShadowMap {
+
+public:
+
+    ShadowMap();
+
+    void init(GLuint depthProgram);
+    void release();
+    void setProgram(GLuint program);
+
+    void setCaster(const glm::mat4& model, const glm::vec3& center, float radius, unsigned int revision);
+    void updatePointLight(const glm::vec3& lightPos);
+    void updateDirectionalLight(const glm::vec3& towardsLight, const glm::mat4& view, const glm::mat4& projection,
+                                float nearplane, float farplane);
+    void disable();
+
+    int render(const std::function<void()>& drawCasters);
+    void bind();
+
+    // Number of shadow map layers rendered since start
+    int renders;
+
+private:
+
+    GLuint texture;
+    GLuint framebuffer;
+    GLuint depthProgram;
+    GLuint locLightMVP;
+
+    GLuint locShadowMatrix;
+    GLuint locCascadeSplits;
+    GLuint locShadowLayers;
+
+    // The layers in use: 0 (no shadows), 1 (point light) or SHADOW_CASCADES (directional light)
+    int layers;
+    glm::mat4 lightMatrix[SHADOW_CASCADES];
+    float cascadeSplits[SHADOW_CASCADES];
+    bool casterVisible[SHADOW_CASCADES];
+
+    // State each layer was last rendered with
+    glm::mat4 renderedMatrix[SHADOW_CASCADES];
+    glm::mat4 renderedModel[SHADOW_CASCADES];
+    unsigned int renderedRevision[SHADOW_CASCADES];
+    bool renderedCaster[SHADOW_CASCADES];
+    bool rendered[SHADOW_CASCADES];
+
+    glm::mat4 casterModel;
+    glm::vec3 casterCenter;
+    float casterRadius;
+    unsigned int casterRevision;
+
+    bool isCurrent(int layer) const;
+
+};
+
+#endif //DATORGRAFIK_SHADOWMAP_H
@@ -0,0 +1,460 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: SoftwareRenderer.cpp
+ *
+ * Description:
+ * Implementation file for the SoftwareRenderer class.
+ *
+ * Dependencies:
+ * - "SoftwareRenderer.h"
+ * - stb_image
+ */
+
+#include "SoftwareRenderer.h"
+#include "include/stb-master/stb_image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Triangles per binning task and vertices per transform task
+#define RASTER_TRIANGLE_CHUNK 2048
+#define RASTER_VERTEX_CHUNK 4096
+
+namespace {
+
+inline uint32_t packColor(const glm::vec4& c) {
+    glm::vec4 v = glm::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f;
+    return (uint32_t)v.r | ((uint32_t)v.g << 8) | ((uint32_t)v.b << 16) | ((uint32_t)v.a << 24);
+}
+
+}
+
+/**
+ * @brief Bilinear lookup with repeat wrapping, as the OpenGL textures are set up.
+ */
+glm::vec4 sampleTexture(const RasterTexture& texture, glm::vec2 uv) {
+    float x = uv.x * texture.width - 0.5f;
+    float y = uv.y * texture.height - 0.5f;
+    float fx = floor(x), fy = floor(y);
+    float tx = x - fx, ty = y - fy;
+
+    int x0 = ((int)fx % texture.width + texture.width) % texture.width;
+    int y0 = ((int)fy % texture.height + texture.height) % texture.height;
+    int x1 = (x0 + 1) % texture.width;
+    int y1 = (y0 + 1) % texture.height;
+
+    auto texel = [&](int tx, int ty) {
+        const unsigned char* p = &texture.rgba[((size_t)ty * texture.width + tx) * 4];
+        return glm::vec4(p[0], p[1], p[2], p[3]);
+    };
+    glm::vec4 top = glm::mix(texel(x0, y0), texel(x1, y0), tx);
+    glm::vec4 bottom = glm::mix(texel(x0, y1), texel(x1, y1), tx);
+    return glm::mix(top, bottom, ty) / 255.0f;
+}
+
+/**
+ * @brief Creates the renderer, it rasterizes on the workers of the JobSystem.
+ */
+SoftwareRenderer::SoftwareRenderer() : jobs(JobSystem::get()) {
+    widthPixels = 0;
+    heightPixels = 0;
+    tilesX = 0;
+    tilesY = 0;
+    trianglesIn = 0;
+    trianglesRasterized = 0;
+}
+
+/**
+ * @brief Sets the size of the color and depth buffers.
+ */
+void SoftwareRenderer::resize(int width, int height) {
+    if (width == widthPixels && height == heightPixels)
+        return;
+    widthPixels = max(width, 0);
+    heightPixels = max(height, 0);
+    tilesX = (widthPixels + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    tilesY = (heightPixels + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    color.assign((size_t)widthPixels * heightPixels, 0);
+    depth.assign((size_t)widthPixels * heightPixels, 1.0f);
+}
+
+/**
+ * @brief Clears the color buffer to a color and the depth buffer to the far plane.
+ */
+void SoftwareRenderer::clear(const glm::vec4& clearColor) {
+    fill(color.begin(), color.end(), packColor(clearColor));
+    fill(depth.begin(), depth.end(), 1.0f);
+}
+
+/**
+ * @brief Renders a mesh into the color and depth buffers.
+ *
+ * @param mesh The mesh.
+ * @param model The model matrix.
+ * @param view The camera's view matrix.
+ * @param projection The camera's projection matrix.
+ * @param eye The camera's position.
+ * @param material The material, as sent to fshader.glsl.
+ * @param light The main light of the scene.
+ * @param texture Diffuse texture, or nullptr for none. Needs texture coordinates in the mesh.
+ *
+ * Vertices are transformed in parallel, then triangles are clipped, set up and binned in
+ * parallel chunks, each with its own bins. Tiles are rasterized in parallel and read the
+ * chunks' bins in order, so the result does not depend on the thread timing.
+ */
+void SoftwareRenderer::draw(const RasterMesh& mesh, const glm::mat4& model, const glm::mat4& view,
+                            const glm::mat4& projection, const glm::vec3& eye, const RasterMaterial& material,
+                            const RasterLight& light, const RasterTexture* texture) {
+    size_t triangleCount = mesh.indexCount / 3;
+    trianglesIn = triangleCount;
+    trianglesRasterized = 0;
+    if (triangleCount == 0 || widthPixels == 0 || heightPixels == 0)
+        return;
+
+    glm::mat4 mvp = projection * view * model;
+    vertices.resize(mesh.vertexCount);
+    size_t vertexChunks = (mesh.vertexCount + RASTER_VERTEX_CHUNK - 1) / RASTER_VERTEX_CHUNK;
+    jobs.parallelFor(vertexChunks, [&](size_t chunk) {
+        size_t end = min(mesh.vertexCount, (chunk + 1) * RASTER_VERTEX_CHUNK);
+        for (size_t i = chunk * RASTER_VERTEX_CHUNK; i < end; i++) {
+            Vertex& v = vertices[i];
+            glm::vec4 p(mesh.positions[i], 1.0f);
+            v.clip = mvp * p;
+            v.world = glm::vec3(model * p);
+            v.normal = glm::normalize(glm::vec3(model * glm::vec4(mesh.normals[i], 0.0f)));
+            v.uv = mesh.texCoords ? mesh.texCoords[i] : glm::vec2(0.0f);
+            v.occlusion = mesh.occlusion ? mesh.occlusion[i] : 1.0f;
+        }
+    });
+
+    size_t chunks = (triangleCount + RASTER_TRIANGLE_CHUNK - 1) / RASTER_TRIANGLE_CHUNK;
+    chunkTriangles.resize(chunks);
+    chunkBins.resize(chunks);
+    jobs.parallelFor(chunks, [&](size_t chunk) {
+        vector<Triangle>& out = chunkTriangles[chunk];
+        out.clear();
+
+        size_t end = min(triangleCount, (chunk + 1) * RASTER_TRIANGLE_CHUNK);
+        for (size_t t = chunk * RASTER_TRIANGLE_CHUNK; t < end; t++) {
+            const unsigned int* idx = &mesh.indices[t * 3];
+            if (idx[0] >= mesh.vertexCount || idx[1] >= mesh.vertexCount || idx[2] >= mesh.vertexCount)
+                continue;
+            const Vertex* v[3] = { &vertices[idx[0]], &vertices[idx[1]], &vertices[idx[2]] };
+
+            // Trivially reject triangles outside one of the frustum planes
+            bool outside = false;
+            for (int axis = 0; axis < 3 && !outside; axis++) {
+                outside = (v[0]->clip[axis] > v[0]->clip.w && v[1]->clip[axis] > v[1]->clip.w &&
+                           v[2]->clip[axis] > v[2]->clip.w) ||
+                          (v[0]->clip[axis] < -v[0]->clip.w && v[1]->clip[axis] < -v[1]->clip.w &&
+                           v[2]->clip[axis] < -v[2]->clip.w);
+            }
+            if (outside)
+                continue;
+
+            if (insideClipPlanes(v[0]->clip) && insideClipPlanes(v[1]->clip) && insideClipPlanes(v[2]->clip)) {
+                setupTriangle(*v[0], *v[1], *v[2], out);
+            } else {
+                clipTriangle(*v[0], *v[1], *v[2],
+                             [](const Vertex& p, const Vertex& q, float t, Vertex& result) {
+                                 result.clip = glm::mix(p.clip, q.clip, t);
+                                 result.world = glm::mix(p.world, q.world, t);
+                                 result.normal = glm::mix(p.normal, q.normal, t);
+                                 result.uv = glm::mix(p.uv, q.uv, t);
+                                 result.occlusion = p.occlusion + (q.occlusion - p.occlusion) * t;
+                             },
+                             [&](const Vertex& a, const Vertex& b, const Vertex& c) {
+                                 setupTriangle(a, b, c, out);
+                             });
+            }
+        }
+        binTriangles(chunk);
+    });
+
+    for (const auto& triangles : chunkTriangles)
+        trianglesRasterized += triangles.size();
+
+    DrawState state;
+    state.eye = eye;
+    state.material = material;
+    state.light = light;
+    state.texture = texture;
+    state.textured = texture != nullptr && mesh.texCoords != nullptr && texture->width > 0;
+
+    jobs.parallelFor((size_t)tilesX * tilesY, [&](size_t tile) {
+        renderTile(tile, state);
+    });
+}
+
+/**
+ * @brief Loads a texture for use with draw(), cached by path.
+ *
+ * @return The texture, or nullptr if the image could not be read.
+ */
+const RasterTexture* SoftwareRenderer::loadTexture(const string& path) {
+    auto it = textures.find(path);
+    if (it != textures.end())
+        return it->second.width > 0 ? &it->second : nullptr;
+
+    RasterTexture& texture = textures[path];
+    int channels;
+    unsigned char* data = stbi_load(path.c_str(), &texture.width, &texture.height, &channels, 4);
+    if (!data) {
+        cerr << "Could not read texture: " << path << endl;
+        texture.width = texture.height = 0;
+        return nullptr;
+    }
+    texture.rgba.assign(data, data + (size_t)texture.width * texture.height * 4);
+    stbi_image_free(data);
+    return &texture;
+}
+
+int SoftwareRenderer::width() const {
+    return widthPixels;
+}
+
+int SoftwareRenderer::height() const {
+    return heightPixels;
+}
+
+const vector<uint32_t>& SoftwareRenderer::colorBuffer() const {
+    return color;
+}
+
+const vector<float>& SoftwareRenderer::depthBuffer() const {
+    return depth;
+}
+
+/**
+ * @brief Projects a clipped triangle to the screen and sets up its edge functions.
+ *
+ * Both windings are accepted, since OpenGL renders without face culling here.
+ */
+void SoftwareRenderer::setupTriangle(const Vertex& a, const Vertex& b, const Vertex& c,
+                                     vector<Triangle>& out) const {
+    const Vertex* v[3] = { &a, &b, &c };
+    glm::vec2 s[3];
+    float z[3], invW[3];
+    for (int i = 0; i < 3; i++) {
+        invW[i] = 1.0f / v[i]->clip.w;
+        glm::vec3 ndc = glm::vec3(v[i]->clip) * invW[i];
+        s[i] = glm::vec2((ndc.x * 0.5f + 0.5f) * widthPixels, (0.5f - ndc.y * 0.5f) * heightPixels);
+        z[i] = ndc.z * 0.5f + 0.5f;
+    }
+
+    Triangle tri;
+    if (!setupEdges(s, widthPixels, heightPixels, tri))
+        return;
+
+    for (int i = 0; i < 3; i++) {
+        int k = tri.order[i];
+        tri.z[i] = z[k];
+        tri.invW[i] = invW[k];
+        tri.world[i] = v[k]->world;
+        tri.normal[i] = v[k]->normal;
+        tri.uv[i] = v[k]->uv;
+        tri.occlusion[i] = v[k]->occlusion;
+    }
+    out.push_back(tri);
+}
+
+/**
+ * @brief Sorts the triangles of one chunk into the bins of the tiles their bounds touch.
+ */
+void SoftwareRenderer::binTriangles(size_t chunk) {
+    vector<vector<uint32_t>>& bins = chunkBins[chunk];
+    bins.resize((size_t)tilesX * tilesY);
+    for (auto& bin : bins)
+        bin.clear();
+
+    const vector<Triangle>& triangles = chunkTriangles[chunk];
+    for (size_t t = 0; t < triangles.size(); t++) {
+        const Triangle& tri = triangles[t];
+        for (int ty = tri.minY / RASTER_TILE_SIZE; ty <= tri.maxY / RASTER_TILE_SIZE; ty++) {
+            for (int tx = tri.minX / RASTER_TILE_SIZE; tx <= tri.maxX / RASTER_TILE_SIZE; tx++)
+                bins[ty * tilesX + tx].push_back((uint32_t)t);
+        }
+    }
+}
+
+/**
+ * @brief Rasterizes and shades one tile.
+ *
+ * Visibility is resolved first against a tile local copy of the depth buffer, keeping the
+ * nearest triangle and its barycentrics per pixel. The covered pixels are shaded afterwards.
+ */
+void SoftwareRenderer::renderTile(size_t tile, const DrawState& state) {
+    const int T = RASTER_TILE_SIZE;
+    int x0 = (int)(tile % tilesX) * T;
+    int y0 = (int)(tile / tilesX) * T;
+    int x1 = min(x0 + T, widthPixels) - 1;
+    int y1 = min(y0 + T, heightPixels) - 1;
+
+    // Padded so four wide loads at the right edge stay inside the arrays
+    float tileDepth[T * T + 4];
+    const Triangle* visible[T * T];
+    float visibleB1[T * T];
+    float visibleB2[T * T];
+
+    for (int y = y0; y <= y1; y++) {
+        memcpy(&tileDepth[(y - y0) * T], &depth[(size_t)y * widthPixels + x0], (x1 - x0 + 1) * sizeof(float));
+        for (int x = x1 - x0 + 1; x < T; x++)
+            tileDepth[(y - y0) * T + x] = 0.0f;
+    }
+    for (int i = 0; i < T * T; i++)
+        visible[i] = nullptr;
+
+    bool anyVisible = false;
+    for (size_t chunk = 0; chunk < chunkBins.size(); chunk++) {
+        const vector<Triangle>& triangles = chunkTriangles[chunk];
+        for (uint32_t index : chunkBins[chunk][tile]) {
+            const Triangle& tri = triangles[index];
+            int bx0 = max(tri.minX, x0), bx1 = min(tri.maxX, x1);
+            int by0 = max(tri.minY, y0), by1 = min(tri.maxY, y1);
+            if (bx0 > bx1 || by0 > by1)
+                continue;
+
+            // Depth is a plane over the screen as well
+            float zA = tri.z[0] * tri.edgeA[0] + tri.z[1] * tri.edgeA[1] + tri.z[2] * tri.edgeA[2];
+            float zB = tri.z[0] * tri.edgeB[0] + tri.z[1] * tri.edgeB[1] + tri.z[2] * tri.edgeB[2];
+            float zC = tri.z[0] * tri.edgeC[0] + tri.z[1] * tri.edgeC[1] + tri.z[2] * tri.edgeC[2];
+
+            for (int y = by0; y <= by1; y++) {
+                float py = y + 0.5f;
+                float* depthRow = &tileDepth[(y - y0) * T];
+                int rowOffset = (y - y0) * T;
+#ifdef __SSE2__
+                const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+                __m128 px = _mm_add_ps(_mm_set1_ps(bx0 + 0.5f), lane);
+                __m128 e[3], step[3];
+                for (int i = 0; i < 3; i++) {
+                    e[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.edgeA[i]), px),
+                                      _mm_set1_ps(tri.edgeB[i] * py + tri.edgeC[i]));
+                    step[i] = _mm_set1_ps(tri.edgeA[i] * 4.0f);
+                }
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), _mm_set1_ps(zB * py + zC));
+                __m128 zStep = _mm_set1_ps(zA * 4.0f);
+                const __m128 zero = _mm_setzero_ps();
+
+                for (int x = bx0; x <= bx1; x += 4) {
+                    __m128 inside = _mm_cmplt_ps(lane, _mm_set1_ps((float)(bx1 - x + 1)));
+                    for (int i = 0; i < 3; i++) {
+                        __m128 covered = (tri.topLeft & (1 << i)) ? _mm_cmpge_ps(e[i], zero) : _mm_cmpgt_ps(e[i], zero);
+                        inside = _mm_and_ps(inside, covered);
+                    }
+
+                    if (_mm_movemask_ps(inside)) {
+                        float* d = depthRow + (x - x0);
+                        __m128 stored = _mm_loadu_ps(d);
+                        __m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, stored));
+                        int bits = _mm_movemask_ps(pass);
+                        if (bits) {
+                            _mm_storeu_ps(d, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, stored)));
+                            float b1[4], b2[4];
+                            _mm_storeu_ps(b1, e[1]);
+                            _mm_storeu_ps(b2, e[2]);
+                            for (int k = 0; k < 4; k++) {
+                                if (bits & (1 << k)) {
+                                    visible[rowOffset + x - x0 + k] = &tri;
+                                    visibleB1[rowOffset + x - x0 + k] = b1[k];
+                                    visibleB2[rowOffset + x - x0 + k] = b2[k];
+                                }
+                            }
+                            anyVisible = true;
+                        }
+                    }
+
+                    for (int i = 0; i < 3; i++)
+                        e[i] = _mm_add_ps(e[i], step[i]);
+                    z = _mm_add_ps(z, zStep);
+                }
+#else
+                for (int x = bx0; x <= bx1; x++) {
+                    float px = x + 0.5f;
+                    float e[3];
+                    bool inside = true;
+                    for (int i = 0; i < 3; i++) {
+                        e[i] = tri.edgeA[i] * px + tri.edgeB[i] * py + tri.edgeC[i];
+                        inside = inside && ((tri.topLeft & (1 << i)) ? e[i] >= 0.0f : e[i] > 0.0f);
+                    }
+                    float z = zA * px + zB * py + zC;
+                    if (!inside || z >= depthRow[x - x0])
+                        continue;
+                    depthRow[x - x0] = z;
+                    visible[rowOffset + x - x0] = &tri;
+                    visibleB1[rowOffset + x - x0] = e[1];
+                    visibleB2[rowOffset + x - x0] = e[2];
+                    anyVisible = true;
+                }
+#endif
+            }
+        }
+    }
+
+    if (!anyVisible)
+        return;
+
+    for (int y = y0; y <= y1; y++) {
+        memcpy(&depth[(size_t)y * widthPixels + x0], &tileDepth[(y - y0) * T], (x1 - x0 + 1) * sizeof(float));
+        uint32_t* colorRow = &color[(size_t)y * widthPixels];
+        for (int x = x0; x <= x1; x++) {
+            int i = (y - y0) * T + (x - x0);
+            if (visible[i])
+                colorRow[x] = shade(*visible[i], visibleB1[i], visibleB2[i], state);
+        }
+    }
+}
+
+/**
+ * @brief Shades one pixel the way fshader.glsl does.
+ *
+ * @param tri The triangle covering the pixel.
+ * @param b1 Screen space barycentric of the triangle's second vertex.
+ * @param b2 Screen space barycentric of the triangle's third vertex.
+ */
+uint32_t SoftwareRenderer::shade(const Triangle& tri, float b1, float b2, const DrawState& state) const {
+    // Perspective correct weights
+    float w0 = (1.0f - b1 - b2) * tri.invW[0];
+    float w1 = b1 * tri.invW[1];
+    float w2 = b2 * tri.invW[2];
+    float sum = w0 + w1 + w2;
+    w0 /= sum;
+    w1 /= sum;
+    w2 /= sum;
+
+    glm::vec3 position = tri.world[0] * w0 + tri.world[1] * w1 + tri.world[2] * w2;
+    glm::vec3 normals = glm::normalize(tri.normal[0] * w0 + tri.normal[1] * w1 + tri.normal[2] * w2);
+    glm::vec3 viewers_position = glm::normalize(state.eye - position);
+
+    const RasterMaterial& m = state.material;
+    const RasterLight& l = state.light;
+    float occlusion = tri.occlusion[0] * w0 + tri.occlusion[1] * w1 + tri.occlusion[2] * w2;
+    glm::vec3 result = l.ambient * m.ambient * occlusion;
+
+    if (l.color != glm::vec3(0.0f)) {
+        glm::vec3 light_position = l.directional ? glm::normalize(l.position) : glm::normalize(l.position - position);
+        glm::vec3 r = glm::reflect(-light_position, normals);
+
+        glm::vec3 diffuse = max(glm::dot(normals, light_position), 0.0f) * l.color * m.diffuse;
+        float highlight = pow(max(glm::dot(r, viewers_position), 0.0f), (float)(int)m.shininess);
+        glm::vec3 specular = max(glm::dot(diffuse, glm::vec3(1.0f)), 0.0f) * highlight * l.color * m.specular;
+        result += diffuse + specular;
+    }
+
+    glm::vec4 fcolor(result, 1.0f);
+    if (state.textured) {
+        glm::vec2 uv = tri.uv[0] * w0 + tri.uv[1] * w1 + tri.uv[2] * w2;
+        fcolor *= sampleTexture(*state.texture, uv);
+    }
+    return packColor(fcolor);
+}
@@ -0,0 +1,151 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: SoftwareRenderer.h
+ *
+ * Description:
+ * Header file for the SoftwareRenderer class, a CPU rendering backend that does not need
+ * OpenGL. It renders the same mesh, camera, light and material data as GeometryRender
+ * with the same Phong and texture shading as fshader.glsl, into an RGBA image and a depth
+ * buffer.
+ *
+ * Triangles are transformed, clipped and binned into screen tiles, then the tiles are
+ * rasterized in parallel on the JobSystem with four pixels at a time evaluated by SSE edge
+ * functions. Each tile first resolves visibility into a small local buffer and then shades
+ * every covered pixel exactly once, so overdraw costs no shading.
+ *
+ * Dependencies:
+ * - GLM (OpenGL Mathematics)
+ * - JobSystem.h
+ * - TriangleSetup.h
+ */
+
+#ifndef DATORGRAFIK_SOFTWARERENDERER_H
+#define DATORGRAFIK_SOFTWARERENDERER_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "JobSystem.h"
+#include "TriangleSetup.h"
+
+#define RASTER_TILE_SIZE 64
+
+// Triangle mesh in the planar layout of Model, texture coordinates and occlusion are optional
+struct RasterMesh {
+    const glm::vec3* positions;
+    const glm::vec3* normals;
+    const glm::vec2* texCoords;
+    size_t vertexCount;
+    const unsigned int* indices;
+    size_t indexCount;
+    const float* occlusion;     // Optional baked ambient occlusion per vertex
+};
+
+struct RasterMaterial {
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    float shininess;
+};
+
+// The Scene's main light
+struct RasterLight {
+    glm::vec3 ambient;
+    glm::vec3 color;
+    glm::vec3 position;     // direction towards the light when directional
+    bool directional;
+};
+
+// 8 bit RGBA image, top row first
+struct RasterTexture {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> rgba;
+};
+
+glm::vec4 sampleTexture(const RasterTexture& texture, glm::vec2 uv);
+
+class SoftwareRenderer {
+
+public:
+
+    SoftwareRenderer();
+
+    void resize(int width, int height);
+    void clear(const glm::vec4& color);
+    void draw(const RasterMesh& mesh, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection,
+              const glm::vec3& eye, const RasterMaterial& material, const RasterLight& light,
+              const RasterTexture* texture);
+
+    const RasterTexture* loadTexture(const std::string& path);
+
+    int width() const;
+    int height() const;
+
+    // Packed RGBA8 (R in the lowest byte) and window depth in [0, 1], top row first
+    const std::vector<uint32_t>& colorBuffer() const;
+    const std::vector<float>& depthBuffer() const;
+
+    // Statistics for the latest draw
+    size_t trianglesIn;
+    size_t trianglesRasterized;
+
+private:
+
+    struct Vertex {
+        glm::vec4 clip;
+        glm::vec3 world;
+        glm::vec3 normal;
+        glm::vec2 uv;
+        float occlusion;
+    };
+
+    // Attributes per vertex, in the order of the edges
+    struct Triangle : ScreenEdges {
+        float z[3];
+        float invW[3];
+        glm::vec3 world[3];
+        glm::vec3 normal[3];
+        glm::vec2 uv[3];
+        float occlusion[3];
+    };
+
+    // Per draw state, shared by the tile tasks
+    struct DrawState {
+        glm::vec3 eye;
+        RasterMaterial material;
+        RasterLight light;
+        const RasterTexture* texture;
+        bool textured;
+    };
+
+    JobSystem& jobs;
+
+    int widthPixels;
+    int heightPixels;
+    int tilesX;
+    int tilesY;
+
+    std::vector<uint32_t> color;
+    std::vector<float> depth;
+
+    std::vector<Vertex> vertices;
+    std::vector<std::vector<Triangle>> chunkTriangles;
+    std::vector<std::vector<std::vector<uint32_t>>> chunkBins;
+
+    std::map<std::string, RasterTexture> textures;
+
+    void setupTriangle(const Vertex& a, const Vertex& b, const Vertex& c, std::vector<Triangle>& out) const;
+    void binTriangles(size_t chunk);
+    void renderTile(size_t tile, const DrawState& state);
+    uint32_t shade(const Triangle& tri, float b1, float b2, const DrawState& state) const;
+
+};
+
+#endif //DATORGRAFIK_SOFTWARERENDERER_H
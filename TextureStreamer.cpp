@@ -0,0 +1,560 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: TextureStreamer.cpp
+ *
+ * Description:
+ * Implementation file for the TextureStreamer class. Decoding and mip generation run as
+ * jobs, all OpenGL calls are made from update() on the thread owning the context.
+ *
+ * Dependencies:
+ * - "TextureStreamer.h"
+ * - "Profiler.h"
+ * - "MemoryTracker.h"
+ * - "ResidencyManager.h"
+ * - stb_image
+ */
+
+#include "TextureStreamer.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "ResidencyManager.h"
+#include "include/stb-master/stb_image.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * @brief Default constructor for the TextureStreamer class.
+ *
+ * Sets a 256 MB mip budget with at most 4 MB uploaded per frame, and 256 MB for the
+ * decoded levels.
+ */
+TextureStreamer::TextureStreamer() {
+    vramBudget = 256u * 1024u * 1024u;
+    uploadBudget = 4u * 1024u * 1024u;
+    cpuBudget = 256u * 1024u * 1024u;
+    resident = 0;
+    frame = 0;
+    requests = 0;
+}
+
+/**
+ * @brief Drops the decodes that have not started, waits for the others and deletes all streamed textures.
+ *
+ * @note Must run while the OpenGL context is still current.
+ */
+TextureStreamer::~TextureStreamer() {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        pending.clear();
+    }
+    JobSystem::get().wait(decodes);
+
+    for (auto& entry : textures) {
+        ResidencyManager::get().remove(entry.second.residencyId);
+        MemoryTracker::get().releaseGpu(GL_TEXTURE, entry.first);
+        MemoryTracker::get().setCpuBytes("Texture " + entry.second.path, 0);
+        glDeleteTextures(1, &entry.first);
+    }
+}
+
+/**
+ * @brief Requests a texture to be streamed from an image file.
+ *
+ * @param path Path to the image file.
+ * @return The OpenGL texture name, usable immediately.
+ *
+ * The texture starts out as a single white texel and is replaced by the decoded mip tail
+ * once it has been decoded. Higher levels follow as the texture becomes visible.
+ */
+GLuint TextureStreamer::request(const string& path) {
+    GLuint texture;
+    const unsigned char white[4] = {255, 255, 255, 255};
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    StreamedTexture& tex = textures[texture];
+    tex.path = path;
+    tex.lastUsedFrame = frame;
+    tex.request = ++requests;
+    tex.residencyId = ResidencyManager::get().add("Texture " + path, [this, texture]() { evictToTail(texture); });
+    trackMemory(texture, tex);
+
+    {
+        lock_guard<mutex> lock(queueMutex);
+        pending.push_back({texture, tex.request, path});
+    }
+    JobSystem::get().run([this]() { decodeNext(); }, &decodes, nullptr, "Texture decode");
+
+    return texture;
+}
+
+/**
+ * @brief Releases a texture previously returned by request().
+ *
+ * @param texture The OpenGL texture name.
+ */
+void TextureStreamer::release(GLuint texture) {
+    auto it = textures.find(texture);
+    if (it == textures.end())
+        return;
+
+    if (it->second.decoded) {
+        for (int level = it->second.residentBase; level < (int)it->second.mips.size(); level++)
+            resident -= levelBytes(it->second.mips[level]);
+    }
+
+    {
+        // Drop a decode that has not started yet
+        lock_guard<mutex> lock(queueMutex);
+        for (auto job = pending.begin(); job != pending.end(); ++job) {
+            if (job->texture == texture) {
+                pending.erase(job);
+                break;
+            }
+        }
+    }
+
+    string path = it->second.path;
+    ResidencyManager::get().remove(it->second.residencyId);
+    MemoryTracker::get().releaseGpu(GL_TEXTURE, texture);
+    glDeleteTextures(1, &texture);
+    textures.erase(it);
+    reportCpuBytes(path);
+}
+
+/**
+ * @brief Reports how many pixels an object using the texture covers on screen.
+ *
+ * @param texture The OpenGL texture name.
+ * @param screenPixels Approximate on-screen diameter in pixels of the textured object.
+ *
+ * Called once per object and frame before update(). The largest footprint of the frame wins.
+ */
+void TextureStreamer::reportFootprint(GLuint texture, float screenPixels) {
+    auto it = textures.find(texture);
+    if (it == textures.end())
+        return;
+
+    it->second.footprint = max(it->second.footprint, screenPixels);
+    it->second.lastUsedFrame = frame;
+    ResidencyManager::get().touch(it->second.residencyId);
+}
+
+/**
+ * @brief Streams mip levels in and out of VRAM.
+ *
+ * Picks up finished decodes, recomputes the wanted mip level for every texture from the
+ * footprints reported since the last call, evicts levels while over budget and uploads
+ * at most uploadBudget bytes of new levels, largest footprints first. A level whose
+ * decoded pixels were dropped has its image decoded again, and is uploaded once that is done.
+ */
+void TextureStreamer::update() {
+    collectFinished();
+
+    order.clear();
+    for (auto& entry : textures) {
+        StreamedTexture& tex = entry.second;
+        if (!tex.decoded)
+            continue;
+        tex.wantedBase = wantedLevel(tex);
+        order.push_back(entry.first);
+    }
+
+    // Evict levels nobody asks for, then least recently used, then the smallest on screen
+    sort(order.begin(), order.end(), [this](GLuint a, GLuint b) {
+        const StreamedTexture& ta = textures[a];
+        const StreamedTexture& tb = textures[b];
+        if (ta.lastUsedFrame != tb.lastUsedFrame)
+            return ta.lastUsedFrame < tb.lastUsedFrame;
+        return ta.footprint < tb.footprint;
+    });
+
+    for (GLuint texture : order) {
+        StreamedTexture& tex = textures[texture];
+        while (tex.residentBase < tex.wantedBase)
+            evictLevel(texture, tex);
+    }
+
+    for (GLuint texture : order) {
+        if (resident <= vramBudget)
+            break;
+        StreamedTexture& tex = textures[texture];
+        while (resident > vramBudget && tex.residentBase < tex.tailLevel)
+            evictLevel(texture, tex);
+    }
+
+    trimDecoded();
+
+    // Stream in, most important first
+    PROFILE_SCOPE("Upload mips");
+    size_t uploaded = 0;
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        StreamedTexture& tex = textures[*it];
+        while (tex.residentBase > tex.wantedBase) {
+            if (tex.mips[tex.residentBase - 1].pixels.empty()) {
+                redecode(*it, tex);
+                break;
+            }
+            size_t cost = levelBytes(tex.mips[tex.residentBase - 1]);
+            if (resident + cost > vramBudget)
+                break;
+            if (uploaded > 0 && uploaded + cost > uploadBudget)
+                break;
+            uploadLevel(*it, tex, tex.residentBase - 1);
+            uploaded += cost;
+        }
+    }
+
+    for (auto& entry : textures)
+        entry.second.footprint = 0.0f;
+    frame++;
+}
+
+/**
+ * @brief Returns the number of bytes of mip data currently uploaded.
+ */
+size_t TextureStreamer::residentBytes() const {
+    return resident;
+}
+
+/**
+ * @brief Returns the number of bytes of decoded mip levels kept on the CPU.
+ */
+size_t TextureStreamer::decodedBytes() const {
+    size_t bytes = 0;
+    for (const auto& entry : textures) {
+        for (const MipLevel& mip : entry.second.mips)
+            bytes += mip.pixels.capacity();
+    }
+    return bytes;
+}
+
+/**
+ * @brief Drops decoded levels nobody wants while over the CPU budget, least recently used first.
+ *
+ * Only levels larger than a texture's wanted level are dropped, so the tail and the levels
+ * on screen stay. Expects the order of the current update().
+ */
+void TextureStreamer::trimDecoded() {
+    size_t bytes = decodedBytes();
+    for (GLuint texture : order) {
+        if (bytes <= cpuBudget)
+            break;
+        StreamedTexture& tex = textures[texture];
+        bool trimmed = false;
+        for (int level = 0; level < tex.wantedBase && bytes > cpuBudget; level++) {
+            vector<unsigned char>& pixels = tex.mips[level].pixels;
+            if (pixels.empty())
+                continue;
+            bytes -= pixels.capacity();
+            vector<unsigned char>().swap(pixels);
+            trimmed = true;
+        }
+        if (trimmed)
+            reportCpuBytes(tex.path);
+    }
+}
+
+/**
+ * @brief Decodes the image of a texture again, for the levels dropped from the CPU.
+ */
+void TextureStreamer::redecode(GLuint texture, StreamedTexture& tex) {
+    if (tex.redecoding || frame < tex.redecodeFrame)
+        return;
+    tex.redecoding = true;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        pending.push_back({texture, tex.request, tex.path});
+    }
+    JobSystem::get().run([this]() { decodeNext(); }, &decodes, nullptr, "Texture decode");
+}
+
+/**
+ * @brief Returns the largest mip level currently resident for a texture.
+ *
+ * @param texture The OpenGL texture name.
+ * @return The base level, or -1 if the texture is unknown or still decoding.
+ */
+int TextureStreamer::residentLevel(GLuint texture) const {
+    auto it = textures.find(texture);
+    if (it == textures.end() || !it->second.decoded)
+        return -1;
+    return it->second.residentBase;
+}
+
+/**
+ * @brief Decode job, decodes the oldest pending request.
+ *
+ * There is a job for every request, one finds nothing left when its request was released.
+ */
+void TextureStreamer::decodeNext() {
+    DecodeJob job;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        if (pending.empty())
+            return;
+        job = pending.front();
+        pending.pop_front();
+    }
+
+    DecodeResult result;
+    result.texture = job.texture;
+    result.request = job.request;
+    result.ok = decode(job.path, result.mips);
+
+    lock_guard<mutex> lock(queueMutex);
+    finished.push_back(std::move(result));
+}
+
+/**
+ * @brief Decodes an image file and builds its full mip chain with a box filter.
+ *
+ * @param path Path to the image file.
+ * @param mips Receives the mip levels, level 0 first.
+ * @return True if the image could be read.
+ */
+bool TextureStreamer::decode(const string& path, vector<MipLevel>& mips) {
+    TRACE_SCOPE("Decode texture");
+    int width, height, nrChannels;
+    unsigned char* image = stbi_load(path.c_str(), &width, &height, &nrChannels, 4);
+    if (image == nullptr)
+        return false;
+
+    MipLevel base;
+    base.width = width;
+    base.height = height;
+    base.pixels.assign(image, image + (size_t)width * height * 4);
+    stbi_image_free(image);
+    mips.push_back(std::move(base));
+
+    while (mips.back().width > 1 || mips.back().height > 1) {
+        const MipLevel& src = mips.back();
+        MipLevel dst;
+        dst.width = max(1, src.width / 2);
+        dst.height = max(1, src.height / 2);
+        dst.pixels.resize((size_t)dst.width * dst.height * 4);
+
+        for (int y = 0; y < dst.height; y++) {
+            int y0 = min(2 * y, src.height - 1);
+            int y1 = min(2 * y + 1, src.height - 1);
+            for (int x = 0; x < dst.width; x++) {
+                int x0 = min(2 * x, src.width - 1);
+                int x1 = min(2 * x + 1, src.width - 1);
+                for (int c = 0; c < 4; c++) {
+                    int sum = src.pixels[((size_t)y0 * src.width + x0) * 4 + c]
+                            + src.pixels[((size_t)y0 * src.width + x1) * 4 + c]
+                            + src.pixels[((size_t)y1 * src.width + x0) * 4 + c]
+                            + src.pixels[((size_t)y1 * src.width + x1) * 4 + c];
+                    dst.pixels[((size_t)y * dst.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+        mips.push_back(std::move(dst));
+    }
+    return true;
+}
+
+/**
+ * @brief Takes over decoded images and uploads their mip tail.
+ *
+ * The 1x1 placeholder in level 0 is released and only the levels up to
+ * TEXTURE_STREAM_TAIL_SIZE are defined, with the base level pointing at the largest of them.
+ * An image decoded again only gives back the pixels of the levels that were dropped.
+ */
+void TextureStreamer::collectFinished() {
+    PROFILE_SCOPE("Upload mip tails");
+    vector<DecodeResult> done;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        done.swap(finished);
+    }
+
+    for (DecodeResult& result : done) {
+        // The name may have been released and handed out again by a later request
+        auto it = textures.find(result.texture);
+        if (it == textures.end() || it->second.request != result.request)
+            continue;
+
+        StreamedTexture& tex = it->second;
+        bool redecoded = tex.redecoding;
+        tex.redecoding = false;
+        if (!result.ok) {
+            cerr << "Could not read texture: " << tex.path << endl;
+            tex.redecodeFrame = frame + TEXTURE_REDECODE_RETRY_FRAMES;
+            continue;
+        }
+
+        if (redecoded) {
+            if (!sameSize(tex.mips, result.mips)) {
+                cerr << "Texture changed size on disk, not streaming its dropped levels: " << tex.path << endl;
+                tex.redecodeFrame = frame + TEXTURE_REDECODE_RETRY_FRAMES;
+                continue;
+            }
+            for (size_t level = 0; level < tex.mips.size(); level++) {
+                if (tex.mips[level].pixels.empty())
+                    tex.mips[level].pixels = std::move(result.mips[level].pixels);
+            }
+            reportCpuBytes(tex.path);
+            continue;
+        }
+
+        // Decoded before, the levels uploaded from the old image are replaced
+        if (tex.decoded) {
+            while (tex.residentBase < tex.tailLevel)
+                evictLevel(result.texture, tex);
+            for (int level = tex.residentBase; level < (int)tex.mips.size(); level++)
+                resident -= levelBytes(tex.mips[level]);
+        }
+        tex.mips = std::move(result.mips);
+        tex.decoded = true;
+        tex.tailLevel = 0;
+        while (tex.tailLevel < (int)tex.mips.size() - 1 &&
+               max(tex.mips[tex.tailLevel].width, tex.mips[tex.tailLevel].height) > TEXTURE_STREAM_TAIL_SIZE)
+            tex.tailLevel++;
+
+        int lastLevel = (int)tex.mips.size() - 1;
+        glBindTexture(GL_TEXTURE_2D, result.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, lastLevel);
+        if (tex.tailLevel > 0)
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        tex.residentBase = lastLevel + 1;
+        for (int level = lastLevel; level >= tex.tailLevel; level--)
+            uploadLevel(result.texture, tex, level);
+        reportCpuBytes(tex.path);
+    }
+}
+
+/**
+ * @brief Computes the mip level needed to draw a texture at its reported footprint.
+ *
+ * The texture is assumed to be mapped once across the object, so one texel per covered
+ * pixel needs the level whose size matches the footprint. Textures not seen this frame
+ * only keep their tail.
+ */
+int TextureStreamer::wantedLevel(const StreamedTexture& tex) const {
+    if (tex.lastUsedFrame != frame || tex.footprint <= 0.0f)
+        return tex.tailLevel;
+
+    float size = (float)max(tex.mips[0].width, tex.mips[0].height);
+    int level = (int)floor(log2(size / tex.footprint));
+    return max(0, min(level, tex.tailLevel));
+}
+
+/**
+ * @brief Uploads one mip level and makes it the texture's base level.
+ */
+void TextureStreamer::uploadLevel(GLuint texture, StreamedTexture& tex, int level) {
+    const MipLevel& mip = tex.mips[level];
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, mip.width, mip.height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, mip.pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    tex.residentBase = level;
+    resident += levelBytes(mip);
+    setBaseLevel(texture, level);
+    trackMemory(texture, tex);
+}
+
+/**
+ * @brief Drops the largest resident mip level of a texture.
+ *
+ * The base level is moved first so the texture stays complete, then the level is
+ * redefined as empty to give its memory back to the driver.
+ */
+void TextureStreamer::evictLevel(GLuint texture, StreamedTexture& tex) {
+    int level = tex.residentBase;
+
+    setBaseLevel(texture, level + 1);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    tex.residentBase = level + 1;
+    resident -= levelBytes(tex.mips[level]);
+    trackMemory(texture, tex);
+}
+
+/**
+ * @brief Drops all levels of a texture above its tail, called by the ResidencyManager.
+ *
+ * The levels are streamed in again by update() once the texture is drawn.
+ */
+void TextureStreamer::evictToTail(GLuint texture) {
+    auto it = textures.find(texture);
+    if (it == textures.end() || !it->second.decoded)
+        return;
+    while (it->second.residentBase < it->second.tailLevel)
+        evictLevel(texture, it->second);
+}
+
+void TextureStreamer::setBaseLevel(GLuint texture, int level) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+size_t TextureStreamer::levelBytes(const MipLevel& mip) {
+    return (size_t)mip.width * mip.height * 4;
+}
+
+/**
+ * @brief Returns whether two mip chains have the same levels with the same sizes.
+ */
+bool TextureStreamer::sameSize(const vector<MipLevel>& a, const vector<MipLevel>& b) {
+    if (a.size() != b.size())
+        return false;
+    for (size_t level = 0; level < a.size(); level++) {
+        if (a[level].width != b[level].width || a[level].height != b[level].height)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reports the resident mip levels of a texture, or its white texel until it is decoded.
+ */
+void TextureStreamer::trackMemory(GLuint texture, const StreamedTexture& tex) {
+    size_t bytes = 4;
+    if (tex.decoded) {
+        bytes = 0;
+        for (int level = tex.residentBase; level < (int)tex.mips.size(); level++)
+            bytes += levelBytes(tex.mips[level]);
+    }
+    MemoryTracker::get().trackGpu(GL_TEXTURE, texture, tex.path.c_str(), bytes);
+    ResidencyManager::get().setBytes(tex.residencyId, bytes);
+}
+
+/**
+ * @brief Reports the decoded mip chains kept for streaming of the textures of an image file.
+ */
+void TextureStreamer::reportCpuBytes(const string& path) {
+    size_t bytes = 0;
+    for (const auto& entry : textures) {
+        if (entry.second.path != path)
+            continue;
+        for (const MipLevel& mip : entry.second.mips)
+            bytes += mip.pixels.capacity();
+    }
+    MemoryTracker::get().setCpuBytes("Texture " + path, bytes);
+}
@@ -0,0 +1,137 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: TextureStreamer.h
+ *
+ * Description:
+ * Header file for the TextureStreamer class, which streams texture mip levels to the GPU
+ * based on how large the textured objects appear on screen. Images are decoded and
+ * mipmapped by jobs of the JobSystem, only the smallest mip levels are uploaded up front,
+ * and higher levels are streamed in and evicted under a VRAM budget by moving
+ * GL_TEXTURE_BASE_LEVEL, so the texture object itself is never reallocated. The resident
+ * levels and the decoded mip chains kept to stream from are reported to the MemoryTracker.
+ * The decoded levels above the tail are kept under a CPU budget as well: the levels no
+ * texture wants are dropped while over it, and the image is decoded again from its file
+ * when they are wanted later.
+ * The textures are also registered with the ResidencyManager, which may evict a texture
+ * not drawn in a frame down to its tail to keep the meshes and textures within its budget.
+ *
+ * Dependencies:
+ * - OpenGL (GLEW)
+ * - stb_image
+ * - "JobSystem.h"
+ */
+
+#ifndef DATORGRAFIK_TEXTURESTREAMER_H
+#define DATORGRAFIK_TEXTURESTREAMER_H
+
+#include <GL/glew.h>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "JobSystem.h"
+
+// Mip levels at or below this size are uploaded as soon as the image is decoded
+#define TEXTURE_STREAM_TAIL_SIZE 64
+
+// Frames before an image that could not be decoded again is tried once more
+#define TEXTURE_REDECODE_RETRY_FRAMES 60
+
+class TextureStreamer {
+
+public:
+
+    TextureStreamer();
+    ~TextureStreamer();
+
+    GLuint request(const std::string& path);
+    void release(GLuint texture);
+
+    void reportFootprint(GLuint texture, float screenPixels);
+    void update();
+
+    size_t residentBytes() const;
+    size_t decodedBytes() const;
+    int residentLevel(GLuint texture) const;
+
+    // Upper bound for streamed mip memory, and per frame upload limit
+    size_t vramBudget;
+    size_t uploadBudget;
+
+    // Upper bound for the decoded levels kept on the CPU, the mip tails are always kept
+    size_t cpuBudget;
+
+private:
+
+    struct MipLevel {
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;
+    };
+
+    struct StreamedTexture {
+        std::string path;
+        bool decoded = false;
+        std::vector<MipLevel> mips;
+        int tailLevel = 0;
+        int residentBase = 0;
+        int wantedBase = 0;
+        float footprint = 0.0f;
+        unsigned int lastUsedFrame = 0;
+        int residencyId = -1;
+        unsigned int request = 0;      // Decodes of other requests for the same texture name are dropped
+        bool redecoding = false;       // Decoded again for levels dropped from the CPU
+        unsigned int redecodeFrame = 0;    // No new decode before this frame after a failed one
+    };
+
+    struct DecodeJob {
+        GLuint texture;
+        unsigned int request;
+        std::string path;
+    };
+
+    struct DecodeResult {
+        GLuint texture;
+        unsigned int request;
+        bool ok;
+        std::vector<MipLevel> mips;
+    };
+
+    std::map<GLuint, StreamedTexture> textures;
+    size_t resident;
+    unsigned int frame;
+    unsigned int requests;
+
+    // Background decoding, one job per request takes the oldest pending decode
+    JobCounter decodes;
+    std::mutex queueMutex;
+    std::deque<DecodeJob> pending;
+    std::vector<DecodeResult> finished;
+
+    // Textures in the order update() evicts them, kept to reuse its memory every frame
+    std::vector<GLuint> order;
+
+    void decodeNext();
+    static bool decode(const std::string& path, std::vector<MipLevel>& mips);
+
+    void collectFinished();
+    int wantedLevel(const StreamedTexture& tex) const;
+    void uploadLevel(GLuint texture, StreamedTexture& tex, int level);
+    void evictLevel(GLuint texture, StreamedTexture& tex);
+    void evictToTail(GLuint texture);
+    void trimDecoded();
+    void redecode(GLuint texture, StreamedTexture& tex);
+    void setBaseLevel(GLuint texture, int level);
+    static size_t levelBytes(const MipLevel& mip);
+    static bool sameSize(const std::vector<MipLevel>& a, const std::vector<MipLevel>& b);
+    void trackMemory(GLuint texture, const StreamedTexture& tex);
+    void reportCpuBytes(const std::string& path);
+
+};
+
+#endif //DATORGRAFIK_TEXTURESTREAMER_H
@@ -0,0 +1,185 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: TraceRecorder.cpp
+ *
+ * Description:
+ * Implementation file for the TraceRecorder class.
+ *
+ * Dependencies:
+ * - "TraceRecorder.h"
+ */
+
+#include "TraceRecorder.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+TraceRecorder TraceRecorder::instance;
+thread_local TraceRecorder::ThreadBuffer* TraceRecorder::threadBuffer = nullptr;
+thread_local bool TraceRecorder::threadRefused = false;
+
+namespace {
+
+    // Writes a string literal as a JSON string
+    void writeString(FILE* file, const char* text) {
+        fputc('"', file);
+        for (const char* c = text; *c != '\0'; c++) {
+            if (*c == '"' || *c == '\\')
+                fputc('\\', file);
+            if ((unsigned char)*c >= 0x20)
+                fputc(*c, file);
+        }
+        fputc('"', file);
+    }
+
+}
+
+/**
+ * @brief Constructor for the TraceRecorder class, recording from the start.
+ */
+TraceRecorder::TraceRecorder() {
+    enabled = true;
+    origin = chrono::steady_clock::now();
+}
+
+/**
+ * @brief Starts or stops recording. The events recorded so far are kept.
+ */
+void TraceRecorder::setEnabled(bool enable) {
+    enabled.store(enable, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the time in the recorder's ticks.
+ */
+TraceRecorder::Ticks TraceRecorder::now() const {
+    return (Ticks)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count();
+}
+
+/**
+ * @brief Adds an event to the calling thread's ring, overwriting its oldest one when full.
+ *
+ * @param name Name of the event, it must outlive the recorder.
+ * @param start Time the event began.
+ * @param end Time the event ended.
+ */
+void TraceRecorder::record(const char* name, Ticks start, Ticks end) {
+    ThreadBuffer* ring = buffer();
+    if (ring == nullptr)
+        return;
+
+    // Only this thread writes the ring, the release publishes the event to write()
+    unsigned long long index = ring->written.load(memory_order_relaxed);
+    Event& event = ring->events[index % TRACE_RING_EVENTS];
+    event.name = name;
+    event.start = start;
+    event.duration = end > start ? end - start : 0;
+    ring->written.store(index + 1, memory_order_release);
+}
+
+/**
+ * @brief Names the calling thread in the traces.
+ *
+ * @param name Name of the thread, it must outlive the recorder.
+ */
+void TraceRecorder::setThreadName(const char* name) {
+    ThreadBuffer* ring = buffer();
+    if (ring != nullptr)
+        ring->name.store(name, memory_order_release);
+}
+
+/**
+ * @brief Writes the events of the last seconds of all threads as a Chrome Trace Event file.
+ *
+ * @param path File to write.
+ * @param seconds Length of the trace, counted back from now.
+ * @return True if the file could be written.
+ *
+ * The threads keep recording while their rings are read.
+ */
+bool TraceRecorder::write(const string& path, double seconds) {
+    Ticks end = now();
+    Ticks span = (Ticks)(max(seconds, 0.0) * 1.0e9);
+    Ticks cutoff = end > span ? end - span : 0;
+
+    vector<ThreadBuffer*> rings;
+    {
+        lock_guard<mutex> lock(threadsMutex);
+        for (const unique_ptr<ThreadBuffer>& ring : threads)
+            rings.push_back(ring.get());
+    }
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        cerr << "Could not write the trace " << path << endl;
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    vector<Event> events;
+    for (ThreadBuffer* ring : rings) {
+        const char* name = ring->name.load(memory_order_acquire);
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                first ? "" : ",\n", ring->id);
+        writeString(file, name != nullptr ? name : "Thread");
+        fprintf(file, "}}");
+        first = false;
+
+        // Copy the ring, then keep the events the thread cannot have reached since
+        unsigned long long written = ring->written.load(memory_order_acquire);
+        unsigned long long oldest = written > TRACE_RING_EVENTS ? written - TRACE_RING_EVENTS : 0;
+        events.clear();
+        for (unsigned long long i = oldest; i < written; i++)
+            events.push_back(ring->events[i % TRACE_RING_EVENTS]);
+        unsigned long long after = ring->written.load(memory_order_acquire);
+        unsigned long long safe = after + 1 > TRACE_RING_EVENTS ? after + 1 - TRACE_RING_EVENTS : 0;
+
+        for (unsigned long long i = max(oldest, safe); i < written; i++) {
+            const Event& event = events[i - oldest];
+            if (event.start + event.duration < cutoff)
+                continue;
+            fprintf(file, ",\n{\"name\":");
+            writeString(file, event.name);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    ring->id, event.start / 1000.0, event.duration / 1000.0);
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    bool ok = ferror(file) == 0;
+    if (fclose(file) != 0 || !ok) {
+        cerr << "Could not write the trace " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the calling thread's ring, creating it on the first call.
+ *
+ * @return Null when TRACE_MAX_THREADS threads already have a ring.
+ */
+TraceRecorder::ThreadBuffer* TraceRecorder::buffer() {
+    if (threadBuffer != nullptr || threadRefused)
+        return threadBuffer;
+
+    lock_guard<mutex> lock(threadsMutex);
+    if (threads.size() >= TRACE_MAX_THREADS) {
+        threadRefused = true;
+        return nullptr;
+    }
+    unique_ptr<ThreadBuffer> ring(new ThreadBuffer());
+    ring->id = (int)threads.size();
+    ring->name = nullptr;
+    ring->written = 0;
+    threadBuffer = ring.get();
+    threads.push_back(std::move(ring));
+    return threadBuffer;
+}
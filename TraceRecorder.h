@@ -0,0 +1,131 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: TraceRecorder.h
+ *
+ * Description:
+ * Header file for the TraceRecorder class, which keeps the scopes of the last seconds
+ * of every thread and writes them as a Chrome Trace Event JSON file, to be opened in
+ * chrome://tracing or Perfetto.
+ *
+ * Every thread records into a ring of its own with a single writer, so recording takes
+ * no lock. A write reads the rings while they are being filled and drops the events a
+ * thread may have overwritten in the meantime. The ring of a thread is created on its
+ * first event, at most TRACE_MAX_THREADS threads are recorded.
+ *
+ * The scopes of Profiler.h are recorded as well as the TRACE_SCOPE ones, which are meant
+ * for the threads the profiler does not measure. Defining PROFILER_DISABLED compiles
+ * both out.
+ *
+ * Dependencies:
+ * - C++11 threads, atomics and chrono
+ */
+
+#ifndef DATORGRAFIK_TRACERECORDER_H
+#define DATORGRAFIK_TRACERECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Events kept per thread, about 25 seconds of the main loop at 60 frames per second
+#define TRACE_RING_EVENTS 32768
+
+// Threads with a ring of their own, the events of any further threads are dropped
+#define TRACE_MAX_THREADS 32
+
+// Seconds written when no other length is asked for
+#define TRACE_DEFAULT_SECONDS 10.0
+
+class TraceRecorder {
+
+public:
+
+    typedef unsigned long long Ticks;   // Nanoseconds since the recorder was created
+
+    static TraceRecorder& get() { return instance; }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+    void setEnabled(bool enable);
+
+    Ticks now() const;
+    void record(const char* name, Ticks start, Ticks end);
+    void setThreadName(const char* name);
+
+    bool write(const std::string& path, double seconds);
+
+private:
+
+    struct Event {
+        const char* name;           // Must outlive the recorder, normally a string literal
+        Ticks start;
+        Ticks duration;
+    };
+
+    struct ThreadBuffer {
+        int id;
+        std::atomic<const char*> name;
+        std::atomic<unsigned long long> written;    // Events ever recorded, the ring holds the newest
+        Event events[TRACE_RING_EVENTS];
+    };
+
+    static TraceRecorder instance;
+    static thread_local ThreadBuffer* threadBuffer;
+    static thread_local bool threadRefused;
+
+    std::atomic<bool> enabled;
+    std::chrono::steady_clock::time_point origin;
+
+    // Taken when a thread records for the first time and when writing, never per event
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads;
+
+    TraceRecorder();
+
+    ThreadBuffer* buffer();
+
+};
+
+/*
+ * Records the enclosing block as one event on the calling thread.
+ */
+class TraceScope {
+
+public:
+
+    explicit TraceScope(const char* name) {
+        this->name = TraceRecorder::get().isEnabled() ? name : nullptr;
+        if (this->name != nullptr)
+            start = TraceRecorder::get().now();
+    }
+    ~TraceScope() {
+        if (name != nullptr)
+            TraceRecorder::get().record(name, start, TraceRecorder::get().now());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+
+    const char* name;
+    TraceRecorder::Ticks start;
+
+};
+
+#ifdef PROFILER_DISABLED
+#define TRACE_SCOPE(name)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#else
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) TraceRecorder::get().setThreadName(name)
+#endif
+
+#endif //DATORGRAFIK_TRACERECORDER_H
@@ -0,0 +1,143 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: TriangleSetup.h
+ *
+ * Description:
+ * Clipping and triangle setup shared by the CPU rasterizers, the SoftwareRenderer and the
+ * OcclusionCuller. Triangles are clipped in clip space against the near plane and a guard
+ * band around the screen, and the pieces are set up as edge functions scaled to
+ * barycentrics with their pixel bounds. The vertex type is the caller's, the clipper only
+ * needs its clip space position and a way to interpolate it.
+ *
+ * Dependencies:
+ * - GLM (OpenGL Mathematics)
+ */
+
+#ifndef DATORGRAFIK_TRIANGLESETUP_H
+#define DATORGRAFIK_TRIANGLESETUP_H
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+
+// Clipping keeps vertices within this many viewports of the screen center, so the
+// edge functions of huge triangles stay precise
+#define CLIP_GUARD_BAND 8.0f
+
+// Edge i runs between the two other vertices and is the barycentric of vertex i
+struct ScreenEdges {
+    float edgeA[3], edgeB[3], edgeC[3];
+    int order[3];                   // Vertex of each edge, counter clockwise on screen
+    int topLeft;                    // Bit i set when edge i owns pixels exactly on it
+    int minX, minY, maxX, maxY;
+};
+
+// Signed distances to the near plane and the guard band, a vertex is inside a plane when >= 0
+inline float clipPlaneDistance(const glm::vec4& p, int plane) {
+    switch (plane) {
+        case 0: return p.z + p.w;                          // near
+        case 1: return CLIP_GUARD_BAND * p.w - p.x;
+        case 2: return CLIP_GUARD_BAND * p.w + p.x;
+        case 3: return CLIP_GUARD_BAND * p.w - p.y;
+        default: return CLIP_GUARD_BAND * p.w + p.y;
+    }
+}
+
+inline bool insideClipPlanes(const glm::vec4& p) {
+    for (int plane = 0; plane < 5; plane++) {
+        if (!(clipPlaneDistance(p, plane) >= 0.0f))
+            return false;
+    }
+    return true;
+}
+
+inline const glm::vec4& clipPosition(const glm::vec4& v) { return v; }
+
+template<typename Vertex>
+inline const glm::vec4& clipPosition(const Vertex& v) { return v.clip; }
+
+/**
+ * @brief Clips a triangle against the near plane and the guard band and hands on the pieces.
+ *
+ * @param lerp Called as lerp(p, q, t, result) for a vertex t of the way from p to q.
+ * @param setup Called as setup(a, b, c) for each triangle of the clipped polygon.
+ */
+template<typename Vertex, typename Lerp, typename Setup>
+void clipTriangle(const Vertex& a, const Vertex& b, const Vertex& c, Lerp lerp, Setup setup) {
+    Vertex polygon[2][16];
+    int count = 3;
+    polygon[0][0] = a;
+    polygon[0][1] = b;
+    polygon[0][2] = c;
+
+    int current = 0;
+    for (int plane = 0; plane < 5 && count > 0; plane++) {
+        const Vertex* in = polygon[current];
+        Vertex* result = polygon[1 - current];
+        int resultCount = 0;
+
+        for (int i = 0; i < count; i++) {
+            const Vertex& p = in[i];
+            const Vertex& q = in[(i + 1) % count];
+            float dp = clipPlaneDistance(clipPosition(p), plane);
+            float dq = clipPlaneDistance(clipPosition(q), plane);
+
+            if (dp >= 0.0f)
+                result[resultCount++] = p;
+            if ((dp >= 0.0f) != (dq >= 0.0f))
+                lerp(p, q, dp / (dp - dq), result[resultCount++]);
+        }
+        count = resultCount;
+        current = 1 - current;
+    }
+
+    for (int i = 1; i + 1 < count; i++)
+        setup(polygon[current][0], polygon[current][i], polygon[current][i + 1]);
+}
+
+/**
+ * @brief Sets up the edge functions and pixel bounds of a triangle in screen coordinates.
+ *
+ * Both windings are accepted, the vertices are reordered counter clockwise.
+ *
+ * @return False for degenerate triangles and those outside the width by height screen.
+ */
+inline bool setupEdges(const glm::vec2 s[3], int width, int height, ScreenEdges& edges) {
+    float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x);
+    if (std::fabs(area) < 1e-8f)
+        return false;
+
+    edges.order[0] = 0;
+    edges.order[1] = 1;
+    edges.order[2] = 2;
+    if (area < 0.0f) {
+        std::swap(edges.order[1], edges.order[2]);
+        area = -area;
+    }
+
+    edges.topLeft = 0;
+    for (int i = 0; i < 3; i++) {
+        const glm::vec2& a = s[edges.order[(i + 1) % 3]];
+        const glm::vec2& b = s[edges.order[(i + 2) % 3]];
+        float A = -(b.y - a.y), B = b.x - a.x;
+        edges.edgeA[i] = A / area;
+        edges.edgeB[i] = B / area;
+        edges.edgeC[i] = ((b.y - a.y) * a.x - (b.x - a.x) * a.y) / area;
+        if (A > 0.0f || (A == 0.0f && B < 0.0f))
+            edges.topLeft |= 1 << i;
+    }
+
+    float minX = std::min(s[0].x, std::min(s[1].x, s[2].x)), maxX = std::max(s[0].x, std::max(s[1].x, s[2].x));
+    float minY = std::min(s[0].y, std::min(s[1].y, s[2].y)), maxY = std::max(s[0].y, std::max(s[1].y, s[2].y));
+    edges.minX = std::max(0, (int)std::floor(minX));
+    edges.minY = std::max(0, (int)std::floor(minY));
+    edges.maxX = std::min(width - 1, (int)std::ceil(maxX));
+    edges.maxY = std::min(height - 1, (int)std::ceil(maxY));
+    return edges.minX <= edges.maxX && edges.minY <= edges.maxY;
+}
+
+#endif //DATORGRAFIK_TRIANGLESETUP_H
@@ -0,0 +1,175 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: Benchmark.cpp
+ *
+ * Description:
+ * Implementation file for the Benchmark class.
+ *
+ * Dependencies:
+ * - "Benchmark.h"
+ */
+
+#include "Benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+    // Writes a string as a JSON string
+    void writeString(ostream& out, const string& text) {
+        out << '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if ((unsigned char)c >= 0x20)
+                out << c;
+        }
+        out << '"';
+    }
+
+    // Writes a number with enough digits for a time in milliseconds
+    void writeNumber(ostream& out, double value) {
+        char text[32];
+        snprintf(text, sizeof(text), "%.6g", value);
+        out << text;
+    }
+
+}
+
+/**
+ * @brief Constructor for the Benchmark class.
+ */
+Benchmark::Benchmark(const BenchOptions& options) : options(options) {
+}
+
+/**
+ * @brief Times one case and keeps its result.
+ *
+ * @param name Name of the kernel, the filter is matched against it.
+ * @param input Name of the data the kernel works on.
+ * @param items Work done per iteration, such as triangles or bytes, for the throughput.
+ * @param unit What the items are.
+ * @param kernel One iteration.
+ * @return False if the case was filtered out.
+ *
+ * The case is reported on stderr as soon as it is done.
+ */
+bool Benchmark::run(const string& name, const string& input, long long items, const char* unit,
+                    const function<void()>& kernel) {
+    if (!options.filter.empty() && name.find(options.filter) == string::npos)
+        return false;
+
+    typedef chrono::steady_clock Clock;
+    for (int i = 0; i < options.warmup; i++)
+        kernel();
+
+    vector<double> samples;
+    double totalMs = 0.0;
+    while ((int)samples.size() < options.maxReps) {
+        Clock::time_point start = Clock::now();
+        kernel();
+        chrono::duration<double, milli> time = Clock::now() - start;
+        samples.push_back(time.count());
+        totalMs += time.count();
+
+        int reps = (int)samples.size();
+        if (reps >= options.minReps && totalMs >= options.minSeconds * 1000.0)
+            break;
+        if (reps >= BENCH_MIN_SAMPLES && totalMs >= options.maxSeconds * 1000.0)
+            break;
+    }
+
+    BenchResult result;
+    result.name = name;
+    result.input = input;
+    result.items = items;
+    result.unit = unit;
+    result.reps = (int)samples.size();
+    result.meanMs = totalMs / samples.size();
+    double variance = 0.0;
+    for (double sample : samples)
+        variance += (sample - result.meanMs) * (sample - result.meanMs);
+    result.stddevMs = samples.size() > 1 ? sqrt(variance / (samples.size() - 1)) : 0.0;
+
+    // Nearest rank percentiles
+    sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    result.minMs = samples[0];
+    result.medianMs = n % 2 == 1 ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+    result.p95Ms = samples[(size_t)max(0.0, ceil(0.95 * n) - 1.0)];
+    resultList.push_back(result);
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-24s %-28s %5d reps  median %10.4f ms  p95 %10.4f ms", name.c_str(),
+             input.c_str(), result.reps, result.medianMs, result.p95Ms);
+    cerr << line << endl;
+    return true;
+}
+
+/**
+ * @brief Returns the results of all cases run so far.
+ */
+const vector<BenchResult>& Benchmark::results() const {
+    return resultList;
+}
+
+/**
+ * @brief Writes the results, the options and the machine as one JSON object.
+ */
+void Benchmark::writeJson(ostream& out) const {
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    out << "{\n  \"date\": ";
+    writeString(out, date);
+    out << ",\n  \"compiler\": ";
+#ifdef __VERSION__
+    writeString(out, __VERSION__);
+#else
+    writeString(out, "unknown");
+#endif
+    out << ",\n  \"hardwareThreads\": " << thread::hardware_concurrency();
+    out << ",\n  \"options\": {\"warmup\": " << options.warmup << ", \"minReps\": " << options.minReps
+        << ", \"maxReps\": " << options.maxReps << ", \"minSeconds\": ";
+    writeNumber(out, options.minSeconds);
+    out << ", \"maxSeconds\": ";
+    writeNumber(out, options.maxSeconds);
+    out << "},\n  \"results\": [";
+
+    for (size_t i = 0; i < resultList.size(); i++) {
+        const BenchResult& result = resultList[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\"name\": ";
+        writeString(out, result.name);
+        out << ", \"input\": ";
+        writeString(out, result.input);
+        out << ", \"items\": " << result.items << ", \"unit\": ";
+        writeString(out, result.unit);
+        out << ", \"reps\": " << result.reps;
+        out << ", \"minMs\": ";
+        writeNumber(out, result.minMs);
+        out << ", \"medianMs\": ";
+        writeNumber(out, result.medianMs);
+        out << ", \"p95Ms\": ";
+        writeNumber(out, result.p95Ms);
+        out << ", \"meanMs\": ";
+        writeNumber(out, result.meanMs);
+        out << ", \"stddevMs\": ";
+        writeNumber(out, result.stddevMs);
+        out << ", \"itemsPerSecond\": ";
+        writeNumber(out, result.medianMs > 0.0 ? result.items / (result.medianMs * 1.0e-3) : 0.0);
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
@@ -0,0 +1,89 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: Benchmark.h
+ *
+ * Description:
+ * Header file for the Benchmark class, which times kernels and reports their timings
+ * as JSON.
+ *
+ * Every case first runs a few untimed warmup iterations. It is then timed one iteration
+ * at a time until it has minReps samples covering minSeconds, or maxReps samples. A case
+ * slower than maxSeconds stops early, but never with fewer than BENCH_MIN_SAMPLES samples.
+ * The median and the 95th percentile are reported along with the minimum, the mean and
+ * the standard deviation. Regressions should be tracked by the median, which a few
+ * interrupted samples do not move.
+ *
+ * Dependencies:
+ * - C++11
+ */
+
+#ifndef DATORGRAFIK_BENCHMARK_H
+#define DATORGRAFIK_BENCHMARK_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Fewest samples any case is reported with
+#define BENCH_MIN_SAMPLES 5
+
+struct BenchOptions {
+    int warmup = 2;
+    int minReps = 10;
+    int maxReps = 1000;
+    double minSeconds = 0.5;
+    double maxSeconds = 10.0;
+    std::string filter;         // Only cases whose name contains it are run
+};
+
+struct BenchResult {
+    std::string name;
+    std::string input;
+    long long items;            // Work done per iteration, in units
+    std::string unit;
+    int reps;
+    double minMs;
+    double medianMs;
+    double p95Ms;
+    double meanMs;
+    double stddevMs;
+};
+
+class Benchmark {
+
+public:
+
+    explicit Benchmark(const BenchOptions& options);
+
+    bool run(const std::string& name, const std::string& input, long long items, const char* unit,
+             const std::function<void()>& kernel);
+
+    const std::vector<BenchResult>& results() const;
+    void writeJson(std::ostream& out) const;
+
+private:
+
+    BenchOptions options;
+    std::vector<BenchResult> resultList;
+
+};
+
+/*
+ * Keeps the compiler from removing the computation of a value that is never used.
+ */
+template <typename T>
+inline void benchKeep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+#endif //DATORGRAFIK_BENCHMARK_H
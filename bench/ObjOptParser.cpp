@@ -0,0 +1,38 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: ObjOptParser.cpp
+ *
+ * Description:
+ * Implementation file for the optimized OBJ parser access.
+ *
+ * Dependencies:
+ * - "ObjOptParser.h"
+ * - tinyobjloader 1.0.6 experimental (tinyobj_loader_opt.h, ltalloc)
+ */
+
+#include "ObjOptParser.h"
+#include <vector>
+
+#define TINYOBJ_LOADER_OPT_IMPLEMENTATION
+#include "tinyobj_loader_opt.h"
+
+/**
+ * @brief Parses OBJ text with the optimized parser.
+ *
+ * @param text Contents of an OBJ file.
+ * @param threads Threads to parse with, -1 for one per hardware thread.
+ * @return Number of vertex coordinates read.
+ */
+size_t parseObjOpt(const std::string& text, int threads) {
+    tinyobj_opt::LoadOption option;
+    option.req_num_threads = threads;
+    tinyobj_opt::attrib_t attrib;
+    std::vector<tinyobj_opt::shape_t> shapes;
+    std::vector<tinyobj_opt::material_t> materials;
+    tinyobj_opt::parseObj(&attrib, &shapes, &materials, text.data(), text.size(), option);
+    return attrib.vertices.size();
+}
@@ -0,0 +1,26 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: ObjOptParser.h
+ *
+ * Description:
+ * Access to the optimized OBJ parser of tinyobjloader's experimental folder, which the
+ * benchmarks compare against the ObjReader. Its header defines unused static functions
+ * and helper macros that clash with tiny_obj_loader.h, so only ObjOptParser.cpp
+ * includes it.
+ *
+ * Dependencies:
+ * - tinyobjloader 1.0.6 experimental (tinyobj_loader_opt.h, ltalloc)
+ */
+
+#ifndef DATORGRAFIK_OBJOPTPARSER_H
+#define DATORGRAFIK_OBJOPTPARSER_H
+
+#include <string>
+
+size_t parseObjOpt(const std::string& text, int threads);
+
+#endif //DATORGRAFIK_OBJOPTPARSER_H
@@ -0,0 +1,405 @@
+/*
+ * Project
+ * Dept: Computing Science, Umeå University
+ *
+ * Author: Gustav Johansson, ens20gjn@cs.umu.se
+ *
+ * File: bench.cpp
+ *
+ * Description:
+ * Microbenchmarks of the geometry and asset kernels, built by 'make bench'. No window or
+ * OpenGL context is needed. Every OBJ file of OBJs/ and two synthetic grids are run through:
+ * - parsing, by tinyobjloader's ObjReader and by its experimental optimized parser
+ * - MeshBuilder::loadObj, the parse and processing Model and the batch renderer do
+ * - the steps of MeshBuilder on their own: vertex and index extraction, normal
+ *   generation, the bounding box and sphere UVs
+ * - transforming the vertices to clip space
+ * The images next to the program are decoded and their mip chains built, the way the
+ * TextureStreamer does, and a batch of model matrices is composed.
+ *
+ * The timings are printed to stderr as they finish and written as JSON, see Benchmark.h.
+ *
+ * Dependencies:
+ * - "Benchmark.h"
+ * - "ObjOptParser.h"
+ * - "MeshBuilder.h"
+ * - GLM (OpenGL Mathematics)
+ * - tinyobjloader
+ * - stb_image
+ */
+
+#include "Benchmark.h"
+#include "ObjOptParser.h"
+#include "MeshBuilder.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "include/tiny_obj_loader.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "include/stb-master/stb_image.h"
+
+// Quads per side of the synthetic grids, two triangles each
+#define BENCH_GRID_SMALL 256
+#define BENCH_GRID_LARGE 1024
+
+// Model matrices composed per iteration of the matrix batch
+#define BENCH_MATRIX_BATCH 4096
+
+using namespace std;
+
+namespace {
+
+    struct ObjInput {
+        string name;
+        string path;            // Empty for the synthetic grids
+        string text;
+    };
+
+    struct ImageInput {
+        string name;
+        string bytes;
+    };
+
+    struct MipLevel {
+        int width;
+        int height;
+        vector<unsigned char> pixels;
+    };
+
+    int usage(const char* program) {
+        cerr << "Usage: " << program << " [--json <file>] [--objs <dir>] [--images <dir>] [--filter <text>]"
+             << " [--reps N] [--warmup N] [--min-time S] [--max-time S] [--quick]" << endl
+             << "  --json      write the results to <file> instead of stdout" << endl
+             << "  --objs      OBJ files to benchmark, default OBJs" << endl
+             << "  --images    .jpg, .png and .bmp files to decode, default the working directory" << endl
+             << "  --filter    only run the cases whose name contains <text>" << endl
+             << "  --reps      fewest timed iterations per case, default 10" << endl
+             << "  --warmup    untimed iterations per case, default 2" << endl
+             << "  --min-time  seconds each case is timed for at least, default 0.5" << endl
+             << "  --max-time  seconds after which a slow case stops early, default 10" << endl
+             << "  --quick     fewer iterations and no large synthetic grid" << endl;
+        return EXIT_FAILURE;
+    }
+
+    // Names of the files in a directory with one of the extensions, sorted
+    vector<string> listFiles(string dir, const vector<string>& extensions) {
+        if (!dir.empty() && dir.back() != '/' && dir.back() != '\\')
+            dir += '/';
+
+        vector<string> names;
+#ifdef _WIN32
+        for (const string& extension : extensions) {
+            _finddata_t entry;
+            intptr_t handle = _findfirst((dir + "*" + extension).c_str(), &entry);
+            if (handle == -1)
+                continue;
+            do {
+                names.push_back(entry.name);
+            } while (_findnext(handle, &entry) == 0);
+            _findclose(handle);
+        }
+#else
+        DIR* directory = opendir(dir.c_str());
+        if (!directory)
+            return names;
+        while (dirent* entry = readdir(directory)) {
+            string name = entry->d_name;
+            for (const string& extension : extensions) {
+                if (name.size() > extension.size() &&
+                    name.compare(name.size() - extension.size(), extension.size(), extension) == 0)
+                    names.push_back(name);
+            }
+        }
+        closedir(directory);
+#endif
+        sort(names.begin(), names.end());
+        return names;
+    }
+
+    bool readFile(const string& path, string& bytes) {
+        ifstream fs(path, ios::binary);
+        if (!fs)
+            return false;
+        ostringstream contents;
+        contents << fs.rdbuf();
+        bytes = contents.str();
+        return true;
+    }
+
+    // A wavy height field of size x size quads
+    ObjInput syntheticGrid(int size) {
+        ObjInput input;
+        input.name = "grid_" + to_string(size) + "x" + to_string(size);
+
+        string& text = input.text;
+        text.reserve((size_t)(size + 1) * (size + 1) * 32 + (size_t)size * size * 48);
+        char line[96];
+        for (int y = 0; y <= size; y++) {
+            for (int x = 0; x <= size; x++) {
+                float u = (float)x / size, v = (float)y / size;
+                snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", u * 2.0f - 1.0f,
+                         0.1f * sinf(u * 12.0f) * cosf(v * 9.0f), v * 2.0f - 1.0f);
+                text += line;
+            }
+        }
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                int a = y * (size + 1) + x + 1;
+                int b = a + 1, c = a + size + 1, d = c + 1;
+                snprintf(line, sizeof(line), "f %d %d %d\nf %d %d %d\n", a, c, b, b, c, d);
+                text += line;
+            }
+        }
+        return input;
+    }
+
+    // Same box filter as TextureStreamer::decode
+    void buildMipChain(const unsigned char* image, int width, int height, vector<MipLevel>& mips) {
+        mips.clear();
+        MipLevel base;
+        base.width = width;
+        base.height = height;
+        base.pixels.assign(image, image + (size_t)width * height * 4);
+        mips.push_back(std::move(base));
+
+        while (mips.back().width > 1 || mips.back().height > 1) {
+            const MipLevel& src = mips.back();
+            MipLevel dst;
+            dst.width = max(1, src.width / 2);
+            dst.height = max(1, src.height / 2);
+            dst.pixels.resize((size_t)dst.width * dst.height * 4);
+            for (int y = 0; y < dst.height; y++) {
+                int y0 = min(2 * y, src.height - 1);
+                int y1 = min(2 * y + 1, src.height - 1);
+                for (int x = 0; x < dst.width; x++) {
+                    int x0 = min(2 * x, src.width - 1);
+                    int x1 = min(2 * x + 1, src.width - 1);
+                    for (int c = 0; c < 4; c++) {
+                        int sum = src.pixels[((size_t)y0 * src.width + x0) * 4 + c]
+                                + src.pixels[((size_t)y0 * src.width + x1) * 4 + c]
+                                + src.pixels[((size_t)y1 * src.width + x0) * 4 + c]
+                                + src.pixels[((size_t)y1 * src.width + x1) * 4 + c];
+                        dst.pixels[((size_t)y * dst.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                    }
+                }
+            }
+            mips.push_back(std::move(dst));
+        }
+    }
+
+    void benchObj(Benchmark& bench, const ObjInput& input) {
+        tinyobj::ObjReader reader;
+        if (!reader.ParseFromString(input.text, "") || reader.GetShapes().empty() ||
+            reader.GetAttrib().vertices.empty()) {
+            cerr << "Skipping " << input.name << ", it has no geometry" << endl;
+            return;
+        }
+        const tinyobj::attrib_t& attrib = reader.GetAttrib();
+        const vector<tinyobj::shape_t>& shapes = reader.GetShapes();
+        long long bytes = (long long)input.text.size();
+
+        MeshData geometry;
+        MeshBuilder::readPositions(attrib, geometry.positions);
+        MeshBuilder::readIndices(shapes, geometry.indices);
+        long long vertexCount = (long long)geometry.positions.size();
+        long long triangles = (long long)geometry.indices.size() / 3;
+        if (triangles == 0) {
+            cerr << "Skipping " << input.name << ", it has no triangles" << endl;
+            return;
+        }
+
+        bench.run("parse/tinyobj", input.name, bytes, "bytes", [&]() {
+            tinyobj::ObjReader parser;
+            parser.ParseFromString(input.text, "");
+            benchKeep(parser.GetAttrib().vertices.size());
+        });
+
+        bench.run("parse/opt", input.name, bytes, "bytes", [&]() {
+            benchKeep(parseObjOpt(input.text, 1));
+        });
+        if (thread::hardware_concurrency() > 1) {
+            bench.run("parse/opt_threads", input.name, bytes, "bytes", [&]() {
+                benchKeep(parseObjOpt(input.text, -1));
+            });
+        }
+
+        if (!input.path.empty()) {
+            bench.run("load/MeshBuilder", input.name, bytes, "bytes", [&]() {
+                MeshData mesh;
+                string error;
+                MeshBuilder::loadObj(input.path, MESH_TEXCOORDS_SPHERE, mesh, error);
+                benchKeep(mesh.radius);
+            });
+        }
+
+        MeshData scratch;
+        bench.run("extract/vertices", input.name, vertexCount, "vertices", [&]() {
+            MeshBuilder::readPositions(attrib, scratch.positions);
+            benchKeep(scratch.positions.back());
+        });
+        bench.run("extract/indices", input.name, triangles, "triangles", [&]() {
+            MeshBuilder::readIndices(shapes, scratch.indices);
+            benchKeep(scratch.indices.size());
+        });
+        bench.run("normals", input.name, triangles, "triangles", [&]() {
+            MeshBuilder::generateNormals(geometry.positions, geometry.indices, geometry.normals);
+            benchKeep(geometry.normals[0]);
+        });
+        bench.run("bounds", input.name, vertexCount, "vertices", [&]() {
+            MeshBuilder::computeBounds(geometry);
+            benchKeep(geometry.radius);
+        });
+        bench.run("uv/sphere", input.name, vertexCount, "vertices", [&]() {
+            MeshBuilder::sphereTexCoords(geometry.positions, geometry.texCoords);
+            benchKeep(geometry.texCoords[0]);
+        });
+
+        glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f) *
+                                   glm::lookAt(glm::vec3(0.0f, 1.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        vector<glm::vec4> clip(geometry.positions.size());
+        bench.run("matrix/vertices", input.name, vertexCount, "vertices", [&]() {
+            for (size_t i = 0; i < geometry.positions.size(); i++)
+                clip[i] = viewProjection * glm::vec4(geometry.positions[i], 1.0f);
+            benchKeep(clip[0]);
+        });
+    }
+
+    void benchImage(Benchmark& bench, const ImageInput& input) {
+        int width, height, channels;
+        unsigned char* image = stbi_load_from_memory((const unsigned char*)input.bytes.data(), (int)input.bytes.size(),
+                                                     &width, &height, &channels, 4);
+        if (image == nullptr) {
+            cerr << "Skipping " << input.name << ", it cannot be decoded" << endl;
+            return;
+        }
+        long long pixels = (long long)width * height;
+
+        bench.run("texture/decode", input.name, pixels, "pixels", [&]() {
+            int w, h, c;
+            unsigned char* decoded = stbi_load_from_memory((const unsigned char*)input.bytes.data(),
+                                                           (int)input.bytes.size(), &w, &h, &c, 4);
+            benchKeep(decoded);
+            stbi_image_free(decoded);
+        });
+
+        vector<MipLevel> mips;
+        bench.run("texture/mips", input.name, pixels, "pixels", [&]() {
+            buildMipChain(image, width, height, mips);
+            benchKeep(mips.back().pixels[0]);
+        });
+        stbi_image_free(image);
+    }
+
+    void benchMatrices(Benchmark& bench) {
+        vector<glm::vec3> positions(BENCH_MATRIX_BATCH);
+        for (int i = 0; i < BENCH_MATRIX_BATCH; i++)
+            positions[i] = glm::vec3(i % 64, (i / 64) % 8, i / 512) * 2.0f;
+        glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f) *
+                                   glm::lookAt(glm::vec3(0.0f, 10.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+        vector<glm::mat4> mvp(BENCH_MATRIX_BATCH);
+        bench.run("matrix/batch", to_string(BENCH_MATRIX_BATCH) + " models", BENCH_MATRIX_BATCH, "matrices", [&]() {
+            for (int i = 0; i < BENCH_MATRIX_BATCH; i++) {
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), positions[i]);
+                model = glm::rotate(model, 0.01f * i, glm::vec3(0.0f, 1.0f, 0.0f));
+                model = glm::scale(model, glm::vec3(0.5f));
+                mvp[i] = viewProjection * model;
+            }
+            benchKeep(mvp[0]);
+        });
+    }
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    string jsonPath, objDir = "OBJs", imageDir = ".";
+    bool quick = false;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--json") && hasValue)
+            jsonPath = argv[++i];
+        else if (!strcmp(argv[i], "--objs") && hasValue)
+            objDir = argv[++i];
+        else if (!strcmp(argv[i], "--images") && hasValue)
+            imageDir = argv[++i];
+        else if (!strcmp(argv[i], "--filter") && hasValue)
+            options.filter = argv[++i];
+        else if (!strcmp(argv[i], "--reps") && hasValue)
+            options.minReps = max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--warmup") && hasValue)
+            options.warmup = max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--min-time") && hasValue)
+            options.minSeconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--max-time") && hasValue)
+            options.maxSeconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--quick"))
+            quick = true;
+        else
+            return usage(argv[0]);
+    }
+    if (quick) {
+        options.warmup = min(options.warmup, 1);
+        options.minReps = BENCH_MIN_SAMPLES;
+        options.minSeconds = 0.1;
+        options.maxSeconds = 1.0;
+    }
+
+    vector<ObjInput> objs;
+    for (const string& name : listFiles(objDir, {".obj"})) {
+        ObjInput input;
+        input.name = name;
+        input.path = objDir + "/" + name;
+        if (readFile(input.path, input.text))
+            objs.push_back(std::move(input));
+    }
+    if (objs.empty())
+        cerr << "No OBJ files in " << objDir << endl;
+    objs.push_back(syntheticGrid(BENCH_GRID_SMALL));
+    if (!quick)
+        objs.push_back(syntheticGrid(BENCH_GRID_LARGE));
+
+    vector<ImageInput> images;
+    for (const string& name : listFiles(imageDir, {".jpg", ".png", ".bmp"})) {
+        ImageInput input;
+        input.name = name;
+        if (readFile(imageDir + "/" + name, input.bytes))
+            images.push_back(std::move(input));
+    }
+
+    Benchmark bench(options);
+    for (const ObjInput& input : objs)
+        benchObj(bench, input);
+    for (const ImageInput& input : images)
+        benchImage(bench, input);
+    benchMatrices(bench);
+
+    if (jsonPath.empty()) {
+        bench.writeJson(cout);
+        return EXIT_SUCCESS;
+    }
+    ofstream fs(jsonPath);
+    bench.writeJson(fs);
+    if (!fs) {
+        cerr << "Could not write " << jsonPath << endl;
+        return EXIT_FAILURE;
+    }
+    cerr << "Results written to " << jsonPath << endl;
+    return EXIT_SUCCESS;
+}
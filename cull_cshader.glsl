@@ -0,0 +1,116 @@
+#version 430
+
+// Culls the objects of a GpuScene against the view frustum, and against the visibility
+// mask from the CPU when there is one, and appends a draw command for every visible one.
+// With a depth pyramid the early pass also drops the objects the pyramid hides and marks
+// them, and the late pass draws the marked objects the rebuilt pyramid shows.
+// The layouts and bindings are those in GpuScene.h.
+
+layout(local_size_x = 64) in;
+
+struct GpuObject {
+    mat4 model;
+    vec4 bounds;            // bounding sphere in object space, w is the radius
+    uint material;
+};
+
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 3) readonly buffer Objects { GpuObject objects[]; };
+layout(std430, binding = 5) writeonly buffer Commands { DrawCommand commands[]; };
+layout(std430, binding = 6) buffer Counters { uint drawCount[2]; uint inFrustum; };
+layout(std430, binding = 7) readonly buffer Visibility { uint visibility[]; };   // one bit per object
+layout(std430, binding = 8) buffer Occluded { uint occluded[]; };               // hidden by the early pass
+
+uniform vec4 frustum[6];    // world space planes with unit normals, pointing inwards
+uniform uint objectCount;
+uniform uint indexCount;
+uniform uint useVisibility;
+uniform uint phase;         // 0 early, 1 late
+
+uniform uint useDepthPyramid;
+uniform sampler2D depthPyramid;
+uniform mat4 pyramidViewProjection;
+
+// Tests the bounding box of a sphere against the depth pyramid
+bool hiddenByPyramid(vec3 center, float radius)
+{
+    vec2 low = vec2(1.0), high = vec2(0.0);
+    float nearest = 1.0;
+    for (int i = 0; i < 8; i++) {
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0,
+                                             (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = pyramidViewProjection * vec4(corner, 1.0);
+        if (clip.w <= 0.0 || clip.z < -clip.w)
+            return false;   // crosses the near plane
+        vec3 ndc = clip.xyz / clip.w;
+        low = min(low, ndc.xy * 0.5 + 0.5);
+        high = max(high, ndc.xy * 0.5 + 0.5);
+        nearest = min(nearest, ndc.z * 0.5 + 0.5);
+    }
+    // Nothing is known outside the pyramid's view
+    if (any(lessThan(high, vec2(0.0))) || any(greaterThan(low, vec2(1.0))))
+        return false;
+    low = clamp(low, 0.0, 1.0);
+    high = clamp(high, 0.0, 1.0);
+
+    // The level where the box spans at most two texels in each direction. Every level
+    // halves the one below, the size is not queried since the level differs per object.
+    ivec2 baseSize = textureSize(depthPyramid, 0);
+    vec2 extent = (high - low) * vec2(baseSize);
+    int levels = textureQueryLevels(depthPyramid);
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, levels - 1);
+
+    ivec2 size = max(baseSize >> level, ivec2(1));
+    ivec2 first = min(ivec2(low * vec2(size)), size - 1);
+    ivec2 last = min(ivec2(high * vec2(size)), size - 1);
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; y++) {
+        for (int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, texelFetch(depthPyramid, ivec2(x, y), level).r);
+    }
+    return nearest > farthest;
+}
+
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= objectCount)
+        return;
+    if (phase == 1u && occluded[id] == 0u)
+        return;
+
+    mat4 model = objects[id].model;
+    vec4 bounds = objects[id].bounds;
+    vec3 center = (model * vec4(bounds.xyz, 1.0)).xyz;
+    float scale = max(length(model[0].xyz), max(length(model[1].xyz), length(model[2].xyz)));
+    float radius = bounds.w * scale;
+
+    // The late pass only sees objects that passed these tests in the early pass
+    if (phase == 0u) {
+        occluded[id] = 0u;
+        if (useVisibility != 0u && (visibility[id >> 5] & (1u << (id & 31u))) == 0u)
+            return;
+        for (int i = 0; i < 6; i++) {
+            if (dot(frustum[i].xyz, center) + frustum[i].w < -radius)
+                return;
+        }
+        atomicAdd(inFrustum, 1u);
+    }
+
+    if (useDepthPyramid != 0u && hiddenByPyramid(center, radius)) {
+        if (phase == 0u)
+            occluded[id] = 1u;
+        return;
+    }
+
+    // The base instance selects the object in the vertex shader
+    uint slot = atomicAdd(drawCount[phase], 1u);
+    commands[slot] = DrawCommand(indexCount, 1u, 0u, 0, id);
+}
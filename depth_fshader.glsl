@@ -0,0 +1,7 @@
+#version 430
+
+// Only depth is written, which the fixed function stage does by itself
+
+void main()
+{
+}
@@ -0,0 +1,35 @@
+#version 430
+
+// Depth pre-pass, laying down the depth the shading pass is then tested against with
+// GL_EQUAL. The position is computed exactly as in vshader.glsl, and both declare it
+// invariant, so the depths match bit for bit.
+
+layout(location = 0) in vec3 vPosition;
+#ifdef GPU_INSTANCES
+layout(location = 4) in uint vInstance;   // index of the object, from the draw command's base instance
+#endif
+
+invariant gl_Position;
+
+uniform mat4 P;
+uniform mat4 V;
+
+#ifdef GPU_INSTANCES
+// Same layout as GpuObject in GpuScene.h, binding as in GpuScene.h
+struct GpuObject {
+    mat4 model;
+    vec4 bounds;
+    uint material;
+};
+layout(std430, binding = 3) readonly buffer Objects { GpuObject objects[]; };
+#else
+uniform mat4 M;
+#endif
+
+void main()
+{
+#ifdef GPU_INSTANCES
+    mat4 M = objects[vInstance].model;
+#endif
+    gl_Position = P * V * M * vec4(vPosition, 1.0);
+}
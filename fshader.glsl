@@ -1,37 +1,221 @@
-#version 330
+#version 430
+
+// Variants are selected with the defines HAS_TEXCOORD, USE_TEXTURE, USE_NORMAL_MAP,
+// CLUSTERED_LIGHTS, USE_SHADOWS, DIRECTIONAL_LIGHT, HAS_OCCLUSION, GPU_INSTANCES and
+// LIGHT_COUNT, which are inserted after the version line (see ShaderVariants).
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 1
+#endif
 
 in vec3 fragNormal;
 in vec3 fragPosition;
+#ifdef HAS_TEXCOORD
 in vec2 fragTexCoord;
+#endif
+#ifdef HAS_OCCLUSION
+in float fragOcclusion;
+#endif
 
 out vec4 fcolor;
 
 uniform vec3 i_a;          // ambient color
-uniform vec3 i_l;          // lighting color
-uniform vec3 l;            // light position
+#if LIGHT_COUNT > 0
+uniform vec3 i_l[LIGHT_COUNT]; // lighting color
+uniform vec3 l[LIGHT_COUNT];   // light position, or direction towards the light for DIRECTIONAL_LIGHT
+#endif
 uniform vec3 v;            // viewers position
+#ifdef GPU_INSTANCES
+// Same layout as GpuMaterial in GpuScene.h, binding as in GpuScene.h
+struct GpuMaterial {
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;          // w is the shininess exponent
+};
+layout(std430, binding = 4) readonly buffer Materials { GpuMaterial materials[]; };
+flat in uint fragMaterial;
+
+// Filled from the instance's material at the start of main
+vec3 am_material;
+vec3 di_material;
+vec3 spec_material;
+int shininess;
+#else
 uniform vec3 am_material;   // ambient material color
 uniform vec3 di_material;   // diffuse material color
 uniform vec3 spec_material; // specular material color
 uniform int shininess;      // shininess exponent
+#endif
 
-uniform bool useTexture;
+#ifdef USE_TEXTURE
 uniform sampler2D ourTexture;
+#endif
+
+#ifdef CLUSTERED_LIGHTS
+// Same layout as Light in Scene.h, bindings as in LightClusters.h
+struct ClusterLight {
+    vec4 positionRange;     // xyz position, w range
+    vec4 colorType;         // xyz color, w 0 point / 1 spot
+    vec4 directionCutoff;   // xyz spot direction, w cosine of the cone angle
+};
+layout(std430, binding = 0) readonly buffer ClusterLights { ClusterLight clusterLights[]; };
+layout(std430, binding = 1) readonly buffer ClusterGrid { uvec2 clusterGrid[]; };       // offset, count
+layout(std430, binding = 2) readonly buffer ClusterIndices { uint clusterIndices[]; };
+
+uniform uvec3 clusterDims;  // clusters in x, y and z
+uniform vec2 clusterZ;      // slice = log(depth) * x - y
+uniform vec2 viewportSize;
+#endif
 
+#ifdef USE_SHADOWS
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrix[SHADOW_CASCADES];
+uniform float cascadeSplits[SHADOW_CASCADES];  // far view depth of each cascade
+uniform int shadowLayers;                      // 0 off, 1 point light map, SHADOW_CASCADES cascades
+#endif
+
+#if defined(CLUSTERED_LIGHTS) || defined(USE_SHADOWS)
+uniform mat4 V;
+#endif
+
+#ifdef USE_NORMAL_MAP
+uniform sampler2D normalMap;
+
+// Builds the tangent frame from screen space derivatives, so no tangents are needed
+vec3 perturbNormal(vec3 n, vec3 p, vec2 uv)
+{
+    vec3 dp1 = dFdx(p);
+    vec3 dp2 = dFdy(p);
+    vec2 duv1 = dFdx(uv);
+    vec2 duv2 = dFdy(uv);
+
+    vec3 dp2perp = cross(dp2, n);
+    vec3 dp1perp = cross(n, dp1);
+    vec3 t = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 b = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invmax = inversesqrt(max(dot(t, t), dot(b, b)));
+    mat3 tbn = mat3(t * invmax, b * invmax, n);
+
+    vec3 mapped = texture(normalMap, uv).xyz * 2.0 - 1.0;
+    return normalize(tbn * mapped);
+}
+#endif
+
+vec3 phong(vec3 normals, vec3 light_position, vec3 viewers_position, vec3 intensity)
+{
+    vec3 r = reflect(-light_position, normals);
+
+    vec3 diffuse = max(dot(normals, light_position), 0) * intensity * di_material;
+    vec3 specular = max(dot(diffuse, vec3(1.0)), 0.0f) * pow(max(dot(r, viewers_position), 0.0), shininess) * intensity * spec_material;
+    return diffuse + specular;
+}
+
+#ifdef USE_SHADOWS
+// Fraction of the main light reaching the fragment, 3x3 PCF
+float shadow()
+{
+    if (shadowLayers == 0)
+        return 1.0;
+
+    int layer = 0;
+    if (shadowLayers > 1) {
+        float depth = -(V * vec4(fragPosition, 1.0)).z;
+        layer = shadowLayers;
+        for (int c = shadowLayers - 1; c >= 0; c--) {
+            if (depth < cascadeSplits[c])
+                layer = c;
+        }
+        if (layer == shadowLayers)
+            return 1.0;
+    }
+
+    vec4 p = shadowMatrix[layer] * vec4(fragPosition, 1.0);
+    p.xyz = p.xyz / p.w * 0.5 + 0.5;
+
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++)
+            lit += texture(shadowMap, vec4(p.xy + vec2(x, y) * texel, float(layer), p.z));
+    }
+    return lit / 9.0;
+}
+#endif
+
+#ifdef CLUSTERED_LIGHTS
+vec3 clusteredLights(vec3 normals, vec3 viewers_position)
+{
+    float depth = -(V * vec4(fragPosition, 1.0)).z;
+    uint slice = uint(max(log(depth) * clusterZ.x - clusterZ.y, 0.0));
+    uvec2 tile = uvec2(gl_FragCoord.xy / viewportSize * vec2(clusterDims.xy));
+    uvec3 cluster = min(uvec3(tile, slice), clusterDims - 1u);
+    uvec2 list = clusterGrid[(cluster.z * clusterDims.y + cluster.y) * clusterDims.x + cluster.x];
+
+    vec3 color = vec3(0.0);
+    for (uint i = 0u; i < list.y; i++) {
+        ClusterLight light = clusterLights[clusterIndices[list.x + i]];
+        vec3 toLight = light.positionRange.xyz - fragPosition;
+        float dist = length(toLight);
+        toLight /= dist;
+
+        // Smooth falloff that reaches zero at the light's range
+        float falloff = clamp(1.0 - pow(dist / light.positionRange.w, 2.0), 0.0, 1.0);
+        falloff *= falloff;
+        if (light.colorType.w > 0.5) {
+            float cosAngle = dot(-toLight, light.directionCutoff.xyz);
+            float cutoff = light.directionCutoff.w;
+            falloff *= smoothstep(cutoff, mix(cutoff, 1.0, 0.1), cosAngle);
+        }
+        if (falloff > 0.0)
+            color += falloff * phong(normals, toLight, viewers_position, light.colorType.xyz);
+    }
+    return color;
+}
+#endif
 
 void main()
 {
+#ifdef GPU_INSTANCES
+    GpuMaterial material = materials[fragMaterial];
+    am_material = material.ambient.xyz;
+    di_material = material.diffuse.xyz;
+    spec_material = material.specular.xyz;
+    shininess = int(material.specular.w);
+#endif
     vec3 normals = normalize(fragNormal);
-    // take away fragPosition so that light has fixed position
-    vec3 light_position = normalize(l - fragPosition);
+#ifdef USE_NORMAL_MAP
+    normals = perturbNormal(normals, fragPosition, fragTexCoord);
+#endif
     vec3 viewers_position = normalize(v - fragPosition);
-    vec3 r = reflect(-light_position, normals);
 
-    vec3 ambient = i_a * am_material;
-    vec3 diffuse = max(dot(normals, light_position), 0) * i_l * di_material;
-    vec3 specular = max(dot(diffuse, vec3(1.0)), 0.0f) * pow(max(dot(r, viewers_position), 0.0), shininess) * i_l * spec_material;
+    vec3 color = i_a * am_material;
+#ifdef HAS_OCCLUSION
+    color *= fragOcclusion;
+#endif
+
+#if LIGHT_COUNT > 0
+    for (int i = 0; i < LIGHT_COUNT; i++) {
+        // take away fragPosition so that light has fixed position
+        vec3 light_position = normalize(l[i] - fragPosition);
+        vec3 intensity = i_l[i];
+        if (i == 0) {
+#ifdef DIRECTIONAL_LIGHT
+            light_position = normalize(l[0]);
+#endif
+#ifdef USE_SHADOWS
+            intensity *= shadow();
+#endif
+        }
+        color += phong(normals, light_position, viewers_position, intensity);
+    }
+#endif
 
-    vec4 textureColor = useTexture ? texture(ourTexture, fragTexCoord) : vec4(1.0, 1.0, 1.0, 1.0);
+#ifdef CLUSTERED_LIGHTS
+    color += clusteredLights(normals, viewers_position);
+#endif
 
-    fcolor = vec4(ambient + diffuse + specular, 1.0) * textureColor;
+#ifdef USE_TEXTURE
+    fcolor = vec4(color, 1.0) * texture(ourTexture, fragTexCoord);
+#else
+    fcolor = vec4(color, 1.0);
+#endif
 }
@@ -24,7 +24,12 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp> // perspective, translate, rotate
 #include "geometryrender.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "ResidencyManager.h"
 #include <iostream>
+#include <chrono>
+#include <algorithm>
 #include "glm/gtx/string_cast.hpp"
 
 using namespace std;
@@ -52,34 +57,25 @@ void GeometryRender::initialize()
     viewChanged = false;
     modelChanged = false;
 
-    // Create and initialize a program object with shaders
-    program = initProgram("vshader.glsl", "fshader.glsl");
+    // Build the common shader variants in one batch, from the disk cache when possible
+    programCache.init("shadercache");
+    shaders.init(&programCache, "vshader.glsl", "fshader.glsl");
+    shaders.precompile({
+        SHADER_TEXCOORD | SHADER_OCCLUSION | SHADER_SHADOWS | SHADER_LIGHTS(1),
+        SHADER_TEXCOORD | SHADER_OCCLUSION | SHADER_TEXTURE | SHADER_SHADOWS | SHADER_LIGHTS(1),
+        SHADER_TEXCOORD | SHADER_OCCLUSION | SHADER_LIGHTS(0),
+        SHADER_TEXCOORD | SHADER_OCCLUSION | SHADER_TEXTURE | SHADER_LIGHTS(0)
+    });
+    cout << "Shader programs: " << programCache.loadedFromDisk << " from cache, "
+         << programCache.compiled << " compiled" << endl;
+    program = shaders.program(SHADER_TEXCOORD | SHADER_OCCLUSION | SHADER_SHADOWS | SHADER_LIGHTS(1));
     debugShader();
 
     // Install the program object as part of the current rendering state
     glUseProgram(program);
 
-    // Create a vertex array object
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-
-    // Create vertex buffer in the shared display list space and
-    // bind it as VertexBuffer (GL_ARRAY_BUFFER)
-    glGenBuffers(1, &vBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vBuffer);
-
-    // Create buffer in the shared display list space and
-    // bind it as GL_ELEMENT_ARRAY_BUFFER
-    glGenBuffers(1, &iBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iBuffer);
-
-    // Create buffer in the shared display list space and
-    // bind it as texCoordBuffer
-    glGenBuffers(1, &tBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, tBuffer);
-
-    // Set the texture buffer for the model
-    object.tBuffer = tBuffer;
+    // Create the vertex array and buffers the object is uploaded into
+    objectMesh.init();
 
     // Example error checking after creating the program
     GLenum error = glGetError();
@@ -107,12 +103,25 @@ void GeometryRender::initialize()
     // Initialize the scene
     world = Scene();
     world.init(program);
+    lightClusters.init();
+    lightClusters.setProgram(program);
+    shadowMap.init(programCache.build(readProgramSource("shadow_vshader.glsl", "shadow_fshader.glsl")));
+    shadowMap.setProgram(program);
+    gpuScene.init(programCache.build(readComputeSource("cull_cshader.glsl")), objectMesh.vertexArray());
+    depthPyramid.init(programCache.build(readComputeSource("hiz_cshader.glsl")));
+    depthPrepass.init(&programCache);
+    gpuScene.attachInstances(depthPrepass.vertexArray());
+    resolutionScaler.init(programCache.build(readProgramSource("upscale_vshader.glsl", "upscale_fshader.glsl")));
 
     // Initialize the model
-    object = Model(program, vao);
+    object = Model(program, &objectMesh);
+    object.textureStreamer = &textureStreamer;
+    object.occlusionBaker = &occlusionBaker;
+    object.importArena = &importArena;
 
     // Copy object and material properties
     objFileName = object.objFileName;
+    objFilePath = object.objFilePath;
     textureFileName = object.textureFileName;
 
     materialDiffuse = object.materialDiffuse;
@@ -125,10 +134,33 @@ void GeometryRender::initialize()
     lightColor = world.lightColor;
     ambientColor = world.ambientColor;
 
+    textureBudgetMB = (int)(textureStreamer.vramBudget / (1024 * 1024));
+    textureCpuBudgetMB = (int)(textureStreamer.cpuBudget / (1024 * 1024));
+    residencyBudgetMB = (int)(ResidencyManager::get().budget / (1024 * 1024));
+
     // Load initial geometry
     object.loadGeometry();
 }
 
+/**
+ * @brief Deletes the OpenGL objects of the renderer while the context is still current.
+ *
+ * The texture streamer deletes its textures itself, as it is destroyed right after.
+ */
+GeometryRender::~GeometryRender()
+{
+    object.releaseCache();
+    objectMesh.release();
+    gpuScene.release();
+    lightClusters.release();
+    shadowMap.release();
+    depthPyramid.release();
+    resolutionScaler.release();
+    MemoryTracker::get().releaseGpu(GL_TEXTURE, softwareTexture);
+    glDeleteTextures(1, &softwareTexture);
+    glDeleteFramebuffers(1, &softwareFramebuffer);
+}
+
 /**
  * @brief Changes the loaded 3D model to a new one.
  *
@@ -143,6 +175,7 @@ void GeometryRender::changeObject()
 {
 
     firstRun = true;
+    geometryRevision++;
     object.latestObj = object.objFileName;
     object.objFilePath = objFilePath;
     object.objFileName = objFileName;
@@ -167,6 +200,19 @@ void GeometryRender::changeTexture()
     object.changeTextures();
 }
 
+/**
+ * @brief Changes the normal map of the loaded 3D model.
+ *
+ * This function updates the object's normal map file path and name and
+ * hands the new file over to the texture streamer.
+ */
+void GeometryRender::changeNormalMap()
+{
+    object.normalMapFilePath = normalMapFilePath;
+    object.normalMapFileName = normalMapFileName;
+    object.changeNormalMap();
+}
+
 /**
  * @brief Checks for any errors reported from the shader.
  *
@@ -214,6 +260,77 @@ bool GeometryRender::getTxtShow()
     return object.textureShow;
 }
 
+/**
+ * @brief Sets whether the normal map should be used or not.
+ *
+ * @param value Boolean indicating whether to use the normal map (`true`) or not (`false`).
+ */
+void GeometryRender::setNormalMapShow(bool value)
+{
+    object.normalMapShow = value;
+}
+
+/**
+ * @brief Retrieves whether the normal map is used.
+ *
+ * @return Boolean indicating whether the normal map is used (`true`) or not (`false`).
+ */
+bool GeometryRender::getNormalMapShow()
+{
+    return object.normalMapShow;
+}
+
+/**
+ * @brief Collects the shader features the current draw needs.
+ *
+ * Lighting, and with it shadows, is compiled out entirely while the light is switched off (black).
+ *
+ * @return The feature mask used to pick a program from the shader variants.
+ */
+unsigned int GeometryRender::shaderFeatures() const
+{
+    unsigned int features = SHADER_TEXCOORD;
+
+    if (object.textureShow)
+        features |= SHADER_TEXTURE;
+    if (object.normalMapShow && object.normalMap != 0)
+        features |= SHADER_NORMAL_MAP;
+
+    features |= SHADER_LIGHTS(world.lightColor != glm::vec3(0.0f) ? 1 : 0);
+    if (!world.lights.empty())
+        features |= SHADER_CLUSTERED;
+    if (shadowsEnabled && !(gpuDriven && renderMode == 0))
+        features |= SHADER_SHADOWS;
+    if (world.lightDirectional)
+        features |= SHADER_DIRECTIONAL;
+    if (bakedOcclusion)
+        features |= SHADER_OCCLUSION;
+    if (gpuDriven && renderMode == 0)
+        features |= SHADER_INSTANCED;
+    return ShaderVariants::normalize(features);
+}
+
+/**
+ * @brief Takes a different shader variant into use.
+ *
+ * @param variant The program to use from now on.
+ *
+ * Uniform locations differ between programs and every program keeps its own
+ * uniform values, so the locations are looked up again and all uniforms are resent.
+ */
+void GeometryRender::useVariant(GLuint variant)
+{
+    program = variant;
+    glUseProgram(program);
+    PROFILE_STATE_CHANGES(1);
+    camera.setProgram(program);
+    world.init(program);
+    object.setProgram(program);
+    lightClusters.setProgram(program);
+    shadowMap.setProgram(program);
+    firstRun = true;
+}
+
 bool GeometryRender::handleMaterial() {
     bool updateModel = false;
     if (object.materialDiffuse != materialDiffuse){
@@ -243,10 +360,526 @@ bool GeometryRender::lightIsChanged() {
     return (
             lightColor != world.lightColor ||
             lightPos != world.lightPos ||
-            ambientColor != world.ambientColor
+            ambientColor != world.ambientColor ||
+            lightDirectional != world.lightDirectional
     );
 }
 
+/**
+ * @brief Estimates how many pixels the object covers on screen.
+ *
+ * Projects the object's bounding sphere with the current projection matrix.
+ * For parallel projections the size does not depend on the distance to the camera.
+ *
+ * @return The approximate on-screen diameter of the object in pixels.
+ */
+float GeometryRender::screenFootprint() const {
+    glm::vec3 center = glm::vec3(object.modelMat * glm::vec4(object.boundingCenter, 1.0f));
+    float scale = std::max(glm::length(glm::vec3(object.modelMat[0])),
+                           std::max(glm::length(glm::vec3(object.modelMat[1])),
+                                    glm::length(glm::vec3(object.modelMat[2]))));
+    float radius = object.boundingRadius * scale;
+
+    float pixels = radius * camera.projectionMatrix[1][1] * height();
+    if (camera.projectionMatrix[3][3] == 0.0f) {
+        float distance = glm::length(center - camera.eye);
+        if (distance <= radius)
+            return std::numeric_limits<float>::max();
+        pixels /= distance;
+    }
+    return pixels;
+}
+
+/**
+ * @brief Streams the object's texture according to its on-screen size.
+ *
+ * Applies the budget from the GUI, reports the object's footprint while the texture is
+ * shown and lets the streamer upload or evict mip levels for this frame.
+ */
+void GeometryRender::handleTextureStreaming() {
+    PROFILE_SCOPE("Texture streaming");
+    textureStreamer.vramBudget = (size_t)textureBudgetMB * 1024 * 1024;
+    textureStreamer.cpuBudget = (size_t)textureCpuBudgetMB * 1024 * 1024;
+
+    if (object.textureShow)
+        textureStreamer.reportFootprint(object.texture, screenFootprint());
+    if (object.normalMapShow)
+        textureStreamer.reportFootprint(object.normalMap, screenFootprint());
+    textureStreamer.update();
+
+    textureResidentMB = textureStreamer.residentBytes() / (1024.0f * 1024.0f);
+    textureDecodedMB = textureStreamer.decodedBytes() / (1024.0f * 1024.0f);
+    textureResidentLevel = textureStreamer.residentLevel(object.texture);
+}
+
+/**
+ * @brief Keeps what is drawn this frame resident and evicts the rest while over the VRAM budget.
+ *
+ * Runs after the texture streaming, which marks the textures drawn this frame.
+ */
+void GeometryRender::handleResidency() {
+    ResidencyManager& residency = ResidencyManager::get();
+    residency.budget = (size_t)residencyBudgetMB * 1024 * 1024;
+    object.markDrawn();
+    residency.update();
+}
+
+/**
+ * @brief Keeps the CPU copy of the object's geometry only while something needs it.
+ *
+ * With dropCpuCopies set the copy is dropped after upload, and read back from the
+ * buffers while the CPU renderers use it or the occlusion culler needs new occluders.
+ */
+void GeometryRender::handleCpuMesh() {
+    bool needed = renderMode != 0 || (gpuDriven && occlusionCulling && occluderRevision != geometryRevision);
+    object.keepCpuMesh = needed || !dropCpuCopies;
+    if (object.keepCpuMesh)
+        object.restoreCpuMesh();
+    else
+        object.dropCpuMesh();
+}
+
+/**
+ * @brief Bins the showroom lights into the clusters and binds them for the draw.
+ *
+ * Binning runs every frame, since the clusters follow the camera. The tiles are sized
+ * from the viewport, which is in framebuffer pixels like gl_FragCoord.
+ */
+void GeometryRender::handleLightClusters() {
+    if (world.lights.empty())
+        return;
+    PROFILE_SCOPE("Light clusters");
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    lightClusters.update(world.lights, camera.viewMatrix, camera.projectionMatrix,
+                         camera.nearplane, camera.farplane);
+    lightClusters.bind(viewport[2], viewport[3]);
+
+    clusterMaxLights = lightClusters.maxLightsPerCluster;
+    clusterAverageLights = lightClusters.averageLightsPerCluster;
+}
+
+/**
+ * @brief Brings the shadow map up to date with the light and the object and binds it.
+ *
+ * The shadow map only renders the layers whose light matrix or caster changed, so
+ * nothing is rendered while the scene and the light stand still.
+ */
+void GeometryRender::handleShadows() {
+    if (!(shaderFeatures() & SHADER_SHADOWS))
+        return;
+    PROFILE_SCOPE("Shadows");
+    PROFILE_GPU_SCOPE("Shadows");
+
+    shadowMap.setCaster(object.modelMat, object.boundingCenter, object.boundingRadius, geometryRevision);
+    if (world.lightDirectional)
+        shadowMap.updateDirectionalLight(world.lightPos, camera.viewMatrix, camera.projectionMatrix,
+                                         camera.nearplane, camera.farplane);
+    else
+        shadowMap.updatePointLight(world.lightPos);
+
+    int rendered = shadowMap.render([this]() {
+        glBindVertexArray(objectMesh.vertexArray());
+        glDrawElements(GL_TRIANGLES, object.getIndices(), GL_UNSIGNED_INT, 0);
+        PROFILE_DRAWS(1, object.getIndices() / 3);
+        PROFILE_STATE_CHANGES(1);
+    });
+    if (rendered > 0) {
+        glUseProgram(program);
+        glBindVertexArray(objectMesh.vertexArray());
+        PROFILE_STATE_CHANGES(2);
+    }
+
+    shadowMap.bind();
+    PROFILE_STATE_CHANGES(1);
+    shadowRenders = shadowMap.renders;
+}
+
+/**
+ * @brief Draws the object alone, through the depth pre-pass when it is on.
+ *
+ * With meshlet culling the meshlets are culled once and the same ranges are drawn in
+ * both passes.
+ */
+void GeometryRender::drawObject() {
+    PROFILE_SCOPE("Object");
+    bool meshlets = meshletCulling && !object.meshlets.empty();
+    if (meshlets)
+        cullMeshlets();
+
+    if (depthPrepassEnabled) {
+        PROFILE_GPU_SCOPE("Depth pre-pass");
+        beginDepthPrepass();
+        depthPrepass.use(0, camera.projectionMatrix, camera.viewMatrix, object.modelMat);
+        drawObjectRanges(meshlets);
+        glUseProgram(program);
+        glBindVertexArray(objectMesh.vertexArray());
+        PROFILE_STATE_CHANGES(2);
+    }
+    depthPrepass.beginShading();
+    drawObjectRanges(meshlets);
+    depthPrepass.end();
+}
+
+/**
+ * @brief Culls the meshlets of the object against the view.
+ *
+ * The meshlets are culled on the workers of the JobSystem, and sorted front to back when that
+ * order is on.
+ */
+void GeometryRender::cullMeshlets() {
+    PROFILE_SCOPE("Meshlet culling");
+    object.meshlets.cull(object.modelMat, camera.viewMatrix, camera.projectionMatrix, meshletConeCulling,
+                         frontToBack, JobSystem::get(), meshletDraws);
+
+    meshletCount = (int)object.meshlets.size();
+    meshletsVisible = (int)meshletDraws.visibleMeshlets;
+    meshletTriangles = (int)meshletDraws.visibleTriangles;
+}
+
+/**
+ * @brief Draws the object with the program and vertex array in use.
+ *
+ * @param meshlets Whether only the visible meshlet ranges are drawn, with one call.
+ */
+void GeometryRender::drawObjectRanges(bool meshlets) {
+    if (!meshlets) {
+        glDrawElements(GL_TRIANGLES, object.getIndices(), GL_UNSIGNED_INT, 0);
+        PROFILE_DRAWS(1, object.getIndices() / 3);
+    } else if (!meshletDraws.counts.empty()) {
+        glMultiDrawElements(GL_TRIANGLES, meshletDraws.counts.data(), GL_UNSIGNED_INT, meshletDraws.offsets.data(),
+                            (GLsizei)meshletDraws.counts.size());
+        PROFILE_DRAWS(1, (long long)meshletDraws.visibleTriangles);
+    }
+}
+
+/**
+ * @brief Starts the depth pre-pass, taking the object's buffers again after a new object was loaded.
+ */
+void GeometryRender::beginDepthPrepass() {
+    if (prepassRevision != geometryRevision) {
+        prepassRevision = geometryRevision;
+        depthPrepass.setMesh(objectMesh.vertexArray());
+    }
+    depthPrepass.begin();
+}
+
+/**
+ * @brief Draws the grid of instances with GPU culling and one indirect draw.
+ *
+ * The CPU work does not depend on the number of instances, except when the grid or the
+ * object's transform changes and the instances are uploaded again, or when occlusion
+ * culling is on and every instance is tested on the CPU first. Hi-Z culling stays on
+ * the GPU, at the cost of a depth copy, the pyramid build and a second dispatch and draw.
+ */
+void GeometryRender::drawInstances() {
+    PROFILE_SCOPE("Instances");
+    updateInstances();
+
+    // Tints of the current material, cheap enough to send every frame
+    vector<GpuMaterial>& materials = instanceMaterials;
+    materials.resize(INSTANCE_MATERIALS);
+    for (int i = 0; i < INSTANCE_MATERIALS; i++) {
+        float hue = (float)i / INSTANCE_MATERIALS;
+        glm::vec3 tint = i == 0 ? glm::vec3(1.0f)
+                                : 0.6f + 0.4f * glm::cos(6.2831853f * (hue + glm::vec3(0.0f, 1.0f / 3.0f, 2.0f / 3.0f)));
+        materials[i].ambient = glm::vec4(object.materialAmbient * tint, 0.0f);
+        materials[i].diffuse = glm::vec4(object.materialDiffuse * tint, 0.0f);
+        materials[i].specular = glm::vec4(object.materialSpecular, object.materialShininess);
+    }
+    gpuScene.setMaterials(materials);
+
+    if (occlusionCulling) {
+        cullOccludedInstances();
+    } else {
+        gpuScene.clearVisibility();
+        occlusionTested = occlusionCulled = occlusionOccluders = 0;
+        occlusionRasterMs = 0.0f;
+    }
+
+    // With Hi-Z culling the pyramid is rebuilt from the early draws before the late pass.
+    // With the depth pre-pass both go into the pre-pass, and are drawn again to be shaded.
+    glm::mat4 viewProjection = camera.projectionMatrix * camera.viewMatrix;
+    auto useDrawProgram = [this]() {
+        if (depthPrepassEnabled) {
+            depthPrepass.use(SHADER_INSTANCED, camera.projectionMatrix, camera.viewMatrix, object.modelMat);
+        } else {
+            glUseProgram(program);
+            PROFILE_STATE_CHANGES(1);
+        }
+    };
+    gpuScene.setDepthPyramid(hizCulling ? &depthPyramid : nullptr);
+    {
+        PROFILE_GPU_SCOPE("Culling");
+        gpuScene.cull(viewProjection, object.getIndices());
+    }
+    if (depthPrepassEnabled)
+        beginDepthPrepass();
+    else
+        depthPrepass.beginShading();
+    useDrawProgram();
+    gpuScene.draw();
+    if (hizCulling) {
+        {
+            PROFILE_GPU_SCOPE("Hi-Z");
+            depthPyramid.build(viewProjection);
+            gpuScene.cullLate(viewProjection, object.getIndices());
+        }
+        useDrawProgram();
+        gpuScene.drawLate();
+    }
+    if (depthPrepassEnabled) {
+        depthPrepass.beginShading();
+        glUseProgram(program);
+        glBindVertexArray(objectMesh.vertexArray());
+        PROFILE_STATE_CHANGES(2);
+        gpuScene.draw();
+        gpuScene.drawLate();
+    }
+    depthPrepass.end();
+
+    gpuInstances = (int)gpuScene.size();
+    gpuVisibleInstances = gpuScene.visibleObjects;
+    hizOccluded = gpuScene.occludedObjects;
+    hizLate = gpuScene.lateObjects;
+}
+
+/**
+ * @brief Places copies of the object on a square grid around it.
+ *
+ * The grid lies in the object's xz plane, spaced a little wider than the object. It is
+ * centered on the object in x and extends away from the default camera in z, so no copy
+ * ends up in front of the object.
+ *
+ * In front to back order the instances are sorted by their distance from the eye again
+ * whenever the camera moves. The culling shader appends the draw commands with atomics,
+ * so the order is only kept as far as the GPU runs its work groups in order, which it
+ * mostly does.
+ */
+void GeometryRender::updateInstances() {
+    if (builtInstanceGrid == instanceGrid && builtInstanceModel == object.modelMat &&
+        builtInstanceRevision == geometryRevision && builtInstanceSorted == frontToBack &&
+        (!frontToBack || builtInstanceEye == camera.eye))
+        return;
+    builtInstanceGrid = instanceGrid;
+    builtInstanceModel = object.modelMat;
+    builtInstanceRevision = geometryRevision;
+    builtInstanceSorted = frontToBack;
+    builtInstanceEye = camera.eye;
+
+    float spacing = 2.5f * object.boundingRadius;
+    float startX = -0.5f * (instanceGrid - 1) * spacing;
+    instances.assign(instanceGrid * instanceGrid, GpuObject());
+    for (int z = 0; z < instanceGrid; z++) {
+        for (int x = 0; x < instanceGrid; x++) {
+            GpuObject& instance = instances[z * instanceGrid + x];
+            glm::vec3 offset(startX + x * spacing, 0.0f, -z * spacing);
+            instance.model = glm::translate(object.modelMat, offset);
+            instance.bounds = glm::vec4(object.boundingCenter, object.boundingRadius);
+            instance.material = (GLuint)((abs(x - instanceGrid / 2) + z) % INSTANCE_MATERIALS);
+        }
+    }
+
+    // Sorted through members, as this runs every frame the camera moves
+    if (frontToBack) {
+        vector<pair<float, size_t>>& order = instanceOrder;
+        order.resize(instances.size());
+        for (size_t i = 0; i < instances.size(); i++) {
+            glm::vec3 center = glm::vec3(instances[i].model * glm::vec4(glm::vec3(instances[i].bounds), 1.0f));
+            order[i] = make_pair(glm::dot(center - camera.eye, center - camera.eye), i);
+        }
+        sort(order.begin(), order.end());
+        sortedInstances.resize(instances.size());
+        for (size_t i = 0; i < order.size(); i++)
+            sortedInstances[i] = instances[order[i].second];
+        instances.swap(sortedInstances);
+    }
+    gpuScene.setObjects(instances);
+}
+
+/**
+ * @brief Marks the instances hidden behind the nearest ones and hands the mask to the GPU culling.
+ *
+ * The instances covering the most of the screen are rasterized as occluders, then every
+ * instance's bounding box is tested against them. The work is split over the culling
+ * threads, while the GPU is still busy with the previous frame.
+ */
+void GeometryRender::cullOccludedInstances() {
+    PROFILE_SCOPE("Occlusion culling");
+    if (occluderRevision != geometryRevision) {
+        occluderRevision = geometryRevision;
+        occlusionCuller.setOccluderMesh(object.getVertices(), object.getIndexData());
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glm::mat4 viewProjection = camera.projectionMatrix * camera.viewMatrix;
+    occlusionCuller.begin(viewProjection, (float)viewport[2] / max(1, viewport[3]));
+
+    // Approximate height on screen of each instance, from its bounding sphere
+    vector<pair<float, size_t>>& candidates = occluderCandidates;
+    candidates.clear();
+    for (size_t i = 0; i < instances.size(); i++) {
+        const GpuObject& instance = instances[i];
+        glm::vec4 center = viewProjection * instance.model * glm::vec4(glm::vec3(instance.bounds), 1.0f);
+        float scale = glm::length(glm::vec3(instance.model[0]));
+        float size = instance.bounds.w * scale * camera.projectionMatrix[1][1] / max(center.w, 1e-4f);
+        if (center.w > instance.bounds.w * scale && size >= OCCLUSION_MIN_OCCLUDER_SIZE)
+            candidates.push_back(make_pair(size, i));
+    }
+    size_t occluders = min<size_t>(OCCLUSION_MAX_OCCLUDERS, candidates.size());
+    partial_sort(candidates.begin(), candidates.begin() + occluders, candidates.end(),
+                 [](const pair<float, size_t>& a, const pair<float, size_t>& b) { return a.first > b.first; });
+    for (size_t i = 0; i < occluders; i++)
+        occlusionCuller.addOccluder(instances[candidates[i].second].model);
+    occlusionCuller.rasterize(JobSystem::get());
+
+    // Each task owns whole words of the mask
+    const size_t chunk = 32 * 8;
+    size_t chunks = (instances.size() + chunk - 1) / chunk;
+    instanceVisibility.assign((instances.size() + 31) / 32, 0u);
+    vector<int>& culled = culledPerChunk;
+    culled.assign(chunks, 0);
+    JobSystem::get().parallelFor(chunks, [&](size_t c) {
+        size_t end = min(instances.size(), (c + 1) * chunk);
+        for (size_t i = c * chunk; i < end; i++) {
+            OcclusionCuller::Visibility visibility =
+                occlusionCuller.testBox(instances[i].model, object.boundingMin, object.boundingMax);
+            if (visibility == OcclusionCuller::OCCLUDED)
+                culled[c]++;
+            else
+                instanceVisibility[i / 32] |= 1u << (i % 32);
+        }
+    });
+    gpuScene.setVisibility(instanceVisibility);
+
+    occlusionTested = (int)instances.size();
+    occlusionCulled = 0;
+    for (int count : culled)
+        occlusionCulled += count;
+    occlusionOccluders = occlusionCuller.occluderCount;
+    occlusionRasterMs = occlusionCuller.rasterMs;
+}
+
+/**
+ * @brief Renders the frame with the CPU backend and copies it to the window.
+ *
+ * The software renderer gets the same mesh, matrices, light and material as the OpenGL
+ * path.
+ */
+void GeometryRender::renderSoftware() {
+    PROFILE_SCOPE("CPU rasterizer");
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    int w = viewport[2], h = viewport[3];
+
+    auto start = std::chrono::steady_clock::now();
+
+    softwareRenderer.resize(w, h);
+    softwareRenderer.clear(glm::vec4(0.2f, 0.2f, 0.2f, 0.0f));
+
+    RasterMesh mesh;
+    mesh.positions = object.getVertices().data();
+    mesh.normals = object.getNormals().data();
+    mesh.texCoords = object.getTexCoords().size() == object.getVertices().size() ? object.getTexCoords().data() : nullptr;
+    mesh.vertexCount = object.getVertices().size();
+    mesh.indices = object.getIndexData().data();
+    mesh.indexCount = object.getIndexData().size();
+    mesh.occlusion = bakedOcclusion && object.getOcclusion().size() == mesh.vertexCount ? object.getOcclusion().data() : nullptr;
+
+    RasterMaterial material = { object.materialAmbient, object.materialDiffuse,
+                                object.materialSpecular, object.materialShininess };
+    RasterLight light = { world.ambientColor, world.lightColor, world.lightPos, world.lightDirectional };
+    const RasterTexture* texture = object.textureShow ? softwareRenderer.loadTexture(object.getTexturePath()) : nullptr;
+
+    softwareRenderer.draw(mesh, object.modelMat, camera.viewMatrix, camera.projectionMatrix, camera.eye,
+                          material, light, texture);
+
+    softwareFrameMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    softwareTriangles = (int)softwareRenderer.trianglesRasterized;
+
+    presentImage(softwareRenderer.colorBuffer().data(), viewport);
+}
+
+/**
+ * @brief Adds samples to the path traced image and copies it to the window.
+ *
+ * The path tracer gets the same mesh, camera, light and material as the other
+ * backends. It starts over whenever any of them change and refines the image for up to
+ * PATH_FRAME_BUDGET_MS each frame otherwise.
+ */
+void GeometryRender::renderPathTraced() {
+    PROFILE_SCOPE("Path tracer");
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    RasterMesh mesh;
+    mesh.positions = object.getVertices().data();
+    mesh.normals = object.getNormals().data();
+    mesh.texCoords = object.getTexCoords().size() == object.getVertices().size() ? object.getTexCoords().data() : nullptr;
+    mesh.vertexCount = object.getVertices().size();
+    mesh.indices = object.getIndexData().data();
+    mesh.indexCount = object.getIndexData().size();
+    mesh.occlusion = nullptr;
+
+    RasterMaterial material = { object.materialAmbient, object.materialDiffuse,
+                                object.materialSpecular, object.materialShininess };
+    RasterLight light = { world.ambientColor, world.lightColor, world.lightPos, world.lightDirectional };
+    const RasterTexture* texture = object.textureShow ? softwareRenderer.loadTexture(object.getTexturePath()) : nullptr;
+
+    pathTracer.resize(viewport[2], viewport[3]);
+    pathTracer.setScene(mesh, object.modelMat, geometryRevision);
+    pathTracer.setCamera(camera.viewMatrix, camera.projectionMatrix);
+    pathTracer.setShading(material, light, texture, pathBounces);
+    pathTracer.render(PATH_FRAME_BUDGET_MS);
+
+    pathSamples = pathTracer.samples;
+    pathRaysPerSecond = (float)pathTracer.raysPerSecond;
+    pathBvhNodes = (int)pathTracer.bvhNodes;
+    pathBvhBuildMs = pathTracer.bvhBuildMs;
+
+    presentImage(pathTracer.colorBuffer().data(), viewport);
+}
+
+/**
+ * @brief Shows an image rendered on the CPU in the viewport.
+ *
+ * @param pixels Packed RGBA8 pixels of the viewport's size, top row first.
+ * @param viewport The current viewport.
+ *
+ * The image is uploaded to a texture and blitted to the default framebuffer, flipped
+ * since it is stored top row first.
+ */
+void GeometryRender::presentImage(const uint32_t* pixels, const GLint viewport[4]) {
+    int w = viewport[2], h = viewport[3];
+
+    if (softwareTexture == 0) {
+        glGenTextures(1, &softwareTexture);
+        glGenFramebuffers(1, &softwareFramebuffer);
+    }
+    glBindTexture(GL_TEXTURE_2D, softwareTexture);
+    if (w != softwareTextureWidth || h != softwareTextureHeight) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, softwareFramebuffer);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, softwareTexture, 0);
+        softwareTextureWidth = w;
+        softwareTextureHeight = h;
+        MemoryTracker::get().trackGpu(GL_TEXTURE, softwareTexture, "CPU rendered image", (size_t)w * h * 4);
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, softwareFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, w, h, viewport[0], viewport[1] + h, viewport[0] + w, viewport[1], GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    PROFILE_STATE_CHANGES(5);
+}
+
 void GeometryRender::handleProjection(){
     bool updateCamera = false;
 
@@ -295,11 +928,34 @@ void GeometryRender::handleProjection(){
 void GeometryRender::display()
 {
 
-    if(object.objFileName == "sphere_large.obj" && object.textureShow && object.textureFileName == "erf.jpg")
+    if(object.earth && object.textureShow)
         rotateEarth();
 
+    bool lightChanged = lightIsChanged();
+    if (lightChanged) {
+        world.lightPos = lightPos;
+        world.lightColor = lightColor;
+        world.ambientColor = ambientColor;
+        world.lightDirectional = lightDirectional;
+    }
+    if ((int)world.lights.size() != showroomLights)
+        world.generateLights(showroomLights, 1);
+
+    occlusionBakeMs = occlusionBaker.bakeMs;
+    occlusionCached = occlusionBaker.fromCache;
+    importTemporaries = (int)object.importTemporaries;
+    importTemporaryKB = object.importTemporaryBytes / 1024.0f;
+    importArenaBlocks = (int)object.importArenaBlocks;
+    importHeapAllocations = (int)object.importHeapAllocations;
+
+    // Pick the shader variant for the features this draw uses
+    GLuint variant = shaders.program(shaderFeatures());
+    if (variant != program)
+        useVariant(variant);
+
     glUseProgram(program);
-    glBindVertexArray(vao);
+    glBindVertexArray(objectMesh.vertexArray());
+    PROFILE_STATE_CHANGES(2);
 
     if(firstRun)
     {
@@ -310,6 +966,9 @@ void GeometryRender::display()
         object.sendModel(true);
     }
 
+    if (lightChanged)
+        world.sendScene();
+
     bool hasSentMaterial = handleMaterial();
 
 		if (modelChanged) {
@@ -320,12 +979,21 @@ void GeometryRender::display()
     }
 
 
-    GLint useTextureLocation = glGetUniformLocation(program, "useTexture");
-    bool useTextureValue = object.textureShow;
-    if(useTextureValue){
-        glBindTexture( GL_TEXTURE_2D , object.texture );
-		}
-    glUniform1i(useTextureLocation, useTextureValue);
+    handleTextureStreaming();
+    handleResidency();
+    handleCpuMesh();
+
+    if (object.textureShow) {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_DIFFUSE);
+        glBindTexture(GL_TEXTURE_2D, object.texture);
+        PROFILE_STATE_CHANGES(1);
+    }
+    if (object.normalMapShow) {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_NORMAL_MAP);
+        glBindTexture(GL_TEXTURE_2D, object.normalMap);
+        glActiveTexture(GL_TEXTURE0);
+        PROFILE_STATE_CHANGES(1);
+    }
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -336,8 +1004,40 @@ void GeometryRender::display()
     }
 
     handleProjection();
-
-    glDrawElements(GL_TRIANGLES, object.getIndices(), GL_UNSIGNED_INT, 0);
+    if (renderMode == 1) {
+        renderSoftware();
+    } else if (renderMode == 2) {
+        renderPathTraced();
+    } else {
+        // Shadows do not depend on the resolution, so they are neither scaled nor timed
+        handleShadows();
+        {
+            PROFILE_GPU_SCOPE("Scene");
+            if (dynamicResolution)
+                resolutionScaler.begin(frameBudgetMs, minResolutionScale, maxResolutionScale);
+            handleLightClusters();
+
+            if (gpuDriven)
+                drawInstances();
+            else
+                drawObject();
+        }
+        prepassFragments = depthPrepass.depthFragments;
+        shadedFragments = depthPrepass.shadedFragments;
+
+        if (dynamicResolution) {
+            {
+                PROFILE_GPU_SCOPE("Upscale");
+                resolutionScaler.end(sharpness);
+            }
+            glUseProgram(program);
+            PROFILE_STATE_CHANGES(1);
+            resolutionScale = resolutionScaler.scale;
+            sceneGpuMs = resolutionScaler.sceneMs;
+            renderWidth = resolutionScaler.renderWidth;
+            renderHeight = resolutionScaler.renderHeight;
+        }
+    }
 
     GLenum error = glGetError();
     if (error != GL_NO_ERROR) {
@@ -347,6 +1047,11 @@ void GeometryRender::display()
     // Not to be called in release...
     debugShader();
 
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_SHADOW_MAP);
+    glBindTexture(GL_TEXTURE_2D_ARRAY , 0);
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_NORMAL_MAP);
+    glBindTexture(GL_TEXTURE_2D , 0);
+    glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D , 0);
     glBindVertexArray(0);
     glUseProgram(0);
@@ -587,6 +1292,33 @@ void GeometryRender::rotateCameraRight(float dx) {
     viewChanged = true;
 }
 
+/**
+ * @brief Returns the position of the camera and the point it looks at.
+ */
+void GeometryRender::getCamera(glm::vec3& eye, glm::vec3& center) {
+    eye = camera.eye;
+    center = camera.center;
+}
+
+/**
+ * @brief Places the camera and turns it towards a point.
+ *
+ * @param eye The new position of the camera.
+ * @param center The point to look at, ignored if it is at the camera.
+ *
+ * The yaw and the pitch are set to match, so the mouse turns the camera on from there.
+ */
+void GeometryRender::setCamera(const glm::vec3& eye, const glm::vec3& center) {
+    camera.eye = eye;
+    glm::vec3 direction = center - eye;
+    if (glm::length(direction) > 1e-6f) {
+        direction = glm::normalize(direction);
+        camera.pitch = glm::mod(glm::degrees(asin(glm::clamp(direction.y, -1.0f, 1.0f))), 360.0f);
+        camera.yaw = glm::mod(glm::degrees(atan2(direction.z, direction.x)), 360.0f);
+    }
+    calculateCameraDirection();
+}
+
 /**
  * @brief Calculate the camera's center and up based on its yaw and pitch.
  *
@@ -19,18 +19,45 @@
  * - GLM (OpenGL Mathematics)
  * - Model.h
  * - Camera.h
+ * - LightClusters.h
+ * - ShadowMap.h
+ * - SoftwareRenderer.h
+ * - PathTracer.h
+ * - OcclusionBaker.h
+ * - Meshlets.h
+ * - GpuScene.h
+ * - DepthPrepass.h
+ * - GpuMesh.h
  */
 
 #pragma once
 
-#include "include/tiny_obj_loader.h"
 #include "openglwindow.h"
 #include <glm/glm.hpp>
 #include "Model.h"
 #include "Camera.h"
+#include "TextureStreamer.h"
+#include "ShaderVariants.h"
+#include "LightClusters.h"
+#include "ShadowMap.h"
+#include "SoftwareRenderer.h"
+#include "PathTracer.h"
+#include "OcclusionBaker.h"
+#include "Meshlets.h"
+#include "GpuScene.h"
+#include "OcclusionCuller.h"
+#include "ResolutionScaler.h"
+#include "DepthPrepass.h"
+#include "GpuMesh.h"
 
 #define MOVE_CAMERA_UNIT 0.05f
 
+// Time spent refining the path traced image each frame
+#define PATH_FRAME_BUDGET_MS 30.0f
+
+// Tints the GPU driven instances cycle through
+#define INSTANCE_MATERIALS 8
+
 typedef float Mat4x4[16];
 
 class GeometryRender : public OpenGLWindow
@@ -39,6 +66,7 @@ public:
     template<typename... ARGS>
     GeometryRender(ARGS&&... args) : OpenGLWindow{ std::forward<ARGS>(args)... }
     {}
+    ~GeometryRender();
 
     void initialize() override;
     void display() override;
@@ -60,34 +88,89 @@ public:
     void rotateCameraDown(float dy) override;
     void rotateCameraLeft(float dx) override;
     void rotateCameraRight(float dx) override;
+    void getCamera(glm::vec3& eye, glm::vec3& center) override;
+    void setCamera(const glm::vec3& eye, const glm::vec3& center) override;
 
     void changeObject() override;
     void changeTexture() override;
+    void changeNormalMap() override;
 
     void setTxtShow(bool value) override;
     bool getTxtShow() override;
+    void setNormalMapShow(bool value) override;
+    bool getNormalMapShow() override;
 
 
 private:
 
 
     GLuint program;
+    ProgramCache programCache;
+    ShaderVariants shaders;
 
-    // OpenGL buffers
-    GLuint vao;
-    GLuint vBuffer;
-    GLuint iBuffer;
-    GLuint tBuffer;
+    // Vertex array and buffers of the object
+    GpuMesh objectMesh;
 
     // OpenGL attribute locations
     GLuint locModel;
 
 
+    TextureStreamer textureStreamer;
+    OcclusionBaker occlusionBaker;
+    Arena importArena;
     Model object;
     Camera camera;
     Scene world;
+    LightClusters lightClusters;
+    ShadowMap shadowMap;
+
+    // CPU rendering backend and the texture its frames are shown through
+    SoftwareRenderer softwareRenderer;
+    GLuint softwareTexture = 0;
+    GLuint softwareFramebuffer = 0;
+    int softwareTextureWidth = 0;
+    int softwareTextureHeight = 0;
+
+    PathTracer pathTracer;
+
+    // Ranges of the meshlets that survived culling
+    MeshletDraws meshletDraws;
+
+    // Instances of the object drawn through the GPU driven path, and what they were built from
+    GpuScene gpuScene;
+    std::vector<GpuObject> instances;
+    std::vector<GpuObject> sortedInstances;                    // Kept between frames to reuse their memory
+    std::vector<std::pair<float, size_t>> instanceOrder;
+    std::vector<GpuMaterial> instanceMaterials;
+    int builtInstanceGrid = 0;
+    glm::mat4 builtInstanceModel = glm::mat4(0.0f);
+    unsigned int builtInstanceRevision = 0;
+    bool builtInstanceSorted = false;
+    glm::vec3 builtInstanceEye = glm::vec3(0.0f);
+
+    // Depth of the previous frame's instances, which the GPU culling tests against
+    DepthPyramid depthPyramid;
+
+    // Hides instances behind the nearest ones before the GPU culls the rest
+    OcclusionCuller occlusionCuller;
+    std::vector<GLuint> instanceVisibility;
+    std::vector<std::pair<float, size_t>> occluderCandidates;   // Kept between frames to reuse their memory
+    std::vector<int> culledPerChunk;
+    unsigned int occluderRevision = ~0u;      // Geometry the occluder mesh was taken from, none yet
+
+    // Lays down the depth before the scene is shaded, and counts the fragments shaded
+    DepthPrepass depthPrepass;
+    unsigned int prepassRevision = ~0u;       // Geometry the pre-pass buffers were taken from, none yet
+
+    // Renders the OpenGL scene at a resolution that keeps its GPU time within the budget
+    ResolutionScaler resolutionScaler;
+
+    // Changed whenever a different object is loaded, so cached shadows are rendered again
+    unsigned int geometryRevision = 0;
 
     void debugShader(void) const;
+    unsigned int shaderFeatures() const;
+    void useVariant(GLuint variant);
     void calculateCameraDirection();
 
     void rotateEarth();
@@ -101,6 +184,22 @@ private:
 
     bool handleMaterial();
     void handleProjection();
+    void handleTextureStreaming();
+    void handleResidency();
+    void handleCpuMesh();
+    void handleLightClusters();
+    void handleShadows();
+    void drawObject();
+    void cullMeshlets();
+    void drawObjectRanges(bool meshlets);
+    void beginDepthPrepass();
+    void drawInstances();
+    void updateInstances();
+    void cullOccludedInstances();
+    void renderSoftware();
+    void renderPathTraced();
+    void presentImage(const uint32_t* pixels, const GLint viewport[4]);
+    float screenFootprint() const;
     bool lightIsChanged();
 
     bool firstRun;
@@ -10,13 +10,17 @@
  *
  * Description: Implementation of the glfwCallbackManager class, which manages GLFW callbacks.
  * It provides error, resize, and key callbacks to be used in GLFW window initialization.
+ * The input callbacks hand every event to the InputRecorder before dispatching it to the
+ * application and the GUI, and drop the real events while a recording is replayed.
  *
  * Dependencies:
  * - OpenGL (GLEW, GLFW)
  * - openglwindow.h
+ * - AllocationCounter.h
  */
 
 #include "openglwindow.h"
+#include "AllocationCounter.h"
 
 // Class for bridging between the C callback functions in glfw and C++ object
 class glfwCallbackManager
@@ -48,6 +52,7 @@ class glfwCallbackManager
      */
     static void resizeCallback(GLFWwindow* window, int width, int height)
     {
+        AllocationCounter::get().disturb();
         if(app)
             app->resizeCallback(window,width,height);
     }
@@ -61,9 +66,90 @@ class glfwCallbackManager
      * @param action The action (press, release, repeat).
      * @param mods The bitfield describing the modifier keys.
      *
-     * This function is called when a key is pressed, released, or repeated.
+     * This function is called when a key is pressed, released, or repeated. The keys of
+     * the recorder and the trace are handled here, they are never recorded or replayed.
      */
     static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+        if (!app)
+            return;
+
+        AllocationCounter::get().disturb();
+        if (key == GLFW_KEY_F9 && action == GLFW_PRESS)
+            app->toggleRecording();
+        else if (key == GLFW_KEY_F10 && action == GLFW_PRESS)
+            app->toggleReplay();
+        else if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+            app->saveTrace();
+        else if (key != GLFW_KEY_F9 && key != GLFW_KEY_F10 && key != GLFW_KEY_F12)
+            input(InputRecorder::event('k', key, scancode, action, mods));
+    }
+
+    static void char_callback(GLFWwindow* window, unsigned int codepoint) {
+        input(InputRecorder::event('c', (int)codepoint));
+    }
+
+    static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+        input(InputRecorder::event('b', button, action, mods));
+    }
+
+    static void cursor_pos_callback(GLFWwindow* window, double x, double y) {
+        input(InputRecorder::event('m', x, y));
+    }
+
+    static void scroll_callback(GLFWwindow* window, double x, double y) {
+        input(InputRecorder::event('s', x, y));
+    }
+
+    static void cursor_enter_callback(GLFWwindow* window, int entered) {
+        input(InputRecorder::event('e', entered));
+    }
+
+    static void focus_callback(GLFWwindow* window, int focused) {
+        input(InputRecorder::event('f', focused));
+    }
+
+    /**
+     * @brief Records an event of the window and dispatches it, unless a recording is replayed.
+     */
+    static void input(const InputRecorder::Event& event) {
+        if (!app || app->input.mode() == InputRecorder::Replaying)
+            return;
+        app->input.record(event);
+        dispatch(event);
+    }
+
+    /**
+     * @brief Hands a real or a replayed event to the application and the GUI.
+     *
+     * Keys only go to the application, the other events to the GUI, as before the events
+     * were recorded. Any event but a mouse move may start work that allocates, so the
+     * frames after it are not steady.
+     */
+    static void dispatch(const InputRecorder::Event& event) {
+        if (!app)
+            return;
+        if (event.type != 'm')
+            AllocationCounter::get().disturb();
+        GLFWwindow* window = app->window();
+        const int* values = event.values;
+        switch (event.type) {
+            case 'k': handleKey(values[0], values[2]); break;
+            case 'c': ImGui_ImplGlfw_CharCallback(window, (unsigned int)values[0]); break;
+            case 'b': ImGui_ImplGlfw_MouseButtonCallback(window, values[0], values[1], values[2]); break;
+            case 'm': ImGui_ImplGlfw_CursorPosCallback(window, event.x, event.y); break;
+            case 's': ImGui_ImplGlfw_ScrollCallback(window, event.x, event.y); break;
+            case 'e': ImGui_ImplGlfw_CursorEnterCallback(window, values[0]); break;
+            case 'f': ImGui_ImplGlfw_WindowFocusCallback(window, values[0]); break;
+        }
+    }
+
+    /**
+     * @brief Moves the object and the camera by a key.
+     *
+     * @param key The key.
+     * @param action The action (press, release, repeat).
+     */
+    static void handleKey(int key, int action) {
         if (app) {
 
             if (key == GLFW_KEY_UP && (action == GLFW_PRESS || action == GLFW_REPEAT))
@@ -159,5 +245,14 @@ public:
         glfwSetFramebufferSizeCallback(app->window() , resizeCallback);
         glfwSetKeyCallback(app->window(), key_callback);
 
+        // Replace the GUI's callbacks, which are called from dispatch() instead
+        glfwSetCharCallback(app->window(), char_callback);
+        glfwSetMouseButtonCallback(app->window(), mouse_button_callback);
+        glfwSetCursorPosCallback(app->window(), cursor_pos_callback);
+        glfwSetScrollCallback(app->window(), scroll_callback);
+        glfwSetCursorEnterCallback(app->window(), cursor_enter_callback);
+        glfwSetWindowFocusCallback(app->window(), focus_callback);
+        app->input.setDispatcher(dispatch);
+
     }
 };
@@ -0,0 +1,30 @@
+#version 430
+
+// Builds one level of a DepthPyramid. Every texel gets the farthest depth of the texels
+// it covers in the source, which is the level below or the copied depth buffer.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(r32f, binding = 0) writeonly uniform image2D destination;
+uniform sampler2D source;
+uniform int sourceLevel;
+
+void main()
+{
+    ivec2 size = imageSize(destination);
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, size)))
+        return;
+
+    // Covered source texels, more than 2x2 when the first level does not halve the depth buffer exactly
+    ivec2 sourceSize = textureSize(source, sourceLevel);
+    ivec2 first = texel * sourceSize / size;
+    ivec2 last = min(((texel + 1) * sourceSize + size - 1) / size, sourceSize) - 1;
+
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; y++) {
+        for (int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, texelFetch(source, ivec2(x, y), sourceLevel).r);
+    }
+    imageStore(destination, texel, vec4(farthest));
+}
@@ -7,16 +7,135 @@
 
 #include "geometryrender.h"
 #include "glfwcallbackmanager.h"
+#include "BatchRenderer.h"
+#include "TraceRecorder.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 
 OpenGLWindow* glfwCallbackManager::app = nullptr;
 
+static int usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [--render <objdir> --out <dir> [--size N] [--frames N] [--cpu]]"
+              << " [--trace <file> [--trace-seconds N]]" << std::endl
+              << "       " << program << " [--record <file> | --replay <file> | --flythrough <file>]"
+              << " [--benchmark N [--warmup N] [--summary <file>]]" << std::endl
+              << "  --render  render every OBJ file of <objdir> without a window" << std::endl
+              << "  --out     directory for the PNG images" << std::endl
+              << "  --size    width and height of the images, default 256" << std::endl
+              << "  --frames  frames per turntable, default 1 renders a thumbnail" << std::endl
+              << "  --cpu     use the CPU renderer instead of OpenGL" << std::endl
+              << "  --trace   write a Chrome trace of the last seconds to <file> on exit" << std::endl
+              << "  --trace-seconds  length of the trace, default 10" << std::endl
+              << "  --record      record the input to <file> until the window closes" << std::endl
+              << "  --replay      replay the input recorded in <file>" << std::endl
+              << "  --flythrough  fly the camera along the path in <file>" << std::endl
+              << "  --benchmark   measure N frames, 0 measures the whole replay or flythrough, then exit" << std::endl
+              << "  --warmup      frames run before measuring, default " << BENCHMARK_DEFAULT_WARMUP << std::endl
+              << "  --summary     JSON file for the benchmark summary, default " << BENCHMARK_DEFAULT_SUMMARY << std::endl;
+    return EXIT_FAILURE;
+}
+
 int main(int argc, char **argv)
 {
+    TRACE_THREAD_NAME("Main");
+    std::string tracePath;
+    double traceSeconds = TRACE_DEFAULT_SECONDS;
+    std::string recordPath;
+    std::string replayPath;
+    std::string flythroughPath;
+    std::string summaryPath;
+    int benchmarkFrames = -1;
+    int warmupFrames = BENCHMARK_DEFAULT_WARMUP;
+    bool batch = false;
+    BatchOptions options;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--trace") && hasValue) {
+            tracePath = argv[++i];
+            continue;
+        }
+        if (!strcmp(argv[i], "--trace-seconds") && hasValue) {
+            traceSeconds = atof(argv[++i]);
+            continue;
+        }
+        if (!strcmp(argv[i], "--record") && hasValue) {
+            recordPath = argv[++i];
+            continue;
+        }
+        if (!strcmp(argv[i], "--replay") && hasValue) {
+            replayPath = argv[++i];
+            continue;
+        }
+        if (!strcmp(argv[i], "--flythrough") && hasValue) {
+            flythroughPath = argv[++i];
+            continue;
+        }
+        if (!strcmp(argv[i], "--benchmark") && hasValue) {
+            benchmarkFrames = atoi(argv[++i]);
+            continue;
+        }
+        if (!strcmp(argv[i], "--warmup") && hasValue) {
+            warmupFrames = atoi(argv[++i]);
+            continue;
+        }
+        if (!strcmp(argv[i], "--summary") && hasValue) {
+            summaryPath = argv[++i];
+            continue;
+        }
+
+        batch = true;
+        if (!strcmp(argv[i], "--render") && hasValue)
+            options.inputDir = argv[++i];
+        else if (!strcmp(argv[i], "--out") && hasValue)
+            options.outputDir = argv[++i];
+        else if (!strcmp(argv[i], "--size") && hasValue)
+            options.size = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--frames") && hasValue)
+            options.frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--cpu"))
+            options.cpu = true;
+        else
+            return usage(argv[0]);
+    }
+
+    if (batch) {
+        if (options.inputDir.empty() || options.outputDir.empty())
+            return usage(argv[0]);
+
+        BatchRenderer renderer(options);
+        int status = renderer.run();
+        if (!tracePath.empty())
+            TraceRecorder::get().write(tracePath, traceSeconds);
+        return status;
+    }
+
+    // A benchmark of 0 frames runs until the replay or the flythrough ends
+    bool workload = !replayPath.empty() || !flythroughPath.empty();
+    if ((!recordPath.empty() && !replayPath.empty()) || (benchmarkFrames == 0 && !workload) ||
+        benchmarkFrames < -1)
+        return usage(argv[0]);
 
     GeometryRender app("3D Studio", 900, 900);
+    app.traceSeconds = (float)traceSeconds;
     glfwCallbackManager::initCallbacks(&app);
     app.initialize();
 
+    if (!recordPath.empty()) {
+        app.inputPath = recordPath;
+        app.toggleRecording();
+    }
+    if (!replayPath.empty() && !app.replayInput(replayPath))
+        return EXIT_FAILURE;
+    if (!flythroughPath.empty() && !app.playFlythrough(flythroughPath))
+        return EXIT_FAILURE;
+    if (benchmarkFrames >= 0)
+        app.startBenchmark(benchmarkFrames, warmupFrames, summaryPath);
+
     app.start();
+    if (app.input.mode() == InputRecorder::Recording)
+        app.toggleRecording();
+    if (!tracePath.empty())
+        app.saveTrace(tracePath);
 }
-
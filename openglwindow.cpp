@@ -21,6 +21,15 @@
  */
 
 #include "openglwindow.h"
+#include "ProgramCache.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "AllocationCounter.h"
+#include "ResidencyManager.h"
+#include <cfloat>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
 #include <glm/glm.hpp>
 #include <glm/ext.hpp> // perspective, translate, rotate
 
@@ -96,6 +105,9 @@ OpenGLWindow::OpenGLWindow(string title, int width, int height)
 
 OpenGLWindow::~OpenGLWindow()
 {
+    // Everything the renderer created is deleted by now
+    MemoryTracker::get().reportLeaks();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -136,25 +148,6 @@ OpenGLWindow::window() const
     return glfwWindow;
 }
 
-// Read shader source files
-string
-OpenGLWindow::readShaderSource(const string shaderFile) const
-{
-    string shaderSource;
-    string line;
-
-    fstream fs(shaderFile, ios::in);
-    if(!fs)
-        return shaderSource;
-
-    while (!fs.eof()) {
-        getline(fs, line);
-        shaderSource.append(line + '\n');
-    }
-    fs.close();
-    return shaderSource;
-}
-
 void OpenGLWindow::reshape(const int width, const int height) const {
 
     if (glfwGetCurrentContext() == nullptr)
@@ -163,82 +156,6 @@ void OpenGLWindow::reshape(const int width, const int height) const {
     glViewport(0,0, width, height);
 }
 
-// Initialize OpenGL shader program
-GLuint 
-OpenGLWindow::initProgram(const string vShaderFile, const string fShaderFile) const
-{
-    GLuint program;
-    int i;
-    GLint  linked;
-
-    struct shaders_t{
-        string   filename;
-        GLenum   type;
-    };
-
-    shaders_t shaders[2] = {
-        { vShaderFile, GL_VERTEX_SHADER },
-        { fShaderFile, GL_FRAGMENT_SHADER }
-    };
-
-    program = glCreateProgram();
-    for (i = 0; i < 2; ++i ) {
-        GLuint shader;
-        GLint  compiled;
-
-        string shaderSource = readShaderSource( shaders[i].filename );
-        if ( shaderSource.empty() ) {
-            cerr << "Failed to read " << shaders[i].filename << endl;
-            exit( EXIT_FAILURE );
-        }
-
-        shader = glCreateShader( shaders[i].type );
-        const char *shaderSrc = shaderSource.c_str();
-        glShaderSource( shader, 1, &shaderSrc, NULL );
-        glCompileShader( shader );
-        checkOpenGLError();
-
-        glGetShaderiv( shader, GL_COMPILE_STATUS, &compiled );
-        if ( !compiled ) {
-            GLint  logSize;
-
-            cerr << "Failed to compile " << shaders[i].filename << endl;
-            glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &logSize );
-            if (logSize > 0) {
-                char logMsg[logSize+1];
-                glGetShaderInfoLog( shader, logSize, nullptr, &(logMsg[0]) );
-                cerr << "Shader info log: " << logMsg << endl;
-            }
-            exit( EXIT_FAILURE );
-        }
-        glAttachShader( program, shader );
-    }
-
-    /* link  and error check */
-    glLinkProgram(program);
-    checkOpenGLError();
-
-    glGetProgramiv( program, GL_LINK_STATUS, &linked );
-    if ( !linked ) {
-        GLint  logSize;
-
-        cerr << "Shader program failed to link!" << endl;
-
-        glGetProgramiv( program, GL_INFO_LOG_LENGTH, &logSize);
-        if ( logSize > 0 ) {
-            char logMsg[logSize+1];
-            glGetProgramInfoLog( program, logSize, NULL, &(logMsg[0]) );
-            cerr << "Program info log: " << logMsg << endl;
-        }
-        exit( EXIT_FAILURE );
-    }
-
-
-
-    return program;
-}
-
-
 // The window resize callback function
 void 
 OpenGLWindow::resizeCallback(GLFWwindow* window, int width, int height)
@@ -264,11 +181,16 @@ OpenGLWindow::DrawGui()
     static ImGuiSliderFlags flags = ImGuiSliderFlags_AlwaysClamp;
     static ImGuiFileDialog fileDialog;
     static ImGuiFileDialog textureDialog; // New dialog for textures
+    static ImGuiFileDialog normalMapDialog;
 
     bool textureShow = getTxtShow();
+    bool normalMapShow = getNormalMapShow();
 
-    string path_to_objs = "./OBJs/";
-    objFilePath = path_to_objs;
+    // Models that come with the application, the file dialog may pick others anywhere
+    static const char* const builtinObjs[][2] = {
+        { "Cube", "cube.obj" }, { "Large Sphere", "sphere_large.obj" }, { "Pokeball", "pokeball.obj" },
+        { "Suzanne", "suzanne.obj" }, { "Teddy", "teddy.obj" }
+    };
 
     ImGui::Begin("3D Studio");
 
@@ -277,29 +199,12 @@ OpenGLWindow::DrawGui()
         if (ImGui::Button("Open File"))
             fileDialog.OpenDialog("ChooseFileDlgKey", "Choose File", ".obj", ".");
 
-        if (ImGui::Button("Cube")){
-            objFileName = "cube.obj";
-            changeObject();
-        }
-
-        if (ImGui::Button("Large Sphere")){
-            objFileName = "sphere_large.obj";
-            changeObject();
-        }
-
-        if (ImGui::Button("Pokeball")){
-            objFileName = "pokeball.obj";
-            changeObject();
-        }
-
-        if (ImGui::Button("Suzanne")){
-            objFileName = "suzanne.obj";
-            changeObject();
-        }
-
-        if (ImGui::Button("Teddy")){
-            objFileName = "teddy.obj";
-            changeObject();
+        for (const auto& obj : builtinObjs) {
+            if (ImGui::Button(obj[0])) {
+                objFileName = obj[1];
+                objFilePath = "./OBJs/";
+                changeObject();
+            }
         }
 
         if (fileDialog.Display("ChooseFileDlgKey")) {
@@ -322,11 +227,21 @@ OpenGLWindow::DrawGui()
         ImGui::InputFloat("z", &lightPos[2], 0.5f, 1.0f, "%1.1f");
         ImGui::PopItemWidth();
 
+        ImGui::Checkbox("Directional light", &lightDirectional);
+        ImGui::Checkbox("Shadows", &shadowsEnabled);
+        ImGui::Text("Shadow map layers rendered: %d", shadowRenders);
+
         ImGui::Text("Light source intensity:");
         ImGui::ColorEdit3("Light",  glm::value_ptr(lightColor));
 
         ImGui::Text("Ambient light intensity:");
         ImGui::ColorEdit3("Ambient",  glm::value_ptr(ambientColor));
+        ImGui::Checkbox("Baked ambient occlusion", &bakedOcclusion);
+        ImGui::Text("Occlusion bake: %.0f ms%s", occlusionBakeMs, occlusionCached ? " (cached)" : "");
+
+        ImGui::Text("Showroom lights:");
+        ImGui::SliderInt("Lights", &showroomLights, 0, 4096, "%d", flags);
+        ImGui::Text("Lights per cluster: max %d, average %.2f", clusterMaxLights, clusterAverageLights);
     }
 
     if (ImGui::CollapsingHeader("Object Material")) {
@@ -363,6 +278,28 @@ OpenGLWindow::DrawGui()
             changeTexture();
             textureDialog.Close();
         }
+
+        ImGui::Checkbox("Use normal map", &normalMapShow);
+        setNormalMapShow(normalMapShow);
+        ImGui::Text("Normal map file: %s", normalMapFileName.c_str());
+        if (ImGui::Button("Open Normal Map File"))
+            normalMapDialog.OpenDialog("ChooseFileDlgKey", "Choose Normal Map File",
+                                       ".jpg,.bmp,.dds,.hdr,.pic,.png,.psd,.tga", ".");
+
+        if (normalMapDialog.Display("ChooseFileDlgKey")) {
+            if (normalMapDialog.IsOk() == true) {
+                normalMapFileName = normalMapDialog.GetCurrentFileName();
+                normalMapFilePath = normalMapDialog.GetCurrentPath();
+                cout << "Normal map file: " << normalMapFileName << endl << "Path: " << normalMapFilePath << endl;
+                changeNormalMap();
+            }
+            normalMapDialog.Close();
+        }
+
+        ImGui::SliderInt("VRAM budget (MB)", &textureBudgetMB, 16, 4096, "%d", flags);
+        ImGui::Text("Streamed: %.1f MB, mip level %d", textureResidentMB, textureResidentLevel);
+        ImGui::SliderInt("Decoded budget (MB)", &textureCpuBudgetMB, 16, 4096, "%d", flags);
+        ImGui::Text("Decoded: %.1f MB", textureDecodedMB);
     }
 
     if (ImGui::CollapsingHeader("Projection")) {
@@ -384,10 +321,309 @@ OpenGLWindow::DrawGui()
         }
     }
 
+    if (ImGui::CollapsingHeader("Renderer")) {
+        ImGui::RadioButton("OpenGL", &renderMode, 0);
+        ImGui::SameLine();
+        ImGui::RadioButton("CPU rasterizer", &renderMode, 1);
+        ImGui::SameLine();
+        ImGui::RadioButton("Path tracer", &renderMode, 2);
+        if (renderMode == 0) {
+            ImGui::Checkbox("GPU driven instances", &gpuDriven);
+            if (gpuDriven) {
+                ImGui::SliderInt("Grid size", &instanceGrid, 1, 100);
+                ImGui::Text("Instances: %d of %d drawn", gpuVisibleInstances, gpuInstances);
+                ImGui::Checkbox("CPU occlusion culling", &occlusionCulling);
+                if (occlusionCulling)
+                    ImGui::Text("Occluded: %d of %d (%.0f%%), %d occluders, %.2f ms", occlusionCulled, occlusionTested,
+                                100.0f * occlusionCulled / max(1, occlusionTested), occlusionOccluders,
+                                occlusionRasterMs);
+                ImGui::Checkbox("Hi-Z occlusion culling", &hizCulling);
+                if (hizCulling)
+                    ImGui::Text("Hi-Z: %d occluded, %d drawn late", hizOccluded, hizLate);
+            } else {
+                ImGui::Checkbox("Meshlet culling", &meshletCulling);
+                ImGui::SameLine();
+                ImGui::Checkbox("Cone culling", &meshletConeCulling);
+                if (meshletCulling)
+                    ImGui::Text("Meshlets: %d of %d, %d triangles", meshletsVisible, meshletCount, meshletTriangles);
+            }
+            ImGui::Checkbox("Depth pre-pass", &depthPrepassEnabled);
+            ImGui::SameLine();
+            ImGui::Checkbox("Front to back", &frontToBack);
+            if (depthPrepassEnabled && prepassFragments > 0)
+                ImGui::Text("Shaded: %lld of %lld fragments (%.0f%% saved)", shadedFragments, prepassFragments,
+                            100.0 * (1.0 - (double)shadedFragments / prepassFragments));
+            else
+                ImGui::Text("Shaded: %lld fragments", shadedFragments);
+            ImGui::Checkbox("Dynamic resolution", &dynamicResolution);
+            if (dynamicResolution) {
+                ImGui::SliderFloat("GPU budget (ms)", &frameBudgetMs, 1.0f, 50.0f, "%.1f");
+                ImGui::SliderFloat("Min scale", &minResolutionScale, 0.25f, 1.0f, "%.2f");
+                ImGui::SliderFloat("Max scale", &maxResolutionScale, minResolutionScale, 1.0f, "%.2f");
+                ImGui::SliderFloat("Sharpness", &sharpness, 0.0f, 1.0f, "%.2f");
+                ImGui::Text("Scene: %.2f ms at %dx%d (%.0f%%)", sceneGpuMs, renderWidth, renderHeight,
+                            100.0f * resolutionScale);
+            }
+        }
+        if (renderMode == 1)
+            ImGui::Text("CPU frame: %.1f ms, %d triangles", softwareFrameMs, softwareTriangles);
+        if (renderMode == 2) {
+            ImGui::SliderInt("Bounces", &pathBounces, 0, 8);
+            ImGui::Text("Samples: %d, %.1f Mrays/s", pathSamples, pathRaysPerSecond * 1e-6f);
+            ImGui::Text("BVH: %d nodes, built in %.1f ms", pathBvhNodes, pathBvhBuildMs);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Profiler")) {
+        ImGui::Checkbox("Enabled", &profilerEnabled);
+        if (profilerEnabled)
+            drawProfiler();
+
+        ImGui::Checkbox("Record trace", &traceEnabled);
+        ImGui::SliderFloat("Trace seconds", &traceSeconds, 1.0f, 30.0f, "%.0f");
+        if (ImGui::Button("Save trace (F12)"))
+            saveTrace();
+    }
+
+    if (ImGui::CollapsingHeader("Memory"))
+        drawMemory();
+
+    if (ImGui::CollapsingHeader("Input"))
+        drawInput();
+
     ImGui::End();
+
+    // The file dialogs allocate while open, as do many widgets while in use
+    if (ImGui::IsAnyItemActive() || fileDialog.IsOpened() || textureDialog.IsOpened() || normalMapDialog.IsOpened())
+        AllocationCounter::get().disturb();
 }
 
+namespace {
+
+// Adds the rows of the scopes under a parent, depth first, and picks the clicked one
+void profilerRows(const vector<Profiler::Scope>& scopes, int parent, bool gpu, int& selected)
+{
+    for (size_t i = 0; i < scopes.size(); i++) {
+        const Profiler::Scope& scope = scopes[i];
+        if (scope.parent != parent || scope.gpu != gpu)
+            continue;
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::PushID((int)i);
+        float indent = 12.0f * scope.depth;
+        if (indent > 0.0f)
+            ImGui::Indent(indent);
+        if (ImGui::Selectable(scope.name, selected == (int)i, ImGuiSelectableFlags_SpanAllColumns))
+            selected = (int)i;
+        if (indent > 0.0f)
+            ImGui::Unindent(indent);
+        ImGui::PopID();
+        ImGui::TableNextColumn();
+        ImGui::Text("%.2f", scope.average);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.2f", scope.maximum);
+        profilerRows(scopes, (int)i, gpu, selected);
+    }
+}
+
+}
+
+/**
+ * @brief Shows the profiler's frame graphs, its scopes and the counters of the last frame.
+ *
+ * Clicking a scope graphs its history. GPU times lag a few frames behind the CPU times.
+ */
+void
+OpenGLWindow::drawProfiler()
+{
+    static int selected = -1;
+    const Profiler& profiler = Profiler::get();
+    const vector<Profiler::Scope>& scopes = profiler.scopes();
+    ImVec2 graphSize(0.0f, 50.0f);
+    char overlay[64];
+
+    snprintf(overlay, sizeof(overlay), "avg %.2f ms, max %.2f ms", profiler.cpuFrameAverage, profiler.cpuFrameMaximum);
+    ImGui::PlotLines("CPU frame", profiler.cpuFrameHistory, PROFILER_HISTORY, profiler.cpuHistoryOffset(), overlay,
+                     0.0f, FLT_MAX, graphSize);
+    snprintf(overlay, sizeof(overlay), "avg %.2f ms, max %.2f ms", profiler.gpuFrameAverage, profiler.gpuFrameMaximum);
+    ImGui::PlotLines("GPU frame", profiler.gpuFrameHistory, PROFILER_HISTORY, profiler.gpuHistoryOffset(), overlay,
+                     0.0f, FLT_MAX, graphSize);
+    if (selected >= 0 && selected < (int)scopes.size()) {
+        const Profiler::Scope& scope = scopes[selected];
+        snprintf(overlay, sizeof(overlay), "avg %.2f ms, max %.2f ms", scope.average, scope.maximum);
+        ImGui::PlotLines(scope.name, scope.history, PROFILER_HISTORY,
+                         scope.gpu ? profiler.gpuHistoryOffset() : profiler.cpuHistoryOffset(), overlay,
+                         0.0f, FLT_MAX, graphSize);
+    }
+
+    ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingStretchProp;
+    for (int gpu = 0; gpu < 2; gpu++) {
+        if (!ImGui::BeginTable(gpu ? "GPU scopes" : "CPU scopes", 3, tableFlags))
+            continue;
+        ImGui::TableSetupColumn(gpu ? "GPU pass" : "CPU scope", ImGuiTableColumnFlags_WidthStretch, 3.0f);
+        ImGui::TableSetupColumn("avg ms", ImGuiTableColumnFlags_WidthStretch, 1.0f);
+        ImGui::TableSetupColumn("max ms", ImGuiTableColumnFlags_WidthStretch, 1.0f);
+        ImGui::TableHeadersRow();
+        profilerRows(scopes, -1, gpu != 0, selected);
+        ImGui::EndTable();
+    }
+
+    ImGui::Text("Draw calls: %d, triangles: %lld", profiler.counters.drawCalls, profiler.counters.triangles);
+    ImGui::Text("State changes: %d", profiler.counters.stateChanges);
+}
+
+
+
+/**
+ * @brief Shows the heap allocations of the last frame per thread, the CPU memory of the assets
+ * and the GPU memory of the OpenGL objects.
+ */
+void
+OpenGLWindow::drawMemory()
+{
+    const MemoryTracker& memory = MemoryTracker::get();
+    ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingStretchProp;
+
+    ImGui::Checkbox("Drop CPU mesh after upload", &dropCpuCopies);
+    ImGui::Text("Last import: %d temporaries, %.1f KB in %d arena blocks, %d heap allocations", importTemporaries,
+                importTemporaryKB, importArenaBlocks, importHeapAllocations);
+
+    const AllocationCounter& allocations = AllocationCounter::get();
+    ImGui::Text("Heap allocations last frame: %llu, %.1f KB, %llu frees", (unsigned long long)allocations.frameAllocations(),
+                allocations.frameBytes() / 1024.0f, (unsigned long long)allocations.frameFrees());
+    ImGui::Text("Steady: %s, steady frames that allocated: %llu", allocations.isSteady() ? "yes" : "no",
+                (unsigned long long)allocations.allocatingSteadyFrames());
+    if (ImGui::BeginTable("Allocations", 2, tableFlags)) {
+        ImGui::TableSetupColumn("Thread", ImGuiTableColumnFlags_WidthStretch, 4.0f);
+        ImGui::TableSetupColumn("Allocations", ImGuiTableColumnFlags_WidthStretch, 1.0f);
+        ImGui::TableHeadersRow();
+        for (int i = 0; i < allocations.threads(); i++) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if (allocations.isMainThread(i))
+                ImGui::Text("%d (main)", i);
+            else
+                ImGui::Text("%d", i);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)allocations.threadFrameAllocations(i));
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::Text("CPU: %.2f MB in %d assets", memory.cpuBytes() / (1024.0f * 1024.0f), (int)memory.cpuAssets().size());
+    if (ImGui::BeginTable("CPU memory", 2, tableFlags)) {
+        ImGui::TableSetupColumn("Asset", ImGuiTableColumnFlags_WidthStretch, 4.0f);
+        ImGui::TableSetupColumn("KB", ImGuiTableColumnFlags_WidthStretch, 1.0f);
+        ImGui::TableHeadersRow();
+        for (const auto& asset : memory.cpuAssets()) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(asset.first.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", asset.second / 1024.0f);
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::Text("GPU: %.2f MB in %d objects", memory.gpuBytes() / (1024.0f * 1024.0f), (int)memory.gpuObjects().size());
+    if (ImGui::BeginTable("GPU memory", 3, tableFlags)) {
+        ImGui::TableSetupColumn("Object", ImGuiTableColumnFlags_WidthStretch, 1.5f);
+        ImGui::TableSetupColumn("Owner", ImGuiTableColumnFlags_WidthStretch, 3.0f);
+        ImGui::TableSetupColumn("KB", ImGuiTableColumnFlags_WidthStretch, 1.0f);
+        ImGui::TableHeadersRow();
+        for (const auto& entry : memory.gpuObjects()) {
+            const MemoryTracker::GpuObject& object = entry.second;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%s %u", MemoryTracker::typeName(object.type), object.name);
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(object.owner.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", object.bytes / 1024.0f);
+        }
+        ImGui::EndTable();
+    }
+
+    const ResidencyManager& residency = ResidencyManager::get();
+    ImGui::SliderInt("Residency budget (MB)", &residencyBudgetMB, 16, 4096);
+    ImGui::Text("Resident: %.2f MB in %d resources, %u evictions, %.2f MB evicted",
+                residency.residentBytes() / (1024.0f * 1024.0f), (int)residency.resources().size(), residency.evictions,
+                residency.evictedBytes / (1024.0f * 1024.0f));
+    if (ImGui::BeginTable("Residency", 3, tableFlags)) {
+        ImGui::TableSetupColumn("Resource", ImGuiTableColumnFlags_WidthStretch, 4.0f);
+        ImGui::TableSetupColumn("KB", ImGuiTableColumnFlags_WidthStretch, 1.0f);
+        ImGui::TableSetupColumn("Unused frames", ImGuiTableColumnFlags_WidthStretch, 1.0f);
+        ImGui::TableHeadersRow();
+        for (const auto& entry : residency.resources()) {
+            const ResidencyManager::Resource& resource = entry.second;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(resource.name.c_str());
+            ImGui::TableNextColumn();
+            if (resource.bytes > 0)
+                ImGui::Text("%.1f", resource.bytes / 1024.0f);
+            else
+                ImGui::TextUnformatted("evicted");
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", residency.currentFrame() - resource.lastUsedFrame);
+        }
+        ImGui::EndTable();
+    }
+}
 
+/**
+ * @brief Shows the state of the input recording and the controls of the camera path.
+ */
+void
+OpenGLWindow::drawInput()
+{
+    switch (input.mode()) {
+        case InputRecorder::Recording:
+            ImGui::Text("Recording: frame %u, %d events", input.frame(), (int)input.events());
+            if (ImGui::Button("Stop recording (F9)"))
+                toggleRecording();
+            break;
+        case InputRecorder::Replaying:
+            ImGui::Text("Replaying: frame %u of %u", input.frame(), input.frames());
+            if (ImGui::Button("Stop replay (F10)"))
+                toggleReplay();
+            break;
+        default:
+            ImGui::Text("Recorded: %u frames, %d events", input.frames(), (int)input.events());
+            if (ImGui::Button("Record (F9)"))
+                toggleRecording();
+            ImGui::SameLine();
+            if (ImGui::Button("Replay (F10)"))
+                toggleReplay();
+            break;
+    }
+    ImGui::Text("Input file: %s", inputPath.c_str());
+
+    ImGui::Separator();
+    ImGui::Text("Camera path: %d keys, %.1f s", (int)cameraPath.size(), cameraPath.duration());
+    if (ImGui::Button("Add camera key")) {
+        glm::vec3 eye, center;
+        getCamera(eye, center);
+        cameraPath.addKey(cameraPath.size() == 0 ? 0.0 : cameraPath.duration() + CAMERA_PATH_KEY_SECONDS, eye, center);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear keys"))
+        cameraPath.clear();
+    if (ImGui::Button("Save path") && cameraPath.save(cameraPathFile))
+        cout << "Camera path written to " << cameraPathFile << endl;
+    ImGui::SameLine();
+    if (ImGui::Button("Load path"))
+        cameraPath.load(cameraPathFile);
+    ImGui::SameLine();
+    if (flythrough) {
+        if (ImGui::Button("Stop flythrough"))
+            flythrough = false;
+    } else if (ImGui::Button("Fly") && cameraPath.size() > 0) {
+        flythrough = true;
+        flythroughFrame = 0;
+    }
+    ImGui::Text("Path file: %s", cameraPathFile.c_str());
+}
 
 // Start the GLFW loop
 void
@@ -401,89 +637,146 @@ OpenGLWindow::start() {
     glfwSetCursorPos(glfwWindow, screenWidth / 2, screenHeight / 2);
     glfwSetInputMode(glfwWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    flying = false;
-    ducking = false;
-    movingCameraBackward = false;
-    movingCameraForward = false;
-    movingCameraRight = false;
-    movingCameraLeft = false;
-    rotating = false;
-
     // Loop until the user closes the window
     while (!glfwWindowShouldClose(glfwWindow)) {
 
-        if (flying)
-            moveCameraUp();
+        // A frame is measured from here to the end of the ImGui draw
+        TraceRecorder::get().setEnabled(traceEnabled);
+        TRACE_SCOPE("Frame");
+        Profiler::get().beginFrame(profilerEnabled || benchmark.isRunning());
+        input.beginFrame();
 
-        if (ducking)
-            moveCameraDown();
+        // A recording or a replay starts after the moves of the frame it started in, so
+        // they are not made in its first frame
+        if (input.mode() == InputRecorder::Idle || input.frame() > 0) {
+            if (flying)
+                moveCameraUp();
 
-        if(movingCameraBackward)
-            moveCameraBackwards();
+            if (ducking)
+                moveCameraDown();
 
-        if(movingCameraForward)
-            moveCameraForwards();
+            if(movingCameraBackward)
+                moveCameraBackwards();
 
-        if(movingCameraLeft)
-            moveCameraLeft();
+            if(movingCameraForward)
+                moveCameraForwards();
 
-        if(movingCameraRight)
-            moveCameraRight();
+            if(movingCameraLeft)
+                moveCameraLeft();
 
-        if(rotating){
+            if(movingCameraRight)
+                moveCameraRight();
 
-            glfwSetInputMode(glfwWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+            if(rotating){
 
-            double x, y;
-            glfwGetCursorPos(glfwWindow, &x, &y);
+                glfwSetInputMode(glfwWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-            double dx = x - 450;
-            double dy = y - 450;
+                // A replay turns the camera as recorded, whatever the real mouse does
+                double dx, dy;
+                if (input.mode() == InputRecorder::Replaying) {
+                    input.takeLook(dx, dy);
+                } else {
+                    double x, y;
+                    glfwGetCursorPos(glfwWindow, &x, &y);
 
-            dx /= 10;
-            dy /= 10;
+                    dx = x - 450;
+                    dy = y - 450;
 
-            if (dx > 0) {
-                rotateCameraRight(-dx);
-            } else if (dx < 0) {
-                rotateCameraLeft(dx);
-            }
+                    dx /= 10;
+                    dy /= 10;
 
-            if (dy > 0) {
-                rotateCameraUp(dy);
-            } else if (dy < 0) {
-                rotateCameraDown(-dy);
-            }
+                    if (dx != 0 || dy != 0)
+                        input.record(InputRecorder::event('l', dx, dy));
+                }
+
+                if (dx > 0) {
+                    rotateCameraRight(-dx);
+                } else if (dx < 0) {
+                    rotateCameraLeft(dx);
+                }
+
+                if (dy > 0) {
+                    rotateCameraUp(dy);
+                } else if (dy < 0) {
+                    rotateCameraDown(-dy);
+                }
 
-            glfwSetCursorPos(glfwWindow, 450, 450);
+                if (input.mode() != InputRecorder::Replaying)
+                    glfwSetCursorPos(glfwWindow, 450, 450);
 
-        } else {
-            glfwSetInputMode(glfwWindow, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+            } else {
+                glfwSetInputMode(glfwWindow, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+            }
+        }
+
+        // The flythrough overrides the camera moves
+        if (flythrough) {
+            glm::vec3 eye, center;
+            if (cameraPath.sample(flythroughFrame * FLYTHROUGH_FRAME_SECONDS, eye, center))
+                setCamera(eye, center);
         }
 
 
         // Swap buffers
-        glfwSwapBuffers(glfwWindow);
+        {
+            PROFILE_SCOPE("Swap buffers");
+            glfwSwapBuffers(glfwWindow);
+        }
 
         // Sleep and wait for an event
-        glfwPollEvents();
+        {
+            PROFILE_SCOPE("Poll events");
+            glfwPollEvents();
+            input.replayEvents();
+        }
 
         // Start the Dear ImGui frame
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
-
-        // Draw the gui
-        DrawGui();
-
-
+        {
+            PROFILE_SCOPE("GUI");
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+
+            // Draw the gui
+            DrawGui();
+        }
 
         // Call display in geometryRender to render the scene
-        display();
+        {
+            PROFILE_SCOPE("Display");
+            display();
+        }
 
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        {
+            PROFILE_SCOPE("ImGui render");
+            PROFILE_GPU_SCOPE("ImGui");
+            ImGui::Render();
+            ImDrawData* drawData = ImGui::GetDrawData();
+            for (int i = 0; i < drawData->CmdListsCount; i++)
+                PROFILE_DRAWS(drawData->CmdLists[i]->CmdBuffer.Size, drawData->CmdLists[i]->IdxBuffer.Size / 3);
+            ImGui_ImplOpenGL3_RenderDrawData(drawData);
+        }
+        Profiler::get().endFrame();
+
+        // A recording grows its list of events, so its frames are not steady
+        if (input.mode() == InputRecorder::Recording)
+            AllocationCounter::get().disturb();
+        AllocationCounter::get().endFrame();
+
+        input.endFrame();
+        if (flythrough && ++flythroughFrame * FLYTHROUGH_FRAME_SECONDS > cameraPath.duration() + 1e-9)
+            flythrough = false;
+
+        if (benchmark.isRunning()) {
+            benchmark.endFrame();
+            bool workloadDone = input.mode() != InputRecorder::Replaying && !flythrough;
+            if (benchmark.isDone() || (benchmarkOnWorkload && workloadDone))
+                finishBenchmark();
+        }
     }
+
+    if (benchmark.isRunning())
+        finishBenchmark();
 }
 
 
@@ -498,3 +791,168 @@ void OpenGLWindow::displayNow()
 
     display();
 }
+
+/**
+ * @brief Writes the last traceSeconds of all threads as a Chrome Trace Event file.
+ *
+ * @param path File to write, empty names it after the current time in the working directory.
+ * @return True if the file could be written.
+ */
+bool OpenGLWindow::saveTrace(const string& path)
+{
+    string file = path;
+    if (file.empty()) {
+        char name[64];
+        time_t now = time(nullptr);
+        strftime(name, sizeof(name), "trace_%Y%m%d_%H%M%S.json", localtime(&now));
+        file = name;
+    }
+
+    if (!TraceRecorder::get().write(file, traceSeconds))
+        return false;
+    cout << "Trace of the last " << traceSeconds << " s written to " << file << endl;
+    return true;
+}
+
+/**
+ * @brief Packs the movement flags, which a recording starts from.
+ */
+unsigned int OpenGLWindow::movementFlags() const
+{
+    bool flags[] = { flying, ducking, movingCameraForward, movingCameraBackward, movingCameraLeft,
+                     movingCameraRight, rotating };
+    unsigned int packed = 0;
+    for (int i = 0; i < 7; i++)
+        packed |= flags[i] ? 1u << i : 0u;
+    return packed;
+}
+
+/**
+ * @brief Sets the movement flags from movementFlags().
+ */
+void OpenGLWindow::setMovementFlags(unsigned int flags)
+{
+    bool* targets[] = { &flying, &ducking, &movingCameraForward, &movingCameraBackward, &movingCameraLeft,
+                        &movingCameraRight, &rotating };
+    for (int i = 0; i < 7; i++)
+        *targets[i] = (flags & (1u << i)) != 0;
+}
+
+/**
+ * @brief Starts recording the input, or stops and writes it to inputPath.
+ */
+void OpenGLWindow::toggleRecording()
+{
+    if (input.mode() == InputRecorder::Recording) {
+        input.stopRecording();
+        if (input.save(inputPath))
+            cout << "Input of " << input.frames() << " frames written to " << inputPath << endl;
+        return;
+    }
+
+    InputRecorder::State state;
+    getCamera(state.eye, state.center);
+    state.flags = movementFlags();
+    glfwGetCursorPos(glfwWindow, &state.cursorX, &state.cursorY);
+    input.startRecording(state);
+    cout << "Recording input, F9 stops" << endl;
+}
+
+/**
+ * @brief Replays a recording from the camera and the movement it started with.
+ *
+ * @param path Recording to replay, empty replays inputPath.
+ * @return False if the file could not be read or holds no frames.
+ */
+bool OpenGLWindow::replayInput(const string& path)
+{
+    string file = path.empty() ? inputPath : path;
+    if (input.mode() == InputRecorder::Recording || !input.load(file))
+        return false;
+
+    const InputRecorder::State& state = input.startState();
+    setCamera(state.eye, state.center);
+    setMovementFlags(state.flags);
+    if (!input.startReplay())
+        return false;
+    inputPath = file;
+    benchmarkWorkload = "replay " + file;
+    return true;
+}
+
+/**
+ * @brief Stops the replay running, or replays inputPath.
+ */
+void OpenGLWindow::toggleReplay()
+{
+    if (input.mode() == InputRecorder::Replaying)
+        input.stopReplay();
+    else
+        replayInput();
+}
+
+/**
+ * @brief Flies the camera along a path from its first key.
+ *
+ * @param path Camera path file, empty flies the keys held.
+ * @return False if the file could not be read or the path has no keys.
+ */
+bool OpenGLWindow::playFlythrough(const string& path)
+{
+    if (!path.empty()) {
+        if (!cameraPath.load(path))
+            return false;
+        cameraPathFile = path;
+    }
+    if (cameraPath.size() == 0)
+        return false;
+    flythrough = true;
+    flythroughFrame = 0;
+    benchmarkWorkload = "flythrough " + cameraPathFile;
+    return true;
+}
+
+/**
+ * @brief Measures the frames from the next one on, then writes the summary and closes the window.
+ *
+ * @param frames Frames to measure, 0 measures until the replay or the flythrough started
+ *        before ends.
+ * @param warmup Frames run before measuring.
+ * @param summaryPath JSON file for the summary.
+ *
+ * Vertical sync is turned off, so the frames are not held to the display rate.
+ */
+void OpenGLWindow::startBenchmark(int frames, int warmup, const string& summaryPath)
+{
+    benchmarkOnWorkload = input.mode() == InputRecorder::Replaying || flythrough;
+    if (!benchmarkOnWorkload)
+        benchmarkWorkload = "static";
+    benchmarkSummary = summaryPath.empty() ? BENCHMARK_DEFAULT_SUMMARY : summaryPath;
+    glfwSwapInterval(0);
+    benchmark.start(frames, warmup);
+}
+
+/**
+ * @brief Ends the benchmark, writes its summary and closes the window.
+ */
+void OpenGLWindow::finishBenchmark()
+{
+    benchmark.finish();
+    const char* renderers[] = { "OpenGL", "CPU rasterizer", "Path tracer" };
+    string renderer = renderMode >= 0 && renderMode < 3 ? renderers[renderMode] : "unknown";
+
+    FrameBenchmark::Stats frame = benchmark.cpuStats();
+    FrameBenchmark::Stats gpu = benchmark.gpuStats();
+    char line[256];
+    snprintf(line, sizeof(line), "Benchmark of %d frames: average %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms, "
+             "GPU average %.3f ms", frame.frames, frame.average, frame.p50, frame.p99, frame.maximum, gpu.average);
+    cerr << line << endl;
+
+    ofstream file(benchmarkSummary);
+    benchmark.writeJson(file, benchmarkWorkload, renderer, width(), height());
+    if (file)
+        cerr << "Benchmark summary written to " << benchmarkSummary << endl;
+    else
+        cerr << "Could not write the benchmark summary " << benchmarkSummary << endl;
+    glfwSetWindowShouldClose(glfwWindow, GLFW_TRUE);
+}
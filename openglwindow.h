@@ -19,6 +19,10 @@
  * - Camera.h (Header file for Camera class)
  * - Scene.h (Header file for Scene class)
  * - Model.h (Header file for Model class)
+ * - TraceRecorder.h (Header file for TraceRecorder class)
+ * - InputRecorder.h (Header file for InputRecorder class)
+ * - CameraPath.h (Header file for CameraPath class)
+ * - FrameBenchmark.h (Header file for FrameBenchmark class)
  */
 
 #pragma once
@@ -33,6 +37,10 @@
 #include "Camera.h"
 #include "Scene.h"
 #include "Model.h"
+#include "TraceRecorder.h"
+#include "InputRecorder.h"
+#include "CameraPath.h"
+#include "FrameBenchmark.h"
 
 const float pi_f = 3.1415926f;
 
@@ -63,34 +71,47 @@ public:
     virtual void rotateCameraDown(float dy) = 0;
     virtual void rotateCameraLeft(float dx) = 0;
     virtual void rotateCameraRight(float dx) = 0;
+    virtual void getCamera(glm::vec3& eye, glm::vec3& center) = 0;
+    virtual void setCamera(const glm::vec3& eye, const glm::vec3& center) = 0;
 
 
 
     virtual void changeObject() = 0;
     virtual void changeTexture() = 0;
+    virtual void changeNormalMap() = 0;
 
     virtual void setTxtShow(bool value) = 0;
     virtual bool getTxtShow() = 0;
+    virtual void setNormalMapShow(bool value) = 0;
+    virtual bool getNormalMapShow() = 0;
 
     // Create smooth movement
-    bool flying;
-    bool ducking;
-    bool movingCameraForward;
-    bool movingCameraBackward;
-    bool movingCameraRight;
-    bool movingCameraLeft;
-    bool rotating;
+    bool flying = false;
+    bool ducking = false;
+    bool movingCameraForward = false;
+    bool movingCameraBackward = false;
+    bool movingCameraRight = false;
+    bool movingCameraLeft = false;
+    bool rotating = false;
 
 
     void start();
     virtual void initialize() = 0;
     virtual void display() = 0;
     void displayNow();
+    bool saveTrace(const std::string& path = "");
+    void toggleRecording();
+    bool replayInput(const std::string& path = "");
+    void toggleReplay();
+    bool playFlythrough(const std::string& path = "");
+    void startBenchmark(int frames, int warmup, const std::string& summaryPath = "");
 
     std::string objFileName;
     std::string objFilePath;
     std::string textureFileName;
     std::string textureFilePath;
+    std::string normalMapFileName;
+    std::string normalMapFilePath;
 
 
     float fov;
@@ -103,6 +124,63 @@ public:
     glm::vec3 lightColor;
     glm::vec3 ambientColor;
 
+    // Shadows of the main light
+    bool lightDirectional = false;
+    bool shadowsEnabled = true;
+    int shadowRenders = 0;
+
+    // Meshlet culling of the OpenGL draw
+    bool meshletCulling = true;
+    bool meshletConeCulling = false;
+    int meshletCount = 0;
+    int meshletsVisible = 0;
+    int meshletTriangles = 0;
+
+    // Grid of instances culled and drawn on the GPU
+    bool gpuDriven = false;
+    int instanceGrid = 11;
+    int gpuInstances = 0;
+    int gpuVisibleInstances = 0;
+
+    // CPU occlusion culling of the instances
+    bool occlusionCulling = false;
+    int occlusionTested = 0;
+    int occlusionCulled = 0;
+    int occlusionOccluders = 0;
+    float occlusionRasterMs = 0.0f;
+
+    // Hi-Z occlusion culling of the instances on the GPU
+    bool hizCulling = false;
+    int hizOccluded = 0;
+    int hizLate = 0;
+
+    // Depth pre-pass and draw order of the OpenGL scene
+    bool depthPrepassEnabled = false;
+    bool frontToBack = false;
+    long long prepassFragments = 0;
+    long long shadedFragments = 0;
+
+    // Dynamic resolution of the OpenGL scene
+    bool dynamicResolution = false;
+    float frameBudgetMs = 12.0f;
+    float minResolutionScale = 0.5f;
+    float maxResolutionScale = 1.0f;
+    float sharpness = 0.5f;
+    float resolutionScale = 1.0f;
+    float sceneGpuMs = 0.0f;
+    int renderWidth = 0;
+    int renderHeight = 0;
+
+    // Ambient occlusion baked when a model is loaded
+    bool bakedOcclusion = true;
+    float occlusionBakeMs = 0.0f;
+    bool occlusionCached = false;
+
+    // Clustered showroom lights
+    int showroomLights = 0;
+    int clusterMaxLights = 0;
+    float clusterAverageLights = 0.0f;
+
 
     glm::vec3 materialAmbient;
     glm::vec3 materialDiffuse;
@@ -112,6 +190,55 @@ public:
 
     int projMode = 0;
 
+    // Texture streaming
+    int textureBudgetMB = 256;
+    int textureCpuBudgetMB = 256;
+    float textureResidentMB = 0.0f;
+    float textureDecodedMB = 0.0f;
+    int textureResidentLevel = -1;
+
+    // VRAM budget of the meshes and textures together, kept by the ResidencyManager
+    int residencyBudgetMB = 512;
+
+    // Rendering backend, 0 OpenGL, 1 CPU rasterizer, 2 path tracer
+    int renderMode = 0;
+    float softwareFrameMs = 0.0f;
+    int softwareTriangles = 0;
+    int pathBounces = 3;
+    int pathSamples = 0;
+    float pathRaysPerSecond = 0.0f;
+    int pathBvhNodes = 0;
+    float pathBvhBuildMs = 0.0f;
+
+    // Drops the CPU copy of the object's geometry once it is uploaded
+    bool dropCpuCopies = false;
+
+    // Temporaries of the last OBJ import, taken from the import arena, and its heap allocations
+    int importTemporaries = 0;
+    float importTemporaryKB = 0.0f;
+    int importArenaBlocks = 0;
+    int importHeapAllocations = 0;
+
+    // Frame profiler, disabled it only costs a flag test per scope
+    bool profilerEnabled = false;
+
+    // Trace of the last seconds of all threads, saved with F12 or from the GUI
+    bool traceEnabled = true;
+    float traceSeconds = (float)TRACE_DEFAULT_SECONDS;
+
+    // Input recorded with F9 and replayed with F10, and camera flythroughs
+    InputRecorder input;
+    std::string inputPath = "input.rec";
+    CameraPath cameraPath;
+    std::string cameraPathFile = "camera.path";
+    bool flythrough = false;
+    unsigned int flythroughFrame = 0;
+
+    // Frame times measured over a replay or a flythrough, the summary is written when it ends
+    FrameBenchmark benchmark;
+    std::string benchmarkSummary;
+    std::string benchmarkWorkload;
+
     float previous_mouse_x = 0;
     float previous_mouse_y = 0;
 
@@ -122,18 +249,21 @@ protected:
     int width() const;
     int height() const;
 
-
-    std::string readShaderSource(const std::string shaderFile) const;
-    GLuint initProgram(const std::string vShaderFile, const std::string fShaderFile) const;
-
     void reshape(const int width, const int height) const;
 
 
 
 private:
     void DrawGui();
+    void drawProfiler();
+    void drawInput();
+    void drawMemory();
+    void finishBenchmark();
+    unsigned int movementFlags() const;
+    void setMovementFlags(unsigned int flags);
     GLFWwindow* glfwWindow;
     int windowWidth = 0;
     int windowHeight = 0;
+    bool benchmarkOnWorkload = false;   // The benchmark ends with the replay or the flythrough
 
 };
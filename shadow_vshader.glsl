@@ -0,0 +1,12 @@
+#version 430
+
+// Depth only pass rendering shadow casters into a ShadowMap layer
+
+layout(location = 0) in vec3 vPosition;
+
+uniform mat4 lightMVP;
+
+void main()
+{
+    gl_Position = lightMVP * vec4(vPosition, 1.0);
+}
@@ -0,0 +1,37 @@
+#version 430
+
+// Upscales the part of the ResolutionScaler's target the scene was drawn to and sharpens
+// it with contrast adaptive sharpening, in the style of AMD's CAS. The sharpening is
+// weaker where the neighbourhood already has high contrast, which avoids halos.
+
+in vec2 uv;
+out vec4 fColor;
+
+uniform sampler2D scene;
+uniform vec2 renderSize;    // Drawn part of the target in texels
+uniform float sharpness;    // 0 only filters, 1 sharpens the most
+
+vec3 fetch(vec2 texel)
+{
+    // Stay inside the drawn part, the rest of the target holds old frames
+    texel = clamp(texel, vec2(0.5), renderSize - 0.5);
+    return texture(scene, texel / vec2(textureSize(scene, 0))).rgb;
+}
+
+void main()
+{
+    vec2 texel = uv * renderSize;
+    vec3 center = fetch(texel);
+    vec3 north = fetch(texel + vec2(0.0, 1.0));
+    vec3 south = fetch(texel - vec2(0.0, 1.0));
+    vec3 east = fetch(texel + vec2(1.0, 0.0));
+    vec3 west = fetch(texel - vec2(1.0, 0.0));
+
+    vec3 low = min(center, min(min(north, south), min(east, west)));
+    vec3 high = max(center, max(max(north, south), max(east, west)));
+    vec3 amount = sqrt(clamp(min(low, 1.0 - high) / max(high, 1e-4), 0.0, 1.0));
+    vec3 weight = -amount * 0.2 * sharpness;
+
+    vec3 color = (center + (north + south + east + west) * weight) / (1.0 + 4.0 * weight);
+    fColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
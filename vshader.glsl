@@ -1,21 +1,58 @@
-#version 330
+#version 430
 
-in vec3 vPosition;
-in vec3 vNormal;
-in vec2 vTexCoord;
+layout(location = 0) in vec3 vPosition;
+layout(location = 1) in vec3 vNormal;
+#ifdef HAS_TEXCOORD
+layout(location = 2) in vec2 vTexCoord;
+#endif
+#ifdef HAS_OCCLUSION
+layout(location = 3) in float vOcclusion;
+#endif
+#ifdef GPU_INSTANCES
+layout(location = 4) in uint vInstance;   // index of the object, from the draw command's base instance
+#endif
 
 out vec3 fragNormal;
 out vec3 fragPosition;
+#ifdef HAS_TEXCOORD
 out vec2 fragTexCoord;
+#endif
+#ifdef HAS_OCCLUSION
+out float fragOcclusion;   // baked ambient occlusion, 1 is unoccluded
+#endif
+
+// Must match depth_vshader.glsl for the GL_EQUAL test after the depth pre-pass
+invariant gl_Position;
 
 uniform mat4 P;
 uniform mat4 V;
+
+#ifdef GPU_INSTANCES
+// Same layout as GpuObject in GpuScene.h, binding as in GpuScene.h
+struct GpuObject {
+    mat4 model;
+    vec4 bounds;
+    uint material;
+};
+layout(std430, binding = 3) readonly buffer Objects { GpuObject objects[]; };
+flat out uint fragMaterial;
+#else
 uniform mat4 M;
+#endif
 
 void main()
 {
+#ifdef GPU_INSTANCES
+    mat4 M = objects[vInstance].model;
+    fragMaterial = objects[vInstance].material;
+#endif
     fragNormal = normalize((M * vec4(vNormal, 0.0)).xyz);
     fragPosition = (M * vec4(vPosition, 1.0)).xyz;
+#ifdef HAS_TEXCOORD
     fragTexCoord = vTexCoord;
+#endif
+#ifdef HAS_OCCLUSION
+    fragOcclusion = vOcclusion;
+#endif
     gl_Position = P * V * M * vec4(vPosition, 1.0);
 }